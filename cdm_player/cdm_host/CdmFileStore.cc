@@ -0,0 +1,372 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "CdmFileStore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// File header: magic followed by the format version.
+const char kStoreMagic[4] = {'W', 'V', 'C', 'S'};
+const uint32_t kStoreVersion = 1;
+const size_t kStoreHeaderSize = 8;
+
+// Record header: CRC-32 of everything after the CRC field, name length, data
+// length and flags, all little endian. The name and data follow.
+const size_t kRecordHeaderSize = 16;
+const uint32_t kRecordTombstone = 1;
+
+// Sanity limits that stop a corrupt length from being trusted.
+const uint32_t kMaxNameLength = 1024;
+const uint32_t kMaxDataLength = 16 * 1024 * 1024;
+
+// Garbage below this is never worth a compaction.
+const uint64_t kMinCompactionGarbage = 64 * 1024;
+
+void PutUint32(uint8_t *out, uint32_t value) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+  out[2] = static_cast<uint8_t>(value >> 16);
+  out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t GetUint32(const uint8_t *in) {
+  return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+         (static_cast<uint32_t>(in[2]) << 16) |
+         (static_cast<uint32_t>(in[3]) << 24);
+}
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t length) {
+  static uint32_t table[256];
+  static std::once_flag once;
+  std::call_once(once, [] {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  });
+  crc = ~crc;
+  for (size_t i = 0; i < length; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Appends the encoded record for |name| to |out|.
+void EncodeRecord(const std::string &name, const uint8_t *data,
+                  uint32_t data_length, uint32_t flags, std::string *out) {
+  uint8_t header[kRecordHeaderSize];
+  PutUint32(header + 4, static_cast<uint32_t>(name.size()));
+  PutUint32(header + 8, data_length);
+  PutUint32(header + 12, flags);
+  uint32_t crc = Crc32(0, header + 4, kRecordHeaderSize - 4);
+  crc = Crc32(crc, reinterpret_cast<const uint8_t *>(name.data()), name.size());
+  crc = Crc32(crc, data, data_length);
+  PutUint32(header, crc);
+  out->append(reinterpret_cast<const char *>(header), kRecordHeaderSize);
+  out->append(name);
+  out->append(reinterpret_cast<const char *>(data), data_length);
+}
+
+bool WriteFully(int fd, const std::string &buffer, off_t offset) {
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t result = pwrite(fd, buffer.data() + written,
+                            buffer.size() - written, offset + written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += result;
+  }
+  return true;
+}
+
+std::string DirectoryOf(const std::string &path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+}  // namespace
+
+CdmFileStore::CdmFileStore()
+    : fd_(-1), map_(NULL), map_length_(0), file_length_(0), live_length_(0) {}
+
+CdmFileStore::~CdmFileStore() { Close(); }
+
+bool CdmFileStore::Open(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CloseLocked();
+  return OpenLocked(path);
+}
+
+void CdmFileStore::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CloseLocked();
+}
+
+bool CdmFileStore::is_open() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fd_ >= 0;
+}
+
+bool CdmFileStore::Compact() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fd_ >= 0 && CompactLocked();
+}
+
+uint64_t CdmFileStore::file_size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return file_length_;
+}
+
+bool CdmFileStore::read(const std::string &name, std::string *data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Entry>::const_iterator it = index_.find(name);
+  if (it == index_.end()) {
+    return false;
+  }
+  const Entry &entry = it->second;
+  // Records appended since the file was mapped are not visible yet.
+  if (entry.data_offset + entry.data_length > map_length_ && !MapLocked()) {
+    return false;
+  }
+  data->assign(reinterpret_cast<const char *>(map_ + entry.data_offset),
+               entry.data_length);
+  return true;
+}
+
+bool CdmFileStore::write(const std::string &name, const std::string &data) {
+  if (data.size() > kMaxDataLength) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return AppendLocked(name, data, 0);
+}
+
+bool CdmFileStore::exists(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.count(name) != 0;
+}
+
+bool CdmFileStore::remove(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!index_.count(name)) {
+    return false;
+  }
+  return AppendLocked(name, std::string(), kRecordTombstone);
+}
+
+int32_t CdmFileStore::size(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Entry>::const_iterator it = index_.find(name);
+  if (it == index_.end()) {
+    return -1;
+  }
+  return static_cast<int32_t>(it->second.data_length);
+}
+
+bool CdmFileStore::OpenLocked(const std::string &path) {
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd_ < 0) {
+    return false;
+  }
+  path_ = path;
+  struct stat info;
+  if (fstat(fd_, &info) != 0) {
+    CloseLocked();
+    return false;
+  }
+  file_length_ = static_cast<uint64_t>(info.st_size);
+  if (file_length_ < kStoreHeaderSize) {
+    // New or never completed store.
+    uint8_t header[kStoreHeaderSize];
+    memcpy(header, kStoreMagic, sizeof(kStoreMagic));
+    PutUint32(header + 4, kStoreVersion);
+    if (ftruncate(fd_, 0) != 0 ||
+        !WriteFully(fd_, std::string(reinterpret_cast<char *>(header),
+                                     kStoreHeaderSize), 0) ||
+        fsync(fd_) != 0) {
+      CloseLocked();
+      return false;
+    }
+    file_length_ = kStoreHeaderSize;
+  }
+  if (!MapLocked() || !ScanLocked()) {
+    CloseLocked();
+    return false;
+  }
+  return true;
+}
+
+void CdmFileStore::CloseLocked() {
+  UnmapLocked();
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  index_.clear();
+  path_.clear();
+  file_length_ = 0;
+  live_length_ = 0;
+}
+
+bool CdmFileStore::CompactLocked() {
+  if (file_length_ > map_length_ && !MapLocked()) {
+    return false;
+  }
+  std::string buffer(map_, map_ + kStoreHeaderSize);
+  buffer.reserve(live_length_);
+  for (std::map<std::string, Entry>::const_iterator it = index_.begin();
+       it != index_.end(); ++it) {
+    EncodeRecord(it->first, map_ + it->second.data_offset,
+                 it->second.data_length, 0, &buffer);
+  }
+
+  std::string path = path_;
+  std::string temp_path = path + ".tmp";
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0600);
+  if (fd < 0) {
+    return false;
+  }
+  bool written = WriteFully(fd, buffer, 0) && fsync(fd) == 0;
+  close(fd);
+  if (!written || rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  // Make the rename itself durable.
+  int dir_fd = open(DirectoryOf(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  CloseLocked();
+  return OpenLocked(path);
+}
+
+bool CdmFileStore::MapLocked() {
+  UnmapLocked();
+  void *map = mmap(NULL, file_length_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  map_ = static_cast<const uint8_t *>(map);
+  map_length_ = file_length_;
+  return true;
+}
+
+void CdmFileStore::UnmapLocked() {
+  if (map_) {
+    munmap(const_cast<uint8_t *>(map_), map_length_);
+    map_ = NULL;
+    map_length_ = 0;
+  }
+}
+
+bool CdmFileStore::ScanLocked() {
+  if (memcmp(map_, kStoreMagic, sizeof(kStoreMagic)) != 0 ||
+      GetUint32(map_ + 4) != kStoreVersion) {
+    return false;
+  }
+  index_.clear();
+  live_length_ = kStoreHeaderSize;
+  uint64_t offset = kStoreHeaderSize;
+  while (map_length_ - offset >= kRecordHeaderSize) {
+    const uint8_t *record = map_ + offset;
+    uint32_t name_length = GetUint32(record + 4);
+    uint32_t data_length = GetUint32(record + 8);
+    uint32_t flags = GetUint32(record + 12);
+    if (name_length > kMaxNameLength || data_length > kMaxDataLength) {
+      break;
+    }
+    uint64_t record_length =
+        kRecordHeaderSize + static_cast<uint64_t>(name_length) + data_length;
+    if (map_length_ - offset < record_length) {
+      break;
+    }
+    uint32_t crc = Crc32(0, record + 4, record_length - 4);
+    if (crc != GetUint32(record)) {
+      break;
+    }
+    std::string name(reinterpret_cast<const char *>(record) + kRecordHeaderSize,
+                     name_length);
+    std::map<std::string, Entry>::iterator it = index_.find(name);
+    if (it != index_.end()) {
+      live_length_ -= it->second.record_length;
+      index_.erase(it);
+    }
+    if (!(flags & kRecordTombstone)) {
+      Entry entry;
+      entry.data_offset = offset + kRecordHeaderSize + name_length;
+      entry.data_length = data_length;
+      entry.record_length = static_cast<uint32_t>(record_length);
+      index_[name] = entry;
+      live_length_ += record_length;
+    }
+    offset += record_length;
+  }
+  if (offset < map_length_) {
+    // Drop the torn or corrupt tail so new records follow the last good one.
+    if (ftruncate(fd_, offset) != 0) {
+      return false;
+    }
+    file_length_ = offset;
+    return MapLocked();
+  }
+  return true;
+}
+
+bool CdmFileStore::AppendLocked(const std::string &name,
+                                const std::string &data, uint32_t flags) {
+  if (fd_ < 0 || name.empty() || name.size() > kMaxNameLength) {
+    return false;
+  }
+  std::string record;
+  record.reserve(kRecordHeaderSize + name.size() + data.size());
+  EncodeRecord(name, reinterpret_cast<const uint8_t *>(data.data()),
+               static_cast<uint32_t>(data.size()), flags, &record);
+  if (!WriteFully(fd_, record, file_length_) || fsync(fd_) != 0) {
+    // Never leave a partial record in front of the next append.
+    if (ftruncate(fd_, file_length_) != 0) {
+      CloseLocked();
+    }
+    return false;
+  }
+
+  std::map<std::string, Entry>::iterator it = index_.find(name);
+  if (it != index_.end()) {
+    live_length_ -= it->second.record_length;
+    index_.erase(it);
+  }
+  if (!(flags & kRecordTombstone)) {
+    Entry entry;
+    entry.data_offset = file_length_ + kRecordHeaderSize + name.size();
+    entry.data_length = static_cast<uint32_t>(data.size());
+    entry.record_length = static_cast<uint32_t>(record.size());
+    index_[name] = entry;
+    live_length_ += record.size();
+  }
+  file_length_ += record.size();
+
+  uint64_t garbage = file_length_ - live_length_;
+  if (garbage >= kMinCompactionGarbage && garbage > live_length_) {
+    // The record is already durable; a failed compaction only costs space.
+    CompactLocked();
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Offline storage for the CDM backed by a single append-only file.
+//
+// Every write appends a checksummed record; a remove appends a tombstone. The
+// file is memory mapped and an in-memory index maps each name to the newest
+// record, so CDM storage calls never open a file. On open the file is scanned
+// and everything after the first truncated or corrupt record is discarded,
+// which makes an interrupted append harmless. Once superseded records make up
+// most of the file it is compacted into a temporary file that atomically
+// replaces the original.
+//
+// Only POSIX and the C++ standard library are used so the store can be built
+// and tested off device.
+
+#ifndef WIDEVINE_BASE_CDM_HOST_IOS_CDMFILESTORE_H_
+#define WIDEVINE_BASE_CDM_HOST_IOS_CDMFILESTORE_H_
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "CdmIncludes.h"
+
+class CdmFileStore : public widevine::Cdm::IStorage {
+ public:
+  CdmFileStore();
+  virtual ~CdmFileStore();
+
+  // Opens the store at |path|, creating it if needed. Returns false if the
+  // file could not be opened or is not a store.
+  bool Open(const std::string &path);
+
+  void Close();
+
+  bool is_open();
+
+  // Rewrites the store with only its live records. Called automatically once
+  // enough of the file is garbage.
+  bool Compact();
+
+  // Size of the backing file in bytes.
+  uint64_t file_size();
+
+  virtual bool read(const std::string &name, std::string *data) override;
+
+  virtual bool write(const std::string &name,
+                     const std::string &data) override;
+
+  virtual bool exists(const std::string &name) override;
+
+  virtual bool remove(const std::string &name) override;
+
+  virtual int32_t size(const std::string &name) override;
+
+ private:
+  // Location of the newest record for a name.
+  struct Entry {
+    uint64_t data_offset;
+    uint32_t data_length;
+    uint32_t record_length;
+  };
+
+  bool OpenLocked(const std::string &path);
+  void CloseLocked();
+  bool CompactLocked();
+  bool MapLocked();
+  void UnmapLocked();
+  bool ScanLocked();
+  bool AppendLocked(const std::string &name, const std::string &data,
+                    uint32_t flags);
+
+  std::mutex mutex_;
+  std::string path_;
+  int fd_;
+  const uint8_t *map_;
+  size_t map_length_;
+  uint64_t file_length_;
+  // Bytes of the header and all records still referenced by |index_|.
+  uint64_t live_length_;
+  std::map<std::string, Entry> index_;
+
+  CdmFileStore(const CdmFileStore &) = delete;
+  CdmFileStore &operator=(const CdmFileStore &) = delete;
+};
+
+#endif  // WIDEVINE_BASE_CDM_HOST_IOS_CDMFILESTORE_H_
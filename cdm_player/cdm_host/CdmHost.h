@@ -16,9 +16,12 @@
 
 #include <dispatch/dispatch.h>
 #include <map>
+#include <vector>
 
+#include "CdmFileStore.h"
 #include "CdmHandler.h"
 #include "CdmIncludes.h"
+#include "CdmTimerWheel.h"
 
 // Wrapper for calls to the CDM.
 class iOSCdmHost : public widevine::Cdm::IEventListener,
@@ -36,6 +39,24 @@ class iOSCdmHost : public widevine::Cdm::IEventListener,
     return s_host;
   }
 
+  // Clear and encrypted byte counts of a single CENC subsample.
+  struct Subsample {
+    uint32_t clear_bytes;
+    uint32_t cipher_bytes;
+  };
+
+  // A sample handed to DecryptBatch. |input| and |output| may alias. When
+  // |subsample_count| is zero the whole sample is treated as encrypted.
+  struct Sample {
+    const uint8_t *input;
+    uint8_t *output;
+    uint32_t length;
+    const uint8_t *iv;
+    uint32_t iv_length;
+    const Subsample *subsamples;
+    size_t subsample_count;
+  };
+
   iOSCdmHost();
 
   // Initalize/Deinitialize should be called once for the lifetime of the app.
@@ -44,11 +65,23 @@ class iOSCdmHost : public widevine::Cdm::IEventListener,
 
   void Deinitialize();
 
+  // Makes the host drive |cdm| instead of the CDM it created and returns the
+  // one it drove before, which the caller then owns. |cdm| must report its
+  // events to this host. For tests only.
+  widevine::Cdm *ReplaceCdmForTesting(widevine::Cdm *cdm);
+
   // Set the callback object to handle responses from the CDM. Since CdmHost
   // is a static class, seting the cdmHandler can overwrite the previous
   // handler.
   void SetiOSCdmHandler(id<iOSCdmHandler> handler);
 
+  // Serves CDM storage from the single file store at |path| instead of the
+  // iOSCdmHandler file methods. Files the handler still holds are moved into
+  // the store the first time the CDM reads them.
+  NSError *OpenStore(NSString *path);
+
+  void CloseStore();
+
   // Creates a session and returns the |sessionId|.  Valid |sessionType|
   // are defined in the spec: http://goo.gl/vmc3pd
   NSError *CreateSession(widevine::Cdm::SessionType sessionType,
@@ -70,6 +103,18 @@ class iOSCdmHost : public widevine::Cdm::IEventListener,
   // Decrypts the |encypted| blob with |key_id| and |iv|.
   NSData *Decrypt(NSData *encrypted, NSData *key_id, NSData *iv);
 
+  // Decrypts every entry of |samples| with |key_id|. Meant to be called with
+  // all samples of one moof, which share a key, so that the CDM is driven from
+  // a single loop instead of one round trip per sample. Stops at the first
+  // sample that fails and returns its error.
+  NSError *DecryptBatch(const uint8_t *key_id, uint32_t key_id_length,
+                        const Sample *samples, size_t sample_count);
+
+  NSError *DecryptBatch(const uint8_t *key_id, uint32_t key_id_length,
+                        const std::vector<Sample> &samples) {
+    return DecryptBatch(key_id, key_id_length, samples.data(), samples.size());
+  }
+
   // Generates a request based on |data|.
   NSError *GenerateRequest(NSString *sessionId, NSData *initData);
 
@@ -102,9 +147,19 @@ class iOSCdmHost : public widevine::Cdm::IEventListener,
   virtual int32_t size(const std::string &name) override final;
 
  private:
+  // Decrypts a single |sample| reusing the key fields already set on |input|.
+  widevine::Cdm::Status DecryptSample(const Sample &sample,
+                                      widevine::Cdm::InputBuffer *input,
+                                      widevine::Cdm::OutputBuffer *output);
+
+  // Copies |name| from the iOSCdmHandler into the store and removes the
+  // handler's copy. Returns false if the handler has no such file.
+  bool MigrateLegacyFile(const std::string &name, std::string *data);
+
   widevine::Cdm *cdm_;
   id<iOSCdmHandler> iOSCdmHandler_;
-  NSMutableDictionary *timers_;
+  CdmDispatchTimer timer_;
+  CdmFileStore store_;
 };
 
 #endif // WIDEVINE_BASE_CDM_HOST_IOS_CDMHOST_H_
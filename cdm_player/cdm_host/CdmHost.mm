@@ -1,13 +1,13 @@
 #include "CdmHost.h"
+
+#include <algorithm>
+
 #include "CdmIncludes.h"
 #include "CdmWrapper.h"
 #include "iOSDeviceCert.h"
 
 using widevine::Cdm;
 
-// Default values for testing content. Can be modified dynamically or here.
-static int kLoopTimer = 1000.0;
-
 @interface NSString (StdStringHelpers)
 + (NSString*)stringWithStdString:(const std::string&)str;
 - (std::string)stdString;
@@ -31,6 +31,19 @@ namespace {
 
 static NSString *kCertFilename = @"cert.bin";
 
+// CENC IVs are 16 bytes; 8 byte IVs are zero padded to a full block.
+const uint32_t kCencIvSize = 16;
+const uint32_t kAesBlockSize = 16;
+
+// Advances the big-endian block counter held in the low 8 bytes of |iv|.
+void AdvanceCounter(uint8_t *iv, uint64_t blocks) {
+  for (int i = kCencIvSize - 1; i >= 8 && blocks; --i) {
+    blocks += iv[i];
+    iv[i] = static_cast<uint8_t>(blocks & 0xff);
+    blocks >>= 8;
+  }
+}
+
 // Creates an NSError object from the given Status
 NSError* GetErrorFromStatus(Cdm::Status status, NSString *desc) {
   if (status == Cdm::kSuccess) {
@@ -45,7 +58,7 @@ NSError* GetErrorFromStatus(Cdm::Status status, NSString *desc) {
 }  // namespace
 
 iOSCdmHost::iOSCdmHost()
-: cdm_(NULL), timers_([[NSMutableDictionary alloc] init]) {}
+: cdm_(NULL) {}
 
 NSError* iOSCdmHost::Initialize(const Cdm::ClientInfo& clientInfo,
     Cdm::LogLevel verbosity) {
@@ -74,12 +87,30 @@ void iOSCdmHost::Deinitialize() {
   }
 }
 
+Cdm *iOSCdmHost::ReplaceCdmForTesting(Cdm *cdm) {
+  Cdm *previous = cdm_;
+  cdm_ = cdm;
+  return previous;
+}
+
 void iOSCdmHost::SetiOSCdmHandler(id<iOSCdmHandler> handler) {
   assert((!iOSCdmHandler_ || !handler) &&
          "iOSCdmHost::setCdmHandler cdmHandler already exists.");
   iOSCdmHandler_ = handler;
 }
 
+NSError *iOSCdmHost::OpenStore(NSString *path) {
+  if (!store_.Open([path stdString])) {
+    return GetErrorFromStatus(Cdm::kUnexpectedError,
+        @"Error opening the license store.");
+  }
+  return nil;
+}
+
+void iOSCdmHost::CloseStore() {
+  store_.Close();
+}
+
 NSError *iOSCdmHost::CreateSession(Cdm::SessionType sessionType,
                                    NSString **sessionIdStr) {
   std::string sessionId;
@@ -136,22 +167,108 @@ void iOSCdmHost::CloseSessions(NSArray *sessionIds) {
 
 NSData* iOSCdmHost::Decrypt(NSData *encrypted, NSData *key_id, NSData *iv) {
   Cdm::InputBuffer input;
-  input.data = reinterpret_cast<const uint8_t*>([encrypted bytes]);
-  input.data_length = (uint32_t)[encrypted length];
   input.key_id = reinterpret_cast<const uint8_t*>([key_id bytes]);
   input.key_id_length = (uint32_t)[key_id length];
-  input.iv = reinterpret_cast<const uint8_t*>([iv bytes]);
-  input.iv_length = (uint32_t)[iv length];
-  input.block_offset = 0;
+
+  Sample sample = {};
+  sample.input = reinterpret_cast<const uint8_t*>([encrypted bytes]);
+  sample.length = (uint32_t)[encrypted length];
+  sample.output = (uint8_t*)malloc(sizeof(uint8_t) * sample.length);
+  sample.iv = reinterpret_cast<const uint8_t*>([iv bytes]);
+  sample.iv_length = (uint32_t)[iv length];
 
   Cdm::OutputBuffer decrypted;
-  decrypted.data = (uint8_t*)malloc(sizeof(uint8_t) * input.data_length);
-  decrypted.data_length = input.data_length;
-  if (cdm_->decrypt(input, decrypted)) {
+  if (DecryptSample(sample, &input, &decrypted)) {
+    free(sample.output);
     return nil;
   }
-  return [NSData dataWithBytesNoCopy:decrypted.data
-                              length:decrypted.data_length];
+  return [NSData dataWithBytesNoCopy:sample.output length:sample.length];
+}
+
+NSError *iOSCdmHost::DecryptBatch(const uint8_t *key_id,
+                                  uint32_t key_id_length,
+                                  const Sample *samples,
+                                  size_t sample_count) {
+  Cdm::InputBuffer input;
+  input.key_id = key_id;
+  input.key_id_length = key_id_length;
+  Cdm::OutputBuffer output;
+  for (size_t i = 0; i < sample_count; ++i) {
+    Cdm::Status status = DecryptSample(samples[i], &input, &output);
+    if (status != Cdm::kSuccess) {
+      return GetErrorFromStatus(status, @"Error decrypting sample.");
+    }
+  }
+  return nil;
+}
+
+Cdm::Status iOSCdmHost::DecryptSample(const Sample &sample,
+                                      Cdm::InputBuffer *input,
+                                      Cdm::OutputBuffer *output) {
+  if (!sample.subsample_count) {
+    input->iv = sample.iv;
+    input->iv_length = sample.iv_length;
+    input->data = sample.input;
+    input->data_length = sample.length;
+    input->block_offset = 0;
+    output->data = sample.output;
+    output->data_length = sample.length;
+    return cdm_->decrypt(*input, *output);
+  }
+
+  // The CDM is told which call starts and which ends the sample, and only
+  // subsamples with cipher bytes are handed to it.
+  size_t first_encrypted = sample.subsample_count;
+  size_t last_encrypted = 0;
+  for (size_t i = 0; i < sample.subsample_count; ++i) {
+    if (sample.subsamples[i].cipher_bytes) {
+      first_encrypted = std::min(first_encrypted, i);
+      last_encrypted = i;
+    }
+  }
+
+  // Each encrypted range continues the AES-CTR stream of the previous one, so
+  // the counter and block offset are derived from the cipher bytes seen so far.
+  uint8_t iv[kCencIvSize] = {0};
+  memcpy(iv, sample.iv, std::min(sample.iv_length, kCencIvSize));
+  input->iv = iv;
+  input->iv_length = kCencIvSize;
+  uint32_t offset = 0;
+  uint32_t block_offset = 0;
+  for (size_t i = 0; i < sample.subsample_count; ++i) {
+    const Subsample &subsample = sample.subsamples[i];
+    if (subsample.clear_bytes > sample.length - offset ||
+        subsample.cipher_bytes >
+            sample.length - offset - subsample.clear_bytes) {
+      return Cdm::kRangeError;
+    }
+    if (subsample.clear_bytes) {
+      memmove(sample.output + offset, sample.input + offset,
+              subsample.clear_bytes);
+      offset += subsample.clear_bytes;
+    }
+    if (!subsample.cipher_bytes) {
+      continue;
+    }
+    input->data = sample.input + offset;
+    input->data_length = subsample.cipher_bytes;
+    input->block_offset = block_offset;
+    input->first_subsample = (i == first_encrypted);
+    input->last_subsample = (i == last_encrypted);
+    output->data = sample.output + offset;
+    output->data_length = subsample.cipher_bytes;
+    Cdm::Status status = cdm_->decrypt(*input, *output);
+    if (status != Cdm::kSuccess) {
+      return status;
+    }
+    offset += subsample.cipher_bytes;
+    uint32_t consumed = block_offset + subsample.cipher_bytes;
+    AdvanceCounter(iv, consumed / kAesBlockSize);
+    block_offset = consumed % kAesBlockSize;
+  }
+  input->first_subsample = true;
+  input->last_subsample = true;
+  return Cdm::kSuccess;
 }
 
 NSError *iOSCdmHost::GenerateRequest(NSString *sessionId, NSData *initData) {
@@ -166,41 +283,11 @@ NSError *iOSCdmHost::GenerateRequest(NSString *sessionId, NSData *initData) {
 void iOSCdmHost::setTimeout(int64_t delay_ms,
                             Cdm::ITimer::IClient* client,
                             void* context) {
-  NSValue* clientValue = [NSValue valueWithPointer:client];
-  __weak NSMutableDictionary* weakTimers = timers_;
-  CFRunLoopTimerRef timer = CFRunLoopTimerCreateWithHandler(
-      NULL,
-      CFAbsoluteTimeGetCurrent() + static_cast<uint32_t>(delay_ms) / kLoopTimer,
-      0,
-      0,
-      0,
-      ^(CFRunLoopTimerRef runloop_timer) {
-        NSValue* timerValue = [NSValue valueWithPointer:runloop_timer];
-        client->onTimerExpired(context);
-        [[weakTimers objectForKey:clientValue] removeObject:timerValue];
-        CFRelease(runloop_timer);
-      });
-  CFRunLoopAddTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopCommonModes);
-
-  NSValue* timerValue = [NSValue valueWithPointer:timer];
-  NSMutableArray* array = [timers_ objectForKey:clientValue];
-  if (!array) {
-    array = [[NSMutableArray alloc] init];
-    [timers_ setObject:array forKey:clientValue];
-  }
-
-  [array addObject:timerValue];
+  timer_.setTimeout(delay_ms, client, context);
 }
 
 void iOSCdmHost::cancel(Cdm::ITimer::IClient* client) {
-  NSValue* clientValue = [NSValue valueWithPointer:client];
-  NSMutableArray* array = [timers_ objectForKey:clientValue];
-  for (NSValue* value in array) {
-    CFRunLoopTimerRef timer = reinterpret_cast<CFRunLoopTimerRef>(
-        [value pointerValue]);
-    CFRunLoopRemoveTimer(CFRunLoopGetCurrent(), timer, kCFRunLoopCommonModes);
-  }
-  [array removeAllObjects];
+  timer_.cancel(client);
 }
 
 int64_t iOSCdmHost::now() {
@@ -247,6 +334,10 @@ bool iOSCdmHost::read(const std::string& name, std::string* data) {
     return true;
   }
 
+  if (store_.is_open()) {
+    return store_.read(name, data) || MigrateLegacyFile(name, data);
+  }
+
   NSData *output = [iOSCdmHandler_ readFile:nameStr];
   if (!output ) {
     return false;
@@ -263,6 +354,10 @@ bool iOSCdmHost::write(const std::string& name, const std::string& data) {
     return false;
   }
 
+  if (store_.is_open()) {
+    return store_.write(name, data);
+  }
+
   NSData *dataObj = [NSData dataWithBytes:data.c_str()
                                    length:data.length()];
   return [iOSCdmHandler_ writeFile:dataObj file:nameStr];
@@ -274,6 +369,9 @@ bool iOSCdmHost::exists(const std::string& name) {
     return true;
   }
 
+  if (store_.is_open() && store_.exists(name)) {
+    return true;
+  }
   return [iOSCdmHandler_ fileExists:nameStr];
 }
 
@@ -282,7 +380,10 @@ bool iOSCdmHost::remove(const std::string& name) {
   if ([nameStr isEqualToString:kCertFilename]) {
     return false;
   }
-  return [iOSCdmHandler_ removeFile:nameStr];
+
+  // A file that has not been migrated yet only exists in the handler.
+  bool removed = store_.is_open() && store_.remove(name);
+  return [iOSCdmHandler_ removeFile:nameStr] || removed;
 }
 
 int32_t iOSCdmHost::size(const std::string& name) {
@@ -291,5 +392,21 @@ int32_t iOSCdmHost::size(const std::string& name) {
     return static_cast<int32_t>(kDeviceCertSize);
   }
 
+  if (store_.is_open() && store_.exists(name)) {
+    return store_.size(name);
+  }
   return [iOSCdmHandler_ fileSize:nameStr];
 }
+
+bool iOSCdmHost::MigrateLegacyFile(const std::string& name, std::string* data) {
+  NSString *nameStr = [NSString stringWithStdString:name];
+  NSData *legacy = [iOSCdmHandler_ readFile:nameStr];
+  if (!legacy) {
+    return false;
+  }
+  data->assign(reinterpret_cast<const char*>([legacy bytes]), [legacy length]);
+  if (store_.write(name, *data)) {
+    [iOSCdmHandler_ removeFile:nameStr];
+  }
+  return true;
+}
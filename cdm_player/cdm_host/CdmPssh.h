@@ -0,0 +1,22 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Widevine PSSH box helpers.
+//
+// A Widevine PSSH box carries a WidevinePsshData protobuf naming the key IDs a
+// license has to cover. Packagers write one box per track, so a title usually
+// has several boxes that only differ in their key IDs and track type. Merging
+// them lets a single license request cover every key of the title.
+
+#import <Foundation/Foundation.h>
+
+// Returns YES if |pssh| is a complete PSSH box carrying Widevine data.
+FOUNDATION_EXTERN BOOL CDMIsWidevinePssh(NSData *pssh);
+
+// Returns the key IDs of the Widevine PSSH box |pssh|, from both the version 1
+// box header and the Widevine data, or nil if |pssh| cannot be parsed.
+FOUNDATION_EXTERN NSArray<NSData *> *CDMWidevinePsshKeyIds(NSData *pssh);
+
+// Merges the Widevine PSSH boxes |psshs| into one box requesting every key ID
+// of all of them. The boxes must agree on everything but their key IDs and
+// track type, which is dropped. Returns nil if a box cannot be parsed or the
+// boxes do not describe the same content.
+FOUNDATION_EXTERN NSData *CDMCombineWidevinePssh(NSArray<NSData *> *psshs);
@@ -0,0 +1,221 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "CdmPssh.h"
+
+// Widevine system ID (edef8ba9-79d6-4ace-a3c8-27dcd51d21ed) as found in a PSSH box.
+static const uint8_t kWidevineSystemId[] = {0xed, 0xef, 0x8b, 0xa9, 0x79, 0xd6, 0x4a, 0xce,
+                                            0xa3, 0xc8, 0x27, 0xdc, 0xd5, 0x1d, 0x21, 0xed};
+// Size of the box header, version and flags preceding the system ID in a PSSH box.
+static const NSUInteger kPsshSystemIdOffset = 12;
+static const NSUInteger kPsshKeyIdSize = 16;
+
+// WidevinePsshData fields rewritten when boxes are merged.
+static const uint64_t kKeyIdField = 2;
+static const uint64_t kTrackTypeField = 5;
+static const uint64_t kWireTypeVarint = 0;
+static const uint64_t kWireType64Bit = 1;
+static const uint64_t kWireTypeLengthDelimited = 2;
+static const uint64_t kWireType32Bit = 5;
+
+// A parsed Widevine PSSH box.
+@interface CDMWidevinePssh : NSObject
+@property(nonatomic) uint8_t version;
+// Key IDs listed in a version 1 box header.
+@property(nonatomic) NSMutableArray<NSData *> *boxKeyIds;
+// Key IDs listed in the Widevine data.
+@property(nonatomic) NSMutableArray<NSData *> *dataKeyIds;
+// The encoded Widevine data fields other than the key IDs and track type.
+@property(nonatomic) NSMutableData *otherFields;
+@end
+
+@implementation CDMWidevinePssh
+@end
+
+static uint32_t ReadUInt32(const uint8_t *bytes) {
+  return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+static void AppendUInt32(NSMutableData *data, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8),
+                      (uint8_t)value};
+  [data appendBytes:bytes length:sizeof(bytes)];
+}
+
+// Reads a protobuf varint at |*position|, advancing it. Returns NO if |end| comes first.
+static BOOL ReadVarint(const uint8_t **position, const uint8_t *end, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *position < end; shift += 7) {
+    uint8_t byte = *(*position)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+static void AppendVarint(NSMutableData *data, uint64_t value) {
+  do {
+    uint8_t byte = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    [data appendBytes:&byte length:1];
+    value >>= 7;
+  } while (value);
+}
+
+// Splits the WidevinePsshData protobuf |data| into |pssh|'s key IDs and other fields.
+static BOOL ParseWidevineData(const uint8_t *data, size_t length, CDMWidevinePssh *pssh) {
+  const uint8_t *position = data;
+  const uint8_t *end = data + length;
+  while (position < end) {
+    const uint8_t *field = position;
+    uint64_t tag;
+    if (!ReadVarint(&position, end, &tag)) {
+      return NO;
+    }
+    const uint8_t *value = position;
+    uint64_t size = 0;
+    switch (tag & 7) {
+      case kWireTypeVarint:
+        if (!ReadVarint(&position, end, &size)) {
+          return NO;
+        }
+        size = 0;
+        break;
+      case kWireType64Bit:
+        size = 8;
+        break;
+      case kWireTypeLengthDelimited:
+        if (!ReadVarint(&position, end, &size)) {
+          return NO;
+        }
+        value = position;
+        break;
+      case kWireType32Bit:
+        size = 4;
+        break;
+      default:
+        return NO;
+    }
+    if (size > (uint64_t)(end - position)) {
+      return NO;
+    }
+    position += size;
+    uint64_t fieldNumber = tag >> 3;
+    if (fieldNumber == kKeyIdField && (tag & 7) == kWireTypeLengthDelimited) {
+      [pssh.dataKeyIds addObject:[NSData dataWithBytes:value length:(NSUInteger)size]];
+    } else if (fieldNumber != kTrackTypeField) {
+      [pssh.otherFields appendBytes:field length:position - field];
+    }
+  }
+  return YES;
+}
+
+static CDMWidevinePssh *ParseWidevinePssh(NSData *box) {
+  if (!CDMIsWidevinePssh(box)) {
+    return nil;
+  }
+  const uint8_t *bytes = (const uint8_t *)box.bytes;
+  const uint8_t *end = bytes + box.length;
+  if (bytes[8] > 1) {
+    return nil;
+  }
+  CDMWidevinePssh *pssh = [[CDMWidevinePssh alloc] init];
+  pssh.version = bytes[8];
+  pssh.boxKeyIds = [NSMutableArray array];
+  pssh.dataKeyIds = [NSMutableArray array];
+  pssh.otherFields = [NSMutableData data];
+  const uint8_t *position = bytes + kPsshSystemIdOffset + sizeof(kWidevineSystemId);
+  if (pssh.version == 1) {
+    if (end - position < 4) {
+      return nil;
+    }
+    uint32_t count = ReadUInt32(position);
+    position += 4;
+    if (count > (size_t)(end - position) / kPsshKeyIdSize) {
+      return nil;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      [pssh.boxKeyIds addObject:[NSData dataWithBytes:position length:kPsshKeyIdSize]];
+      position += kPsshKeyIdSize;
+    }
+  }
+  if (end - position < 4) {
+    return nil;
+  }
+  uint32_t dataSize = ReadUInt32(position);
+  position += 4;
+  if (dataSize > (size_t)(end - position) ||
+      !ParseWidevineData(position, dataSize, pssh)) {
+    return nil;
+  }
+  return pssh;
+}
+
+BOOL CDMIsWidevinePssh(NSData *pssh) {
+  if (pssh.length < kPsshSystemIdOffset + sizeof(kWidevineSystemId)) {
+    return NO;
+  }
+  const uint8_t *bytes = (const uint8_t *)pssh.bytes;
+  return memcmp(bytes + 4, "pssh", 4) == 0 &&
+         memcmp(bytes + kPsshSystemIdOffset, kWidevineSystemId, sizeof(kWidevineSystemId)) == 0;
+}
+
+NSArray<NSData *> *CDMWidevinePsshKeyIds(NSData *pssh) {
+  CDMWidevinePssh *parsed = ParseWidevinePssh(pssh);
+  if (!parsed) {
+    return nil;
+  }
+  NSMutableOrderedSet<NSData *> *keyIds =
+      [NSMutableOrderedSet orderedSetWithArray:parsed.boxKeyIds];
+  [keyIds addObjectsFromArray:parsed.dataKeyIds];
+  return keyIds.array;
+}
+
+NSData *CDMCombineWidevinePssh(NSArray<NSData *> *psshs) {
+  if (!psshs.count) {
+    return nil;
+  }
+  uint8_t version = 0;
+  NSData *otherFields = nil;
+  NSMutableOrderedSet<NSData *> *boxKeyIds = [NSMutableOrderedSet orderedSet];
+  NSMutableOrderedSet<NSData *> *dataKeyIds = [NSMutableOrderedSet orderedSet];
+  for (NSData *box in psshs) {
+    CDMWidevinePssh *pssh = ParseWidevinePssh(box);
+    if (!pssh) {
+      return nil;
+    }
+    if (!otherFields) {
+      otherFields = pssh.otherFields;
+    } else if (![otherFields isEqualToData:pssh.otherFields]) {
+      // Different provider, content or policy.
+      return nil;
+    }
+    version = MAX(version, pssh.version);
+    [boxKeyIds addObjectsFromArray:pssh.boxKeyIds];
+    [dataKeyIds addObjectsFromArray:pssh.dataKeyIds];
+  }
+
+  NSMutableData *data = [otherFields mutableCopy];
+  for (NSData *keyId in dataKeyIds) {
+    AppendVarint(data, kKeyIdField << 3 | kWireTypeLengthDelimited);
+    AppendVarint(data, keyId.length);
+    [data appendData:keyId];
+  }
+  NSMutableData *box = [NSMutableData data];
+  AppendUInt32(box, 0);  // Size, set below.
+  [box appendBytes:"pssh" length:4];
+  AppendUInt32(box, (uint32_t)version << 24);
+  [box appendBytes:kWidevineSystemId length:sizeof(kWidevineSystemId)];
+  if (version == 1) {
+    AppendUInt32(box, (uint32_t)boxKeyIds.count);
+    for (NSData *keyId in boxKeyIds) {
+      [box appendData:keyId];
+    }
+  }
+  AppendUInt32(box, (uint32_t)data.length);
+  [box appendData:data];
+  uint8_t size[4] = {(uint8_t)(box.length >> 24), (uint8_t)(box.length >> 16),
+                     (uint8_t)(box.length >> 8), (uint8_t)box.length};
+  [box replaceBytesInRange:NSMakeRange(0, sizeof(size)) withBytes:size];
+  return box;
+}
@@ -0,0 +1,318 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "CdmTimerWheel.h"
+
+#include <dispatch/dispatch.h>
+
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+const uint64_t kNanosecondsPerMillisecond = 1000000;
+// Timers are rarely late by more than this, and the slack lets the system
+// coalesce wake ups.
+const uint64_t kTimerLeewayNs = kNanosecondsPerMillisecond;
+// Longest the dispatch source sleeps at once. Waking up early is harmless and
+// keeps far away wake ups from overflowing dispatch_time.
+const uint64_t kMaxSleepMs = 24 * 60 * 60 * 1000;
+
+int HighestBit(uint64_t value) { return 63 - __builtin_clzll(value); }
+
+int LowestBit(uint64_t value) { return __builtin_ctzll(value); }
+
+}  // namespace
+
+struct CdmTimerWheel::Timer {
+  Link slot_link;
+  Link client_link;
+  uint64_t expiration;
+  Client *client;
+  void *context;
+  // Position in |slots_|, or -1 once expired.
+  int level;
+  int slot;
+
+  static Timer *FromSlotLink(Link *link) {
+    return reinterpret_cast<Timer *>(reinterpret_cast<char *>(link) -
+                                     offsetof(Timer, slot_link));
+  }
+
+  static Timer *FromClientLink(Link *link) {
+    return reinterpret_cast<Timer *>(reinterpret_cast<char *>(link) -
+                                     offsetof(Timer, client_link));
+  }
+};
+
+void CdmTimerWheel::Link::InsertBefore(Link *position) {
+  prev = position->prev;
+  next = position;
+  prev->next = this;
+  position->prev = this;
+}
+
+void CdmTimerWheel::Link::Unlink() {
+  prev->next = next;
+  next->prev = prev;
+  prev = next = this;
+}
+
+CdmTimerWheel::CdmTimerWheel(uint64_t now) : current_(now), size_(0) {
+  for (int level = 0; level < kLevels; ++level) {
+    occupied_[level] = 0;
+  }
+}
+
+CdmTimerWheel::~CdmTimerWheel() {
+  for (std::unordered_map<Client *, Link>::iterator it = clients_.begin();
+       it != clients_.end(); ++it) {
+    Link &timers = it->second;
+    while (!timers.empty()) {
+      Timer *timer = Timer::FromClientLink(timers.next);
+      timer->client_link.Unlink();
+      delete timer;
+    }
+  }
+}
+
+void CdmTimerWheel::Schedule(uint64_t expiration, Client *client,
+                             void *context) {
+  Timer *timer = new Timer;
+  timer->expiration = expiration < current_ ? current_ : expiration;
+  timer->client = client;
+  timer->context = context;
+  timer->client_link.InsertBefore(&clients_[client]);
+  Insert(timer);
+  ++size_;
+}
+
+void CdmTimerWheel::Cancel(Client *client) {
+  std::unordered_map<Client *, Link>::iterator it = clients_.find(client);
+  if (it == clients_.end()) {
+    return;
+  }
+  Link &timers = it->second;
+  while (!timers.empty()) {
+    Timer *timer = Timer::FromClientLink(timers.next);
+    timer->client_link.Unlink();
+    Unlink(timer);
+    delete timer;
+    --size_;
+  }
+  clients_.erase(it);
+}
+
+bool CdmTimerWheel::PopExpired(uint64_t now, Client **client,
+                               void **context) {
+  Advance(now);
+  if (expired_.empty()) {
+    return false;
+  }
+  Timer *timer = Timer::FromSlotLink(expired_.next);
+  timer->slot_link.Unlink();
+  timer->client_link.Unlink();
+  std::unordered_map<Client *, Link>::iterator it =
+      clients_.find(timer->client);
+  if (it->second.empty()) {
+    clients_.erase(it);
+  }
+  *client = timer->client;
+  *context = timer->context;
+  delete timer;
+  --size_;
+  return true;
+}
+
+uint64_t CdmTimerWheel::NextWakeup() const {
+  if (!expired_.empty()) {
+    return current_;
+  }
+  int level;
+  int slot;
+  return NextEvent(&level, &slot);
+}
+
+uint64_t CdmTimerWheel::NextEvent(int *level, int *slot) const {
+  // Slots of lower levels always come before those of higher levels.
+  for (int l = 0; l < kLevels; ++l) {
+    int shift = l * kLevelBits;
+    int digit = static_cast<int>((current_ >> shift) & (kSlots - 1));
+    uint64_t round = current_ >> (shift + kLevelBits) << (shift + kLevelBits);
+    // Level 0 holds the current tick itself; higher levels only hold slots
+    // after the current one.
+    uint64_t ahead = l == 0 ? ~0ULL << digit
+                            : (digit == kSlots - 1 ? 0 : ~0ULL << (digit + 1));
+    if (occupied_[l] & ahead) {
+      *level = l;
+      *slot = LowestBit(occupied_[l] & ahead);
+      return round | (static_cast<uint64_t>(*slot) << shift);
+    }
+    if (l == kLevels - 1 && occupied_[l]) {
+      // The remaining top level slots belong to the next round.
+      *level = l;
+      *slot = LowestBit(occupied_[l]);
+      return round + (1ULL << (shift + kLevelBits)) +
+             (static_cast<uint64_t>(*slot) << shift);
+    }
+  }
+  return kNever;
+}
+
+void CdmTimerWheel::Advance(uint64_t now) {
+  while (true) {
+    int level;
+    int slot;
+    uint64_t tick = NextEvent(&level, &slot);
+    if (tick > now) {
+      break;
+    }
+    current_ = tick;
+    Link &head = slots_[level][slot];
+    occupied_[level] &= ~(1ULL << slot);
+    if (level == 0) {
+      while (!head.empty()) {
+        Timer *timer = Timer::FromSlotLink(head.next);
+        timer->slot_link.Unlink();
+        timer->slot_link.InsertBefore(&expired_);
+        timer->level = -1;
+      }
+      continue;
+    }
+    // Move the timers of the slot down now that its time has come.
+    Link cascade;
+    while (!head.empty()) {
+      Link *link = head.next;
+      link->Unlink();
+      link->InsertBefore(&cascade);
+    }
+    while (!cascade.empty()) {
+      Timer *timer = Timer::FromSlotLink(cascade.next);
+      timer->slot_link.Unlink();
+      Insert(timer);
+    }
+  }
+  // No slot starts before |now|, so every timer keeps its level.
+  if (now > current_) {
+    current_ = now;
+  }
+}
+
+void CdmTimerWheel::Insert(Timer *timer) {
+  uint64_t difference = timer->expiration ^ current_;
+  int level = 0;
+  if (difference >> (kLevels * kLevelBits)) {
+    level = kLevels - 1;
+  } else if (difference) {
+    level = HighestBit(difference) / kLevelBits;
+  }
+  int slot = static_cast<int>((timer->expiration >> (level * kLevelBits)) &
+                              (kSlots - 1));
+  timer->level = level;
+  timer->slot = slot;
+  timer->slot_link.InsertBefore(&slots_[level][slot]);
+  occupied_[level] |= 1ULL << slot;
+}
+
+void CdmTimerWheel::Unlink(Timer *timer) {
+  timer->slot_link.Unlink();
+  if (timer->level >= 0 && slots_[timer->level][timer->slot].empty()) {
+    occupied_[timer->level] &= ~(1ULL << timer->slot);
+  }
+}
+
+struct CdmDispatchTimer::State {
+  std::mutex mutex;
+  std::chrono::steady_clock::time_point origin;
+  CdmTimerWheel wheel;
+  dispatch_queue_t queue;
+  dispatch_source_t source;
+  // Tick the source is set to fire at.
+  uint64_t armed;
+
+  State() : origin(std::chrono::steady_clock::now()), wheel(0),
+            armed(CdmTimerWheel::kNever) {}
+
+  uint64_t Now() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - origin).count();
+  }
+
+  // Points the dispatch source at the next wake up of the wheel.
+  void RearmLocked(uint64_t now) {
+    uint64_t wakeup = wheel.NextWakeup();
+    if (wakeup == armed) {
+      return;
+    }
+    armed = wakeup;
+    dispatch_time_t start = DISPATCH_TIME_FOREVER;
+    if (wakeup != CdmTimerWheel::kNever) {
+      uint64_t delay = wakeup > now ? wakeup - now : 0;
+      if (delay > kMaxSleepMs) {
+        delay = kMaxSleepMs;
+      }
+      start = dispatch_time(
+          DISPATCH_TIME_NOW,
+          static_cast<int64_t>(delay * kNanosecondsPerMillisecond));
+    }
+    dispatch_source_set_timer(source, start, DISPATCH_TIME_FOREVER,
+                              kTimerLeewayNs);
+  }
+
+  // Runs on |queue|. Each timer is popped under the lock and fired outside of
+  // it, so a cancel racing with the source is honored for every timer that
+  // has not started firing.
+  static void Fire(void *context) {
+    State *state = static_cast<State *>(context);
+    while (true) {
+      CdmTimerWheel::Client *client;
+      void *timer_context;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        uint64_t now = state->Now();
+        state->armed = CdmTimerWheel::kNever;
+        if (!state->wheel.PopExpired(now, &client, &timer_context)) {
+          state->RearmLocked(now);
+          return;
+        }
+      }
+      client->onTimerExpired(timer_context);
+    }
+  }
+
+  static void Noop(void *) {}
+};
+
+CdmDispatchTimer::CdmDispatchTimer() : state_(new State) {
+  state_->queue = dispatch_queue_create(
+      "com.google.widevine.cdm-player.timer", DISPATCH_QUEUE_SERIAL);
+  state_->source =
+      dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, state_->queue);
+  dispatch_set_context(state_->source, state_);
+  dispatch_source_set_event_handler_f(state_->source, &State::Fire);
+  dispatch_source_set_timer(state_->source, DISPATCH_TIME_FOREVER,
+                            DISPATCH_TIME_FOREVER, kTimerLeewayNs);
+  dispatch_resume(state_->source);
+}
+
+CdmDispatchTimer::~CdmDispatchTimer() {
+  dispatch_source_cancel(state_->source);
+  // Wait out a callback that may still be running.
+  dispatch_sync_f(state_->queue, NULL, &State::Noop);
+  dispatch_release(state_->source);
+  dispatch_release(state_->queue);
+  delete state_;
+}
+
+void CdmDispatchTimer::setTimeout(int64_t delay_ms, IClient *client,
+                                  void *context) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  uint64_t now = state_->Now();
+  state_->wheel.Schedule(now + (delay_ms > 0 ? delay_ms : 0), client, context);
+  state_->RearmLocked(now);
+}
+
+void CdmDispatchTimer::cancel(IClient *client) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->wheel.Cancel(client);
+  state_->RearmLocked(state_->Now());
+}
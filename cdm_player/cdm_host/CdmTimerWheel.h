@@ -0,0 +1,119 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Timers for the CDM.
+//
+// CdmTimerWheel is a hierarchical timer wheel: six levels of 64 slots with a
+// resolution of one millisecond. A timer lives in the level of the highest
+// 6-bit digit in which its expiration differs from the current time and is
+// moved down a level each time the current time enters its slot, so
+// scheduling and cancelling a timer are O(1) no matter how many are pending.
+// Timers further out than the top level wraps around stay in the top level
+// until their round comes.
+//
+// CdmDispatchTimer implements Cdm::ITimer on top of the wheel. Timers fire on
+// a private serial dispatch queue driven by a single dispatch timer source, so
+// they do not depend on the run loop of the thread that scheduled them and can
+// be cancelled from any thread.
+//
+// Neither class uses Objective-C, so both build and can be tested off device
+// against libdispatch.
+
+#ifndef WIDEVINE_BASE_CDM_HOST_IOS_CDMTIMERWHEEL_H_
+#define WIDEVINE_BASE_CDM_HOST_IOS_CDMTIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+
+#include "CdmIncludes.h"
+
+class CdmTimerWheel {
+ public:
+  typedef widevine::Cdm::ITimer::IClient Client;
+
+  // Returned by NextWakeup() when no timer is pending.
+  static const uint64_t kNever = UINT64_MAX;
+
+  // |now| is the current tick. Ticks are milliseconds from any origin.
+  explicit CdmTimerWheel(uint64_t now);
+  ~CdmTimerWheel();
+
+  // Schedules a timer for |client| and |context| that expires at |expiration|.
+  // A client may have any number of timers.
+  void Schedule(uint64_t expiration, Client *client, void *context);
+
+  // Cancels every pending timer of |client|.
+  void Cancel(Client *client);
+
+  // Removes the earliest pending timer that expired at or before |now| and
+  // returns its client and context. Returns false if no timer has expired.
+  bool PopExpired(uint64_t now, Client **client, void **context);
+
+  // The tick by which PopExpired should next be called, or kNever. This can
+  // be earlier than the next expiration when timers need to move down a level.
+  uint64_t NextWakeup() const;
+
+  size_t size() const { return size_; }
+
+ private:
+  static const int kLevelBits = 6;
+  static const int kSlots = 1 << kLevelBits;
+  static const int kLevels = 6;
+
+  // Intrusive circular list node. A node that is not in a list points at
+  // itself.
+  struct Link {
+    Link *prev;
+    Link *next;
+
+    Link() : prev(this), next(this) {}
+    bool empty() const { return next == this; }
+    void InsertBefore(Link *position);
+    void Unlink();
+  };
+
+  struct Timer;
+
+  // Returns the tick of the next slot to process and its level and slot.
+  uint64_t NextEvent(int *level, int *slot) const;
+  void Advance(uint64_t now);
+  void Insert(Timer *timer);
+  void Unlink(Timer *timer);
+
+  uint64_t current_;
+  size_t size_;
+  Link slots_[kLevels][kSlots];
+  // Bit n of occupied_[level] is set when slots_[level][n] is not empty.
+  uint64_t occupied_[kLevels];
+  // Timers that expired but have not been popped yet, in expiration order.
+  Link expired_;
+  // All timers of each client, for cancellation.
+  std::unordered_map<Client *, Link> clients_;
+
+  CdmTimerWheel(const CdmTimerWheel &) = delete;
+  CdmTimerWheel &operator=(const CdmTimerWheel &) = delete;
+};
+
+class CdmDispatchTimer : public widevine::Cdm::ITimer {
+ public:
+  CdmDispatchTimer();
+  // Must not be destroyed from a timer callback.
+  virtual ~CdmDispatchTimer();
+
+  virtual void setTimeout(int64_t delay_ms, IClient *client,
+                          void *context) override;
+
+  // No callback for |client| starts after cancel returns. A callback that is
+  // already running on the timer queue is not waited for.
+  virtual void cancel(IClient *client) override;
+
+ private:
+  // Dispatch objects are kept out of this header so that it means the same
+  // in C++ and in Objective-C++ files compiled with ARC.
+  struct State;
+  State *state_;
+
+  CdmDispatchTimer(const CdmDispatchTimer &) = delete;
+  CdmDispatchTimer &operator=(const CdmDispatchTimer &) = delete;
+};
+
+#endif  // WIDEVINE_BASE_CDM_HOST_IOS_CDMTIMERWHEEL_H_
@@ -4,6 +4,23 @@
 
 extern NSString *const kiOSCdmError;
 
+// Clear and encrypted byte counts of a single CENC subsample.
+typedef struct {
+  uint32_t clearBytes;
+  uint32_t cipherBytes;
+} iOSCdmSubsample;
+
+// A sample decrypted in place by decryptSamples:count:keyId:. When
+// |subsampleCount| is zero the whole sample is encrypted.
+typedef struct {
+  uint8_t *data;
+  uint32_t length;
+  const uint8_t *iv;
+  uint32_t ivLength;
+  const iOSCdmSubsample *subsamples;
+  size_t subsampleCount;
+} iOSCdmSample;
+
 @protocol iOSCdmDelegate <NSObject>
 // Returns the dispatch_queue the delegate desires to be called back on.
 - (dispatch_queue_t)iOSCdmDispatchQueue:(iOSCdm *)iOSCdm;
@@ -28,6 +45,9 @@ extern NSString *const kiOSCdmError;
             offline:(BOOL)isOffline
     completionBlock:(void (^)(NSData *, NSError *))completionBlock;
 
+// Path of the single file the CDM should keep its offline licenses in. When
+// implemented the file methods below are only used to migrate existing files.
+- (NSString *)iOSCdmLicenseStorePath:(iOSCdm *)iOSCdm;
 // Asks whether the given file exists (See writeData).
 - (BOOL)fileExists:(NSString *)fileName;
 // Asks the size of the file saved with writeData.
@@ -41,6 +61,8 @@ extern NSString *const kiOSCdmError;
 // with the |pssh|.  Future sessions will call sessionIdFromPssh with the same
 // |pssh|.
 - (void)onSessionCreatedWithPssh:(NSData *)pssh sessionId:(NSString *)sessionId;
+// Called when the offline license stored for |pssh| is used for playback.
+- (void)onSessionUsedWithPssh:(NSData *)pssh;
 // Reads a file saved with writeData.
 - (NSData *)readFile:(NSString *)fileName;
 // Removes the file saved with writeData.
@@ -67,15 +89,53 @@ extern NSString *const kiOSCdmError;
 
 // Decrypts the sepcified |encrypted| data with |keyId| and |iv|.
 - (NSData *)decrypt:(NSData *)encrypted keyId:(NSData *)keyId IV:(NSData *)iv;
+// Decrypts |length| bytes of |encrypted| directly into |clear| without the
+// intermediate copies made by decrypt:keyId:IV:. |keyId| is 16 bytes.
+// Returns NO if the CDM failed to decrypt the sample.
+- (BOOL)decrypt:(const uint8_t *)encrypted
+         length:(size_t)length
+         output:(uint8_t *)clear
+          keyId:(const uint8_t *)keyId
+             IV:(const uint8_t *)iv
+       IVLength:(size_t)ivLength;
+// Decrypts |count| |samples| that share |keyId|, 16 bytes, in place in one
+// call into the CDM host, e.g. all samples of a track fragment. Returns NO if
+// any sample failed to decrypt.
+- (BOOL)decryptSamples:(const iOSCdmSample *)samples
+                 count:(size_t)count
+                 keyId:(const uint8_t *)keyId;
 // Use |psshKey| to retrive the key status and expiration of the license.
+// |expiration| is in milliseconds since 1970, 0 if the license does not
+// expire, and NULL on error. A stored session that is not in use is loaded
+// only for the call and closed again.
 - (void)getLicenseInfo:(NSData *)psshKey
        completionBlock:
            (void (^)(int64_t *expiration, NSError *))completionBlock;
+// Fetches a new offline license for |psshKey|. The stored license stays in use
+// until the new one has been added, and is removed afterwards.
+- (void)renewOfflineLicenseForPsshKey:(NSData *)psshKey
+                      completionBlock:(void (^)(NSError *))completionBlock;
 // Given a |psshKey|, |completionBlock| will be called
 // once the license data has been added.
 - (void)processPsshKey:(NSData *)psshKey
           isOfflineVod:(BOOL)isOfflineVod
        completionBlock:(void(^)(NSError *))completionBlock;
+// Like processPsshKey:, for all |psshKeys| of a title at once. Widevine PSSHs
+// that differ only in their key IDs are merged so that a single license
+// request covers all of them; if that request fails, or the PSSHs cannot be
+// merged, each is requested on its own. |completionBlock| is called once
+// every key has been added or failed, with the first error if any.
+- (void)processPsshKeys:(NSArray<NSData *> *)psshKeys
+           isOfflineVod:(BOOL)isOfflineVod
+        completionBlock:(void(^)(NSError *))completionBlock;
+// Loads the stored offline sessions of |psshKeys| on a background queue so
+// that later processPsshKey: calls for them return without loading. Calls
+// |completionBlock| with the seconds spent loading each session, keyed by
+// PSSH. PSSHs without a stored session or that failed to load are omitted.
+- (void)loadOfflineSessionsForPsshKeys:(NSArray<NSData *> *)psshKeys
+                       completionBlock:
+                           (void (^)(NSDictionary<NSData *, NSNumber *> *))
+                               completionBlock;
 // The offline license for |psshKey| will be removed and
 // then call the |completionBlock|.
 - (void)removeOfflineLicenseForPsshKey:(NSData *)psshKey
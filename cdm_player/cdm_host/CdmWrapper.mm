@@ -1,17 +1,24 @@
 #include "CdmHost.h"
 
 #include "CdmHandler.h"
+#include "CdmPssh.h"
 #include "CdmWrapper.h"
 
 NSString *const kiOSCdmError = @"kiOSCdmError";
 
+// Marks |_stateQueue| so that state accessors can tell they are already on it.
+static char kStateQueueKey;
+
 @interface iOSCdm ()<iOSCdmHandler>
 @end
 
 @implementation iOSCdm {
+  // Session state. Only read on |_stateQueue| and only written by its
+  // barriers, which also order the CDM calls creating and removing sessions.
   NSMutableDictionary *_sessionIdsToBlocks;
   NSMutableDictionary *_psshKeysToIds;
   NSMutableDictionary *_offlineSessions;
+  dispatch_queue_t _stateQueue;
   uint32_t _currentSessionId;
   __weak id<iOSCdmDelegate> _delegate;
 }
@@ -24,6 +31,11 @@ extern const char *OEMCryptoTfit_Version();
 - (id)init {
   self = [super init];
   if (self) {
+    _stateQueue = dispatch_queue_create(
+        "com.google.widevine.cdm-player.cdm-sessions",
+        DISPATCH_QUEUE_CONCURRENT);
+    dispatch_queue_set_specific(_stateQueue, &kStateQueueKey, &kStateQueueKey,
+                                NULL);
     // TODO(justsomeguy): Add ability to change client info and cdm settings.
     widevine::Cdm::ClientInfo clientInfo;
     NSString *displayName = [[NSBundle mainBundle]
@@ -60,147 +72,316 @@ extern const char *OEMCryptoTfit_Version();
 }
 
 - (void)setupCdmWithDelegate:(id<iOSCdmDelegate>)delegate {
-  _delegate = delegate;
-  _sessionIdsToBlocks = [[NSMutableDictionary alloc] init];
-  _psshKeysToIds = [[NSMutableDictionary alloc] init];
-  _offlineSessions = [[NSMutableDictionary alloc] init];
+  [self writeState:^{
+    _delegate = delegate;
+    _sessionIdsToBlocks = [[NSMutableDictionary alloc] init];
+    _psshKeysToIds = [[NSMutableDictionary alloc] init];
+    _offlineSessions = [[NSMutableDictionary alloc] init];
+  }];
+  if ([delegate respondsToSelector:@selector(iOSCdmLicenseStorePath:)]) {
+    NSError *error = iOSCdmHost::GetHost()->OpenStore(
+        [delegate iOSCdmLicenseStorePath:self]);
+    if (error) {
+      NSLog(@"::ERROR::Opening license store: %@", error);
+    }
+  }
 }
 
 - (void)shutdownCdm {
-  NSArray *sessionIds = _psshKeysToIds.allValues;
-  _sessionIdsToBlocks = nil;
-  _psshKeysToIds = nil;
-  _offlineSessions = nil;
-
-  iOSCdmHost::GetHost()->CloseSessions(sessionIds);
+  __block NSArray *sessionIds = nil;
+  [self writeState:^{
+    sessionIds = _psshKeysToIds.allValues;
+    _sessionIdsToBlocks = nil;
+    _psshKeysToIds = nil;
+    _offlineSessions = nil;
+    iOSCdmHost::GetHost()->CloseSessions(sessionIds);
+  }];
+  iOSCdmHost::GetHost()->CloseStore();
   _delegate = nil;
 }
 
 - (void)processPsshKey:(NSData *)psshKey
           isOfflineVod:(BOOL)isOfflineVod
        completionBlock:(void(^)(NSError *))completionBlock {
-  dispatch_queue_t queue = [_delegate iOSCdmDispatchQueue:self];
-  NSString *sessionId = _psshKeysToIds[psshKey];
-  NSError *error = nil;
+  [self processPsshKey:psshKey
+               aliases:nil
+          isOfflineVod:isOfflineVod
+       completionBlock:completionBlock];
+}
 
-  if (isOfflineVod && !sessionId) {
-    // Check if license was previously stored.
-    if ([_delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
-      sessionId = [_delegate sessionIdFromPssh:psshKey];
-      _psshKeysToIds[psshKey] = sessionId;
+- (void)processPsshKeys:(NSArray<NSData *> *)psshKeys
+           isOfflineVod:(BOOL)isOfflineVod
+        completionBlock:(void(^)(NSError *))completionBlock {
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
+  NSMutableOrderedSet<NSData *> *combinable =
+      [NSMutableOrderedSet orderedSetWithArray:psshKeys];
+  // PSSHs that already have a session, live or stored, keep using it.
+  NSMutableArray<NSData *> *separate = [NSMutableArray array];
+  [self readState:^{
+    for (NSData *psshKey in combinable) {
+      if (_psshKeysToIds[psshKey]) {
+        [separate addObject:psshKey];
+      }
     }
-  }
-  // Session ID exists, attempt to Load Session.
-  if (isOfflineVod && sessionId) {
-    if (_offlineSessions[sessionId]) {
-      // NOOP. Already Loaded.
-    } else {
-      error = iOSCdmHost::GetHost()->LoadSession(sessionId);
-      if (error) {
-        // Do NOT error out if session is already loaded.
-        if (!error.code) {
-          dispatch_async(queue, ^{
-            completionBlock(error);
-          });
-          return;
-        }
+  }];
+  if (isOfflineVod &&
+      [delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
+    for (NSData *psshKey in combinable) {
+      if (![separate containsObject:psshKey] &&
+          [delegate sessionIdFromPssh:psshKey]) {
+        [separate addObject:psshKey];
       }
-      _offlineSessions[sessionId] = @YES;
     }
   }
-  if (!sessionId) {
-    // Setup new Streaming Session.
-    error = iOSCdmHost::GetHost()->CreateSession(
-        isOfflineVod ? widevine::Cdm::kPersistent : widevine::Cdm::kTemporary,
-        &sessionId);
-    if (error) {
-      dispatch_async(queue, ^{
-        completionBlock(error);
-      });
-      return;
-    }
-    // Add the completionBlock to the array to ensure the blocks are called
-    // once the GenerateRequest completes.
-    [[self blocksForSessionId:sessionId] addObject:[completionBlock copy]];
+  [combinable removeObjectsInArray:separate];
+  NSData *combined = nil;
+  if (combinable.count > 1) {
+    combined = CDMCombineWidevinePssh(combinable.array);
+  }
+  if (!combined) {
+    [separate addObjectsFromArray:combinable.array];
+  }
 
-    error = iOSCdmHost::GetHost()->GenerateRequest(sessionId, psshKey);
-    if (error) {
-      // The completionBlock is not called if GenerateRequest fails.
-      // Call it here and clean up the session.
+  dispatch_group_t group = dispatch_group_create();
+  NSMutableArray<NSError *> *errors = [NSMutableArray array];
+  void (^requestSeparately)(NSData *) = ^(NSData *psshKey) {
+    dispatch_group_enter(group);
+    [self processPsshKey:psshKey
+            isOfflineVod:isOfflineVod
+         completionBlock:^(NSError *error) {
+           if (error) {
+             @synchronized(errors) {
+               [errors addObject:error];
+             }
+           }
+           dispatch_group_leave(group);
+         }];
+  };
+  for (NSData *psshKey in separate) {
+    requestSeparately(psshKey);
+  }
+  if (combined) {
+    // The individual PSSHs are mapped to the combined session while its
+    // request is pending, so streams asking for them join it. A failed
+    // session drops the mapping, and the keys are then requested one by one
+    // in case the license server does not support multi-key requests.
+    NSArray<NSData *> *aliases = combinable.array;
+    dispatch_group_enter(group);
+    [self processPsshKey:combined
+                 aliases:aliases
+            isOfflineVod:isOfflineVod
+         completionBlock:^(NSError *error) {
+           if (error) {
+             NSLog(@"::WARNING::Multi-key license request failed, requesting "
+                   @"%tu keys separately: %@", aliases.count, error);
+             for (NSData *psshKey in aliases) {
+               requestSeparately(psshKey);
+             }
+           }
+           dispatch_group_leave(group);
+         }];
+  }
+  if (queue && completionBlock) {
+    dispatch_group_notify(group, queue, ^{
+      completionBlock(errors.firstObject);
+    });
+  }
+}
+
+// Processes |psshKey|. The PSSHs in |aliases| are pointed at the session of
+// |psshKey| if they do not have one yet.
+- (void)processPsshKey:(NSData *)psshKey
+               aliases:(NSArray<NSData *> *)aliases
+          isOfflineVod:(BOOL)isOfflineVod
+       completionBlock:(void(^)(NSError *))completionBlock {
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
+  // Every stream asks again for each init segment, so the common case of a
+  // ready session is answered from a concurrent read.
+  __block BOOL ready = NO;
+  [self readState:^{
+    NSString *sessionId = _psshKeysToIds[psshKey];
+    ready = sessionId && !_sessionIdsToBlocks[sessionId] &&
+            (!isOfflineVod || _offlineSessions[sessionId]);
+    for (NSData *alias in aliases) {
+      ready = ready && _psshKeysToIds[alias];
+    }
+  }];
+  if (ready) {
+    if (isOfflineVod &&
+        [delegate respondsToSelector:@selector(onSessionUsedWithPssh:)]) {
+      [delegate onSessionUsedWithPssh:psshKey];
+    }
+    if (queue) {
       dispatch_async(queue, ^{
-        completionBlock(error);
+        completionBlock(nil);
       });
-      iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
-      return;
     }
-    _psshKeysToIds[psshKey] = sessionId;
-    [self onSessionCreated:sessionId];
+    return;
   }
-  NSMutableArray *blocks = _sessionIdsToBlocks[sessionId];
-  if (blocks) {
-    [blocks addObject:[completionBlock copy]];
-  } else if (queue) {
-    dispatch_async(queue, ^{
-        completionBlock(nil);
-    });
+
+  // The state may have changed since it was read; decide again in a barrier.
+  __block NSString *createdSessionId = nil;
+  [self writeState:^{
+    createdSessionId = [self startSessionForPsshKey:psshKey
+                                            aliases:aliases
+                                       isOfflineVod:isOfflineVod
+                                           delegate:delegate
+                                              queue:queue
+                                    completionBlock:completionBlock];
+  }];
+  if (createdSessionId) {
+    [self onSessionCreated:createdSessionId];
   }
 }
 
 - (void)getLicenseInfo:(NSData *)psshKey
        completionBlock:
            (void (^)(int64_t *expiration, NSError *))completionBlock {
-  NSError *error = nil;
-  NSString *sessionId = _psshKeysToIds[psshKey];
-
-  dispatch_queue_t queue = [_delegate iOSCdmDispatchQueue:self];
-  auto callCompletionBlock = ^(NSError *error) {
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
+  auto callCompletionBlock = ^(int64_t expiration, NSError *error) {
     if (queue && completionBlock) {
       dispatch_async(queue, ^{
-        completionBlock(nil, error);
+        int64_t result = expiration;
+        completionBlock(error ? NULL : &result, error);
       });
     }
   };
-  // No Session has been loaded.
-  if (!sessionId) {
-    // Check if license was previously stored.
-    if ([_delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
-      sessionId = [_delegate sessionIdFromPssh:psshKey];
-    }
-    // License exists, attempt to Load Session.
-    if (sessionId) {
+  __block NSString *sessionId = nil;
+  [self readState:^{
+    sessionId = _psshKeysToIds[psshKey];
+  }];
+  __block int64_t expiration = 0;
+  __block NSError *error = nil;
+  if (sessionId) {
+    error = iOSCdmHost::GetHost()->GetLicenseInfo(sessionId, &expiration);
+  } else {
+    // A stored session is loaded only to read its license and is closed again,
+    // so that checking every stored title does not leave all of them open. It
+    // is not recorded; the barrier keeps playback from picking it up meanwhile.
+    [self writeState:^{
+      sessionId = _psshKeysToIds[psshKey];
+      if (sessionId) {
+        error = iOSCdmHost::GetHost()->GetLicenseInfo(sessionId, &expiration);
+        return;
+      }
+      if ([delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
+        sessionId = [delegate sessionIdFromPssh:psshKey];
+      }
+      if (!sessionId) {
+        return;
+      }
       error = iOSCdmHost::GetHost()->LoadSession(sessionId);
-      if (error) {
-        // Do NOT error out if session is already loaded.
-        if (!error.code) {
-          dispatch_async(queue, ^{
-            completionBlock(nil, error);
-          });
-          return;
-        }
+      // Do NOT error out if session is already loaded; it is then left open
+      // for whoever loaded it.
+      BOOL loadedHere = !error;
+      if (error && !error.code) {
+        return;
       }
-    }
-    _psshKeysToIds[psshKey] = sessionId;
+      error = iOSCdmHost::GetHost()->GetLicenseInfo(sessionId, &expiration);
+      if (loadedHere) {
+        iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
+      }
+    }];
   }
-  if (sessionId) {
-    int64_t expiration;
-    error = iOSCdmHost::GetHost()->GetLicenseInfo(sessionId, &expiration);
+  if (error) {
+    NSLog(@"::ERROR::Unable to get Expiration");
+  }
+  callCompletionBlock(error ? 0 : expiration, error);
+}
+
+- (void)renewOfflineLicenseForPsshKey:(NSData *)psshKey
+                      completionBlock:(void (^)(NSError *))completionBlock {
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
+  __block NSError *error = nil;
+  __weak iOSCdm *weakSelf = self;
+  [self writeState:^{
+    NSString *oldSessionId = _psshKeysToIds[psshKey];
+    if (!oldSessionId &&
+        [delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
+      oldSessionId = [delegate sessionIdFromPssh:psshKey];
+    }
+    NSString *sessionId = nil;
+    error = iOSCdmHost::GetHost()->CreateSession(widevine::Cdm::kPersistent,
+                                                 &sessionId);
     if (error) {
-      NSLog(@"::ERROR::Unable to get Expiration");
-      callCompletionBlock(error);
       return;
     }
-    if (expiration > 0) {
-      NSTimeInterval timeInterval = double(expiration);
-      NSDate *timeStamp = [NSDate dateWithTimeIntervalSince1970:timeInterval];
-      NSLog(@"Expiration: %@", timeStamp);
+    // The PSSH keeps pointing at the current license until the new one has
+    // been stored, so playback started meanwhile is not held up.
+    [[self blocksForSessionId:sessionId] addObject:[^(NSError *error) {
+      [weakSelf finishRenewalOfPsshKey:psshKey
+                             sessionId:sessionId
+                          oldSessionId:oldSessionId
+                                 error:error];
+      completionBlock(error);
+    } copy]];
+    error = iOSCdmHost::GetHost()->GenerateRequest(sessionId, psshKey);
+    if (error) {
+      [_sessionIdsToBlocks removeObjectForKey:sessionId];
+      iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
     }
+  }];
+  if (error) {
+    dispatch_async(queue, ^{
+      completionBlock(error);
+    });
   }
-  callCompletionBlock(error);
+}
+
+- (void)loadOfflineSessionsForPsshKeys:(NSArray<NSData *> *)psshKeys
+                       completionBlock:
+                           (void (^)(NSDictionary<NSData *, NSNumber *> *))
+                               completionBlock {
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+    NSMutableDictionary *loadTimes = [NSMutableDictionary dictionary];
+    for (NSData *psshKey in psshKeys) {
+      NSString *sessionId = nil;
+      if ([delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
+        sessionId = [delegate sessionIdFromPssh:psshKey];
+      }
+      if (!sessionId) {
+        continue;
+      }
+      __block BOOL loaded = NO;
+      [self readState:^{
+        loaded = _offlineSessions[sessionId] != nil;
+      }];
+      if (loaded) {
+        continue;
+      }
+      // Loaded outside of the barrier so that playback starting meanwhile is
+      // not held up. A stream loading the same session at the same time sees
+      // an already loaded error, which it ignores.
+      CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+      NSError *error = iOSCdmHost::GetHost()->LoadSession(sessionId);
+      if (error) {
+        NSLog(@"::WARNING::Unable to load session %@: %@", sessionId, error);
+        continue;
+      }
+      loadTimes[psshKey] = @(CFAbsoluteTimeGetCurrent() - start);
+      [self writeState:^{
+        _offlineSessions[sessionId] = @YES;
+        _psshKeysToIds[psshKey] = sessionId;
+      }];
+    }
+    if (queue && completionBlock) {
+      dispatch_async(queue, ^{
+        completionBlock(loadTimes);
+      });
+    }
+  });
 }
 
 - (void)removeOfflineLicenseForPsshKey:(NSData *)psshKey
                        completionBlock:(void(^)(NSError *))completionBlock {
-  dispatch_queue_t queue = [_delegate iOSCdmDispatchQueue:self];
+  id<iOSCdmDelegate> delegate = _delegate;
+  dispatch_queue_t queue = [delegate iOSCdmDispatchQueue:self];
   auto callCompletionBlock = ^(NSError *error) {
     if (queue && completionBlock) {
       dispatch_async(queue, ^{
@@ -208,23 +389,23 @@ extern const char *OEMCryptoTfit_Version();
       });
     }
   };
-  NSString *sessionIdForKey = [_delegate sessionIdFromPssh:psshKey];
+  NSString *sessionIdForKey = [delegate sessionIdFromPssh:psshKey];
   if (sessionIdForKey) {
-    NSError *error = nil;
-    error = iOSCdmHost::GetHost()->RemoveSession(sessionIdForKey);
-    if (error) {
-      NSLog(@"::ERROR::Removing Session");
-      callCompletionBlock(error);
-      return;
-    }
-    if (![_delegate removePssh:psshKey]) {
-      error = [NSError errorWithDomain:@"RemovePssh" code:errno userInfo:nil];
-      NSLog(@"::ERROR::Removing PSSH: %@", error);
-      callCompletionBlock(error);
-      return;
-    }
-    [_offlineSessions removeObjectForKey:sessionIdForKey];
-    [_psshKeysToIds removeObjectForKey:psshKey];
+    __block NSError *error = nil;
+    [self writeState:^{
+      error = iOSCdmHost::GetHost()->RemoveSession(sessionIdForKey);
+      if (error) {
+        NSLog(@"::ERROR::Removing Session");
+        return;
+      }
+      if (![delegate removePssh:psshKey]) {
+        error = [NSError errorWithDomain:@"RemovePssh" code:errno userInfo:nil];
+        NSLog(@"::ERROR::Removing PSSH: %@", error);
+        return;
+      }
+      [_offlineSessions removeObjectForKey:sessionIdForKey];
+      [_psshKeysToIds removeObjectForKey:psshKey];
+    }];
     callCompletionBlock(error);
   }
 }
@@ -233,6 +414,51 @@ extern const char *OEMCryptoTfit_Version();
   return iOSCdmHost::GetHost()->Decrypt(encrypted, keyId, iv);
 }
 
+- (BOOL)decrypt:(const uint8_t *)encrypted
+         length:(size_t)length
+         output:(uint8_t *)clear
+          keyId:(const uint8_t *)keyId
+             IV:(const uint8_t *)iv
+       IVLength:(size_t)ivLength {
+  iOSCdmHost::Sample sample = {};
+  sample.input = encrypted;
+  sample.output = clear;
+  sample.length = (uint32_t)length;
+  sample.iv = iv;
+  sample.iv_length = (uint32_t)ivLength;
+  return !iOSCdmHost::GetHost()->DecryptBatch(keyId, 16, &sample, 1);
+}
+
+- (BOOL)decryptSamples:(const iOSCdmSample *)samples
+                 count:(size_t)count
+                 keyId:(const uint8_t *)keyId {
+  size_t subsampleCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    subsampleCount += samples[i].subsampleCount;
+  }
+  // Reserved up front so the samples can point into it while it is filled.
+  std::vector<iOSCdmHost::Subsample> subsamples;
+  subsamples.reserve(subsampleCount);
+  std::vector<iOSCdmHost::Sample> hostSamples(count);
+  for (size_t i = 0; i < count; ++i) {
+    const iOSCdmSample &sample = samples[i];
+    iOSCdmHost::Sample &hostSample = hostSamples[i];
+    hostSample.input = sample.data;
+    hostSample.output = sample.data;
+    hostSample.length = sample.length;
+    hostSample.iv = sample.iv;
+    hostSample.iv_length = sample.ivLength;
+    hostSample.subsamples = subsamples.data() + subsamples.size();
+    hostSample.subsample_count = sample.subsampleCount;
+    for (size_t j = 0; j < sample.subsampleCount; ++j) {
+      iOSCdmHost::Subsample subsample = {sample.subsamples[j].clearBytes,
+                                         sample.subsamples[j].cipherBytes};
+      subsamples.push_back(subsample);
+    }
+  }
+  return !iOSCdmHost::GetHost()->DecryptBatch(keyId, 16, hostSamples);
+}
+
 #pragma mark -
 #pragma mark iOSCdmHandler methods
 
@@ -245,39 +471,174 @@ extern const char *OEMCryptoTfit_Version();
 }
 
 - (void)onSessionCreated:(NSString *)sessionId {
-  NSArray *keys = [_psshKeysToIds allKeysForObject:sessionId];
+  id<iOSCdmDelegate> delegate = _delegate;
+  __block NSArray *keys = nil;
+  __block NSArray *blocks = nil;
+  [self writeState:^{
+    keys = [_psshKeysToIds allKeysForObject:sessionId];
+    if ([_offlineSessions[sessionId] isEqual:@YES]) {
+      blocks = [self takeBlocksForSessionId:sessionId];
+      [_offlineSessions removeObjectForKey:sessionId];
+    }
+  }];
   for (NSData *key in keys) {
-    if ([_delegate respondsToSelector:@selector(onSessionCreatedWithPssh:sessionId:)]) {
-      [_delegate onSessionCreatedWithPssh:key sessionId:sessionId];
+    if ([delegate respondsToSelector:@selector(onSessionCreatedWithPssh:sessionId:)]) {
+      [delegate onSessionCreatedWithPssh:key sessionId:sessionId];
     }
   }
-  if ([_offlineSessions[sessionId] isEqual:@YES]) {
-    [self callBlockWithError:nil forSessionId:sessionId];
-    [_sessionIdsToBlocks removeObjectForKey:sessionId];
-    [_offlineSessions removeObjectForKey:sessionId];
-  }
+  [self callBlocks:blocks withError:nil];
 }
 
 - (void)onSessionUpdated:(NSString *)sessionId {
-  [self callBlockWithError:nil forSessionId:sessionId];
-  [_sessionIdsToBlocks removeObjectForKey:sessionId];
+  __block NSArray *blocks = nil;
+  [self writeState:^{
+    blocks = [self takeBlocksForSessionId:sessionId];
+  }];
+  [self callBlocks:blocks withError:nil];
 }
 
 - (void)onSessionFailed:(NSString *)sessionId error:(NSError *)error {
-  if (_sessionIdsToBlocks[sessionId]) {
-    [self callBlockWithError:error forSessionId:sessionId];
-    [_sessionIdsToBlocks removeObjectForKey:sessionId];
-  }
-  if (_psshKeysToIds[sessionId]) {
+  __block NSArray *blocks = nil;
+  [self writeState:^{
+    blocks = [self takeBlocksForSessionId:sessionId];
+    // Forget the PSSH mapping so the next request for it creates a new
+    // session.
     NSArray *keys = [_psshKeysToIds allKeysForObject:sessionId];
-    [_psshKeysToIds removeObjectsForKeys:keys];
-    iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
-  }
+    if (keys.count) {
+      [_psshKeysToIds removeObjectsForKeys:keys];
+      iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
+    }
+  }];
+  [self callBlocks:blocks withError:error];
 }
 
 #pragma mark -
 #pragma mark private methods
 
+// Runs |block| with shared access to the session state. Blocks may run
+// concurrently with each other, so they must neither change the state nor
+// call into the CDM or the delegate.
+- (void)readState:(dispatch_block_t)block {
+  if (dispatch_get_specific(&kStateQueueKey)) {
+    block();
+  } else {
+    dispatch_sync(_stateQueue, block);
+  }
+}
+
+// Runs |block| with exclusive access to the session state. CDM calls made
+// from |block| may call back into the handler methods on the same thread,
+// which then run inline.
+- (void)writeState:(dispatch_block_t)block {
+  if (dispatch_get_specific(&kStateQueueKey)) {
+    block();
+  } else {
+    dispatch_barrier_sync(_stateQueue, block);
+  }
+}
+
+// The slow path of processPsshKey:, run in a barrier. Returns the ID of the
+// session it created, if any, for the caller to announce once outside of the
+// barrier.
+- (NSString *)startSessionForPsshKey:(NSData *)psshKey
+                             aliases:(NSArray<NSData *> *)aliases
+                        isOfflineVod:(BOOL)isOfflineVod
+                            delegate:(id<iOSCdmDelegate>)delegate
+                               queue:(dispatch_queue_t)queue
+                     completionBlock:(void(^)(NSError *))completionBlock {
+  NSString *sessionId = _psshKeysToIds[psshKey];
+  NSError *error = nil;
+
+  if (isOfflineVod && !sessionId) {
+    // Check if license was previously stored.
+    if ([delegate respondsToSelector:@selector(sessionIdFromPssh:)]) {
+      sessionId = [delegate sessionIdFromPssh:psshKey];
+      _psshKeysToIds[psshKey] = sessionId;
+    }
+  }
+  // Session ID exists, attempt to Load Session.
+  if (isOfflineVod && sessionId) {
+    if ([delegate respondsToSelector:@selector(onSessionUsedWithPssh:)]) {
+      [delegate onSessionUsedWithPssh:psshKey];
+    }
+    if (_offlineSessions[sessionId]) {
+      // NOOP. Already Loaded.
+    } else {
+      error = iOSCdmHost::GetHost()->LoadSession(sessionId);
+      if (error) {
+        // Do NOT error out if session is already loaded.
+        if (!error.code) {
+          dispatch_async(queue, ^{
+            completionBlock(error);
+          });
+          return nil;
+        }
+      }
+      _offlineSessions[sessionId] = @YES;
+    }
+  }
+  if (!sessionId) {
+    // Setup new Streaming Session.
+    error = iOSCdmHost::GetHost()->CreateSession(
+        isOfflineVod ? widevine::Cdm::kPersistent : widevine::Cdm::kTemporary,
+        &sessionId);
+    if (error) {
+      dispatch_async(queue, ^{
+        completionBlock(error);
+      });
+      return nil;
+    }
+    // Add the completionBlock to the array to ensure the blocks are called
+    // once the GenerateRequest completes. The PSSH is mapped to the session
+    // before the request is sent so that the same PSSH arriving from another
+    // source (manifest or init segment) joins the pending request.
+    [[self blocksForSessionId:sessionId] addObject:[completionBlock copy]];
+    _psshKeysToIds[psshKey] = sessionId;
+    NSArray *mappedAliases = [self mapAliases:aliases toSessionId:sessionId];
+
+    error = iOSCdmHost::GetHost()->GenerateRequest(sessionId, psshKey);
+    if (error) {
+      // The completionBlock is not called if GenerateRequest fails.
+      // Call it here and clean up the session.
+      dispatch_async(queue, ^{
+        completionBlock(error);
+      });
+      [_psshKeysToIds removeObjectForKey:psshKey];
+      [_psshKeysToIds removeObjectsForKeys:mappedAliases];
+      [_sessionIdsToBlocks removeObjectForKey:sessionId];
+      iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
+      return nil;
+    }
+    // completionBlock is already queued on the session.
+    return sessionId;
+  }
+  [self mapAliases:aliases toSessionId:sessionId];
+  NSMutableArray *blocks = _sessionIdsToBlocks[sessionId];
+  if (blocks) {
+    [blocks addObject:[completionBlock copy]];
+  } else if (queue) {
+    dispatch_async(queue, ^{
+        completionBlock(nil);
+    });
+  }
+  return nil;
+}
+
+// Points the PSSHs of |aliases| without a session at |sessionId| and returns
+// them. Must be called in a barrier.
+- (NSArray *)mapAliases:(NSArray<NSData *> *)aliases
+            toSessionId:(NSString *)sessionId {
+  NSMutableArray *mapped = [NSMutableArray array];
+  for (NSData *alias in aliases) {
+    if (!_psshKeysToIds[alias]) {
+      _psshKeysToIds[alias] = sessionId;
+      [mapped addObject:alias];
+    }
+  }
+  return mapped;
+}
+
+// Must be called in a barrier.
 - (NSMutableArray *)blocksForSessionId:(NSString *)sessionId {
   NSMutableArray *blocks = _sessionIdsToBlocks[sessionId];
   if (!blocks) {
@@ -287,8 +648,50 @@ extern const char *OEMCryptoTfit_Version();
   return blocks;
 }
 
-- (void)callBlockWithError:(NSError *)error forSessionId:(NSString *)sessionId {
+// Removes and returns the blocks waiting on |sessionId|. Must be called in a
+// barrier; the blocks are called after it so that they can use the CDM.
+- (NSArray *)takeBlocksForSessionId:(NSString *)sessionId {
   NSArray *blocks = _sessionIdsToBlocks[sessionId];
+  [_sessionIdsToBlocks removeObjectForKey:sessionId];
+  return blocks;
+}
+
+// Points |psshKey| at the renewed |sessionId| and removes the license it
+// replaces. Removing the old license is best effort; on failure it is only
+// left unreferenced.
+- (void)finishRenewalOfPsshKey:(NSData *)psshKey
+                     sessionId:(NSString *)sessionId
+                  oldSessionId:(NSString *)oldSessionId
+                         error:(NSError *)error {
+  if (error) {
+    iOSCdmHost::GetHost()->CloseSessions(@[ sessionId ]);
+    return;
+  }
+  id<iOSCdmDelegate> delegate = _delegate;
+  [self writeState:^{
+    _psshKeysToIds[psshKey] = sessionId;
+    _offlineSessions[sessionId] = @YES;
+  }];
+  if ([delegate respondsToSelector:@selector(onSessionCreatedWithPssh:sessionId:)]) {
+    [delegate onSessionCreatedWithPssh:psshKey sessionId:sessionId];
+  }
+  if (!oldSessionId || [oldSessionId isEqualToString:sessionId]) {
+    return;
+  }
+  [self writeState:^{
+    if (!_offlineSessions[oldSessionId] &&
+        iOSCdmHost::GetHost()->LoadSession(oldSessionId)) {
+      NSLog(@"::WARNING::Unable to load replaced session %@", oldSessionId);
+      return;
+    }
+    [_offlineSessions removeObjectForKey:oldSessionId];
+    if (iOSCdmHost::GetHost()->RemoveSession(oldSessionId)) {
+      NSLog(@"::WARNING::Unable to remove replaced session %@", oldSessionId);
+    }
+  }];
+}
+
+- (void)callBlocks:(NSArray *)blocks withError:(NSError *)error {
   for (void (^block)(NSError *error) in blocks) {
     block(error);
   }
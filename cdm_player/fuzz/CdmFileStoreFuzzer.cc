@@ -0,0 +1,85 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Fuzzer for CdmFileStore opening a damaged file.
+//
+// The input is written out as the store file. Whatever it holds, opening it
+// must either fail or leave a store that answers consistently and keeps new
+// writes through a compaction and a reopen.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "CdmFileStore.h"
+
+// Names stored by the seed corpus.
+static const char *const kNames[] = {"cert.bin", "ksid0001", "ksid0002"};
+
+static std::string TemporaryPath() {
+  const char *dir = getenv("TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/CdmFileStoreXXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    abort();
+  }
+  close(fd);
+  return path;
+}
+
+static bool WriteFile(const std::string &path, const uint8_t *data,
+                      size_t size) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, size, file) == size;
+  return fclose(file) == 0 && ok;
+}
+
+// Every stored name reads back as many bytes as its size says.
+static void CheckConsistent(CdmFileStore *store) {
+  for (const char *name : kNames) {
+    std::string data;
+    bool exists = store->exists(name);
+    if (store->read(name, &data) != exists) {
+      abort();
+    }
+    int32_t size = store->size(name);
+    if (exists ? size != static_cast<int32_t>(data.size()) : size != -1) {
+      abort();
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  std::string path = TemporaryPath();
+  if (!WriteFile(path, data, size)) {
+    abort();
+  }
+  CdmFileStore store;
+  if (store.Open(path)) {
+    CheckConsistent(&store);
+    if (!store.write("ksid0002", "license")) {
+      abort();
+    }
+    // False when the damaged file did not hold the name.
+    store.remove("ksid0001");
+    store.Compact();
+    CheckConsistent(&store);
+    store.Close();
+    if (!store.Open(path)) {
+      abort();
+    }
+    CheckConsistent(&store);
+    std::string license;
+    if (!store.read("ksid0002", &license) || license != "license" ||
+        store.exists("ksid0001")) {
+      abort();
+    }
+  }
+  store.Close();
+  unlink(path.c_str());
+  return 0;
+}
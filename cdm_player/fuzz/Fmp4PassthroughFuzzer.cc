@@ -0,0 +1,86 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Fuzzer for the fragmented MP4 helpers, which parse and rewrite segments
+// fetched from the network.
+//
+// The input is used both as an initialization segment and as a media segment,
+// so a file holding a moov followed by fragments reaches every helper. The
+// media segment is decrypted as 'cenc' even when the moov does not describe an
+// encrypted track, so that sample encryption is parsed for every input.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "Fmp4Passthrough.h"
+
+struct Segment {
+  const uint8_t *data;
+  size_t size;
+};
+
+// Checks that every sample handed over for decryption lies in the segment, and
+// that its subsamples fit in it.
+static bool CheckDecrypt(void *context, const uint8_t *key_id,
+                         const Fmp4EncryptedSample *samples,
+                         size_t sample_count) {
+  const Segment *segment = static_cast<const Segment *>(context);
+  for (size_t i = 0; i < sample_count; ++i) {
+    const Fmp4EncryptedSample &sample = samples[i];
+    if (sample.data < segment->data ||
+        sample.size > segment->size ||
+        sample.data + sample.size > segment->data + segment->size ||
+        sample.iv_size > kFmp4MaxIvSize) {
+      abort();
+    }
+    uint64_t subsamples_size = 0;
+    for (size_t j = 0; j < sample.subsample_count; ++j) {
+      subsamples_size += sample.subsamples[j].clear_size;
+      subsamples_size += sample.subsamples[j].protected_size;
+    }
+    if (subsamples_size > sample.size) {
+      abort();
+    }
+  }
+  return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  Fmp4Track track;
+  ParseFmp4Track(data, size, &track);
+  std::vector<uint8_t> clear;
+  if (ClearFmp4Initialization(data, size, &clear) && clear.size() > size) {
+    abort();
+  }
+  Fmp4SegmentIndex index;
+  ParseFmp4SegmentIndex(data, size, 0, &index);
+
+  std::vector<uint8_t> segment(data, data + size);
+  track.encrypted = true;
+  track.scheme = Fmp4FourCC('c', 'e', 'n', 'c');
+  if (!track.default_iv_size) {
+    track.default_iv_size = 8;
+  }
+  Segment context = {segment.data(), segment.size()};
+  DecryptFmp4Segment(track, segment.data(), segment.size(), CheckDecrypt,
+                     &context);
+
+  size_t extent = 0;
+  std::vector<uint8_t> key_frame;
+  if (Fmp4KeyFrameExtent(data, size, &extent) && extent <= size) {
+    CutFmp4KeyFrame(data, extent, &key_frame);
+  }
+  std::vector<Fmp4Chunk> chunks;
+  if (ParseFmp4Chunks(data, size, &chunks)) {
+    for (const Fmp4Chunk &chunk : chunks) {
+      if (chunk.offset > size || chunk.size > size - chunk.offset) {
+        abort();
+      }
+    }
+  }
+  uint64_t start = 0;
+  uint64_t duration = 0;
+  ParseFmp4SegmentTiming(data, size, &start, &duration);
+  ParseFmp4SegmentStart(data, size, &start);
+  return 0;
+}
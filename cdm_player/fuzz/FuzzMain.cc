@@ -0,0 +1,152 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Stand-in for the libFuzzer driver when the fuzzers are not built with Clang.
+//
+// Runs LLVMFuzzerTestOneInput on every file named on the command line, or
+// found in a directory named there, followed by random mutations of it. The
+// mutations use a fixed seed so that a failure reproduces on every run. Each
+// input is copied to a buffer of exactly its size so that the sanitizers catch
+// reads past its end. As with libFuzzer, -runs=N sets the number of mutations
+// of each input.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static const int kDefaultRuns = 1000;
+static const char kRunsFlag[] = "-runs=";
+
+// Values that tend to land on the edge cases of sizes and counts.
+static const uint32_t kInterestingValues[] = {
+    0, 1, 7, 8, 16, 0x7f, 0xff, 0xffff, 0x7fffffff, 0xfffffff8, 0xffffffff};
+
+static bool ReadFile(const std::string &path, std::string *data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  char buffer[4096];
+  size_t read = 0;
+  data->clear();
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data->append(buffer, read);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// Adds |path| to |inputs|, or the regular files in it if it is a directory.
+static bool ListInputs(const std::string &path,
+                       std::vector<std::string> *inputs) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  if (!S_ISDIR(info.st_mode)) {
+    inputs->push_back(path);
+    return true;
+  }
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    return false;
+  }
+  std::vector<std::string> files;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string file = path + "/" + entry->d_name;
+    if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+      files.push_back(file);
+    }
+  }
+  closedir(dir);
+  // readdir order depends on the file system.
+  std::sort(files.begin(), files.end());
+  inputs->insert(inputs->end(), files.begin(), files.end());
+  return true;
+}
+
+static void Mutate(std::mt19937 *random, std::string *data) {
+  for (int mutations = 1 + (*random)() % 8; mutations > 0; --mutations) {
+    if (data->empty()) {
+      data->push_back(static_cast<char>((*random)()));
+      continue;
+    }
+    size_t position = (*random)() % data->size();
+    switch ((*random)() % 5) {
+      case 0:
+        (*data)[position] = static_cast<char>((*random)());
+        break;
+      case 1: {
+        uint32_t value = kInterestingValues[(*random)() %
+                                            (sizeof(kInterestingValues) /
+                                             sizeof(kInterestingValues[0]))];
+        // Big endian, as in MP4 boxes.
+        for (size_t i = 0; i < 4 && position + i < data->size(); ++i) {
+          (*data)[position + i] = static_cast<char>(value >> (24 - 8 * i));
+        }
+        break;
+      }
+      case 2:
+        data->erase(position, 1 + (*random)() % 16);
+        break;
+      case 3:
+        data->insert(position,
+                     data->substr((*random)() % data->size(),
+                                  (*random)() % 32));
+        break;
+      default:
+        data->resize(position);
+        break;
+    }
+  }
+}
+
+static void Run(const std::string &data) {
+  // libFuzzer never passes a null pointer, even for an empty input.
+  static const uint8_t kEmpty = 0;
+  std::vector<uint8_t> buffer(data.begin(), data.end());
+  LLVMFuzzerTestOneInput(buffer.empty() ? &kEmpty : buffer.data(),
+                         buffer.size());
+}
+
+int main(int argc, char **argv) {
+  int runs = kDefaultRuns;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], kRunsFlag, strlen(kRunsFlag)) == 0) {
+      runs = atoi(argv[i] + strlen(kRunsFlag));
+    } else if (!ListInputs(argv[i], &inputs)) {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (inputs.empty()) {
+    fprintf(stderr, "Usage: %s [-runs=N] FILE_OR_DIR...\n", argv[0]);
+    return 1;
+  }
+  std::mt19937 random(1);
+  for (const std::string &input : inputs) {
+    std::string data;
+    if (!ReadFile(input, &data)) {
+      fprintf(stderr, "Cannot read %s\n", input.c_str());
+      return 1;
+    }
+    Run(data);
+    for (int i = 0; i < runs; ++i) {
+      std::string mutated = data;
+      Mutate(&random, &mutated);
+      Run(mutated);
+    }
+  }
+  printf("Ran %zu inputs with %d mutations each\n", inputs.size(), runs);
+  return 0;
+}
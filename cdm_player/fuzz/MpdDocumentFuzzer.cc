@@ -0,0 +1,97 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Fuzzer for MpdDocument, which parses manifests fetched from the network.
+//
+// Every value of the parsed model is read back, so that a view past the end of
+// the buffer or into a released string is caught by the sanitizers, and the
+// timing values are parsed as MpdParser does.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "MpdDocument.h"
+#include "MpdTime.h"
+
+// Every value is either a view into the buffer or decoded from one, so none
+// can be longer.
+static void CheckValue(MpdStringPiece value, size_t size) {
+  if (value.ToString().size() > size) {
+    abort();
+  }
+}
+
+static void CheckDuration(MpdStringPiece value, size_t size) {
+  CheckValue(value, size);
+  double seconds = 0;
+  ParseMpdDuration(value, &seconds);
+}
+
+static void CheckProtection(const std::vector<MpdContentProtection> &list,
+                            size_t size) {
+  for (const MpdContentProtection &protection : list) {
+    CheckValue(protection.scheme_id_uri, size);
+    CheckValue(protection.value, size);
+    CheckValue(protection.default_kid, size);
+    CheckValue(protection.pssh, size);
+  }
+}
+
+static void CheckSegment(const MpdSegmentInfo &segment, size_t size) {
+  CheckValue(segment.initialization_url, size);
+  CheckValue(segment.media, size);
+  CheckValue(segment.availability_time_offset, size);
+  for (const MpdSegmentUrl &url : segment.segment_urls) {
+    CheckValue(url.media, size);
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  MpdDocument document;
+  if (!document.Parse(reinterpret_cast<const char *>(data), size)) {
+    if (!document.error() || document.error_offset() > size) {
+      abort();
+    }
+    return 0;
+  }
+  const Mpd &mpd = document.mpd();
+  CheckValue(mpd.type, size);
+  CheckValue(mpd.profiles, size);
+  CheckValue(mpd.base_url, size);
+  double seconds = 0;
+  CheckValue(mpd.availability_start_time, size);
+  ParseMpdDateTime(mpd.availability_start_time, &seconds);
+  CheckDuration(mpd.media_presentation_duration, size);
+  CheckDuration(mpd.min_buffer_time, size);
+  CheckDuration(mpd.minimum_update_period, size);
+  CheckDuration(mpd.time_shift_buffer_depth, size);
+  for (const MpdPeriod &period : mpd.periods) {
+    CheckValue(period.id, size);
+    CheckDuration(period.start, size);
+    CheckDuration(period.duration, size);
+    CheckValue(period.base_url, size);
+    CheckSegment(period.segment, size);
+    for (const MpdAdaptationSet &adaptation_set : period.adaptation_sets) {
+      CheckValue(adaptation_set.id, size);
+      CheckValue(adaptation_set.content_type, size);
+      CheckValue(adaptation_set.lang, size);
+      CheckValue(adaptation_set.mime_type, size);
+      CheckValue(adaptation_set.codecs, size);
+      CheckValue(adaptation_set.frame_rate, size);
+      CheckValue(adaptation_set.base_url, size);
+      CheckProtection(adaptation_set.content_protection, size);
+      CheckSegment(adaptation_set.segment, size);
+      for (const MpdRepresentation &representation :
+           adaptation_set.representations) {
+        CheckValue(representation.id, size);
+        CheckValue(representation.mime_type, size);
+        CheckValue(representation.codecs, size);
+        CheckValue(representation.frame_rate, size);
+        CheckValue(representation.base_url, size);
+        CheckProtection(representation.content_protection, size);
+        CheckSegment(representation.segment, size);
+      }
+    }
+  }
+  return 0;
+}
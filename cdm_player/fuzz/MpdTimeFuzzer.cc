@@ -0,0 +1,32 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Fuzzer for the xs:duration and xs:dateTime parsers of MPD timing attributes,
+// and for the character reference decoding of MpdXmlReader.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "MpdTime.h"
+#include "MpdXmlReader.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  MpdStringPiece value(reinterpret_cast<const char *>(data), size);
+  // Both parsers leave |seconds| alone on failure.
+  const double kUnset = -12345.0;
+  double seconds = kUnset;
+  if (!ParseMpdDuration(value, &seconds) && seconds != kUnset) {
+    abort();
+  }
+  seconds = kUnset;
+  if (!ParseMpdDateTime(value, &seconds) && seconds != kUnset) {
+    abort();
+  }
+  // A character reference is never shorter than what it decodes to.
+  std::string unescaped;
+  MpdXmlReader::Unescape(value, &unescaped);
+  if (unescaped.size() > size) {
+    abort();
+  }
+  return 0;
+}
@@ -3,9 +3,13 @@
 #import "AppDelegate.h"
 
 #import "LicenseManager.h"
+#import "LocalWebServer.h"
 #import "MasterViewController.h"
 #import "Logging.h"
 
+// Offline titles whose licenses are loaded at launch, most recently played first.
+static const NSUInteger kWarmOfflineSessionCount = 3;
+
 @implementation AppDelegate {
   UIWindow *_window;
 }
@@ -33,7 +37,12 @@
   [self.window setRootViewController:navController];
   [[UIApplication sharedApplication] setStatusBarStyle:UIStatusBarStyleDefault animated:YES];
   [[UIApplication sharedApplication] setStatusBarHidden:NO withAnimation:NO];
-  [LicenseManager startup];
+  [LicenseManager startupWithWarmSessionCount:kWarmOfflineSessionCount];
+  // Every title is served by the same local web server, so it is only started once.
+  NSError *error = nil;
+  if (![[LocalWebServer sharedInstance] start:&error]) {
+    CDMLogNSError(error, @"starting the local web server");
+  }
   return YES;
 }
 
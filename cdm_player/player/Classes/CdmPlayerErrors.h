@@ -9,6 +9,8 @@ typedef NS_ENUM(NSInteger, CDMPlayerErrorCode) {
   CdmPlayeriOSErrorCode_NoConnection = 2,
   CdmPlayeriOSErrorCode_EmptyMPD = 3,
   CdmPlayeriOSErrorCode_AlreadyDownloading = 4,
+  CdmPlayeriOSErrorCode_LicenseRequestFailed = 5,
+  CdmPlayeriOSErrorCode_HTTPError = 6,
 };
 
 @interface NSError (CDMPlayerErrors)
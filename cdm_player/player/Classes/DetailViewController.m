@@ -53,8 +53,6 @@ static void *PlaybackViewControllerStatusObservationContext =
 static void *PlaybackViewControllerCurrentItemObservationContext =
     &PlaybackViewControllerCurrentItemObservationContext;
 
-NSString *kDash2HlsURL = @"http://%@:%d/dash2hls.m3u8";
-
 @implementation DetailViewController
 
 - (instancetype)initWithMediaResource:(MediaResource *)mediaResource {
@@ -213,11 +211,9 @@ NSString *kDash2HlsURL = @"http://%@:%d/dash2hls.m3u8";
 }
 
 - (void)streamingReady:(NSNotification *)notification {
-  NSString *address =
-      [[NSString alloc] initWithFormat:kDash2HlsURL, _streaming.address, _streaming.httpPort];
-  _mediaURL = [[NSURL alloc] initWithString:address];
+  _mediaURL = _streaming.playlistURL;
   AVURLAsset *asset = [AVURLAsset URLAssetWithURL:_mediaURL options:nil];
-  if (Udt_SetAVURLAsset(asset, NULL, dispatch_get_main_queue()) != kDashToHlsStatus_OK) {
+  if (Udt_SetAVURLAsset(asset, _streaming, dispatch_get_main_queue()) != kDashToHlsStatus_OK) {
     CDMLogWarn(@"Cannot set the loopback encryption");
   }
 
@@ -2,6 +2,10 @@
 
 @class Downloader;
 
+// Keys of the validators dictionary of downloadData:validators:completion:.
+extern NSString *const kDownloaderETagKey;
+extern NSString *const kDownloaderLastModifiedKey;
+
 // Delegate to communicate the status of a download.
 @protocol DownloadDelegate <NSObject>
 // Checks the status of the existing download and reports back a percentage.
@@ -35,6 +39,7 @@
            delegate:(id<DownloadDelegate>)delegate;
 
 // Used to pull only the range of the requested file and does NOT save the data to disk.
+// An empty |range| pulls the whole file.
 - (void)downloadPartialData:(NSURL *)URL
                       range:(NSRange)range
                  completion:(void (^)(NSData *data, NSError *error)) completion;
@@ -42,6 +47,25 @@
 // Synchronous version of downloadPartialData:range:completion
 - (NSData *)downloadPartialDataSync:(NSURL *)URL range:(NSRange)range;
 
+// Pulls the whole file as it arrives, for files that are still being written such as the segments
+// of a chunked CMAF stream. |received| is called with each piece of the file in order, then
+// |completion| once, with an error if the download failed. Both are called on a background queue.
+- (void)downloadStreamingData:(NSURL *)URL
+                     received:(void (^)(NSData *data))received
+                   completion:(void (^)(NSError *error))completion;
+
+// Pulls the whole file unless it still matches |validators|, the validators returned by an earlier
+// call for the same URL (kDownloaderETagKey and kDownloaderLastModifiedKey). Remote files are
+// requested with If-None-Match and If-Modified-Since; local files are compared by size and
+// modification date. When the file is unchanged |data| is nil and |notModified| is YES.
+// |validators| in the completion are the ones to pass on the next call.
+- (void)downloadData:(NSURL *)URL
+          validators:(NSDictionary<NSString *, NSString *> *)validators
+          completion:(void (^)(NSData *data,
+                               NSDictionary<NSString *, NSString *> *validators,
+                               BOOL notModified,
+                               NSError *error))completion;
+
 // Downloader singleton and url sessions. Exposed to allow mocking in unit tests.
 @property(strong, nonatomic) NSURLSession *downloadSession;
 
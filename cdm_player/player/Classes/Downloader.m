@@ -16,16 +16,49 @@
 @implementation DownloadInfo
 @end
 
+// Handlers of a download started by downloadStreamingData:received:completion:.
+@interface StreamingDownloadInfo : NSObject
+@property(nonatomic, copy) void (^received)(NSData *data);
+@property(nonatomic, copy) void (^completion)(NSError *error);
+@end
+
+@implementation StreamingDownloadInfo
+@end
+
 static NSString *const kMpdString = @"mpd";
 NSString *const kRangeHeaderString = @"Range";
+NSString *const kDownloaderETagKey = @"ETag";
+NSString *const kDownloaderLastModifiedKey = @"Last-Modified";
+static NSString *const kIfNoneMatchHeaderString = @"If-None-Match";
+static NSString *const kIfModifiedSinceHeaderString = @"If-Modified-Since";
+static const NSInteger kHTTPStatusNotModified = 304;
+static const NSInteger kHTTPStatusBadRequest = 400;
 NSTimeInterval const kDownloadTimeout = 10.0;
+// Stream initialization fetches every representation of an MPD at once.
+NSInteger const kMaxConnectionsPerHost = 8;
 
-@interface Downloader () <NSURLSessionDownloadDelegate>
+@interface Downloader () <NSURLSessionDataDelegate, NSURLSessionDownloadDelegate>
 @property(nonatomic) NSMutableDictionary<NSURL *, DownloadInfo *> *downloadInfoForRequest;
+// Streaming downloads by task identifier. Only accessed while synchronized on self.
+@property(nonatomic)
+    NSMutableDictionary<NSNumber *, StreamingDownloadInfo *> *streamingInfoForTask;
 @property dispatch_queue_t delegateQueue;
 -(instancetype)initInternal;
 @end
 
+// Returns the value of the header |name| of |response|. Header names are case insensitive.
+static NSString *HeaderValue(NSHTTPURLResponse *response, NSString *name) {
+  __block NSString *value = nil;
+  [response.allHeaderFields enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+    if ([key isKindOfClass:[NSString class]] &&
+        [(NSString *)key caseInsensitiveCompare:name] == NSOrderedSame) {
+      value = obj;
+      *stop = YES;
+    }
+  }];
+  return value;
+}
+
 @implementation Downloader
 
 - (instancetype)initInternal {
@@ -33,10 +66,12 @@ NSTimeInterval const kDownloadTimeout = 10.0;
     NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
     config.timeoutIntervalForRequest = kDownloadTimeout;
     config.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    config.HTTPMaximumConnectionsPerHost = kMaxConnectionsPerHost;
     self.downloadSession = [NSURLSession sessionWithConfiguration:config
                                                          delegate:self
                                                     delegateQueue:nil];
     self.downloadInfoForRequest = [[NSMutableDictionary<NSURL *, DownloadInfo *> alloc] init];
+    self.streamingInfoForTask = [NSMutableDictionary dictionary];
     self.delegateQueue = dispatch_get_main_queue();
   }
   return self;
@@ -97,7 +132,9 @@ NSTimeInterval const kDownloadTimeout = 10.0;
       return;
     }
     [fileHandle seekToFileOffset:range.location];
-    NSData *data = [fileHandle readDataOfLength:range.length];
+    // As with remote URLs, an empty range reads the whole file.
+    NSData *data = range.length ? [fileHandle readDataOfLength:range.length]
+                                : [fileHandle readDataToEndOfFile];
     completion(data, nil);
     return;
   }
@@ -142,8 +179,134 @@ NSTimeInterval const kDownloadTimeout = 10.0;
   return downloaded;
 }
 
+- (void)downloadStreamingData:(NSURL *)URL
+                     received:(void (^)(NSData *data))received
+                   completion:(void (^)(NSError *error))completion {
+  CDMLogInfo(@"Downloading data at %@.", URL);
+  if ([URL isFileURL]) {
+    // Local files are already complete.
+    NSError *error = nil;
+    NSData *data = [NSData dataWithContentsOfURL:URL options:NSDataReadingUncached error:&error];
+    if (data.length) {
+      received(data);
+    }
+    completion(error);
+    return;
+  }
+  NSURLRequest *request =
+      [NSURLRequest requestWithURL:URL
+                       cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                   timeoutInterval:kDownloadTimeout];
+  // Without a completion handler the data is delivered to the delegate as it arrives.
+  NSURLSessionDataTask *task = [self.downloadSession dataTaskWithRequest:request];
+  StreamingDownloadInfo *info = [[StreamingDownloadInfo alloc] init];
+  info.received = received;
+  info.completion = completion;
+  @synchronized(self) {
+    self.streamingInfoForTask[@(task.taskIdentifier)] = info;
+  }
+  [task resume];
+}
+
+- (void)downloadData:(NSURL *)URL
+          validators:(NSDictionary<NSString *, NSString *> *)validators
+          completion:(void (^)(NSData *data,
+                               NSDictionary<NSString *, NSString *> *validators,
+                               BOOL notModified,
+                               NSError *error))completion {
+  if ([URL isFileURL]) {
+    [self downloadFileData:URL validators:validators completion:completion];
+    return;
+  }
+  CDMLogInfo(@"Downloading data at %@.", URL);
+  NSURLRequestCachePolicy policy = NSURLRequestReloadIgnoringLocalCacheData;
+  NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL
+                                                         cachePolicy:policy
+                                                     timeoutInterval:kDownloadTimeout];
+  NSString *eTag = validators[kDownloaderETagKey];
+  if (eTag) {
+    [request setValue:eTag forHTTPHeaderField:kIfNoneMatchHeaderString];
+  }
+  NSString *lastModified = validators[kDownloaderLastModifiedKey];
+  if (lastModified) {
+    [request setValue:lastModified forHTTPHeaderField:kIfModifiedSinceHeaderString];
+  }
+
+  void (^wrapped)(NSData *, NSURLResponse *, NSError *) = NULL;
+  wrapped = ^(NSData * _Nullable data,
+              NSURLResponse * _Nullable response,
+              NSError * _Nullable error) {
+    if (error) {
+      completion(nil, validators, NO, error);
+      return;
+    }
+    NSInteger statusCode = 200;
+    NSMutableDictionary<NSString *, NSString *> *responseValidators =
+        [NSMutableDictionary dictionary];
+    if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+      NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
+      statusCode = httpResponse.statusCode;
+      for (NSString *key in @[ kDownloaderETagKey, kDownloaderLastModifiedKey ]) {
+        NSString *value = HeaderValue(httpResponse, key);
+        if (value) {
+          responseValidators[key] = value;
+        }
+      }
+    }
+    if (statusCode == kHTTPStatusNotModified) {
+      // A 304 may omit validators that have not changed.
+      NSMutableDictionary *merged = [validators mutableCopy] ?: [NSMutableDictionary dictionary];
+      [merged addEntriesFromDictionary:responseValidators];
+      completion(nil, merged, YES, nil);
+    } else if (statusCode < 200 || statusCode >= 300) {
+      NSDictionary *userInfo = @{
+        NSURLErrorFailingURLErrorKey : URL,
+        NSLocalizedDescriptionKey : [NSHTTPURLResponse localizedStringForStatusCode:statusCode]
+      };
+      completion(nil, validators, NO,
+                 [NSError cdmErrorWithCode:CdmPlayeriOSErrorCode_HTTPError userInfo:userInfo]);
+    } else {
+      completion(data, responseValidators, NO, nil);
+    }
+  };
+  NSURLSessionDataTask *task = [self.downloadSession dataTaskWithRequest:request
+                                                       completionHandler:wrapped];
+  [task resume];
+}
+
 #pragma mark - helpers
 
+// Local files have no HTTP validators, so an ETag is made from their size and modification date.
+- (void)downloadFileData:(NSURL *)URL
+              validators:(NSDictionary<NSString *, NSString *> *)validators
+              completion:(void (^)(NSData *data,
+                                   NSDictionary<NSString *, NSString *> *validators,
+                                   BOOL notModified,
+                                   NSError *error))completion {
+  NSError *error = nil;
+  NSDictionary<NSFileAttributeKey, id> *attributes =
+      [[NSFileManager defaultManager] attributesOfItemAtPath:URL.path error:&error];
+  if (error) {
+    completion(nil, validators, NO, error);
+    return;
+  }
+  NSTimeInterval modified = attributes.fileModificationDate.timeIntervalSince1970;
+  NSString *eTag =
+      [NSString stringWithFormat:@"\"%llu-%.6f\"", attributes.fileSize, modified];
+  NSDictionary<NSString *, NSString *> *fileValidators = @{kDownloaderETagKey : eTag};
+  if ([validators[kDownloaderETagKey] isEqualToString:eTag]) {
+    completion(nil, fileValidators, YES, nil);
+    return;
+  }
+  CDMLogInfo(@"Downloading data at %@.", URL);
+  NSData *data = [NSData dataWithContentsOfURL:URL options:NSDataReadingUncached error:&error];
+  if (error) {
+    completion(nil, validators, NO, error);
+    return;
+  }
+  completion(data, fileValidators, NO, nil);
+}
+
 // Dispatches an error to the delegate of the download info.
 - (void)dispatchError:(NSError *)error forDownload:(DownloadInfo *)info withSourceURL:(NSURL *)url {
   dispatch_async(self.delegateQueue, ^{
@@ -170,11 +333,55 @@ NSTimeInterval const kDownloadTimeout = 10.0;
   }
 }
 
+// Accesses the handlers of the given streaming download.
+- (StreamingDownloadInfo *)streamingInfoForTask:(NSURLSessionTask *)task
+                                   shouldRemove:(BOOL)shouldRemove {
+  @synchronized (self) {
+    StreamingDownloadInfo *info = self.streamingInfoForTask[@(task.taskIdentifier)];
+    if (shouldRemove) {
+      [self.streamingInfoForTask removeObjectForKey:@(task.taskIdentifier)];
+    }
+    return info;
+  }
+}
+
+#pragma mark - NSURLSessionDataDelegate
+
+- (void)URLSession:(NSURLSession *)session
+              dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveResponse:(NSURLResponse *)response
+     completionHandler:(void (^)(NSURLSessionResponseDisposition disposition))completionHandler {
+  // Error pages are not part of the file; the download then completes with a cancellation error.
+  if ([response isKindOfClass:[NSHTTPURLResponse class]] &&
+      ((NSHTTPURLResponse *)response).statusCode >= kHTTPStatusBadRequest) {
+    CDMLogError(@"status %zd for %@",
+                ((NSHTTPURLResponse *)response).statusCode,
+                dataTask.originalRequest.URL);
+    completionHandler(NSURLSessionResponseCancel);
+    return;
+  }
+  completionHandler(NSURLSessionResponseAllow);
+}
+
+- (void)URLSession:(NSURLSession *)session
+          dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveData:(NSData *)data {
+  StreamingDownloadInfo *info = [self streamingInfoForTask:dataTask shouldRemove:NO];
+  if (info) {
+    info.received(data);
+  }
+}
+
 #pragma mark - NSURLSessionDownloadDelegate
 
 - (void)URLSession:(NSURLSession *)session
                     task:(NSURLSessionTask *)task
     didCompleteWithError:(NSError *)error {
+  StreamingDownloadInfo *streamingInfo = [self streamingInfoForTask:task shouldRemove:YES];
+  if (streamingInfo) {
+    streamingInfo.completion(error);
+    return;
+  }
   if (error) {
     DownloadInfo *info = [self downloadInfoForTask:task shouldRemove:YES];
     [self dispatchError:error forDownload:info withSourceURL:task.originalRequest.URL];
@@ -0,0 +1,1243 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "Fmp4Passthrough.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const size_t kFullBoxHeaderSize = 4;
+// Largest box header, with a 64 bit size.
+const size_t kMaxBoxHeaderSize = 16;
+// Per-sample IV sizes allowed by 'cenc'.
+const size_t kIvSizes[] = {8, 16};
+// Bytes of a sample entry before its child boxes, past the box header.
+const size_t kVisualSampleEntrySize = 78;
+const size_t kAudioSampleEntrySize = 28;
+// stsd has a full box header and an entry count before its entries.
+const size_t kSampleDescriptionHeaderSize = kFullBoxHeaderSize + 4;
+
+// trun flags.
+const uint32_t kTrunDataOffsetPresent = 0x1;
+const uint32_t kTrunFirstSampleFlagsPresent = 0x4;
+const uint32_t kTrunSampleDurationPresent = 0x100;
+const uint32_t kTrunSampleSizePresent = 0x200;
+const uint32_t kTrunSampleFlagsPresent = 0x400;
+const uint32_t kTrunSampleCompositionOffsetPresent = 0x800;
+// tfhd flags.
+const uint32_t kTfhdBaseDataOffsetPresent = 0x1;
+const uint32_t kTfhdSampleDescriptionIndexPresent = 0x2;
+const uint32_t kTfhdDefaultSampleDurationPresent = 0x8;
+const uint32_t kTfhdDefaultSampleSizePresent = 0x10;
+const uint32_t kTfhdDefaultSampleFlagsPresent = 0x20;
+// senc flags.
+const uint32_t kSencOverrideTrackEncryption = 0x1;
+const uint32_t kSencUseSubsamples = 0x2;
+// saiz and saio flags.
+const uint32_t kAuxInfoTypePresent = 0x1;
+
+const uint32_t kCenc = Fmp4FourCC('c', 'e', 'n', 'c');
+const uint32_t kEnca = Fmp4FourCC('e', 'n', 'c', 'a');
+const uint32_t kEncv = Fmp4FourCC('e', 'n', 'c', 'v');
+const uint32_t kFrma = Fmp4FourCC('f', 'r', 'm', 'a');
+const uint32_t kFtyp = Fmp4FourCC('f', 't', 'y', 'p');
+const uint32_t kMdat = Fmp4FourCC('m', 'd', 'a', 't');
+const uint32_t kMdhd = Fmp4FourCC('m', 'd', 'h', 'd');
+const uint32_t kMdia = Fmp4FourCC('m', 'd', 'i', 'a');
+const uint32_t kMinf = Fmp4FourCC('m', 'i', 'n', 'f');
+const uint32_t kMoof = Fmp4FourCC('m', 'o', 'o', 'f');
+const uint32_t kMoov = Fmp4FourCC('m', 'o', 'o', 'v');
+const uint32_t kPssh = Fmp4FourCC('p', 's', 's', 'h');
+const uint32_t kSaio = Fmp4FourCC('s', 'a', 'i', 'o');
+const uint32_t kSaiz = Fmp4FourCC('s', 'a', 'i', 'z');
+const uint32_t kSchi = Fmp4FourCC('s', 'c', 'h', 'i');
+const uint32_t kSchm = Fmp4FourCC('s', 'c', 'h', 'm');
+const uint32_t kSdtp = Fmp4FourCC('s', 'd', 't', 'p');
+const uint32_t kSenc = Fmp4FourCC('s', 'e', 'n', 'c');
+const uint32_t kSidx = Fmp4FourCC('s', 'i', 'd', 'x');
+const uint32_t kSinf = Fmp4FourCC('s', 'i', 'n', 'f');
+const uint32_t kStbl = Fmp4FourCC('s', 't', 'b', 'l');
+const uint32_t kStsd = Fmp4FourCC('s', 't', 's', 'd');
+const uint32_t kSubs = Fmp4FourCC('s', 'u', 'b', 's');
+const uint32_t kTenc = Fmp4FourCC('t', 'e', 'n', 'c');
+const uint32_t kTfdt = Fmp4FourCC('t', 'f', 'd', 't');
+const uint32_t kTfhd = Fmp4FourCC('t', 'f', 'h', 'd');
+const uint32_t kTraf = Fmp4FourCC('t', 'r', 'a', 'f');
+const uint32_t kTrak = Fmp4FourCC('t', 'r', 'a', 'k');
+const uint32_t kTrun = Fmp4FourCC('t', 'r', 'u', 'n');
+
+// Bounds checked big endian reader over a byte range.
+class Reader {
+ public:
+  Reader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  size_t position() const { return position_; }
+  size_t remaining() const { return size_ - position_; }
+
+  bool Skip(size_t count) {
+    if (count > remaining()) {
+      return false;
+    }
+    position_ += count;
+    return true;
+  }
+
+  bool Read(size_t count, uint64_t *value) {
+    if (count > remaining()) {
+      return false;
+    }
+    uint64_t result = 0;
+    for (size_t i = 0; i < count; ++i) {
+      result = result << 8 | data_[position_ + i];
+    }
+    position_ += count;
+    *value = result;
+    return true;
+  }
+
+  bool Read8(uint8_t *value) { return ReadAs(1, value); }
+  bool Read16(uint16_t *value) { return ReadAs(2, value); }
+  bool Read32(uint32_t *value) { return ReadAs(4, value); }
+  bool Read64(uint64_t *value) { return Read(8, value); }
+
+  bool ReadBytes(size_t count, uint8_t *bytes) {
+    if (count > remaining()) {
+      return false;
+    }
+    memcpy(bytes, data_ + position_, count);
+    position_ += count;
+    return true;
+  }
+
+ private:
+  template <typename T>
+  bool ReadAs(size_t count, T *value) {
+    uint64_t result = 0;
+    if (!Read(count, &result)) {
+      return false;
+    }
+    *value = static_cast<T>(result);
+    return true;
+  }
+
+  const uint8_t *data_;
+  size_t size_;
+  size_t position_ = 0;
+};
+
+// A box within a byte range, with |payload| pointing past its header.
+struct Box {
+  uint32_t type = 0;
+  const uint8_t *start = nullptr;
+  size_t size = 0;
+  const uint8_t *payload = nullptr;
+  size_t payload_size = 0;
+};
+
+// Reads the header of the box at the start of |data|, which need not hold the
+// rest of the box. A size of 0 extends the box to the end of |data|.
+bool ReadBoxHeader(const uint8_t *data, size_t size, uint32_t *type,
+                   uint64_t *box_size, size_t *header_size) {
+  Reader reader(data, size);
+  uint32_t box_size32 = 0;
+  if (!reader.Read32(&box_size32) || !reader.Read32(type)) {
+    return false;
+  }
+  *box_size = box_size32;
+  if (box_size32 == 1) {
+    if (!reader.Read64(box_size)) {
+      return false;
+    }
+  } else if (box_size32 == 0) {
+    *box_size = size;
+  }
+  *header_size = reader.position();
+  return *box_size >= *header_size;
+}
+
+// Reads the box at the start of |data|, which has to hold all of it.
+bool ReadBox(const uint8_t *data, size_t size, Box *box) {
+  uint64_t box_size = 0;
+  size_t header_size = 0;
+  if (!ReadBoxHeader(data, size, &box->type, &box_size, &header_size) ||
+      box_size > size) {
+    return false;
+  }
+  box->start = data;
+  box->size = static_cast<size_t>(box_size);
+  box->payload = data + header_size;
+  box->payload_size = box->size - header_size;
+  return true;
+}
+
+// Iterates over the boxes of a byte range. Stops at the first malformed box,
+// which is reported by valid().
+class BoxIterator {
+ public:
+  BoxIterator(const uint8_t *data, size_t size) : data_(data), size_(size) {
+    Next();
+  }
+
+  bool done() const { return done_; }
+  bool valid() const { return valid_; }
+  const Box &box() const { return box_; }
+
+  void Next() {
+    if (position_ >= size_) {
+      done_ = true;
+      return;
+    }
+    if (!ReadBox(data_ + position_, size_ - position_, &box_)) {
+      done_ = true;
+      valid_ = false;
+      return;
+    }
+    position_ += box_.size;
+  }
+
+ private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t position_ = 0;
+  Box box_;
+  bool done_ = false;
+  bool valid_ = true;
+};
+
+// Finds the first box of |type| among the boxes of a byte range.
+bool FindBox(const uint8_t *data, size_t size, uint32_t type, Box *box) {
+  for (BoxIterator it(data, size); !it.done(); it.Next()) {
+    if (it.box().type == type) {
+      *box = it.box();
+      return true;
+    }
+  }
+  return false;
+}
+
+// Follows |path|, a list of |count| box types, down from the boxes of a byte
+// range.
+bool FindBoxPath(const uint8_t *data, size_t size, const uint32_t *path,
+                 size_t count, Box *box) {
+  Box current;
+  current.payload = data;
+  current.payload_size = size;
+  for (size_t i = 0; i < count; ++i) {
+    if (!FindBox(current.payload, current.payload_size, path[i], &current)) {
+      return false;
+    }
+  }
+  *box = current;
+  return true;
+}
+
+// Bytes of an encv or enca sample entry before its child boxes.
+size_t SampleEntryHeaderSize(uint32_t type) {
+  return type == kEncv ? kVisualSampleEntrySize : kAudioSampleEntrySize;
+}
+
+// Reads the protection scheme of the sinf box |sinf| into |track|.
+bool ParseProtectionScheme(const Box &sinf, Fmp4Track *track) {
+  Box box;
+  if (!FindBox(sinf.payload, sinf.payload_size, kFrma, &box)) {
+    return false;
+  }
+  Reader frma(box.payload, box.payload_size);
+  if (!frma.Read32(&track->format)) {
+    return false;
+  }
+  if (FindBox(sinf.payload, sinf.payload_size, kSchm, &box)) {
+    Reader schm(box.payload, box.payload_size);
+    if (!schm.Skip(kFullBoxHeaderSize) || !schm.Read32(&track->scheme)) {
+      return false;
+    }
+  }
+  const uint32_t tenc_path[] = {kSchi, kTenc};
+  if (!FindBoxPath(sinf.payload, sinf.payload_size, tenc_path, 2, &box)) {
+    return false;
+  }
+  // Version, flags and the reserved or pattern bytes, then the defaults.
+  Reader tenc(box.payload, box.payload_size);
+  uint8_t is_protected = 0;
+  if (!tenc.Skip(kFullBoxHeaderSize + 2) || !tenc.Read8(&is_protected) ||
+      !tenc.Read8(&track->default_iv_size) ||
+      !tenc.ReadBytes(kFmp4KeyIdSize, track->default_key_id)) {
+    return false;
+  }
+  track->encrypted = is_protected != 0;
+  return track->default_iv_size <= kFmp4MaxIvSize;
+}
+
+// Reads the first sample entry of the stsd box |stsd| into |track|.
+bool ParseSampleDescription(const Box &stsd, Fmp4Track *track) {
+  if (stsd.payload_size < kSampleDescriptionHeaderSize) {
+    return false;
+  }
+  Box entry;
+  if (!ReadBox(stsd.payload + kSampleDescriptionHeaderSize,
+               stsd.payload_size - kSampleDescriptionHeaderSize, &entry)) {
+    return false;
+  }
+  track->format = entry.type;
+  if (entry.type != kEncv && entry.type != kEnca) {
+    return true;
+  }
+  size_t header_size = SampleEntryHeaderSize(entry.type);
+  if (entry.payload_size < header_size) {
+    return false;
+  }
+  Box sinf;
+  if (!FindBox(entry.payload + header_size, entry.payload_size - header_size,
+               kSinf, &sinf)) {
+    return false;
+  }
+  return ParseProtectionScheme(sinf, track);
+}
+
+// Appends the 32 bit big endian |value| to |out|.
+void Append32(uint32_t value, std::vector<uint8_t> *out) {
+  out->push_back(static_cast<uint8_t>(value >> 24));
+  out->push_back(static_cast<uint8_t>(value >> 16));
+  out->push_back(static_cast<uint8_t>(value >> 8));
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+// Writes the size of the box starting at |start| in |out|, which ends at the
+// end of |out|.
+bool PatchBoxSize(size_t start, std::vector<uint8_t> *out) {
+  size_t size = out->size() - start;
+  if (size > UINT32_MAX) {
+    return false;
+  }
+  (*out)[start] = static_cast<uint8_t>(size >> 24);
+  (*out)[start + 1] = static_cast<uint8_t>(size >> 16);
+  (*out)[start + 2] = static_cast<uint8_t>(size >> 8);
+  (*out)[start + 3] = static_cast<uint8_t>(size);
+  return true;
+}
+
+bool CopyClearBoxes(const uint8_t *data, size_t size, uint32_t parent,
+                    std::vector<uint8_t> *out);
+
+// Copies |box|, a child of a |parent| box, to |out|. Descends into the boxes
+// on the way to the sample entries so that their protection can be removed.
+bool CopyClearBox(const Box &box, uint32_t parent, std::vector<uint8_t> *out) {
+  if (box.type == kSinf && (parent == kEncv || parent == kEnca)) {
+    return true;
+  }
+  size_t header_size = 0;
+  uint32_t type = box.type;
+  switch (box.type) {
+    case kMoov:
+    case kTrak:
+    case kMdia:
+    case kMinf:
+    case kStbl:
+      break;
+    case kStsd:
+      header_size = kSampleDescriptionHeaderSize;
+      break;
+    case kEncv:
+    case kEnca: {
+      header_size = SampleEntryHeaderSize(box.type);
+      if (box.payload_size < header_size) {
+        return false;
+      }
+      Fmp4Track track;
+      Box sinf;
+      if (!FindBox(box.payload + header_size, box.payload_size - header_size,
+                   kSinf, &sinf) ||
+          !ParseProtectionScheme(sinf, &track)) {
+        return false;
+      }
+      type = track.format;
+      break;
+    }
+    default:
+      out->insert(out->end(), box.start, box.start + box.size);
+      return true;
+  }
+  if (box.payload_size < header_size) {
+    return false;
+  }
+  size_t start = out->size();
+  Append32(0, out);
+  Append32(type, out);
+  out->insert(out->end(), box.payload, box.payload + header_size);
+  if (!CopyClearBoxes(box.payload + header_size,
+                      box.payload_size - header_size, box.type, out)) {
+    return false;
+  }
+  return PatchBoxSize(start, out);
+}
+
+bool CopyClearBoxes(const uint8_t *data, size_t size, uint32_t parent,
+                    std::vector<uint8_t> *out) {
+  BoxIterator it(data, size);
+  for (; !it.done(); it.Next()) {
+    if (!CopyClearBox(it.box(), parent, out)) {
+      return false;
+    }
+  }
+  return it.valid();
+}
+
+// Sample layout of a track fragment, from its tfhd.
+struct FragmentDefaults {
+  uint64_t base_data_offset = 0;
+  // True if the tfhd gives |base_data_offset| instead of using the moof.
+  bool explicit_base_data_offset = false;
+  uint32_t sample_duration = 0;
+  uint32_t sample_size = 0;
+};
+
+bool ParseTrackFragmentHeader(const Box &tfhd, const uint8_t *moof,
+                              const uint8_t *segment,
+                              FragmentDefaults *defaults) {
+  Reader reader(tfhd.payload, tfhd.payload_size);
+  uint32_t version_and_flags = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Skip(4)) {
+    return false;
+  }
+  uint32_t flags = version_and_flags & 0xffffff;
+  // Without an explicit offset, data is relative to the moof.
+  defaults->base_data_offset = static_cast<uint64_t>(moof - segment);
+  if (flags & kTfhdBaseDataOffsetPresent) {
+    if (!reader.Read64(&defaults->base_data_offset)) {
+      return false;
+    }
+    defaults->explicit_base_data_offset = true;
+  }
+  if ((flags & kTfhdSampleDescriptionIndexPresent) && !reader.Skip(4)) {
+    return false;
+  }
+  if ((flags & kTfhdDefaultSampleDurationPresent) &&
+      !reader.Read32(&defaults->sample_duration)) {
+    return false;
+  }
+  if ((flags & kTfhdDefaultSampleSizePresent) &&
+      !reader.Read32(&defaults->sample_size)) {
+    return false;
+  }
+  if ((flags & kTfhdDefaultSampleFlagsPresent) && !reader.Skip(4)) {
+    return false;
+  }
+  return true;
+}
+
+// A sample of a track fragment, as an offset from the start of the segment.
+struct Sample {
+  uint64_t offset;
+  uint32_t size;
+};
+
+// Appends the samples of the trun box |trun| to |samples|, up to
+// |max_samples| of them. |data_offset| is where its data starts when the trun
+// does not say, and is moved past it. Returns false if the trun is cut short
+// or lists more samples than a segment of |segment_size| bytes could hold.
+bool ParseTrackRun(const Box &trun, const FragmentDefaults &defaults,
+                   uint64_t segment_size, size_t max_samples,
+                   uint64_t *data_offset, std::vector<Sample> *samples) {
+  Reader reader(trun.payload, trun.payload_size);
+  uint32_t version_and_flags = 0;
+  uint32_t sample_count = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Read32(&sample_count)) {
+    return false;
+  }
+  uint32_t flags = version_and_flags & 0xffffff;
+  if (flags & kTrunDataOffsetPresent) {
+    uint32_t offset = 0;
+    if (!reader.Read32(&offset)) {
+      return false;
+    }
+    *data_offset = defaults.base_data_offset +
+                   static_cast<int64_t>(static_cast<int32_t>(offset));
+  }
+  if ((flags & kTrunFirstSampleFlagsPresent) && !reader.Skip(4)) {
+    return false;
+  }
+  // The count is checked before anything is allocated for the samples.
+  size_t entry_size = ((flags & kTrunSampleDurationPresent) ? 4 : 0) +
+                      ((flags & kTrunSampleSizePresent) ? 4 : 0) +
+                      ((flags & kTrunSampleFlagsPresent) ? 4 : 0) +
+                      ((flags & kTrunSampleCompositionOffsetPresent) ? 4 : 0);
+  if ((entry_size && sample_count > reader.remaining() / entry_size) ||
+      sample_count > segment_size ||
+      (!(flags & kTrunSampleSizePresent) && defaults.sample_size &&
+       sample_count > segment_size / defaults.sample_size)) {
+    return false;
+  }
+  uint32_t count = static_cast<uint32_t>(
+      std::min<uint64_t>(sample_count, max_samples));
+  samples->reserve(samples->size() + count);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t size = defaults.sample_size;
+    if ((flags & kTrunSampleDurationPresent) && !reader.Skip(4)) {
+      return false;
+    }
+    if ((flags & kTrunSampleSizePresent) && !reader.Read32(&size)) {
+      return false;
+    }
+    if ((flags & kTrunSampleFlagsPresent) && !reader.Skip(4)) {
+      return false;
+    }
+    if ((flags & kTrunSampleCompositionOffsetPresent) && !reader.Skip(4)) {
+      return false;
+    }
+    Sample sample = {*data_offset, size};
+    samples->push_back(sample);
+    *data_offset += size;
+  }
+  return true;
+}
+
+// Adds the duration of the samples of the trun box |trun| to |duration|.
+// Returns false if neither the trun nor |defaults| give sample durations.
+bool AddTrackRunDuration(const Box &trun, const FragmentDefaults &defaults,
+                         uint64_t *duration) {
+  Reader reader(trun.payload, trun.payload_size);
+  uint32_t version_and_flags = 0;
+  uint32_t sample_count = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Read32(&sample_count)) {
+    return false;
+  }
+  uint32_t flags = version_and_flags & 0xffffff;
+  if (!(flags & kTrunSampleDurationPresent)) {
+    if (sample_count && !defaults.sample_duration) {
+      return false;
+    }
+    *duration += static_cast<uint64_t>(sample_count) * defaults.sample_duration;
+    return true;
+  }
+  if ((flags & kTrunDataOffsetPresent) && !reader.Skip(4)) {
+    return false;
+  }
+  if ((flags & kTrunFirstSampleFlagsPresent) && !reader.Skip(4)) {
+    return false;
+  }
+  size_t skipped = ((flags & kTrunSampleSizePresent) ? 4 : 0) +
+                   ((flags & kTrunSampleFlagsPresent) ? 4 : 0) +
+                   ((flags & kTrunSampleCompositionOffsetPresent) ? 4 : 0);
+  for (uint32_t i = 0; i < sample_count; ++i) {
+    uint32_t sample_duration = 0;
+    if (!reader.Read32(&sample_duration) || !reader.Skip(skipped)) {
+      return false;
+    }
+    *duration += sample_duration;
+  }
+  return true;
+}
+
+// Reads the decode time of the track fragment |traf| from its tfdt into
+// |start| and adds the duration of its samples to |duration|.
+bool ParseTrackFragmentTiming(const Box &traf, const uint8_t *moof,
+                              uint64_t *start, uint64_t *duration) {
+  Box tfdt;
+  Box tfhd;
+  FragmentDefaults defaults;
+  if (!FindBox(traf.payload, traf.payload_size, kTfdt, &tfdt) ||
+      !FindBox(traf.payload, traf.payload_size, kTfhd, &tfhd) ||
+      !ParseTrackFragmentHeader(tfhd, moof, moof, &defaults)) {
+    return false;
+  }
+  Reader reader(tfdt.payload, tfdt.payload_size);
+  uint8_t version = 0;
+  if (!reader.Read8(&version) || !reader.Skip(3) ||
+      !reader.Read(version == 1 ? 8 : 4, start)) {
+    return false;
+  }
+  BoxIterator it(traf.payload, traf.payload_size);
+  for (; !it.done(); it.Next()) {
+    if (it.box().type == kTrun &&
+        !AddTrackRunDuration(it.box(), defaults, duration)) {
+      return false;
+    }
+  }
+  return it.valid();
+}
+
+// Reads the IV and subsamples of |sample| of |segment| from |senc| into
+// |encrypted|, appending the subsamples to |subsamples|. |encrypted| is left
+// without data when the sample has no protected bytes.
+bool ReadSampleEncryption(const Fmp4Track &track, bool use_subsamples,
+                          const Sample &sample, Reader *senc, uint8_t *segment,
+                          size_t segment_size, Fmp4EncryptedSample *encrypted,
+                          std::vector<Fmp4Subsample> *subsamples) {
+  if (!senc->ReadBytes(track.default_iv_size, encrypted->iv)) {
+    return false;
+  }
+  encrypted->iv_size = track.default_iv_size;
+  if (sample.offset > segment_size ||
+      sample.size > segment_size - sample.offset) {
+    return false;
+  }
+  uint64_t protected_size = sample.size;
+  if (use_subsamples) {
+    uint16_t subsample_count = 0;
+    if (!senc->Read16(&subsample_count)) {
+      return false;
+    }
+    protected_size = 0;
+    size_t position = 0;
+    for (uint16_t i = 0; i < subsample_count; ++i) {
+      uint16_t clear_size = 0;
+      Fmp4Subsample subsample;
+      if (!senc->Read16(&clear_size) ||
+          !senc->Read32(&subsample.protected_size)) {
+        return false;
+      }
+      subsample.clear_size = clear_size;
+      position += clear_size;
+      if (position > sample.size ||
+          subsample.protected_size > sample.size - position) {
+        return false;
+      }
+      position += subsample.protected_size;
+      protected_size += subsample.protected_size;
+      subsamples->push_back(subsample);
+    }
+    encrypted->subsample_count = subsample_count;
+  }
+  if (protected_size) {
+    encrypted->data = segment + sample.offset;
+    encrypted->size = sample.size;
+  }
+  return true;
+}
+
+// Decrypts the samples of the traf box |traf| of the moof at |moof|.
+bool DecryptTrackFragment(const Fmp4Track &track, const Box &traf,
+                          const uint8_t *moof, uint8_t *segment,
+                          size_t segment_size, Fmp4DecryptFunction decrypt,
+                          void *context) {
+  Box tfhd;
+  FragmentDefaults defaults;
+  if (!FindBox(traf.payload, traf.payload_size, kTfhd, &tfhd) ||
+      !ParseTrackFragmentHeader(tfhd, moof, segment, &defaults)) {
+    return false;
+  }
+  std::vector<Sample> samples;
+  uint64_t data_offset = defaults.base_data_offset;
+  BoxIterator it(traf.payload, traf.payload_size);
+  for (; !it.done(); it.Next()) {
+    if (it.box().type == kTrun &&
+        !ParseTrackRun(it.box(), defaults, segment_size, SIZE_MAX,
+                       &data_offset, &samples)) {
+      return false;
+    }
+  }
+  if (!it.valid()) {
+    return false;
+  }
+  Box senc;
+  if (!FindBox(traf.payload, traf.payload_size, kSenc, &senc)) {
+    // A fragment without sample encryption information is clear.
+    return true;
+  }
+  Reader reader(senc.payload, senc.payload_size);
+  uint32_t version_and_flags = 0;
+  uint32_t sample_count = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Read32(&sample_count) ||
+      sample_count != samples.size()) {
+    return false;
+  }
+  bool use_subsamples = (version_and_flags & kSencUseSubsamples) != 0;
+  std::vector<Fmp4EncryptedSample> encrypted;
+  encrypted.reserve(samples.size());
+  std::vector<Fmp4Subsample> subsamples;
+  // Index in |subsamples| of the first subsample of each entry of |encrypted|.
+  std::vector<size_t> first_subsamples;
+  first_subsamples.reserve(samples.size());
+  for (const Sample &sample : samples) {
+    Fmp4EncryptedSample entry;
+    size_t first_subsample = subsamples.size();
+    if (!ReadSampleEncryption(track, use_subsamples, sample, &reader, segment,
+                              segment_size, &entry, &subsamples)) {
+      return false;
+    }
+    if (entry.data) {
+      encrypted.push_back(entry);
+      first_subsamples.push_back(first_subsample);
+    }
+  }
+  if (encrypted.empty()) {
+    return true;
+  }
+  // Pointed at once all have been read, as reading may move them.
+  for (size_t i = 0; i < encrypted.size(); ++i) {
+    encrypted[i].subsamples = subsamples.data() + first_subsamples[i];
+  }
+  return decrypt(context, track.default_key_id, encrypted.data(),
+                 encrypted.size());
+}
+
+// Reads the first sample of the first trun of |traf|, a track fragment of the
+// moof at |moof|, as an offset from |moof|.
+bool ParseFirstSample(const Box &traf, const uint8_t *moof, Sample *sample) {
+  Box tfhd;
+  Box trun;
+  FragmentDefaults defaults;
+  if (!FindBox(traf.payload, traf.payload_size, kTfhd, &tfhd) ||
+      !ParseTrackFragmentHeader(tfhd, moof, moof, &defaults) ||
+      defaults.explicit_base_data_offset ||
+      !FindBox(traf.payload, traf.payload_size, kTrun, &trun)) {
+    return false;
+  }
+  // Only the first sample is read, so the segment, which may not have been
+  // received yet, does not bound the count.
+  std::vector<Sample> samples;
+  uint64_t data_offset = defaults.base_data_offset;
+  if (!ParseTrackRun(trun, defaults, UINT64_MAX, 1, &data_offset, &samples) ||
+      samples.empty()) {
+    return false;
+  }
+  *sample = samples[0];
+  return true;
+}
+
+// Positions in a moof being cut to its first sample that depend on the size of
+// the boxes written before them. Positions are from the start of the moof.
+struct KeyFrameCut {
+  // Data offset field of the trun.
+  size_t data_offset = 0;
+  // Offset field of the saio, or 0 without one.
+  size_t aux_info_offset = 0;
+  size_t aux_info_offset_size = 0;
+  uint64_t original_aux_info_offset = 0;
+  // Entries of the senc, before and after the cut, or 0 without one.
+  size_t original_sample_encryption = 0;
+  size_t original_sample_encryption_end = 0;
+  size_t sample_encryption = 0;
+};
+
+// Appends |box| to |out| with the 32 bit |count| at |count_position| of its
+// payload replaced by 1, followed by |entry_size| bytes of its first entry.
+bool AppendFirstEntry(const Box &box, size_t count_position, size_t entry_size,
+                      std::vector<uint8_t> *out) {
+  if (count_position + 4 > box.payload_size ||
+      entry_size > box.payload_size - count_position - 4) {
+    return false;
+  }
+  const uint8_t *entry = box.payload + count_position + 4;
+  Append32(0, out);
+  Append32(box.type, out);
+  size_t start = out->size() - 8;
+  out->insert(out->end(), box.payload, box.payload + count_position);
+  Append32(1, out);
+  out->insert(out->end(), entry, entry + entry_size);
+  return PatchBoxSize(start, out);
+}
+
+// Appends the trun box |trun| to |out| with only its first sample.
+bool CutTrackRun(const Box &trun, std::vector<uint8_t> *out,
+                 KeyFrameCut *cut) {
+  Reader reader(trun.payload, trun.payload_size);
+  uint32_t version_and_flags = 0;
+  uint32_t sample_count = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Read32(&sample_count) ||
+      !sample_count) {
+    return false;
+  }
+  uint32_t flags = version_and_flags & 0xffffff;
+  // Without a data offset the samples follow those of an earlier fragment.
+  if (!(flags & kTrunDataOffsetPresent)) {
+    return false;
+  }
+  size_t entry_size = 0;
+  const uint32_t entry_fields[] = {
+      kTrunSampleDurationPresent, kTrunSampleSizePresent,
+      kTrunSampleFlagsPresent, kTrunSampleCompositionOffsetPresent};
+  for (uint32_t field : entry_fields) {
+    if (flags & field) {
+      entry_size += 4;
+    }
+  }
+  // The data offset is written once the size of the moof is known.
+  cut->data_offset = out->size() + 8 + reader.position();
+  size_t count_position = reader.position() - 4;
+  if (!AppendFirstEntry(trun, count_position,
+                        (flags & kTrunFirstSampleFlagsPresent ? 8 : 4) +
+                            entry_size,
+                        out)) {
+    return false;
+  }
+  return true;
+}
+
+// Appends the saiz box |saiz| to |out| with only its first sample.
+bool CutAuxInfoSizes(const Box &saiz, std::vector<uint8_t> *out) {
+  Reader reader(saiz.payload, saiz.payload_size);
+  uint32_t version_and_flags = 0;
+  uint8_t default_size = 0;
+  if (!reader.Read32(&version_and_flags) ||
+      ((version_and_flags & kAuxInfoTypePresent) && !reader.Skip(8)) ||
+      !reader.Read8(&default_size)) {
+    return false;
+  }
+  return AppendFirstEntry(saiz, reader.position(), default_size ? 0 : 1, out);
+}
+
+// Appends the saio box |saio| to |out| with only its first offset, which is
+// fixed up once the senc it points at has been cut.
+bool CutAuxInfoOffsets(const Box &saio, std::vector<uint8_t> *out,
+                       KeyFrameCut *cut) {
+  Reader reader(saio.payload, saio.payload_size);
+  uint32_t version_and_flags = 0;
+  if (!reader.Read32(&version_and_flags) ||
+      ((version_and_flags & kAuxInfoTypePresent) && !reader.Skip(8))) {
+    return false;
+  }
+  size_t count_position = reader.position();
+  cut->aux_info_offset_size = (version_and_flags >> 24) == 1 ? 8 : 4;
+  if (!reader.Skip(4) ||
+      !reader.Read(cut->aux_info_offset_size, &cut->original_aux_info_offset)) {
+    return false;
+  }
+  cut->aux_info_offset = out->size() + 8 + count_position + 4;
+  return AppendFirstEntry(saio, count_position, cut->aux_info_offset_size, out);
+}
+
+// Sets |first_size| to the size of the first entry of the senc |entries|. The
+// IV size is not known from the fragment, so it is the one for which the
+// |count| entries fill the box exactly.
+bool FirstSampleEncryptionSize(const uint8_t *entries, size_t size,
+                               uint32_t count, bool use_subsamples,
+                               size_t *first_size) {
+  for (size_t iv_size : kIvSizes) {
+    Reader reader(entries, size);
+    size_t first = 0;
+    bool valid = true;
+    for (uint32_t i = 0; i < count && valid; ++i) {
+      uint16_t subsample_count = 0;
+      valid = reader.Skip(iv_size) &&
+              (!use_subsamples || (reader.Read16(&subsample_count) &&
+                                   reader.Skip(6 * subsample_count)));
+      if (!i) {
+        first = reader.position();
+      }
+    }
+    if (valid && !reader.remaining()) {
+      *first_size = first;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Appends the senc box |senc| of the moof at |moof| to |out| with only its
+// first sample.
+bool CutSampleEncryption(const Box &senc, const uint8_t *moof,
+                         std::vector<uint8_t> *out, KeyFrameCut *cut) {
+  Reader reader(senc.payload, senc.payload_size);
+  uint32_t version_and_flags = 0;
+  uint32_t sample_count = 0;
+  if (!reader.Read32(&version_and_flags) || !reader.Read32(&sample_count) ||
+      (version_and_flags & kSencOverrideTrackEncryption)) {
+    return false;
+  }
+  size_t entry_size = 0;
+  if (!FirstSampleEncryptionSize(
+          senc.payload + reader.position(), reader.remaining(), sample_count,
+          (version_and_flags & kSencUseSubsamples) != 0, &entry_size)) {
+    return false;
+  }
+  cut->original_sample_encryption =
+      static_cast<size_t>(senc.payload - moof) + reader.position();
+  cut->original_sample_encryption_end = cut->original_sample_encryption +
+                                        reader.remaining();
+  cut->sample_encryption = out->size() + 8 + reader.position();
+  return AppendFirstEntry(senc, reader.position() - 4, entry_size, out);
+}
+
+// Appends the traf box |traf| of the moof at |moof| to |out| with only its
+// first sample.
+bool CutTrackFragment(const Box &traf, const uint8_t *moof,
+                      std::vector<uint8_t> *out, KeyFrameCut *cut) {
+  size_t start = out->size();
+  Append32(0, out);
+  Append32(kTraf, out);
+  bool has_trun = false;
+  BoxIterator it(traf.payload, traf.payload_size);
+  for (; !it.done(); it.Next()) {
+    const Box &box = it.box();
+    bool cut_box = true;
+    switch (box.type) {
+      case kTrun:
+        // Samples of later runs are dropped.
+        cut_box = has_trun || CutTrackRun(box, out, cut);
+        has_trun = true;
+        break;
+      case kSaiz:
+        cut_box = CutAuxInfoSizes(box, out);
+        break;
+      case kSaio:
+        cut_box = CutAuxInfoOffsets(box, out, cut);
+        break;
+      case kSenc:
+        cut_box = CutSampleEncryption(box, moof, out, cut);
+        break;
+      case kSdtp:
+      case kSubs:
+        // Other per-sample tables are dropped rather than cut.
+        break;
+      default:
+        out->insert(out->end(), box.start, box.start + box.size);
+        break;
+    }
+    if (!cut_box) {
+      return false;
+    }
+  }
+  return it.valid() && has_trun && PatchBoxSize(start, out);
+}
+
+// Writes the |size| byte big endian |value| at |position| of |out|.
+void Patch(size_t position, uint64_t value, size_t size,
+           std::vector<uint8_t> *out) {
+  for (size_t i = 0; i < size; ++i) {
+    (*out)[position + i] = static_cast<uint8_t>(value >> (8 * (size - 1 - i)));
+  }
+}
+
+}  // namespace
+
+bool ParseFmp4Track(const uint8_t *data, size_t size, Fmp4Track *track) {
+  Fmp4Track result;
+  Box moov;
+  if (!FindBox(data, size, kMoov, &moov)) {
+    return false;
+  }
+  BoxIterator it(moov.payload, moov.payload_size);
+  for (; !it.done(); it.Next()) {
+    if (it.box().type == kPssh) {
+      result.psshs.push_back(
+          std::vector<uint8_t>(it.box().start, it.box().start + it.box().size));
+    }
+  }
+  if (!it.valid()) {
+    return false;
+  }
+  Box box;
+  const uint32_t mdhd_path[] = {kTrak, kMdia, kMdhd};
+  if (!FindBoxPath(moov.payload, moov.payload_size, mdhd_path, 3, &box)) {
+    return false;
+  }
+  Reader mdhd(box.payload, box.payload_size);
+  uint8_t version = 0;
+  // Version, flags and the creation and modification times.
+  if (!mdhd.Read8(&version) || !mdhd.Skip(3) ||
+      !mdhd.Skip(version == 1 ? 16 : 8) || !mdhd.Read32(&result.timescale)) {
+    return false;
+  }
+  const uint32_t stsd_path[] = {kTrak, kMdia, kMinf, kStbl, kStsd};
+  if (!FindBoxPath(moov.payload, moov.payload_size, stsd_path, 5, &box) ||
+      !ParseSampleDescription(box, &result)) {
+    return false;
+  }
+  *track = result;
+  return true;
+}
+
+bool ClearFmp4Initialization(const uint8_t *data, size_t size,
+                             std::vector<uint8_t> *clear) {
+  std::vector<uint8_t> out;
+  BoxIterator it(data, size);
+  for (; !it.done(); it.Next()) {
+    const Box &box = it.box();
+    if (box.type == kFtyp) {
+      out.insert(out.end(), box.start, box.start + box.size);
+    } else if (box.type == kMoov && !CopyClearBox(box, 0, &out)) {
+      return false;
+    }
+  }
+  if (!it.valid()) {
+    return false;
+  }
+  clear->swap(out);
+  return true;
+}
+
+bool ParseFmp4SegmentIndex(const uint8_t *data, size_t size,
+                           uint64_t data_offset, Fmp4SegmentIndex *index) {
+  Box sidx;
+  if (!FindBox(data, size, kSidx, &sidx)) {
+    return false;
+  }
+  Reader reader(sidx.payload, sidx.payload_size);
+  Fmp4SegmentIndex result;
+  uint8_t version = 0;
+  uint64_t first_offset = 0;
+  uint16_t reference_count = 0;
+  // Version, flags, reference ID, timescale, earliest presentation time and
+  // first offset, then a reserved field and the references.
+  if (!reader.Read8(&version) || !reader.Skip(3 + 4) ||
+      !reader.Read32(&result.timescale) ||
+      !reader.Skip(version == 1 ? 8 : 4) ||
+      !reader.Read(version == 1 ? 8 : 4, &first_offset) || !reader.Skip(2) ||
+      !reader.Read16(&reference_count)) {
+    return false;
+  }
+  // Offsets are relative to the first byte after the sidx.
+  uint64_t offset = data_offset + static_cast<uint64_t>(sidx.start - data) +
+                    sidx.size + first_offset;
+  for (uint16_t i = 0; i < reference_count; ++i) {
+    uint32_t reference = 0;
+    Fmp4SegmentReference segment;
+    if (!reader.Read32(&reference) || !reader.Read32(&segment.duration) ||
+        !reader.Skip(4)) {
+      return false;
+    }
+    if (reference & 0x80000000) {
+      // Hierarchical indexes are not supported.
+      return false;
+    }
+    segment.offset = offset;
+    segment.size = reference & 0x7fffffff;
+    result.references.push_back(segment);
+    offset += segment.size;
+  }
+  *index = result;
+  return true;
+}
+
+bool DecryptFmp4Segment(const Fmp4Track &track, uint8_t *data, size_t size,
+                        Fmp4DecryptFunction decrypt, void *context) {
+  if (!track.encrypted) {
+    return true;
+  }
+  // Other schemes use CBC or patterns the CDM does not decrypt.
+  if (track.scheme != kCenc || !track.default_iv_size) {
+    return false;
+  }
+  BoxIterator it(data, size);
+  for (; !it.done(); it.Next()) {
+    const Box &moof = it.box();
+    if (moof.type != kMoof) {
+      continue;
+    }
+    BoxIterator traf(moof.payload, moof.payload_size);
+    for (; !traf.done(); traf.Next()) {
+      if (traf.box().type == kTraf &&
+          !DecryptTrackFragment(track, traf.box(), moof.start, data, size,
+                                decrypt, context)) {
+        return false;
+      }
+    }
+    if (!traf.valid()) {
+      return false;
+    }
+  }
+  return it.valid();
+}
+
+bool Fmp4KeyFrameExtent(const uint8_t *data, size_t size, size_t *extent) {
+  size_t position = 0;
+  while (true) {
+    uint32_t type = 0;
+    uint64_t box_size = 0;
+    size_t header_size = 0;
+    if (position >= size || !ReadBoxHeader(data + position, size - position,
+                                            &type, &box_size, &header_size)) {
+      if (position < size && size - position >= kMaxBoxHeaderSize) {
+        return false;
+      }
+      *extent = position + kMaxBoxHeaderSize;
+      return true;
+    }
+    if (box_size > SIZE_MAX - position) {
+      return false;
+    }
+    if (type != kMoof) {
+      position += static_cast<size_t>(box_size);
+      continue;
+    }
+    if (box_size > size - position) {
+      *extent = position + static_cast<size_t>(box_size);
+      return true;
+    }
+    Box moof;
+    Box traf;
+    Sample sample;
+    if (!ReadBox(data + position, size - position, &moof) ||
+        !FindBox(moof.payload, moof.payload_size, kTraf, &traf) ||
+        !ParseFirstSample(traf, moof.start, &sample) ||
+        sample.offset < moof.size || sample.size > SIZE_MAX - position ||
+        sample.offset > SIZE_MAX - position - sample.size) {
+      // The sample is in the mdat that follows the moof.
+      return false;
+    }
+    *extent = position + static_cast<size_t>(sample.offset + sample.size);
+    return true;
+  }
+}
+
+bool CutFmp4KeyFrame(const uint8_t *data, size_t size,
+                     std::vector<uint8_t> *key_frame) {
+  BoxIterator it(data, size);
+  while (!it.done() && it.box().type != kMoof) {
+    it.Next();
+  }
+  if (it.done()) {
+    return false;
+  }
+  const Box moof = it.box();
+  Box traf;
+  size_t traf_count = 0;
+  for (BoxIterator child(moof.payload, moof.payload_size); !child.done();
+       child.Next()) {
+    if (child.box().type == kTraf) {
+      traf = child.box();
+      ++traf_count;
+    }
+  }
+  Sample sample;
+  if (traf_count != 1 || !ParseFirstSample(traf, moof.start, &sample)) {
+    return false;
+  }
+  // The sample has to be in the mdat that follows the moof, which |data| only
+  // holds up to the end of the sample.
+  size_t available = size - static_cast<size_t>(moof.start - data);
+  uint32_t type = 0;
+  uint64_t mdat_size = 0;
+  size_t mdat_header_size = 0;
+  if (moof.size > available ||
+      !ReadBoxHeader(moof.start + moof.size, available - moof.size, &type,
+                     &mdat_size, &mdat_header_size) ||
+      type != kMdat || mdat_size > UINT64_MAX - moof.size) {
+    return false;
+  }
+  uint64_t mdat_data = moof.size + mdat_header_size;
+  uint64_t limit = std::min<uint64_t>(available, moof.size + mdat_size);
+  if (sample.offset < mdat_data || sample.size > limit ||
+      sample.offset > limit - sample.size) {
+    return false;
+  }
+  uint64_t sample_end = sample.offset + sample.size;
+
+  std::vector<uint8_t> out;
+  KeyFrameCut cut;
+  Append32(0, &out);
+  Append32(kMoof, &out);
+  for (BoxIterator child(moof.payload, moof.payload_size); !child.done();
+       child.Next()) {
+    const Box &box = child.box();
+    if (box.type != kTraf) {
+      out.insert(out.end(), box.start, box.start + box.size);
+    } else if (!CutTrackFragment(box, moof.start, &out, &cut)) {
+      return false;
+    }
+  }
+  if (!PatchBoxSize(0, &out)) {
+    return false;
+  }
+  // Data between the start of the mdat and the sample is kept, so the sample
+  // keeps its place in the mdat.
+  uint64_t data_offset = out.size() + 8 + (sample.offset - mdat_data);
+  Patch(cut.data_offset, data_offset, 4, &out);
+  if (cut.aux_info_offset) {
+    // The auxiliary information is expected in the senc.
+    if (!cut.sample_encryption ||
+        cut.original_aux_info_offset < cut.original_sample_encryption ||
+        cut.original_aux_info_offset >= cut.original_sample_encryption_end) {
+      return false;
+    }
+    Patch(cut.aux_info_offset,
+          cut.original_aux_info_offset - cut.original_sample_encryption +
+              cut.sample_encryption,
+          cut.aux_info_offset_size, &out);
+  }
+  size_t mdat_start = out.size();
+  Append32(0, &out);
+  Append32(kMdat, &out);
+  out.insert(out.end(), moof.start + mdat_data, moof.start + sample_end);
+  if (!PatchBoxSize(mdat_start, &out)) {
+    return false;
+  }
+  key_frame->swap(out);
+  return true;
+}
+
+bool ParseFmp4Chunks(const uint8_t *data, size_t size,
+                     std::vector<Fmp4Chunk> *chunks) {
+  std::vector<Fmp4Chunk> result;
+  size_t position = 0;
+  size_t moof_start = 0;
+  bool in_chunk = false;
+  while (position < size) {
+    uint32_t type = 0;
+    uint64_t box_size = 0;
+    size_t header_size = 0;
+    if (!ReadBoxHeader(data + position, size - position, &type, &box_size,
+                       &header_size)) {
+      // Only the header of the last box may be cut short.
+      if (size - position >= kMaxBoxHeaderSize) {
+        return false;
+      }
+      break;
+    }
+    if (box_size > size - position) {
+      // The rest of the box has not been received yet.
+      break;
+    }
+    if (type == kMoof) {
+      moof_start = position;
+      in_chunk = true;
+    }
+    position += static_cast<size_t>(box_size);
+    if (type == kMdat && in_chunk) {
+      Fmp4Chunk chunk;
+      chunk.offset = moof_start;
+      chunk.size = position - moof_start;
+      result.push_back(chunk);
+      in_chunk = false;
+    }
+  }
+  chunks->swap(result);
+  return true;
+}
+
+bool ParseFmp4SegmentTiming(const uint8_t *data, size_t size, uint64_t *start,
+                            uint64_t *duration) {
+  uint64_t first_start = 0;
+  uint64_t total = 0;
+  bool found = false;
+  BoxIterator it(data, size);
+  for (; !it.done(); it.Next()) {
+    const Box &moof = it.box();
+    if (moof.type != kMoof) {
+      continue;
+    }
+    Box traf;
+    uint64_t fragment_start = 0;
+    if (!FindBox(moof.payload, moof.payload_size, kTraf, &traf) ||
+        !ParseTrackFragmentTiming(traf, moof.start, &fragment_start, &total)) {
+      return false;
+    }
+    if (!found) {
+      first_start = fragment_start;
+      found = true;
+    }
+  }
+  if (!it.valid() || !found) {
+    return false;
+  }
+  *start = first_start;
+  *duration = total;
+  return true;
+}
+
+bool ParseFmp4SegmentStart(const uint8_t *data, size_t size, uint64_t *start) {
+  for (BoxIterator it(data, size); !it.done(); it.Next()) {
+    const Box &moof = it.box();
+    if (moof.type != kMoof) {
+      continue;
+    }
+    Box traf;
+    uint64_t duration = 0;
+    return FindBox(moof.payload, moof.payload_size, kTraf, &traf) &&
+           ParseTrackFragmentTiming(traf, moof.start, start, &duration);
+  }
+  return false;
+}
@@ -0,0 +1,157 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Fragmented MP4 helpers for streams that are served without transmuxing.
+//
+// UDT only transmuxes H.264 and AAC to TS. Representations in other codecs,
+// such as HEVC and E-AC-3, are served to AVPlayer as the fragmented MP4 the
+// packager produced, behind an EXT-X-MAP. AVPlayer cannot decrypt Common
+// Encryption itself, so 'cenc' samples are decrypted in place with the CDM and
+// the initialization segment is rewritten to describe clear samples.
+//
+// Only the C++ standard library is used so the helpers can be built and
+// tested off device.
+
+#ifndef CDM_PLAYER_FMP4PASSTHROUGH_H_
+#define CDM_PLAYER_FMP4PASSTHROUGH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+const size_t kFmp4KeyIdSize = 16;
+const size_t kFmp4MaxIvSize = 16;
+
+// Builds the four character code of a box or scheme type, e.g. 'cenc'.
+constexpr uint32_t Fmp4FourCC(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(static_cast<uint8_t>(a)) << 24 |
+         static_cast<uint32_t>(static_cast<uint8_t>(b)) << 16 |
+         static_cast<uint32_t>(static_cast<uint8_t>(c)) << 8 |
+         static_cast<uint32_t>(static_cast<uint8_t>(d));
+}
+
+// The track of an initialization segment, as needed to serve its segments.
+struct Fmp4Track {
+  // Media timescale of the track, from its mdhd.
+  uint32_t timescale = 0;
+  // Sample entry type of the samples once decrypted, e.g. 'hvc1' or 'ec-3'.
+  uint32_t format = 0;
+  bool encrypted = false;
+  // Protection scheme type from the schm, e.g. 'cenc'. 0 when clear.
+  uint32_t scheme = 0;
+  // Defaults from the tenc box of an encrypted track.
+  uint8_t default_key_id[kFmp4KeyIdSize] = {};
+  uint8_t default_iv_size = 0;
+  // Complete pssh boxes of the moov, in order.
+  std::vector<std::vector<uint8_t>> psshs;
+};
+
+// A media segment listed by a sidx box.
+struct Fmp4SegmentReference {
+  // Offset of the segment from the start of the file.
+  uint64_t offset = 0;
+  uint32_t size = 0;
+  // Duration in the timescale of the sidx.
+  uint32_t duration = 0;
+};
+
+struct Fmp4SegmentIndex {
+  uint32_t timescale = 0;
+  std::vector<Fmp4SegmentReference> references;
+};
+
+// A subsample of an encrypted sample: |clear_size| clear bytes followed by
+// |protected_size| encrypted ones.
+struct Fmp4Subsample {
+  uint32_t clear_size = 0;
+  uint32_t protected_size = 0;
+};
+
+// An encrypted sample of a track fragment. Its protected bytes form one
+// AES-CTR stream starting at |iv|. Without subsamples the whole sample is
+// protected.
+struct Fmp4EncryptedSample {
+  uint8_t *data = nullptr;
+  uint32_t size = 0;
+  uint8_t iv[kFmp4MaxIvSize] = {};
+  size_t iv_size = 0;
+  const Fmp4Subsample *subsamples = nullptr;
+  size_t subsample_count = 0;
+};
+
+// Decrypts in place the |sample_count| |samples| of a track fragment, which
+// share the key |key_id|, kFmp4KeyIdSize bytes. Returns false if any sample
+// could not be decrypted.
+typedef bool (*Fmp4DecryptFunction)(void *context, const uint8_t *key_id,
+                                    const Fmp4EncryptedSample *samples,
+                                    size_t sample_count);
+
+// Reads the first track of the initialization segment |data|. Returns false if
+// |data| has no moov or its track cannot be parsed.
+bool ParseFmp4Track(const uint8_t *data, size_t size, Fmp4Track *track);
+
+// Copies the ftyp and moov of the initialization segment |data| to |clear|,
+// with the protection of the sample entry removed so that it describes the
+// samples once decrypted. Other top level boxes, such as a sidx, are dropped.
+// Returns false if |data| cannot be parsed.
+bool ClearFmp4Initialization(const uint8_t *data, size_t size,
+                             std::vector<uint8_t> *clear);
+
+// Reads the sidx box of |data|, the bytes of a file from |data_offset| on.
+// Returns false if |data| has no sidx or it references other sidx boxes.
+bool ParseFmp4SegmentIndex(const uint8_t *data, size_t size,
+                           uint64_t data_offset, Fmp4SegmentIndex *index);
+
+// Decrypts the samples of the media segment |data| of |track| in place, using
+// the sample encryption (senc) of each fragment. The protected samples of a
+// track fragment are handed to |decrypt| at once. Clear tracks are left as is.
+// Returns false if the segment cannot be parsed, uses a scheme other than
+// 'cenc', or |decrypt| fails.
+bool DecryptFmp4Segment(const Fmp4Track &track, uint8_t *data, size_t size,
+                        Fmp4DecryptFunction decrypt, void *context);
+
+// Sets |extent| to the number of bytes from the start of the media segment
+// |data|, which may be a prefix of the segment, needed to cut its key frame
+// with CutFmp4KeyFrame: up to the end of the first sample of its first moof.
+// When |data| ends before that moof does, |extent| only covers what is needed
+// to read further, so it is larger than |size|. Returns false if the segment
+// cannot be parsed.
+bool Fmp4KeyFrameExtent(const uint8_t *data, size_t size, size_t *extent);
+
+// Copies the first moof of the media segment |data| to |key_frame| with only
+// its first sample, which starts a segment and so is a key frame, followed by
+// an mdat holding that sample. The sample tables and sample encryption of the
+// moof are cut to match. |data| needs Fmp4KeyFrameExtent bytes. Returns false
+// if the fragment cannot be cut, e.g. because it holds more than one track.
+bool CutFmp4KeyFrame(const uint8_t *data, size_t size,
+                     std::vector<uint8_t> *key_frame);
+
+// A moof and the mdat following it. Chunked CMAF packagers write each
+// segment as several of them, which are sent as soon as they are produced.
+struct Fmp4Chunk {
+  // Offset of the moof from the start of the segment.
+  size_t offset = 0;
+  // Bytes from the start of the moof to the end of the mdat.
+  size_t size = 0;
+};
+
+// Lists the complete chunks of the media segment |data|, which may be the
+// prefix of a segment still being received. Boxes between chunks, such as a
+// styp or prft, are left out. Returns false if the segment cannot be parsed.
+bool ParseFmp4Chunks(const uint8_t *data, size_t size,
+                     std::vector<Fmp4Chunk> *chunks);
+
+// Reads the decode time of the first sample of the media segment |data|, from
+// the tfdt of its first moof, and the total duration of its samples, both in
+// the timescale of the track. Only the first track fragment of each moof is
+// read. Returns false if the segment cannot be parsed or lacks a tfdt or the
+// durations of its samples.
+bool ParseFmp4SegmentTiming(const uint8_t *data, size_t size, uint64_t *start,
+                            uint64_t *duration);
+
+// Reads the decode time of the first sample of the media segment |data|, from
+// the tfdt of its first moof, in the timescale of the track. |data| may be
+// the start of the segment, cut anywhere after that moof. Returns false if no
+// complete moof with a tfdt precedes the cut.
+bool ParseFmp4SegmentStart(const uint8_t *data, size_t size, uint64_t *start);
+
+#endif  // CDM_PLAYER_FMP4PASSTHROUGH_H_
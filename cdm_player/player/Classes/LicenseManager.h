@@ -2,10 +2,49 @@
 
 #import "CdmWrapper.h"
 
+@class LicenseRenewalScheduler;
+
+// Timing of a single license exchange with the license server.
+@interface LicenseRequestMetrics : NSObject
+// Number of HTTP attempts made, including retries.
+@property(nonatomic) NSUInteger attempts;
+// Seconds from sending the first attempt to receiving the final response.
+@property(nonatomic) NSTimeInterval duration;
+// HTTP status code of the final response, 0 if no response was received.
+@property(nonatomic) NSInteger statusCode;
+@end
+
 @interface LicenseManager : NSObject <iOSCdmDelegate>
 + (void)startup;
+// Like startup, and also loads the persistent sessions of the |count| most recently played offline
+// titles in the background so that their playback does not wait on session loads.
++ (void)startupWithWarmSessionCount:(NSUInteger)count;
 + (LicenseManager *)sharedInstance;
 
+// Creates a manager storing its key files and KeyMap in |keyStoreURL|, a directory URL.
+// init uses Documents/Keystore/.
+- (instancetype)initWithKeyStoreURL:(NSURL *)keyStoreURL;
+// The PSSH to session ID map is served from memory and its changes are journaled in the
+// background. Blocks until all pending changes have been written to disk.
+- (void)synchronizeKeyMap;
+// PSSHs that have a persisted offline license.
+- (NSArray<NSData *> *)offlinePsshKeys;
+// Up to |count| PSSHs of persisted offline licenses, most recently played first.
+- (NSArray<NSData *> *)recentlyUsedPsshKeys:(NSUInteger)count;
+// Last recorded expiration of the offline license of |pssh| in milliseconds since 1970, 0 if it
+// never expires. nil if unknown; forgotten when the PSSH gets a new session or is removed.
+- (NSNumber *)licenseExpirationForPssh:(NSData *)pssh;
+// Records the expiration of the offline license of |pssh| in the KeyMap. nil forgets it.
+- (void)setLicenseExpiration:(NSNumber *)expiration forPssh:(NSData *)pssh;
+
 @property(nonatomic, retain) NSURL *licenseServerURL;
+// Session used to send license requests. Exposed to allow mocking in unit tests.
+@property(strong, nonatomic) NSURLSession *licenseSession;
+// Metrics of the most recent license requests, oldest first.
+@property(readonly) NSArray<LicenseRequestMetrics *> *requestMetrics;
+// Renews the offline licenses of sharedInstance ahead of expiration. Started by startup.
+@property(readonly) LicenseRenewalScheduler *renewalScheduler;
+// Seconds spent loading each session warmed by startupWithWarmSessionCount:, keyed by PSSH.
+@property(readonly) NSDictionary<NSData *, NSNumber *> *warmSessionLoadTimes;
 
 @end
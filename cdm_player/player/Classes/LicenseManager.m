@@ -2,19 +2,83 @@
 
 #import "LicenseManager.h"
 
+#import "CdmPlayerErrors.h"
+#import "LicenseRenewalScheduler.h"
 #import "Streaming.h"
 #import "Logging.h"
 
 static NSString *kStorageName = @"Keystore/";
 static NSString *kKeyMapName = @"KeyMap";
+static NSString *kKeyMapJournalName = @"KeyMap.journal";
+static NSString *kKeyMapUsageName = @"KeyMap.usage";
+static NSString *kKeyMapExpirationName = @"KeyMap.expiration";
+static NSString *kLicenseStoreName = @"Licenses.store";
 static NSString *const kLicenseUrlString =
     @"https://proxy.uat.widevine.com/proxy";
 static NSString *const rexLicenseUrlString =
 @"http://146.148.35.45:8081";
 
+// Audio and video keys are usually requested at the same time.
+static const NSInteger kMaxLicenseRequestsInFlight = 4;
+static const NSUInteger kMaxLicenseAttempts = 3;
+static const NSUInteger kMaxRequestMetrics = 32;
+static const NSTimeInterval kLicenseRequestTimeout = 10.0;
+// Delay before the first retry, doubled for every further attempt.
+static const NSTimeInterval kLicenseRetryDelay = 0.5;
+// Number of journal records after which the KeyMap is rewritten and the journal truncated.
+static const NSUInteger kKeyMapCompactionThreshold = 64;
+
+// Operations recorded in the KeyMap journal. Each record is the operation byte followed by the
+// length-prefixed PSSH and, for kKeyMapJournalSet, the length-prefixed UTF-8 session ID, for
+// kKeyMapJournalUse, the length-prefixed time of use in seconds since 1970 as a double or, for
+// kKeyMapJournalExpire, the length-prefixed expiration as an int64, empty once it is forgotten.
+typedef NS_ENUM(uint8_t, KeyMapJournalOp) {
+  kKeyMapJournalSet = 1,
+  kKeyMapJournalRemove = 2,
+  kKeyMapJournalUse = 3,
+  kKeyMapJournalExpire = 4,
+};
+
+// Reads a uint32 length-prefixed field at |*cursor|, or returns nil if the record is truncated.
+static NSData *ReadJournalField(const uint8_t *bytes, NSUInteger length, NSUInteger *cursor) {
+  uint32_t fieldLength = 0;
+  if (length - *cursor < sizeof(fieldLength)) {
+    return nil;
+  }
+  memcpy(&fieldLength, bytes + *cursor, sizeof(fieldLength));
+  *cursor += sizeof(fieldLength);
+  if (length - *cursor < fieldLength) {
+    return nil;
+  }
+  NSData *field = [NSData dataWithBytes:bytes + *cursor length:fieldLength];
+  *cursor += fieldLength;
+  return field;
+}
+
+static void AppendJournalField(NSMutableData *record, NSData *field) {
+  uint32_t fieldLength = (uint32_t)field.length;
+  [record appendBytes:&fieldLength length:sizeof(fieldLength)];
+  [record appendData:field];
+}
+
+@implementation LicenseRequestMetrics
+@end
+
 @interface LicenseManager () {
   NSURL *_keyStoreURL;
   dispatch_queue_t _queue;
+  NSMutableArray<LicenseRequestMetrics *> *_requestMetrics;
+  // PSSH to session ID map, loaded once. Read concurrently, written with barriers.
+  NSMutableDictionary<NSData *, NSString *> *_keyMap;
+  // Last time each PSSH in _keyMap was played back. Guarded by _keyMapQueue.
+  NSMutableDictionary<NSData *, NSDate *> *_lastUsed;
+  // Last known license expiration of PSSHs in _keyMap. Guarded by _keyMapQueue.
+  NSMutableDictionary<NSData *, NSNumber *> *_expirations;
+  dispatch_queue_t _keyMapQueue;
+  // Serial queue that appends to the journal and compacts it behind the in-memory map.
+  dispatch_queue_t _journalQueue;
+  NSFileHandle *_journal;
+  NSUInteger _journalRecords;
 }
 
 @end
@@ -31,18 +95,50 @@ static NSString *const rexLicenseUrlString =
 // keychain can be dumped and modified a user would be able to copy the licenses.
 
 + (void)startup {
-  [self sharedInstance];
+  [[self sharedInstance].renewalScheduler start];
+}
+
++ (void)startupWithWarmSessionCount:(NSUInteger)count {
+  [self startup];
+  LicenseManager *licenseManager = [self sharedInstance];
+  NSArray<NSData *> *psshKeys = [licenseManager recentlyUsedPsshKeys:count];
+  if (!psshKeys.count) {
+    return;
+  }
+  [[iOSCdm sharedInstance]
+      loadOfflineSessionsForPsshKeys:psshKeys
+                     completionBlock:^(NSDictionary<NSData *, NSNumber *> *loadTimes) {
+                       for (NSData *pssh in psshKeys) {
+                         NSNumber *loadTime = loadTimes[pssh];
+                         if (loadTime) {
+                           CDMLogInfo(@"Warmed offline session %@ in %.1f ms",
+                                      [licenseManager sessionIdFromPssh:pssh],
+                                      loadTime.doubleValue * 1000);
+                         }
+                       }
+                       licenseManager->_warmSessionLoadTimes = loadTimes;
+                     }];
 }
 
 - (instancetype)init {
+  NSURL *documentsURL =
+      [[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory
+                                             inDomains:NSUserDomainMask][0];
+  return [self initWithKeyStoreURL:[NSURL URLWithString:kStorageName relativeToURL:documentsURL]];
+}
+
+- (instancetype)initWithKeyStoreURL:(NSURL *)keyStoreURL {
   self = [super init];
   if (self) {
     _queue =
         dispatch_queue_create("com.google.widevine.cdm-player.licensing", DISPATCH_QUEUE_SERIAL);
-    _keyStoreURL =
-        [NSURL URLWithString:kStorageName
-               relativeToURL:[[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory
-                                                                    inDomains:NSUserDomainMask][0]];
+    NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
+    config.timeoutIntervalForRequest = kLicenseRequestTimeout;
+    config.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    config.HTTPMaximumConnectionsPerHost = kMaxLicenseRequestsInFlight;
+    _licenseSession = [NSURLSession sessionWithConfiguration:config];
+    _requestMetrics = [NSMutableArray array];
+    _keyStoreURL = keyStoreURL;
     NSError *error = nil;
     [[NSFileManager defaultManager] createDirectoryAtURL:_keyStoreURL
                              withIntermediateDirectories:YES
@@ -52,6 +148,11 @@ static NSString *const rexLicenseUrlString =
       CDMLogNSError(error, @"creating directory");
       return nil;
     }
+    _keyMapQueue = dispatch_queue_create("com.google.widevine.cdm-player.keymap",
+                                         DISPATCH_QUEUE_CONCURRENT);
+    _journalQueue = dispatch_queue_create("com.google.widevine.cdm-player.keymap-journal",
+                                          DISPATCH_QUEUE_SERIAL);
+    [self loadKeyMap];
   }
   return self;
 }
@@ -63,10 +164,17 @@ static NSString *const rexLicenseUrlString =
   dispatch_once(&token, ^{
     s_licMgr = [[LicenseManager alloc] init];
     [[iOSCdm sharedInstance] setupCdmWithDelegate:s_licMgr];
+    s_licMgr->_renewalScheduler =
+        [[LicenseRenewalScheduler alloc] initWithLicenseManager:s_licMgr
+                                                            cdm:[iOSCdm sharedInstance]];
   });
   return s_licMgr;
 }
 
+- (NSString *)iOSCdmLicenseStorePath:(iOSCdm *)iOSCdm {
+  return [[_keyStoreURL path] stringByAppendingPathComponent:kLicenseStoreName];
+}
+
 - (NSData *)readFile:(NSString *)fileName {
   return [NSData dataWithContentsOfURL:[NSURL URLWithString:fileName relativeToURL:_keyStoreURL]];
 }
@@ -104,41 +212,109 @@ static NSString *const rexLicenseUrlString =
 }
 
 - (BOOL)removePssh:(NSData *)pssh {
-  NSURL *fileURL = [NSURL URLWithString:kKeyMapName relativeToURL:_keyStoreURL];
-  NSData *keyMapData = [NSData dataWithContentsOfURL:fileURL];
-  if (keyMapData) {
-    NSMutableDictionary *keyMap = [NSKeyedUnarchiver unarchiveObjectWithData:keyMapData];
-    [keyMap removeObjectForKey:pssh];
-    keyMapData = [NSKeyedArchiver archivedDataWithRootObject:keyMap];
-    [keyMapData writeToURL:fileURL atomically:YES];
-    return true;
+  __block BOOL removed = NO;
+  dispatch_barrier_sync(_keyMapQueue, ^{
+    removed = _keyMap[pssh] != nil;
+    [_keyMap removeObjectForKey:pssh];
+    [_lastUsed removeObjectForKey:pssh];
+    [_expirations removeObjectForKey:pssh];
+  });
+  if (removed) {
+    [self appendJournalOp:kKeyMapJournalRemove pssh:pssh value:nil];
   }
-  return false;
+  return removed;
 }
 
 - (void)onSessionCreatedWithPssh:(NSData *)pssh sessionId:(NSString *)sessionId {
-  NSURL *fileURL = [NSURL URLWithString:kKeyMapName relativeToURL:_keyStoreURL];
+  if (!pssh || !sessionId) {
+    return;
+  }
+  pssh = [pssh copy];
+  dispatch_barrier_sync(_keyMapQueue, ^{
+    // A new session holds a new license.
+    _keyMap[pssh] = sessionId;
+    [_expirations removeObjectForKey:pssh];
+  });
+  [self appendJournalOp:kKeyMapJournalSet
+                   pssh:pssh
+                  value:[sessionId dataUsingEncoding:NSUTF8StringEncoding]];
+  [self onSessionUsedWithPssh:pssh];
+}
 
-  NSMutableDictionary *keyMap = [NSMutableDictionary dictionary];
-  NSData *keyMapData = [NSData dataWithContentsOfURL:fileURL];
-  if (keyMapData) {
-    keyMap = [NSKeyedUnarchiver unarchiveObjectWithData:keyMapData];
+- (void)onSessionUsedWithPssh:(NSData *)pssh {
+  NSDate *now = [NSDate date];
+  __block BOOL known = NO;
+  dispatch_barrier_sync(_keyMapQueue, ^{
+    known = _keyMap[pssh] != nil;
+    if (known) {
+      _lastUsed[pssh] = now;
+    }
+  });
+  if (known) {
+    NSTimeInterval time = now.timeIntervalSince1970;
+    [self appendJournalOp:kKeyMapJournalUse
+                     pssh:pssh
+                    value:[NSData dataWithBytes:&time length:sizeof(time)]];
   }
-  keyMap[pssh] = sessionId;
+}
 
-  keyMapData = [NSKeyedArchiver archivedDataWithRootObject:keyMap];
-  [keyMapData writeToURL:fileURL atomically:YES];
+- (NSArray<NSData *> *)recentlyUsedPsshKeys:(NSUInteger)count {
+  __block NSArray<NSData *> *psshKeys = nil;
+  dispatch_sync(_keyMapQueue, ^{
+    psshKeys = [_lastUsed keysSortedByValueUsingComparator:^(NSDate *a, NSDate *b) {
+      return [b compare:a];
+    }];
+  });
+  return [psshKeys subarrayWithRange:NSMakeRange(0, MIN(count, psshKeys.count))];
 }
 
-- (NSString *)sessionIdFromPssh:(NSData *)pssh {
-  NSURL *fileURL = [NSURL URLWithString:kKeyMapName relativeToURL:_keyStoreURL];
+- (NSNumber *)licenseExpirationForPssh:(NSData *)pssh {
+  __block NSNumber *expiration = nil;
+  dispatch_sync(_keyMapQueue, ^{
+    expiration = _expirations[pssh];
+  });
+  return expiration;
+}
 
-  NSData *keyMapData = [NSData dataWithContentsOfURL:fileURL];
-  if (keyMapData) {
-    NSMutableDictionary *keyMap = [NSKeyedUnarchiver unarchiveObjectWithData:keyMapData];
-    return [keyMap objectForKey:pssh];
+- (void)setLicenseExpiration:(NSNumber *)expiration forPssh:(NSData *)pssh {
+  __block BOOL changed = NO;
+  dispatch_barrier_sync(_keyMapQueue, ^{
+    if (!_keyMap[pssh] || _expirations[pssh] == expiration ||
+        [_expirations[pssh] isEqual:expiration]) {
+      return;
+    }
+    _expirations[pssh] = expiration;
+    changed = YES;
+  });
+  if (changed) {
+    int64_t value = expiration.longLongValue;
+    [self appendJournalOp:kKeyMapJournalExpire
+                     pssh:pssh
+                    value:expiration ? [NSData dataWithBytes:&value length:sizeof(value)]
+                                     : [NSData data]];
   }
-  return nil;
+}
+
+- (NSString *)sessionIdFromPssh:(NSData *)pssh {
+  __block NSString *sessionId = nil;
+  dispatch_sync(_keyMapQueue, ^{
+    sessionId = _keyMap[pssh];
+  });
+  return sessionId;
+}
+
+- (NSArray<NSData *> *)offlinePsshKeys {
+  __block NSArray<NSData *> *psshKeys = nil;
+  dispatch_sync(_keyMapQueue, ^{
+    psshKeys = _keyMap.allKeys;
+  });
+  return psshKeys;
+}
+
+- (void)synchronizeKeyMap {
+  dispatch_sync(_journalQueue, ^{
+    [_journal synchronizeFile];
+  });
 }
 
 - (dispatch_queue_t)iOSCdmDispatchQueue:(iOSCdm *)iOSCdm {
@@ -155,11 +331,258 @@ static NSString *const rexLicenseUrlString =
       [NSMutableURLRequest requestWithURL:_licenseServerURL];
   [request setHTTPMethod:@"POST"];
   [request setHTTPBody:data];
-  NSURLResponse *response = nil;
+  LicenseRequestMetrics *metrics = [[LicenseRequestMetrics alloc] init];
+  [self sendLicenseRequest:request
+                   metrics:metrics
+                 startTime:CFAbsoluteTimeGetCurrent()
+           completionBlock:completionBlock];
+}
+
+- (NSArray<LicenseRequestMetrics *> *)requestMetrics {
+  @synchronized(_requestMetrics) {
+    return [_requestMetrics copy];
+  }
+}
+
+#pragma mark - private methods
+
+- (NSURL *)keyMapURL {
+  return [NSURL URLWithString:kKeyMapName relativeToURL:_keyStoreURL];
+}
+
+- (NSURL *)keyMapUsageURL {
+  return [NSURL URLWithString:kKeyMapUsageName relativeToURL:_keyStoreURL];
+}
+
+- (NSURL *)keyMapExpirationURL {
+  return [NSURL URLWithString:kKeyMapExpirationName relativeToURL:_keyStoreURL];
+}
+
+- (NSURL *)keyMapJournalURL {
+  return [NSURL URLWithString:kKeyMapJournalName relativeToURL:_keyStoreURL];
+}
+
+// Loads the last compacted KeyMap and replays the journal written since.
+- (void)loadKeyMap {
+  _keyMap = [NSMutableDictionary dictionary];
+  NSData *keyMapData = [NSData dataWithContentsOfURL:[self keyMapURL]];
+  if (keyMapData) {
+    NSDictionary *keyMap = [NSKeyedUnarchiver unarchiveObjectWithData:keyMapData];
+    if ([keyMap isKindOfClass:[NSDictionary class]]) {
+      [_keyMap addEntriesFromDictionary:keyMap];
+    }
+  }
+  _lastUsed = [NSMutableDictionary dictionary];
+  NSData *usageData = [NSData dataWithContentsOfURL:[self keyMapUsageURL]];
+  if (usageData) {
+    NSDictionary *usage = [NSKeyedUnarchiver unarchiveObjectWithData:usageData];
+    if ([usage isKindOfClass:[NSDictionary class]]) {
+      [_lastUsed addEntriesFromDictionary:usage];
+    }
+  }
+  _expirations = [NSMutableDictionary dictionary];
+  NSData *expirationData = [NSData dataWithContentsOfURL:[self keyMapExpirationURL]];
+  if (expirationData) {
+    NSDictionary *expirations = [NSKeyedUnarchiver unarchiveObjectWithData:expirationData];
+    if ([expirations isKindOfClass:[NSDictionary class]]) {
+      [_expirations addEntriesFromDictionary:expirations];
+    }
+  }
+  NSData *journalData = [NSData dataWithContentsOfURL:[self keyMapJournalURL]];
+  unsigned long long validLength = [self replayJournal:journalData];
+
+  NSString *journalPath = [[self keyMapJournalURL] path];
+  if (!journalData) {
+    [[NSFileManager defaultManager] createFileAtPath:journalPath contents:nil attributes:nil];
+  }
+  _journal = [NSFileHandle fileHandleForWritingAtPath:journalPath];
+  // Drop a record torn by a crash in the middle of an append.
+  [_journal truncateFileAtOffset:validLength];
+  if (_journalRecords >= kKeyMapCompactionThreshold) {
+    dispatch_async(_journalQueue, ^{
+      [self compactKeyMap];
+    });
+  }
+}
+
+// Applies the journal records in |data| to _keyMap. Returns the length of the complete records.
+- (unsigned long long)replayJournal:(NSData *)data {
+  const uint8_t *bytes = (const uint8_t *)data.bytes;
+  NSUInteger length = data.length;
+  NSUInteger offset = 0;
+  _journalRecords = 0;
+  while (offset < length) {
+    NSUInteger cursor = offset;
+    uint8_t op = bytes[cursor++];
+    NSData *pssh = ReadJournalField(bytes, length, &cursor);
+    if (!pssh) {
+      break;
+    }
+    if (op == kKeyMapJournalSet) {
+      NSData *sessionIdData = ReadJournalField(bytes, length, &cursor);
+      NSString *sessionId =
+          sessionIdData ? [[NSString alloc] initWithData:sessionIdData
+                                                encoding:NSUTF8StringEncoding]
+                        : nil;
+      if (!sessionId) {
+        break;
+      }
+      _keyMap[pssh] = sessionId;
+      [_expirations removeObjectForKey:pssh];
+    } else if (op == kKeyMapJournalRemove) {
+      [_keyMap removeObjectForKey:pssh];
+      [_lastUsed removeObjectForKey:pssh];
+      [_expirations removeObjectForKey:pssh];
+    } else if (op == kKeyMapJournalUse) {
+      NSData *timeData = ReadJournalField(bytes, length, &cursor);
+      NSTimeInterval time = 0;
+      if (timeData.length != sizeof(time)) {
+        break;
+      }
+      memcpy(&time, timeData.bytes, sizeof(time));
+      if (_keyMap[pssh]) {
+        _lastUsed[pssh] = [NSDate dateWithTimeIntervalSince1970:time];
+      }
+    } else if (op == kKeyMapJournalExpire) {
+      NSData *expirationData = ReadJournalField(bytes, length, &cursor);
+      int64_t expiration = 0;
+      if (!expirationData ||
+          (expirationData.length && expirationData.length != sizeof(expiration))) {
+        break;
+      }
+      memcpy(&expiration, expirationData.bytes, expirationData.length);
+      if (!expirationData.length) {
+        [_expirations removeObjectForKey:pssh];
+      } else if (_keyMap[pssh]) {
+        _expirations[pssh] = @(expiration);
+      }
+    } else {
+      break;
+    }
+    offset = cursor;
+    _journalRecords++;
+  }
+  if (offset < length) {
+    CDMLogWarn(@"Ignoring %tu trailing bytes of the KeyMap journal", length - offset);
+  }
+  return offset;
+}
+
+// Records a KeyMap mutation in the journal without blocking the caller. |value| is the second
+// field of kKeyMapJournalSet, kKeyMapJournalUse and kKeyMapJournalExpire records.
+- (void)appendJournalOp:(KeyMapJournalOp)op pssh:(NSData *)pssh value:(NSData *)value {
+  NSMutableData *record = [NSMutableData dataWithBytes:&op length:sizeof(op)];
+  AppendJournalField(record, pssh);
+  if (op != kKeyMapJournalRemove) {
+    AppendJournalField(record, value);
+  }
+  dispatch_async(_journalQueue, ^{
+    @try {
+      [_journal seekToEndOfFile];
+      [_journal writeData:record];
+    } @catch (NSException *exception) {
+      CDMLogError(@"writing KeyMap journal: %@", exception);
+      return;
+    }
+    if (++_journalRecords >= kKeyMapCompactionThreshold) {
+      [self compactKeyMap];
+    }
+  });
+}
+
+// Rewrites the KeyMap from memory and empties the journal. The KeyMap is replaced atomically
+// before the journal is truncated, so a crash in between only replays records already applied.
+// Called on _journalQueue.
+- (void)compactKeyMap {
+  __block NSDictionary *snapshot = nil;
+  __block NSDictionary *usageSnapshot = nil;
+  __block NSDictionary *expirationSnapshot = nil;
+  dispatch_sync(_keyMapQueue, ^{
+    snapshot = [_keyMap copy];
+    usageSnapshot = [_lastUsed copy];
+    expirationSnapshot = [_expirations copy];
+  });
+  NSData *keyMapData = [NSKeyedArchiver archivedDataWithRootObject:snapshot];
+  NSData *usageData = [NSKeyedArchiver archivedDataWithRootObject:usageSnapshot];
+  NSData *expirationData = [NSKeyedArchiver archivedDataWithRootObject:expirationSnapshot];
   NSError *error = nil;
-  NSData *response_data =
-      [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
-  completionBlock(response_data, error);
+  if (![keyMapData writeToURL:[self keyMapURL] options:NSDataWritingAtomic error:&error] ||
+      ![usageData writeToURL:[self keyMapUsageURL] options:NSDataWritingAtomic error:&error] ||
+      ![expirationData writeToURL:[self keyMapExpirationURL]
+                          options:NSDataWritingAtomic
+                            error:&error]) {
+    CDMLogNSError(error, @"compacting KeyMap");
+    return;
+  }
+  [_journal truncateFileAtOffset:0];
+  [_journal synchronizeFile];
+  _journalRecords = 0;
+}
+
+// Sends |request| without blocking the licensing queue. Transient failures are retried with
+// exponential backoff up to kMaxLicenseAttempts. |completionBlock| is called on the licensing
+// queue with the final result.
+- (void)sendLicenseRequest:(NSURLRequest *)request
+                   metrics:(LicenseRequestMetrics *)metrics
+                 startTime:(CFAbsoluteTime)startTime
+           completionBlock:(void (^)(NSData *, NSError *))completionBlock {
+  metrics.attempts++;
+  void (^handler)(NSData *, NSURLResponse *, NSError *) =
+      ^(NSData *data, NSURLResponse *response, NSError *error) {
+        NSInteger statusCode = 0;
+        if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+          statusCode = ((NSHTTPURLResponse *)response).statusCode;
+        }
+        if (metrics.attempts < kMaxLicenseAttempts &&
+            [self shouldRetryLicenseRequestWithStatus:statusCode error:error]) {
+          NSTimeInterval delay = kLicenseRetryDelay * (1 << (metrics.attempts - 1));
+          CDMLogWarn(@"License request attempt %tu failed (status %zd), retrying in %.1fs",
+                     metrics.attempts, statusCode, delay);
+          dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _queue,
+                         ^{
+                           [self sendLicenseRequest:request
+                                            metrics:metrics
+                                          startTime:startTime
+                                    completionBlock:completionBlock];
+                         });
+          return;
+        }
+        if (!error && (statusCode < 200 || statusCode >= 300)) {
+          error = [NSError cdmErrorWithCode:CdmPlayeriOSErrorCode_LicenseRequestFailed
+                                   userInfo:@{
+                                     NSLocalizedDescriptionKey : [NSString
+                                         stringWithFormat:@"License server returned %zd",
+                                                          statusCode]
+                                   }];
+          data = nil;
+        }
+        metrics.statusCode = statusCode;
+        metrics.duration = CFAbsoluteTimeGetCurrent() - startTime;
+        [self recordMetrics:metrics];
+        CDMLogInfo(@"License request finished in %.3fs after %tu attempt(s), status %zd",
+                   metrics.duration, metrics.attempts, statusCode);
+        dispatch_async(_queue, ^{
+          completionBlock(data, error);
+        });
+      };
+  [[_licenseSession dataTaskWithRequest:request completionHandler:handler] resume];
+}
+
+// Network failures and server side errors are worth retrying, client errors are not.
+- (BOOL)shouldRetryLicenseRequestWithStatus:(NSInteger)statusCode error:(NSError *)error {
+  if (error) {
+    return [error.domain isEqualToString:NSURLErrorDomain] && error.code != NSURLErrorCancelled;
+  }
+  return statusCode >= 500 || statusCode == 429;
+}
+
+- (void)recordMetrics:(LicenseRequestMetrics *)metrics {
+  @synchronized(_requestMetrics) {
+    [_requestMetrics addObject:metrics];
+    if (_requestMetrics.count > kMaxRequestMetrics) {
+      [_requestMetrics removeObjectAtIndex:0];
+    }
+  }
 }
 
 @end
@@ -0,0 +1,56 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+#import "CdmWrapper.h"
+
+@class LicenseManager;
+
+// The license operations the scheduler needs from the CDM. Implemented by iOSCdm.
+@protocol LicenseRenewalCdm <NSObject>
+- (void)getLicenseInfo:(NSData *)psshKey
+       completionBlock:(void (^)(int64_t *expiration, NSError *))completionBlock;
+- (void)renewOfflineLicenseForPsshKey:(NSData *)psshKey
+                      completionBlock:(void (^)(NSError *))completionBlock;
+@end
+
+@interface iOSCdm (LicenseRenewalScheduler) <LicenseRenewalCdm>
+@end
+
+// Renews offline licenses before they expire so that offline playback never waits on the license
+// server. The expiration of every persisted license is checked periodically and whenever the
+// device starts charging, but only while idle so that checks never compete with playback for the
+// CDM. Expirations are kept in the KeyMap, so the CDM is only asked about new or renewed licenses.
+// Licenses inside |renewalWindow| are renewed while the device is charging; licenses inside
+// |urgentRenewalWindow| are renewed on any check.
+@interface LicenseRenewalScheduler : NSObject
+
+- (instancetype)initWithLicenseManager:(LicenseManager *)licenseManager
+                                   cdm:(id<LicenseRenewalCdm>)cdm NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Starts the periodic checks. The first one runs once the app has been idle for |idleDelay|.
+- (void)start;
+- (void)stop;
+
+// Called as playback starts and stops. The scheduler is not idle while any playback is active, nor
+// for |idleDelay| after the last one stops.
+- (void)playbackDidStart;
+- (void)playbackDidStop;
+
+// Checks every persisted license and renews the ones that are due. |completion| is called on an
+// arbitrary queue with the number of licenses renewed.
+- (void)checkLicensesWithCompletion:(void (^)(NSUInteger renewed))completion;
+
+// Seconds before expiration from which a license is renewed while charging. Defaults to 3 days.
+@property(nonatomic) NSTimeInterval renewalWindow;
+// Seconds before expiration from which a license is renewed regardless of power. Defaults to 1 day.
+@property(nonatomic) NSTimeInterval urgentRenewalWindow;
+// Seconds without playback before the scheduler is idle, counted from init. Defaults to 5 minutes.
+@property(nonatomic) NSTimeInterval idleDelay;
+// Whether periodic and charging checks may run.
+@property(readonly, getter=isIdle) BOOL idle;
+// Whether the device is charging. Tracked from UIDevice once started.
+@property(atomic) BOOL charging;
+
+@end
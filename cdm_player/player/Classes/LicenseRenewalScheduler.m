@@ -0,0 +1,232 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "LicenseRenewalScheduler.h"
+
+#import <UIKit/UIKit.h>
+
+#import "LicenseManager.h"
+#import "Logging.h"
+
+static const NSTimeInterval kCheckInterval = 60 * 60;
+// Checks are not time critical; a generous leeway lets the system batch the wake up.
+static const NSTimeInterval kCheckLeeway = 10 * 60;
+static const NSTimeInterval kDefaultRenewalWindow = 3 * 24 * 60 * 60;
+static const NSTimeInterval kDefaultUrgentRenewalWindow = 24 * 60 * 60;
+static const NSTimeInterval kDefaultIdleDelay = 5 * 60;
+
+@implementation iOSCdm (LicenseRenewalScheduler)
+@end
+
+@implementation LicenseRenewalScheduler {
+  __weak LicenseManager *_licenseManager;
+  id<LicenseRenewalCdm> _cdm;
+  dispatch_queue_t _queue;
+  dispatch_source_t _timer;
+  // PSSHs with a renewal in flight.
+  NSMutableSet<NSData *> *_renewing;
+  // Number of playbacks in progress and the time the last one started or stopped. Guarded by
+  // _queue.
+  NSUInteger _activePlaybacks;
+  CFAbsoluteTime _lastPlaybackActivity;
+  id _batteryObserver;
+}
+
+- (instancetype)initWithLicenseManager:(LicenseManager *)licenseManager
+                                   cdm:(id<LicenseRenewalCdm>)cdm {
+  self = [super init];
+  if (self) {
+    _licenseManager = licenseManager;
+    _cdm = cdm;
+    dispatch_queue_attr_t attr =
+        dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+    _queue = dispatch_queue_create("com.google.widevine.cdm-player.renewal", attr);
+    _renewing = [NSMutableSet set];
+    _renewalWindow = kDefaultRenewalWindow;
+    _urgentRenewalWindow = kDefaultUrgentRenewalWindow;
+    _idleDelay = kDefaultIdleDelay;
+    // The app is launching, which is when playback is most likely to start.
+    _lastPlaybackActivity = CFAbsoluteTimeGetCurrent();
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+}
+
+- (void)start {
+  if (_timer) {
+    return;
+  }
+  _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+  __weak LicenseRenewalScheduler *weakSelf = self;
+  dispatch_source_set_event_handler(_timer, ^{
+    [weakSelf checkLicensesIfIdle];
+  });
+  dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, _idleDelay * NSEC_PER_SEC),
+                            kCheckInterval * NSEC_PER_SEC, kCheckLeeway * NSEC_PER_SEC);
+  dispatch_resume(_timer);
+
+  dispatch_async(dispatch_get_main_queue(), ^{
+    UIDevice *device = [UIDevice currentDevice];
+    device.batteryMonitoringEnabled = YES;
+    [weakSelf updateBatteryState:device.batteryState];
+    _batteryObserver = [[NSNotificationCenter defaultCenter]
+        addObserverForName:UIDeviceBatteryStateDidChangeNotification
+                    object:device
+                     queue:[NSOperationQueue mainQueue]
+                usingBlock:^(NSNotification *note) {
+                  [weakSelf updateBatteryState:device.batteryState];
+                }];
+  });
+}
+
+- (void)stop {
+  if (_timer) {
+    dispatch_source_cancel(_timer);
+    _timer = nil;
+  }
+  if (_batteryObserver) {
+    [[NSNotificationCenter defaultCenter] removeObserver:_batteryObserver];
+    _batteryObserver = nil;
+  }
+}
+
+- (void)playbackDidStart {
+  dispatch_async(_queue, ^{
+    _activePlaybacks++;
+    _lastPlaybackActivity = CFAbsoluteTimeGetCurrent();
+  });
+}
+
+- (void)playbackDidStop {
+  dispatch_async(_queue, ^{
+    if (_activePlaybacks) {
+      _activePlaybacks--;
+    }
+    _lastPlaybackActivity = CFAbsoluteTimeGetCurrent();
+  });
+}
+
+- (BOOL)isIdle {
+  __block BOOL idle = NO;
+  dispatch_sync(_queue, ^{
+    idle = [self idleOnQueue];
+  });
+  return idle;
+}
+
+- (void)checkLicensesWithCompletion:(void (^)(NSUInteger renewed))completion {
+  dispatch_async(_queue, ^{
+    NSArray<NSData *> *psshKeys = [_licenseManager offlinePsshKeys];
+    dispatch_group_t group = dispatch_group_create();
+    __block NSUInteger renewed = 0;
+    for (NSData *psshKey in psshKeys) {
+      if ([_renewing containsObject:psshKey]) {
+        continue;
+      }
+      dispatch_group_enter(group);
+      [self expirationForPsshKey:psshKey completion:^(NSNumber *expiration) {
+        if (!expiration || ![self shouldRenewLicenseExpiringAt:expiration.longLongValue]) {
+          dispatch_group_leave(group);
+          return;
+        }
+        [self renewPsshKey:psshKey completion:^(BOOL success) {
+          renewed += success;
+          dispatch_group_leave(group);
+        }];
+      }];
+    }
+    dispatch_group_notify(group, _queue, ^{
+      if (renewed) {
+        CDMLogInfo(@"Renewed %tu offline licenses", renewed);
+      }
+      if (completion) {
+        completion(renewed);
+      }
+    });
+  });
+}
+
+#pragma mark - private methods
+
+- (void)updateBatteryState:(UIDeviceBatteryState)batteryState {
+  BOOL charging =
+      batteryState == UIDeviceBatteryStateCharging || batteryState == UIDeviceBatteryStateFull;
+  if (charging == self.charging) {
+    return;
+  }
+  self.charging = charging;
+  if (charging) {
+    dispatch_async(_queue, ^{
+      [self checkLicensesIfIdle];
+    });
+  }
+}
+
+// Called on |_queue|.
+- (BOOL)idleOnQueue {
+  return !_activePlaybacks && CFAbsoluteTimeGetCurrent() - _lastPlaybackActivity >= _idleDelay;
+}
+
+// Called on |_queue|. A check skipped during playback is made up by the next periodic one.
+- (void)checkLicensesIfIdle {
+  if ([self idleOnQueue]) {
+    [self checkLicensesWithCompletion:nil];
+  }
+}
+
+- (BOOL)shouldRenewLicenseExpiringAt:(int64_t)expiration {
+  if (expiration <= 0) {
+    return NO;
+  }
+  NSTimeInterval remaining = expiration / 1000.0 - [[NSDate date] timeIntervalSince1970];
+  if (remaining <= _urgentRenewalWindow) {
+    return YES;
+  }
+  return self.charging && remaining <= _renewalWindow;
+}
+
+// Calls |completion| on |_queue| with the expiration of |psshKey| recorded in the KeyMap, querying
+// the CDM for it if needed. The expiration is nil if the CDM could not report it.
+- (void)expirationForPsshKey:(NSData *)psshKey completion:(void (^)(NSNumber *))completion {
+  LicenseManager *licenseManager = _licenseManager;
+  NSNumber *expiration = [licenseManager licenseExpirationForPssh:psshKey];
+  if (expiration) {
+    completion(expiration);
+    return;
+  }
+  [_cdm getLicenseInfo:psshKey
+       completionBlock:^(int64_t *expiration, NSError *error) {
+         NSNumber *value = expiration ? @(*expiration) : nil;
+         dispatch_async(_queue, ^{
+           if (error) {
+             CDMLogNSError(error, @"getting license expiration");
+           }
+           if (value) {
+             [licenseManager setLicenseExpiration:value forPssh:psshKey];
+           }
+           completion(value);
+         });
+       }];
+}
+
+// Calls |completion| on |_queue| once |psshKey| has been renewed or failed to renew.
+- (void)renewPsshKey:(NSData *)psshKey completion:(void (^)(BOOL success))completion {
+  [_renewing addObject:psshKey];
+  [_cdm renewOfflineLicenseForPsshKey:psshKey
+                      completionBlock:^(NSError *error) {
+                        dispatch_async(_queue, ^{
+                          [_renewing removeObject:psshKey];
+                          if (error) {
+                            CDMLogNSError(error, @"renewing offline license");
+                          } else {
+                            // Read the new expiration on the next check.
+                            [_licenseManager setLicenseExpiration:nil forPssh:psshKey];
+                          }
+                          completion(!error);
+                        });
+                      }];
+}
+
+@end
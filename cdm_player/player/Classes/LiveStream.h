@@ -1,10 +1,13 @@
 // Copyright 2015 Google Inc. All rights reserved.
 // Object contained within a Stream object to store details for non-SegmentBase.
-@interface LiveStream : NSObject
+@interface LiveStream : NSObject <NSSecureCoding>
 
 // All properties are optional and only stored if found within the manifest.
 // Date establishing when stream was created, corresponds to first segment.
 @property NSDate *availabilityStartTime;
+// Seconds before its end from which a segment can be requested. Chunked CMAF streams are
+// available a chunk after they start, so the chunks last segmentDuration minus this.
+@property NSTimeInterval availabilityTimeOffset;
 // Duration of Stream
 @property NSUInteger duration;
 // URL for the Init file, if present
@@ -12,19 +15,25 @@
 // Media File name property. May contain wildcards (i.e $Number$)
 // See https://gpac.wp.mines-telecom.fr/mp4box/dash
 @property NSString *mediaFileName;
-// Determines how many segments to include beyond current playing segment.
-@property NSUInteger minBufferTime;
-// Minumum amount of time allowed before making another playlist request.
-@property NSUInteger minimumUpdatePeriod;
+// Determines how many segments to include beyond current playing segment, in seconds.
+@property NSTimeInterval minBufferTime;
+// Minumum amount of time in seconds allowed before making another playlist request.
+@property NSTimeInterval minimumUpdatePeriod;
 // ID of the specific stream.
 @property NSString *representationId;
 // Retrieved or calculated duration of each segment within the stream.
 @property float segmentDuration;
+// Start time of every segment in a SegmentTimeline followed by the end of the last one, in
+// |timescale| units. Nil when the manifest has no SegmentTimeline.
+@property(copy) NSArray<NSNumber *> *segmentTimeline;
 // Number of first segment to be used/created.
 @property NSUInteger startNumber;
 // Value pulled from the manifest to determine the length of the segments.
 @property NSUInteger timescale;
-// Determines how long to keep previously played segments in the playlist.
-@property NSUInteger timeShiftBufferDepth;
+// Determines how long in seconds to keep previously played segments in the playlist.
+@property NSTimeInterval timeShiftBufferDepth;
+
+// Returns YES if every property of |liveStream| is equal to the receiver's.
+- (BOOL)isEqualToLiveStream:(LiveStream *)liveStream;
 
 @end
@@ -3,23 +3,31 @@
 #import "LocalWebConnection.h"
 
 #import "LocalWebServer.h"
+#import "Logging.h"
 
-// Handles incoming HTTP request to the |LocalWebServer|.
+// Handles incoming HTTP request to the |LocalWebServer|, passing them to the Streaming object of
+// their path prefix.
 @implementation LocalWebConnection {
-  Streaming *_streaming;
+  LocalWebServer *_server;
 }
 
 - (id)initWithAsyncSocket:(GCDAsyncSocket *)newSocket configuration:(HTTPConfig *)aConfig {
   self = [super initWithAsyncSocket:newSocket configuration:aConfig];
   if (self) {
     if ([aConfig.server class] == [LocalWebServer class]) {
-      _streaming = ((LocalWebServer *)config.server).streaming;
+      _server = (LocalWebServer *)config.server;
     }
   }
   return self;
 }
 
 - (NSObject<HTTPResponse> *)httpResponseForMethod:(NSString *)method URI:(NSString *)path {
-  return [_streaming responseForMethod:method path:path connection:self];
+  NSString *relativePath = nil;
+  Streaming *streaming = [_server streamingForPath:path relativePath:&relativePath];
+  if (!streaming) {
+    CDMLogWarn(@"no playback session serves %@", path);
+    return nil;
+  }
+  return [streaming responseForMethod:method path:relativePath connection:self];
 }
 @end
@@ -3,12 +3,28 @@
 #import "HTTPServer.h"
 #import "Streaming.h"
 
-// Web server running locally in the app.
+// Web server running locally in the app, shared by every Streaming object.
+// Started once at launch on the loopback interface, which it never leaves. Sessions played over
+// AirPlay are also served by a separate listener on the network interface, which only serves their
+// prefixes and runs while at least one of them does. Nothing is published over Bonjour. Each
+// Streaming object is served under its own random path prefix.
 @interface LocalWebServer : HTTPServer
-@property(nonatomic) NSURL *rootURL;
-@property(nonatomic, readonly) NSString *hostname;
 @property(nonatomic, readonly) dispatch_queue_t connectionQueue;
-@property(nonatomic) Streaming *streaming;
 
-- (id)initWithStreaming:(Streaming *)streaming;
++ (LocalWebServer *)sharedInstance;
+// Serves the requests under a new random path prefix with |streaming|, which is not retained.
+// Returns the prefix.
+- (NSString *)addStreaming:(Streaming *)streaming;
+// Also serves the requests under |prefix|, returned by addStreaming:, on the interface with
+// |address|, e.g. that of Wi-Fi while AirPlay is active. Starts the AirPlay listener, or moves it
+// to |address| if it listens on another interface. Returns its port, or 0 on failure.
+- (UInt16)listenForPrefix:(NSString *)prefix onAddress:(NSString *)address error:(NSError **)errPtr;
+// Stops serving the requests under |prefix| on the AirPlay listener, which stops once it serves
+// no prefix.
+- (void)stopListeningForPrefix:(NSString *)prefix;
+// Stops serving the requests under |prefix|, on the loopback interface and the AirPlay listener.
+- (void)removeStreamingWithPrefix:(NSString *)prefix;
+// Returns the Streaming object serving |path| and sets |relativePath| to the rest of the path, e.g.
+// @"/0-5.ts". Returns nil if no Streaming object serves |path|.
+- (Streaming *)streamingForPath:(NSString *)path relativePath:(NSString **)relativePath;
 @end
@@ -4,36 +4,140 @@
 
 #import "LocalWebConnection.h"
 
-NSString *kHttpPrefix = @"http://%@";
-NSString *kHost = @"%@:%d";
+static NSString *const kSessionPrefixFormat = @"/%@";
+// Interface the shared server listens on.
+static NSString *const kLoopbackInterface = @"localhost";
 
-@implementation LocalWebServer
+@implementation LocalWebServer {
+  // Streaming objects by the prefix of their paths. Guarded by itself; requests are handled on
+  // the connection queues.
+  NSMapTable<NSString *, Streaming *> *_streamings;
+  // Listener serving the sessions played over AirPlay on the network interface, or nil while
+  // there are none. Only used by the shared server, guarded by _streamings.
+  LocalWebServer *_airplayServer;
+}
+
++ (LocalWebServer *)sharedInstance {
+  static LocalWebServer *sharedInstance = nil;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedInstance = [[LocalWebServer alloc] init];
+  });
+  return sharedInstance;
+}
 
-- (id)initWithStreaming:(Streaming *)streaming {
+- (id)init {
+  return [self initWithInterface:kLoopbackInterface];
+}
+
+- (id)initWithInterface:(NSString *)interface {
   self = [super init];
   if (self) {
-    _streaming = streaming;
+    _streamings = [NSMapTable strongToWeakObjectsMapTable];
+    // No Bonjour type, so the service is not published. The port is picked by the system.
+    [self setInterface:interface];
+    [self setConnectionClass:[LocalWebConnection class]];
   }
   return self;
 }
 
 - (BOOL)start:(NSError *__autoreleasing *)errPtr {
-  if (self.isRunning) {
+  @synchronized(self) {
+    if (self.isRunning) {
+      return YES;
+    }
+    if (![super start:errPtr]) {
+      return NO;
+    }
+    // Keep the port when listening on another interface, so playlist URLs stay valid.
+    [self setPort:self.listeningPort];
     return YES;
   }
-  [self setPort:_streaming.httpPort];
-  [self setType:@"_http._tcp."];
-  [self setInterface:_streaming.address];
-  [self setConnectionClass:[LocalWebConnection class]];
-  BOOL success = [super start:errPtr];
-  if (success) {
-    _rootURL = [NSURL URLWithString:[NSString stringWithFormat:kHttpPrefix, [self hostname]]];
+}
+
+- (NSString *)addStreaming:(Streaming *)streaming {
+  @synchronized(_streamings) {
+    // Random, so that hosts reaching the server during AirPlay cannot guess them.
+    NSString *prefix = [NSString stringWithFormat:kSessionPrefixFormat, [NSUUID UUID].UUIDString];
+    [_streamings setObject:streaming forKey:prefix];
+    return prefix;
+  }
+}
+
+- (UInt16)listenForPrefix:(NSString *)prefix
+                onAddress:(NSString *)address
+                    error:(NSError *__autoreleasing *)errPtr {
+  @synchronized(_streamings) {
+    Streaming *streaming = [_streamings objectForKey:prefix];
+    if (!streaming || !address) {
+      return 0;
+    }
+    if (_airplayServer && ![_airplayServer.interface isEqualToString:address]) {
+      // The network address changed; only AirPlay sessions are served on the old one.
+      [_airplayServer stop];
+      [_airplayServer setInterface:address];
+    }
+    if (!_airplayServer) {
+      _airplayServer = [[LocalWebServer alloc] initWithInterface:address];
+    }
+    if (![_airplayServer start:errPtr]) {
+      return 0;
+    }
+    @synchronized(_airplayServer->_streamings) {
+      [_airplayServer->_streamings setObject:streaming forKey:prefix];
+    }
+    return _airplayServer.listeningPort;
+  }
+}
+
+- (void)stopListeningForPrefix:(NSString *)prefix {
+  if (!prefix) {
+    return;
+  }
+  @synchronized(_streamings) {
+    if (!_airplayServer) {
+      return;
+    }
+    NSUInteger count = 0;
+    @synchronized(_airplayServer->_streamings) {
+      [_airplayServer->_streamings removeObjectForKey:prefix];
+      // Weak entries of stopped sessions that were never removed do not count.
+      count = _airplayServer->_streamings.objectEnumerator.allObjects.count;
+    }
+    if (!count) {
+      [_airplayServer stop];
+      _airplayServer = nil;
+    }
   }
-  return success;
 }
 
-- (NSString *)hostname {
-  return [NSString stringWithFormat:kHost, _streaming.address, _streaming.httpPort];
+- (void)removeStreamingWithPrefix:(NSString *)prefix {
+  if (!prefix) {
+    return;
+  }
+  [self stopListeningForPrefix:prefix];
+  @synchronized(_streamings) {
+    [_streamings removeObjectForKey:prefix];
+  }
+}
+
+- (Streaming *)streamingForPath:(NSString *)path relativePath:(NSString **)relativePath {
+  if (![path hasPrefix:@"/"]) {
+    return nil;
+  }
+  NSRange separator = [path rangeOfString:@"/" options:0 range:NSMakeRange(1, path.length - 1)];
+  if (separator.location == NSNotFound) {
+    return nil;
+  }
+  NSString *prefix = [path substringToIndex:separator.location];
+  Streaming *streaming = nil;
+  @synchronized(_streamings) {
+    streaming = [_streamings objectForKey:prefix];
+  }
+  if (streaming && relativePath) {
+    *relativePath = [path substringFromIndex:separator.location];
+  }
+  return streaming;
 }
 
 - (dispatch_queue_t)connectionQueue {
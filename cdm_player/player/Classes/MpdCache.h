@@ -0,0 +1,33 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+@class Stream;
+@class Streaming;
+
+// On disk cache of parsed manifests, so that reopening a title does not parse its MPD again.
+// Entries are keyed by MPD URL and hold the streams parsed from it along with the HTTP
+// validators of the response, which are used to check that the manifest has not changed.
+@interface MpdCache : NSObject
+
+// Cache in Library/Caches/MpdCache/.
++ (MpdCache *)sharedInstance;
+
+// Creates a cache storing its entries in |directoryURL|, a directory URL.
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Returns new Stream objects for the cached manifest of |mpdURL|, owned by |streaming|, and sets
+// |validators| to the validators they were stored with. Returns nil if nothing usable is cached.
+- (NSArray<Stream *> *)streamsForMpdURL:(NSURL *)mpdURL
+                              streaming:(Streaming *)streaming
+                             validators:(NSDictionary<NSString *, NSString *> **)validators;
+// Stores |streams| as parsed from the manifest of |mpdURL|. Written in the background.
+- (void)setStreams:(NSArray<Stream *> *)streams
+        validators:(NSDictionary<NSString *, NSString *> *)validators
+         forMpdURL:(NSURL *)mpdURL;
+- (void)removeStreamsForMpdURL:(NSURL *)mpdURL;
+// Blocks until all pending writes have finished.
+- (void)synchronize;
+
+@end
@@ -0,0 +1,148 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "MpdCache.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "Logging.h"
+#import "Stream.h"
+
+// Bumped whenever the archived Stream fields change, so older entries are parsed again.
+static const NSInteger kMpdCacheVersion = 4;
+static NSString *const kMpdCacheDirectoryName = @"MpdCache";
+static NSString *const kMpdCacheVersionKey = @"version";
+static NSString *const kMpdCacheURLKey = @"mpdURL";
+static NSString *const kMpdCacheValidatorsKey = @"validators";
+static NSString *const kMpdCacheStreamsKey = @"streams";
+
+@implementation MpdCache {
+  NSURL *_directoryURL;
+  // Serializes writes and removals.
+  dispatch_queue_t _writeQueue;
+}
+
++ (MpdCache *)sharedInstance {
+  static MpdCache *sharedInstance = nil;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    NSURL *cachesURL = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory
+                                                              inDomains:NSUserDomainMask][0];
+    sharedInstance = [[MpdCache alloc]
+        initWithDirectoryURL:[cachesURL URLByAppendingPathComponent:kMpdCacheDirectoryName
+                                                        isDirectory:YES]];
+  });
+  return sharedInstance;
+}
+
+- (instancetype)initWithDirectoryURL:(NSURL *)directoryURL {
+  NSParameterAssert(directoryURL);
+  self = [super init];
+  if (self) {
+    _directoryURL = directoryURL;
+    _writeQueue =
+        dispatch_queue_create("com.google.widevine.cdm-player.mpd-cache", DISPATCH_QUEUE_SERIAL);
+    NSError *error = nil;
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL
+                             withIntermediateDirectories:YES
+                                              attributes:nil
+                                                   error:&error];
+    CDMLogNSError(error, @"creating %@", directoryURL);
+  }
+  return self;
+}
+
+- (NSArray<Stream *> *)streamsForMpdURL:(NSURL *)mpdURL
+                              streaming:(Streaming *)streaming
+                             validators:(NSDictionary<NSString *, NSString *> **)validators {
+  NSData *data = [NSData dataWithContentsOfURL:[self entryURLForMpdURL:mpdURL]];
+  if (!data) {
+    return nil;
+  }
+  NSDictionary *entry = nil;
+  NSSet *classes = [NSSet setWithObjects:[NSDictionary class], [NSArray class], [NSString class],
+                                         [NSNumber class], [NSURL class], [Period class],
+                                         [Stream class], nil];
+  // Malformed archives raise rather than returning nil.
+  @try {
+    NSKeyedUnarchiver *unarchiver = [[NSKeyedUnarchiver alloc] initForReadingWithData:data];
+    unarchiver.requiresSecureCoding = YES;
+    entry = [unarchiver decodeObjectOfClasses:classes forKey:NSKeyedArchiveRootObjectKey];
+    [unarchiver finishDecoding];
+  } @catch (NSException *exception) {
+    CDMLogWarn(@"discarding unreadable cache entry for %@: %@", mpdURL, exception.reason);
+  }
+  if (![entry isKindOfClass:[NSDictionary class]]) {
+    [self removeStreamsForMpdURL:mpdURL];
+    return nil;
+  }
+  NSArray<Stream *> *streams = entry[kMpdCacheStreamsKey];
+  NSDictionary<NSString *, NSString *> *entryValidators = entry[kMpdCacheValidatorsKey];
+  // Entries are named by a hash of the URL; the stored URL guards against collisions.
+  if (![entry[kMpdCacheVersionKey] isEqual:@(kMpdCacheVersion)] ||
+      ![entry[kMpdCacheURLKey] isEqual:mpdURL.absoluteString] ||
+      ![streams isKindOfClass:[NSArray class]] || !streams.count ||
+      ![entryValidators isKindOfClass:[NSDictionary class]]) {
+    [self removeStreamsForMpdURL:mpdURL];
+    return nil;
+  }
+  for (Stream *stream in streams) {
+    if (![stream isKindOfClass:[Stream class]]) {
+      [self removeStreamsForMpdURL:mpdURL];
+      return nil;
+    }
+    stream.streaming = streaming;
+  }
+  if (validators) {
+    *validators = entryValidators;
+  }
+  return streams;
+}
+
+- (void)setStreams:(NSArray<Stream *> *)streams
+        validators:(NSDictionary<NSString *, NSString *> *)validators
+         forMpdURL:(NSURL *)mpdURL {
+  NSParameterAssert(mpdURL);
+  if (!streams.count || !validators.count) {
+    return;
+  }
+  // Archived on the caller's queue, as the streams change once playback starts.
+  NSData *data = [NSKeyedArchiver archivedDataWithRootObject:@{
+    kMpdCacheVersionKey : @(kMpdCacheVersion),
+    kMpdCacheURLKey : mpdURL.absoluteString,
+    kMpdCacheValidatorsKey : validators,
+    kMpdCacheStreamsKey : streams,
+  }];
+  NSURL *entryURL = [self entryURLForMpdURL:mpdURL];
+  dispatch_async(_writeQueue, ^{
+    NSError *error = nil;
+    [data writeToURL:entryURL options:NSDataWritingAtomic error:&error];
+    CDMLogNSError(error, @"caching %@", mpdURL);
+  });
+}
+
+- (void)removeStreamsForMpdURL:(NSURL *)mpdURL {
+  NSURL *entryURL = [self entryURLForMpdURL:mpdURL];
+  dispatch_async(_writeQueue, ^{
+    [[NSFileManager defaultManager] removeItemAtURL:entryURL error:nil];
+  });
+}
+
+- (void)synchronize {
+  dispatch_sync(_writeQueue, ^{
+  });
+}
+
+#pragma mark - private methods
+
+- (NSURL *)entryURLForMpdURL:(NSURL *)mpdURL {
+  NSData *urlData = [mpdURL.absoluteString dataUsingEncoding:NSUTF8StringEncoding];
+  unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+  CC_SHA1(urlData.bytes, (CC_LONG)urlData.length, digest);
+  NSMutableString *name = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+  for (size_t i = 0; i < CC_SHA1_DIGEST_LENGTH; ++i) {
+    [name appendFormat:@"%02x", digest[i]];
+  }
+  return [_directoryURL URLByAppendingPathComponent:name isDirectory:NO];
+}
+
+@end
@@ -0,0 +1,525 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "MpdDocument.h"
+
+namespace {
+
+// Parses the leading decimal digits of |value|, saturating on overflow. Like
+// -[NSString integerValue], anything after them is ignored.
+uint64_t ParseUint64(MpdStringPiece value) {
+  value = value.Trim();
+  uint64_t result = 0;
+  for (char c : value) {
+    if (c < '0' || c > '9') {
+      break;
+    }
+    uint64_t digit = c - '0';
+    if (result > (UINT64_MAX - digit) / 10) {
+      return UINT64_MAX;
+    }
+    result = result * 10 + digit;
+  }
+  return result;
+}
+
+uint32_t ParseUint32(MpdStringPiece value) {
+  uint64_t result = ParseUint64(value);
+  return result > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(result);
+}
+
+int64_t ParseInt64(MpdStringPiece value) {
+  value = value.Trim();
+  if (value.starts_with("-")) {
+    uint64_t magnitude = ParseUint64(value.substr(1));
+    return magnitude > INT64_MAX ? INT64_MIN : -static_cast<int64_t>(magnitude);
+  }
+  uint64_t result = ParseUint64(value);
+  return result > INT64_MAX ? INT64_MAX : static_cast<int64_t>(result);
+}
+
+// Parses "first-last". Ranges without a '-' are left absent.
+MpdByteRange ParseByteRange(MpdStringPiece value) {
+  MpdByteRange range;
+  size_t dash = value.find('-');
+  if (dash != MpdStringPiece::npos) {
+    range.present = true;
+    range.first = ParseUint64(value.substr(0, dash));
+    range.last = ParseUint64(value.substr(dash + 1));
+  }
+  return range;
+}
+
+// Elements the builder understands, in the place it understands them.
+enum Element {
+  kOther,
+  kMpd,
+  kPeriod,
+  kAdaptationSet,
+  kRepresentation,
+  kBaseUrl,
+  kContentProtection,
+  kPssh,
+  kSegmentBase,
+  kSegmentList,
+  kSegmentTemplate,
+  kInitialization,
+  kSegmentTimeline,
+  kTimelineEntry,
+  kSegmentUrl,
+};
+
+struct ChildElement {
+  Element parent;
+  const char *name;
+  Element element;
+};
+
+// Local names of the elements read from each kind of parent.
+const ChildElement kChildElements[] = {
+    {kMpd, "Period", kPeriod},
+    {kMpd, "BaseURL", kBaseUrl},
+    {kPeriod, "AdaptationSet", kAdaptationSet},
+    {kPeriod, "BaseURL", kBaseUrl},
+    {kPeriod, "SegmentBase", kSegmentBase},
+    {kPeriod, "SegmentList", kSegmentList},
+    {kPeriod, "SegmentTemplate", kSegmentTemplate},
+    {kAdaptationSet, "Representation", kRepresentation},
+    {kAdaptationSet, "BaseURL", kBaseUrl},
+    {kAdaptationSet, "ContentProtection", kContentProtection},
+    {kAdaptationSet, "SegmentBase", kSegmentBase},
+    {kAdaptationSet, "SegmentList", kSegmentList},
+    {kAdaptationSet, "SegmentTemplate", kSegmentTemplate},
+    {kRepresentation, "BaseURL", kBaseUrl},
+    {kRepresentation, "ContentProtection", kContentProtection},
+    {kRepresentation, "SegmentBase", kSegmentBase},
+    {kRepresentation, "SegmentList", kSegmentList},
+    {kRepresentation, "SegmentTemplate", kSegmentTemplate},
+    {kContentProtection, "pssh", kPssh},
+    {kSegmentBase, "Initialization", kInitialization},
+    {kSegmentList, "Initialization", kInitialization},
+    {kSegmentList, "SegmentURL", kSegmentUrl},
+    {kSegmentList, "SegmentTimeline", kSegmentTimeline},
+    {kSegmentTemplate, "SegmentTimeline", kSegmentTimeline},
+    {kSegmentTimeline, "S", kTimelineEntry},
+};
+
+Element Classify(MpdStringPiece name, Element parent) {
+  for (const ChildElement &child : kChildElements) {
+    if (child.parent == parent && name == child.name) {
+      return child.element;
+    }
+  }
+  return kOther;
+}
+
+}  // namespace
+
+MpdSegmentInfo::MpdSegmentInfo()
+    : type(kNone),
+      timescale(1),
+      presentation_time_offset(0),
+      duration(0),
+      start_number(1),
+      has_timeline(false) {}
+
+MpdRepresentation::MpdRepresentation()
+    : bandwidth(0), width(0), height(0), audio_sampling_rate(0) {}
+
+MpdAdaptationSet::MpdAdaptationSet()
+    : width(0), height(0), audio_sampling_rate(0) {}
+
+// Builds the Mpd of an MpdDocument from the events of MpdXmlReader.
+class MpdDocumentBuilder : public MpdXmlHandler {
+ public:
+  explicit MpdDocumentBuilder(MpdDocument *document)
+      : document_(document),
+        mpd_(&document->mpd_),
+        error_(nullptr),
+        text_seen_(false),
+        representation_protection_(false),
+        segment_urls_replaced_(false) {}
+
+  const char *error() const { return error_; }
+
+  virtual bool StartElement(MpdStringPiece qualified_name,
+                            const MpdXmlAttribute *attributes,
+                            size_t attribute_count) override;
+  virtual bool EndElement(MpdStringPiece name) override;
+  virtual bool Text(MpdStringPiece text) override;
+
+ private:
+  // Returns |value|, decoded into the document if it has references.
+  MpdStringPiece Value(MpdStringPiece value);
+  // Element kind |depth| levels above the innermost open element.
+  Element Ancestor(size_t depth) const;
+  MpdSegmentInfo *SegmentInfo(Element level);
+  MpdStringPiece *BaseUrl(Element level);
+  std::vector<MpdContentProtection> *ContentProtection(Element level);
+  void StartSegment(Element element, MpdSegmentInfo *info);
+
+  MpdDocument *document_;
+  Mpd *mpd_;
+  const char *error_;
+  std::vector<Element> open_elements_;
+  // Whether the current BaseURL or pssh element has had its text.
+  bool text_seen_;
+  // Whether the current Representation replaced the inherited
+  // ContentProtections with its own.
+  bool representation_protection_;
+  // Whether the current SegmentList replaced the inherited SegmentURLs.
+  bool segment_urls_replaced_;
+};
+
+MpdStringPiece MpdDocumentBuilder::Value(MpdStringPiece value) {
+  if (value.find('&') == MpdStringPiece::npos) {
+    return value;
+  }
+  document_->unescaped_.push_back(std::string());
+  std::string *decoded = &document_->unescaped_.back();
+  MpdXmlReader::Unescape(value, decoded);
+  return MpdStringPiece(*decoded);
+}
+
+Element MpdDocumentBuilder::Ancestor(size_t depth) const {
+  return depth < open_elements_.size()
+             ? open_elements_[open_elements_.size() - 1 - depth]
+             : kOther;
+}
+
+MpdSegmentInfo *MpdDocumentBuilder::SegmentInfo(Element level) {
+  switch (level) {
+    case kPeriod:
+      return &mpd_->periods.back().segment;
+    case kAdaptationSet:
+      return &mpd_->periods.back().adaptation_sets.back().segment;
+    case kRepresentation:
+      return &mpd_->periods.back()
+                  .adaptation_sets.back()
+                  .representations.back()
+                  .segment;
+    default:
+      return nullptr;
+  }
+}
+
+MpdStringPiece *MpdDocumentBuilder::BaseUrl(Element level) {
+  switch (level) {
+    case kMpd:
+      return &mpd_->base_url;
+    case kPeriod:
+      return &mpd_->periods.back().base_url;
+    case kAdaptationSet:
+      return &mpd_->periods.back().adaptation_sets.back().base_url;
+    case kRepresentation:
+      return &mpd_->periods.back()
+                  .adaptation_sets.back()
+                  .representations.back()
+                  .base_url;
+    default:
+      return nullptr;
+  }
+}
+
+std::vector<MpdContentProtection> *MpdDocumentBuilder::ContentProtection(
+    Element level) {
+  switch (level) {
+    case kAdaptationSet:
+      return &mpd_->periods.back().adaptation_sets.back().content_protection;
+    case kRepresentation:
+      return &mpd_->periods.back()
+                  .adaptation_sets.back()
+                  .representations.back()
+                  .content_protection;
+    default:
+      return nullptr;
+  }
+}
+
+void MpdDocumentBuilder::StartSegment(Element element, MpdSegmentInfo *info) {
+  MpdSegmentInfo::Type type = element == kSegmentBase
+                                  ? MpdSegmentInfo::kBase
+                                  : element == kSegmentList
+                                        ? MpdSegmentInfo::kList
+                                        : MpdSegmentInfo::kTemplate;
+  // Only the same kind of segment information is inherited.
+  if (info->type != type) {
+    *info = MpdSegmentInfo();
+    info->type = type;
+  }
+  segment_urls_replaced_ = false;
+}
+
+bool MpdDocumentBuilder::StartElement(MpdStringPiece qualified_name,
+                                      const MpdXmlAttribute *attributes,
+                                      size_t attribute_count) {
+  MpdStringPiece name = qualified_name.LocalName();
+  Element element;
+  if (open_elements_.empty()) {
+    if (name != "MPD") {
+      error_ = "root element is not an MPD";
+      return false;
+    }
+    element = kMpd;
+  } else {
+    element = Classify(name, open_elements_.back());
+  }
+  Element parent = Ancestor(0);
+  open_elements_.push_back(element);
+  text_seen_ = false;
+
+  MpdSegmentInfo *segment = nullptr;
+  switch (element) {
+    case kPeriod:
+      mpd_->periods.push_back(MpdPeriod());
+      break;
+    case kAdaptationSet: {
+      const MpdPeriod &period = mpd_->periods.back();
+      MpdAdaptationSet adaptation_set;
+      adaptation_set.base_url = period.base_url;
+      adaptation_set.segment = period.segment;
+      mpd_->periods.back().adaptation_sets.push_back(adaptation_set);
+      break;
+    }
+    case kRepresentation: {
+      MpdAdaptationSet &adaptation_set =
+          mpd_->periods.back().adaptation_sets.back();
+      MpdRepresentation representation;
+      representation.mime_type = adaptation_set.mime_type;
+      representation.codecs = adaptation_set.codecs;
+      representation.width = adaptation_set.width;
+      representation.height = adaptation_set.height;
+      representation.frame_rate = adaptation_set.frame_rate;
+      representation.audio_sampling_rate = adaptation_set.audio_sampling_rate;
+      representation.base_url = adaptation_set.base_url;
+      representation.content_protection = adaptation_set.content_protection;
+      representation.segment = adaptation_set.segment;
+      adaptation_set.representations.push_back(representation);
+      representation_protection_ = false;
+      break;
+    }
+    case kContentProtection: {
+      std::vector<MpdContentProtection> *protection =
+          ContentProtection(parent);
+      if (parent == kRepresentation && !representation_protection_) {
+        protection->clear();
+        representation_protection_ = true;
+      }
+      protection->push_back(MpdContentProtection());
+      break;
+    }
+    case kSegmentBase:
+    case kSegmentList:
+    case kSegmentTemplate:
+      segment = SegmentInfo(parent);
+      StartSegment(element, segment);
+      break;
+    case kInitialization:
+      segment = SegmentInfo(Ancestor(2));
+      break;
+    case kSegmentUrl:
+      segment = SegmentInfo(Ancestor(2));
+      if (!segment_urls_replaced_) {
+        segment->segment_urls.clear();
+        segment_urls_replaced_ = true;
+      }
+      segment->segment_urls.push_back(MpdSegmentUrl());
+      break;
+    case kSegmentTimeline:
+      segment = SegmentInfo(Ancestor(2));
+      segment->has_timeline = true;
+      segment->timeline.clear();
+      break;
+    case kTimelineEntry: {
+      segment = SegmentInfo(Ancestor(3));
+      MpdTimelineEntry entry = {false, 0, 0, 0};
+      segment->timeline.push_back(entry);
+      break;
+    }
+    default:
+      break;
+  }
+
+  for (size_t i = 0; i < attribute_count; ++i) {
+    MpdStringPiece key = attributes[i].name;
+    MpdStringPiece value = Value(attributes[i].value.Trim());
+    switch (element) {
+      case kMpd:
+        if (key == "type") {
+          mpd_->type = value;
+        } else if (key == "profiles") {
+          mpd_->profiles = value;
+        } else if (key == "availabilityStartTime") {
+          mpd_->availability_start_time = value;
+        } else if (key == "mediaPresentationDuration") {
+          mpd_->media_presentation_duration = value;
+        } else if (key == "minBufferTime") {
+          mpd_->min_buffer_time = value;
+        } else if (key == "minimumUpdatePeriod") {
+          mpd_->minimum_update_period = value;
+        } else if (key == "timeShiftBufferDepth") {
+          mpd_->time_shift_buffer_depth = value;
+        }
+        break;
+      case kPeriod: {
+        MpdPeriod &period = mpd_->periods.back();
+        if (key == "id") {
+          period.id = value;
+        } else if (key == "start") {
+          period.start = value;
+        } else if (key == "duration") {
+          period.duration = value;
+        }
+        break;
+      }
+      case kAdaptationSet: {
+        MpdAdaptationSet &adaptation_set =
+            mpd_->periods.back().adaptation_sets.back();
+        if (key == "id") {
+          adaptation_set.id = value;
+        } else if (key == "contentType") {
+          adaptation_set.content_type = value;
+        } else if (key == "lang") {
+          adaptation_set.lang = value;
+        } else if (key == "mimeType") {
+          adaptation_set.mime_type = value;
+        } else if (key == "codecs") {
+          adaptation_set.codecs = value;
+        } else if (key == "width") {
+          adaptation_set.width = ParseUint32(value);
+        } else if (key == "height") {
+          adaptation_set.height = ParseUint32(value);
+        } else if (key == "frameRate") {
+          adaptation_set.frame_rate = value;
+        } else if (key == "audioSamplingRate") {
+          adaptation_set.audio_sampling_rate = ParseUint32(value);
+        }
+        break;
+      }
+      case kRepresentation: {
+        MpdRepresentation &representation =
+            mpd_->periods.back().adaptation_sets.back().representations.back();
+        if (key == "id") {
+          representation.id = value;
+        } else if (key == "bandwidth") {
+          representation.bandwidth = ParseUint64(value);
+        } else if (key == "mimeType") {
+          representation.mime_type = value;
+        } else if (key == "codecs") {
+          representation.codecs = value;
+        } else if (key == "width") {
+          representation.width = ParseUint32(value);
+        } else if (key == "height") {
+          representation.height = ParseUint32(value);
+        } else if (key == "frameRate") {
+          representation.frame_rate = value;
+        } else if (key == "audioSamplingRate") {
+          representation.audio_sampling_rate = ParseUint32(value);
+        }
+        break;
+      }
+      case kContentProtection: {
+        MpdContentProtection &protection =
+            ContentProtection(parent)->back();
+        if (key == "schemeIdUri") {
+          protection.scheme_id_uri = value;
+        } else if (key == "value") {
+          protection.value = value;
+        } else if (key.LocalName() == "default_KID") {
+          protection.default_kid = value;
+        }
+        break;
+      }
+      case kSegmentBase:
+      case kSegmentList:
+      case kSegmentTemplate:
+        if (key == "timescale") {
+          segment->timescale = ParseUint64(value);
+        } else if (key == "presentationTimeOffset") {
+          segment->presentation_time_offset = ParseUint64(value);
+        } else if (key == "duration") {
+          segment->duration = ParseUint64(value);
+        } else if (key == "startNumber") {
+          segment->start_number = ParseUint64(value);
+        } else if (key == "indexRange") {
+          segment->index_range = ParseByteRange(value);
+        } else if (key == "initialization" && element == kSegmentTemplate) {
+          segment->initialization_url = value;
+        } else if (key == "media" && element == kSegmentTemplate) {
+          segment->media = value;
+        } else if (key == "availabilityTimeOffset") {
+          segment->availability_time_offset = value;
+        }
+        break;
+      case kInitialization:
+        if (key == "range") {
+          segment->initialization_range = ParseByteRange(value);
+        } else if (key == "sourceURL") {
+          segment->initialization_url = value;
+        }
+        break;
+      case kSegmentUrl:
+        if (key == "media") {
+          segment->segment_urls.back().media = value;
+        } else if (key == "mediaRange") {
+          segment->segment_urls.back().media_range = ParseByteRange(value);
+        }
+        break;
+      case kTimelineEntry: {
+        MpdTimelineEntry &entry = segment->timeline.back();
+        if (key == "t") {
+          entry.has_start = true;
+          entry.start = ParseUint64(value);
+        } else if (key == "d") {
+          entry.duration = ParseUint64(value);
+        } else if (key == "r") {
+          entry.repeat = ParseInt64(value);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  return true;
+}
+
+bool MpdDocumentBuilder::EndElement(MpdStringPiece /* name */) {
+  open_elements_.pop_back();
+  return true;
+}
+
+bool MpdDocumentBuilder::Text(MpdStringPiece text) {
+  Element element = Ancestor(0);
+  if (element != kBaseUrl && element != kPssh) {
+    return true;
+  }
+  text = text.Trim();
+  if (text.empty() || text_seen_) {
+    return true;
+  }
+  text_seen_ = true;
+  if (element == kBaseUrl) {
+    *BaseUrl(Ancestor(1)) = Value(text);
+  } else {
+    ContentProtection(Ancestor(2))->back().pssh = Value(text);
+  }
+  return true;
+}
+
+MpdDocument::MpdDocument() : error_(nullptr), error_offset_(0) {}
+
+bool MpdDocument::Parse(const char *data, size_t length) {
+  mpd_ = Mpd();
+  unescaped_.clear();
+  MpdDocumentBuilder builder(this);
+  MpdXmlReader reader(&builder);
+  if (reader.Parse(data, length)) {
+    error_ = nullptr;
+    error_offset_ = 0;
+    return true;
+  }
+  error_ = builder.error() ? builder.error() : reader.error();
+  error_offset_ = reader.error_offset();
+  return false;
+}
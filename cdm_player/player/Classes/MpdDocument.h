@@ -0,0 +1,171 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Typed model of a DASH manifest built with MpdXmlReader.
+//
+// MpdDocument::Parse fills an Mpd of Periods, AdaptationSets and
+// Representations. Inheritable attributes, BaseURLs, ContentProtections and
+// segment information are resolved while parsing, so every Representation
+// carries the values that apply to it. String values are MpdStringPieces into
+// the parsed buffer, which must outlive the document; only values containing
+// character references are decoded into storage owned by the document.
+//
+// Only the C++ standard library is used so the model can be built, tested and
+// fuzzed off device.
+
+#ifndef CDM_PLAYER_MPDDOCUMENT_H_
+#define CDM_PLAYER_MPDDOCUMENT_H_
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "MpdXmlReader.h"
+
+struct MpdContentProtection {
+  MpdStringPiece scheme_id_uri;
+  MpdStringPiece value;
+  MpdStringPiece default_kid;
+  // Base64 text of the cenc:pssh child, if any.
+  MpdStringPiece pssh;
+};
+
+// A byte range such as indexRange="1555-1766"; |last| is inclusive.
+struct MpdByteRange {
+  MpdByteRange() : present(false), first(0), last(0) {}
+
+  bool present;
+  uint64_t first;
+  uint64_t last;
+};
+
+// An S element of a SegmentTimeline.
+struct MpdTimelineEntry {
+  bool has_start;
+  uint64_t start;
+  uint64_t duration;
+  // Number of additional segments; -1 repeats until the next entry or the end
+  // of the Period.
+  int64_t repeat;
+};
+
+// A SegmentURL of a SegmentList.
+struct MpdSegmentUrl {
+  MpdStringPiece media;
+  MpdByteRange media_range;
+};
+
+// The SegmentBase, SegmentList or SegmentTemplate that applies to a level,
+// merged with the ones inherited from the levels above it.
+struct MpdSegmentInfo {
+  enum Type { kNone, kBase, kList, kTemplate };
+
+  MpdSegmentInfo();
+
+  Type type;
+  uint64_t timescale;
+  uint64_t presentation_time_offset;
+  // Duration of each segment in |timescale| units, 0 if unknown.
+  uint64_t duration;
+  uint64_t start_number;
+  MpdByteRange index_range;
+  // Initialization@range.
+  MpdByteRange initialization_range;
+  // Initialization@sourceURL or SegmentTemplate@initialization.
+  MpdStringPiece initialization_url;
+  // SegmentTemplate@media.
+  MpdStringPiece media;
+  // Seconds before the end of a segment from which it can be requested, e.g.
+  // when a chunked CMAF packager sends each segment as it is produced.
+  MpdStringPiece availability_time_offset;
+  std::vector<MpdSegmentUrl> segment_urls;
+  bool has_timeline;
+  std::vector<MpdTimelineEntry> timeline;
+};
+
+struct MpdRepresentation {
+  MpdRepresentation();
+
+  MpdStringPiece id;
+  uint64_t bandwidth;
+  MpdStringPiece mime_type;
+  MpdStringPiece codecs;
+  uint32_t width;
+  uint32_t height;
+  MpdStringPiece frame_rate;
+  uint32_t audio_sampling_rate;
+  // Innermost BaseURL of the Representation, AdaptationSet or Period. The
+  // MPD's own BaseURL is kept in Mpd::base_url.
+  MpdStringPiece base_url;
+  std::vector<MpdContentProtection> content_protection;
+  MpdSegmentInfo segment;
+};
+
+struct MpdAdaptationSet {
+  MpdAdaptationSet();
+
+  MpdStringPiece id;
+  MpdStringPiece content_type;
+  MpdStringPiece lang;
+  MpdStringPiece mime_type;
+  MpdStringPiece codecs;
+  uint32_t width;
+  uint32_t height;
+  MpdStringPiece frame_rate;
+  uint32_t audio_sampling_rate;
+  MpdStringPiece base_url;
+  std::vector<MpdContentProtection> content_protection;
+  MpdSegmentInfo segment;
+  std::vector<MpdRepresentation> representations;
+};
+
+struct MpdPeriod {
+  MpdStringPiece id;
+  MpdStringPiece start;
+  MpdStringPiece duration;
+  MpdStringPiece base_url;
+  MpdSegmentInfo segment;
+  std::vector<MpdAdaptationSet> adaptation_sets;
+};
+
+struct Mpd {
+  MpdStringPiece type;
+  MpdStringPiece profiles;
+  MpdStringPiece availability_start_time;
+  MpdStringPiece media_presentation_duration;
+  MpdStringPiece min_buffer_time;
+  MpdStringPiece minimum_update_period;
+  MpdStringPiece time_shift_buffer_depth;
+  MpdStringPiece base_url;
+  std::vector<MpdPeriod> periods;
+};
+
+class MpdDocument {
+ public:
+  MpdDocument();
+
+  // Parses the manifest in |data|, which must outlive the document. Returns
+  // false if it is malformed or not an MPD, in which case everything parsed
+  // before the error is kept.
+  bool Parse(const char *data, size_t length);
+
+  const Mpd &mpd() const { return mpd_; }
+
+  // Static description of the last error, or nullptr.
+  const char *error() const { return error_; }
+  size_t error_offset() const { return error_offset_; }
+
+ private:
+  friend class MpdDocumentBuilder;
+
+  Mpd mpd_;
+  // Decoded values that contained character references. A deque keeps the
+  // strings in place as it grows.
+  std::deque<std::string> unescaped_;
+  const char *error_;
+  size_t error_offset_;
+
+  MpdDocument(const MpdDocument &) = delete;
+  MpdDocument &operator=(const MpdDocument &) = delete;
+};
+
+#endif  // CDM_PLAYER_MPDDOCUMENT_H_
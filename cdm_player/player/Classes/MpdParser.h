@@ -3,10 +3,12 @@
 #import "AppDelegate.h"
 #import "Stream.h"
 
-@interface MpdParser : NSObject <NSXMLParserDelegate>
+@interface MpdParser : NSObject
 
 // Array of streams found in the XML manifest.
 @property(nonatomic, strong) NSMutableArray<Stream *> *streams;
+// Periods of the manifest, in order. Every stream refers to one of them.
+@property(nonatomic, strong) NSArray<Period *> *periods;
 
 - (instancetype)initWithMpdData:(NSData *)mpdData;
 
@@ -17,6 +19,13 @@
                                      mpdData:(NSData *)mpdData
                                      baseURL:(NSURL *)baseURL
                                 storeOffline:(BOOL)storeOffline;
+// Applies a refreshed live manifest to |streams|, which were parsed from an earlier version of it.
+// Streams are matched by Period and Representation id and only their timing is updated, so
+// existing Stream objects and sessions are kept. Representations that were not there before are
+// ignored. Returns the streams that changed.
++ (NSArray<Stream *> *)updateStreams:(NSArray<Stream *> *)streams
+                         withMpdData:(NSData *)mpdData
+                             baseURL:(NSURL *)baseURL;
 
 // Convert MPEG Dash formatted duration into seconds.
 - (NSUInteger)convertDurationToSeconds:(NSString *)string;
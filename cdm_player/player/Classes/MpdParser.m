@@ -1,615 +0,0 @@
-// Copyright 2015 Google Inc. All rights reserved.
-
-#import "MpdParser.h"
-
-#import <objc/message.h>
-#import <objc/runtime.h>
-#import "Logging.h"
-#import "CdmPlayerHelpers.h"
-
-static NSString *const kDashAdaptationSet = @"AdaptationSet";
-static NSString *const kDashContentComponent = @"ContentComponent";
-static NSString *const kDashContentProtection = @"ContentProtection";
-static NSString *const kDashPeriod = @"Period";
-static NSString *const kDashRepresentation = @"Representation";
-static NSString *const kDashRepresentationBaseURL = @"BaseURL";
-static NSString *const kDashRepresentationBW = @"bandwidth";
-static NSString *const kDashRepresentationCodec = @"codecs";
-static NSString *const kDashRepresentationHeight = @"height";
-static NSString *const kDashRepresentationMime = @"mimeType";
-static NSString *const kDashRepresentationWidth = @"width";
-static NSString *const kDashSegmentBase = @"SegmentBase";
-static NSString *const kDashSegmentBaseIndexRange = @"indexRange";
-static NSString *const kDashSegmentBaseInitializationRange = @"range";
-static NSString *const kDashSegmentInitRange = @"Initialization";
-static NSString *const kDashSegmentList = @"SegmentList";
-static NSString *const kDashSegmentListURL = @"SegmentURL";
-static NSString *const kDashSegmentTemplate = @"SegmentTemplate";
-static NSString *const kDashSegmentTimeline = @"SegmentTimeline";
-
-static NSString *const kAttrAudioSampleRate = @"audioSamplingRate";
-static NSString *const kAttrBandwidth = @"bandwidth";
-static NSString *const kAttrCodecs = @"codecs";
-static NSString *const kAttrCodecAvc1 = @"avc1";
-static NSString *const kAttrCodecMp4a = @"mp4a";
-static NSString *const kAttrContentType = @"contentType";
-static NSString *const kAttrDuration = @"duration";
-static NSString *const kAttrHeight = @"height";
-static NSString *const kAttrId = @"id";
-static NSString *const kAttrIndexRange = @"indexRange";
-static NSString *const kAttrLang = @"lang";
-static NSString *const kAttrMimeType = @"mimeType";
-static NSString *const kAttrMimeTypeAudio = @"audio/";
-static NSString *const kAttrMimeTypeVideo = @"video/";
-static NSString *const kAttrNumChannels = @"numChannels";
-static NSString *const kAttrPssh = @"pssh";
-static NSString *const kAttrPsshCenc = @"cenc:pssh";
-static NSString *const kAttrSampleRate = @"sampleRate";
-static NSString *const kAttrWidth = @"width";
-
-static NSString *const kBoolNo = @"NO";
-static NSString *const kBoolYes = @"YES";
-static NSString *const kDashMediaType = @"dashMediaType";
-static NSString *const kDashToHlsString = @"DashToHls";
-static NSString *const kDashSeparator = @"-";
-static NSString *const kHttpString = @"http";
-static NSString *const kIsVideoString = @"isVideo";
-static NSString *const kNewLineCharacter = @"\n";
-static NSString *const kRootURL = @"rootURL";
-static NSString *const kSlashesString = @"//";
-static NSString *const kStreamingString = @"Streaming";
-static NSString *const kVideoString = @"video";
-static NSString *const kRegexPattern =
-    @"^P(?:(\\d{0,2})Y)?(?:(\\d{0,2})M)?(?:(\\d{0,2})D)"
-    @"?.(?:(\\d{0,2})H)?(?:(\\d{0,2})M)?(?:(\\d*[.]?\\d+)S)?$";
-
-@implementation MpdParser {
-  NSString *_currentElement;
-  NSDateFormatter *_dateFormat;
-  NSUInteger _maxAudioBandwidth;
-  NSUInteger _maxVideoBandwidth;
-  NSMutableDictionary *_mpdDict;
-  NSURL *_mpdURL;
-  NSInteger _offlineAudioIndex;
-  NSInteger _offlineVideoIndex;
-  NSXMLParser *_parser;
-  BOOL _playOffline;
-  NSRegularExpression *_regex;
-  BOOL _storeOffline;
-  NSInteger _streamCount;
-  Streaming *_streaming;
-}
-
-// Init methods.
-- (instancetype)initWithMpdData:(NSData *)mpdData {
-  return [self initWithStreaming:nil mpdData:mpdData baseURL:nil storeOffline:nil];
-}
-
-- (instancetype)initWithStreaming:(Streaming *)streaming
-                          mpdData:(NSData *)mpdData
-                          baseURL:(NSURL *)baseURL
-                     storeOffline:(BOOL)storeOffline {
-  self = [super init];
-  if (self) {
-    _mpdDict = [[NSMutableDictionary alloc] init];
-    _parser = [[NSXMLParser alloc] initWithData:mpdData];
-    _mpdURL = baseURL;
-    _streams = [[NSMutableArray alloc] init];
-    _streaming = streaming;
-    _storeOffline = storeOffline;
-    // Only files in the "Documents" path are considered offline files, for testing purposes.
-    _playOffline = [_mpdURL isFileURL] && [_mpdURL.pathComponents containsObject:@"Documents"];
-    if (_parser) {
-      [_parser setDelegate:self];
-      [_parser parse];
-    }
-  }
-  return self;
-}
-
-// External methods to be used to begin parsing.
-+ (NSArray *)parseMpdWithStreaming:(Streaming *)streaming
-                           mpdData:(NSData *)mpdData
-                           baseURL:(NSURL *)baseURL
-                      storeOffline:(BOOL)storeOffline {
-  // TODO(seawardt): Implement as a class method of Stream.
-  return [[MpdParser alloc] initWithStreaming:streaming
-                                      mpdData:mpdData
-                                      baseURL:baseURL
-                                 storeOffline:storeOffline]
-    .streams;
-}
-
-#pragma mark NSXMLParser methods -- start
-
-// Set stream counter to track the amout of streams found in the manifest.
-- (void)parserDidStartDocument:(NSXMLParser *)parser {
-  _streamCount = 0;
-}
-
-// XML Element found, being parsing.
-- (void)parser:(NSXMLParser *)parser
-didStartElement:(NSString *)elementName
-   namespaceURI:(NSString *)namespaceURI
-  qualifiedName:(NSString *)qName
-     attributes:(NSDictionary *)attributeDict {
-  _currentElement = elementName;
-  for (NSString *key in attributeDict) {
-    NSString *value = [[attributeDict valueForKey:key]
-                       stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
-    if ([elementName isEqualToString:kDashContentProtection]) {
-      // Reset PSSH for each Adapation Set.
-      [_mpdDict removeObjectForKey:kAttrPsshCenc];
-    }
-    // Check that value isnt blank.
-    if (([value length] != 0)) {
-      [_mpdDict setValue:value forKey:key];
-      if ([key isEqualToString:kDashRepresentationMime]) {
-        if ([value containsString:kVideoString]) {
-          [_mpdDict setValue:kBoolYes forKey:kIsVideoString];
-        } else {
-          [_mpdDict setValue:kBoolNo forKey:kIsVideoString];
-        }
-      }
-      if ([elementName hasPrefix:@"Segment"]) {
-        if (![self setDashMediaType:elementName]) {
-          [parser abortParsing];
-        }
-      }
-    }
-  }
-}
-
-// Characters found within an element that do not contain a specific key.
-- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string {
-  if (string) {
-    // Ignores values that contain two lines. If needed, modify as necessary.
-    if (![string containsString:kNewLineCharacter]) {
-      if ([string hasPrefix:kSlashesString]) {
-        [_mpdDict setValue:string forKey:kRootURL];
-      }
-      // Stores PSSH to dictionary
-      if ([_currentElement isEqualToString:kAttrPsshCenc]) {
-        [_mpdDict setValue:string forKey:kAttrPssh];
-      }
-      [_mpdDict setValue:string forKey:_currentElement];
-    }
-  }
-}
-
-// Finished parsing Element.
-- (void)parser:(NSXMLParser *)parser
- didEndElement:(NSString *)elementName
-  namespaceURI:(NSString *)namespaceURI
- qualifiedName:(NSString *)qName {
-  if ([elementName isEqualToString:kDashRepresentation]) {
-    // Setup stream if mimeType (video/mp4) and codec (avc1) are supported.
-    if ([[_mpdDict objectForKey:kAttrMimeType] containsString:kAttrMimeTypeVideo]) {
-      if ([[_mpdDict objectForKey:kAttrCodecs] containsString:kAttrCodecAvc1]) {
-        if (![self setStreamProperties:elementName]) {
-          [parser abortParsing];
-        }
-      }
-    }
-    // Setup stream if mimeType (audio/mp4) and codec (mp4a) are supported.
-    if ([[_mpdDict objectForKey:kAttrMimeType] containsString:kAttrMimeTypeAudio]) {
-      if ([[_mpdDict objectForKey:kAttrCodecs] containsString:kAttrCodecMp4a]) {
-        if (![self setStreamProperties:elementName]) {
-          [parser abortParsing];
-        }
-      }
-    }
-  }
-}
-
-// If parsing fails, this error will be returned.
-- (void)parser:(NSXMLParser *)parser parseErrorOccurred:(NSError *)parseError {
-  CDMLogNSError(parseError, @"parsing");
-}
-
-- (void)parserDidEndDocument:(NSXMLParser *)parser {
-}
-
-#pragma mark NSXMLParser methods -- end
-
-// Look up aviailable properties from Stream object and populate the required values.
-- (BOOL)setStreamProperties:(NSString *)elementName {
-  Stream *stream = [[Stream alloc] initWithStreaming:_streaming];
-  unsigned int numberOfProperties = 0;
-  unsigned int propertyIndex = 0;
-  objc_property_t *properties = class_copyPropertyList([Stream class], &numberOfProperties);
-  for (propertyIndex = 0; propertyIndex < numberOfProperties; propertyIndex++) {
-    objc_property_t property = properties[propertyIndex];
-    [self setProperty:stream property:property];
-  }
-  // Stream Complete
-  // TODO: Enable _storeOffline by downloading single video/audio stream (b/27264914)
-  _storeOffline = NO;
-  if (_storeOffline) {
-    [self storeOfflineStream:stream];
-  } else {
-    [_streams addObject:stream];
-    _streamCount++;
-  }
-  if ([self validateStreamAttributes:stream]) {
-    return YES;
-  }
-  return NO;
-}
-
-// Check Property type and determine attribute.
-- (NSString *)getPropertyType:(objc_property_t)property {
-  const char *attribute = property_getAttributes(property);
-  if (!attribute) {
-    CDMLogError(@"empty property attribute %@", property);
-    return nil;
-  }
-  NSString *attributeString = [NSString stringWithUTF8String:attribute];
-  NSArray *attributeArray = [attributeString componentsSeparatedByString:@","];
-  NSString *attributeSubstr = [[attributeArray objectAtIndex:0] substringFromIndex:1];
-  NSString *attributeStripped = [attributeSubstr stringByReplacingOccurrencesOfString:@"\""
-                                                                           withString:@""];
-
-  // Verify attribute values are valid.
-  if (!attributeStripped || [attributeStripped length] == 0) {
-    CDMLogError(@"empty property character %@", property);
-    return nil;
-  }
-
-  switch (attribute[1]) {
-    case '@':  // NSString
-      attributeString = [attributeStripped substringFromIndex:1];
-      break;
-    case 'I':  // NSUinteger 32-bit
-    case 'Q':  // NSUinteger 64-bit
-      attributeString = @"NSUInteger";
-      break;
-    case 'c':  // BOOL 32-bit
-    case 'B':  // BOOL 64-bit
-      attributeString = @"BOOL";
-      break;
-    case '^':  // Special Class
-      attributeString =
-          [[[attributeStripped substringFromIndex:2] componentsSeparatedByString:@"="] firstObject];
-      break;
-    case '{':
-      attributeString = @"NSRange";
-      break;
-    default: {
-      CDMLogError(@"no property matched %c", attribute[1]);
-      attributeString = nil;
-      break;
-    }
-  }
-  return attributeString;
-}
-
-// Uses available property in Stream object and value when property and key match.
-- (void)setProperty:(Stream *)stream property:(objc_property_t)property {
-  NSString *propertyName = [NSString stringWithUTF8String:property_getName(property)];
-  const char *attribute = property_getAttributes(property);
-  NSString *attributeString = [NSString stringWithUTF8String:attribute];
-  NSArray *attributeArray = [attributeString componentsSeparatedByString:@","];
-  NSString *attributeSubstr = [[attributeArray objectAtIndex:0] substringFromIndex:1];
-  NSString *attributeStripped = [attributeSubstr stringByReplacingOccurrencesOfString:@"\""
-                                                                           withString:@""];
-  NSString *propertyType = [attributeStripped substringFromIndex:1];
-  switch (attribute[1]) {
-    case '@':  // Char
-      if ([propertyType isEqualToString:@"NSURL"]) {
-        NSURL *value =
-            [self makeStreamURL:[_mpdDict objectForKey:kDashRepresentationBaseURL] init:NO];
-        [stream setValue:value forKey:propertyName];
-      }
-      if ([propertyType isEqualToString:@"NSData"]) {
-        NSData *value = [[NSData alloc] init];
-        if ([propertyName isEqualToString:@"pssh"]) {
-          NSString *psshString = [_mpdDict objectForKey:kAttrPsshCenc];
-          if (psshString) {
-            value = [[NSData alloc] initWithBase64EncodedString:psshString options:0];
-          }
-        }
-        [stream setValue:value forKey:propertyName];
-      }
-      if ([propertyType isEqualToString:@"NSString"]) {
-        NSString *value = [_mpdDict objectForKey:propertyName];
-        [stream setValue:value forKey:propertyName];
-      }
-      if ([propertyType isEqualToString:@"LiveStream"]) {
-        [self setLiveProperties:(Stream *)stream];
-      }
-      if ([propertyType isEqualToString:@"NSDate"]) {
-        [stream setValue:[NSDate dateWithTimeIntervalSince1970:0] forKey:propertyName];
-      }
-      break;
-    case 'I':  // NSUinteger 32-bit
-    case 'Q':  // NSUinteger 64-bit
-      if ([propertyName isEqualToString:@"streamIndex"]) {
-        [stream setValue:[NSNumber numberWithInteger:_streamCount] forKey:propertyName];
-      } else if ([propertyName isEqualToString:@"mediaPresentationDuration"]) {
-        NSUInteger value = [self convertDurationToSeconds:[_mpdDict objectForKey:propertyName]];
-        [stream setValue:[NSNumber numberWithInteger:value] forKey:propertyName];
-      } else {
-        NSUInteger value = [[_mpdDict objectForKey:propertyName] integerValue];
-        [stream setValue:[NSNumber numberWithInteger:value] forKey:propertyName];
-      }
-      break;
-    case 'c':  // BOOL 32-bit
-    case 'B':  // BOOL 64-bit
-      if (propertyName) {
-        BOOL value = [[_mpdDict objectForKey:propertyName] boolValue];
-        [stream setValue:[NSNumber numberWithBool:value] forKey:propertyName];
-      }
-      break;
-    case '^':  // Special Class
-      break;
-    case '{':
-      if ([propertyType isEqualToString:@"_NSRange=QQ}"]) {
-        NSRange value = [self extractInitialRange];
-        stream.initialRange = value;
-      }
-      if ([propertyType isEqualToString:@"_NSRange=II}"]) {
-        NSRange value = [self extractInitialRange];
-        stream.initialRange = value;
-      }
-      break;
-    default: {
-      CDMLogError(@"unknown property type %c", attribute[1]);
-      attributeString = nil;
-      break;
-    }
-  }
-}
-
-// Check each stream and store highest rates for video/audio.
-- (void)storeOfflineStream:(Stream *)stream {
-  // Look up higest bitrate
-  if (stream.isVideo) {
-    if (stream.bandwidth > _maxVideoBandwidth) {
-      if (_maxVideoBandwidth) {
-        [_streams replaceObjectAtIndex:_offlineVideoIndex withObject:stream];
-      } else {
-        [_streams addObject:stream];
-        _offlineVideoIndex = _streamCount;
-      }
-      _maxVideoBandwidth = stream.bandwidth;
-    }
-  } else {
-    if (stream.bandwidth > _maxAudioBandwidth) {
-      if (_maxAudioBandwidth) {
-        [_streams replaceObjectAtIndex:_offlineAudioIndex withObject:stream];
-      } else {
-        [_streams addObject:stream];
-        _offlineAudioIndex = _streamCount;
-      }
-      _maxAudioBandwidth = stream.bandwidth;
-    }
-  }
-}
-
-// Ensure all properties are populated from the MPD, otherwise return false.
-- (BOOL)validateStreamAttributes:(Stream *)stream {
-  BOOL attributeExists = YES;
-  unsigned int numberOfProperties, i;
-  objc_property_t *properties = class_copyPropertyList([Stream class], &numberOfProperties);
-  for (i = 0; i < numberOfProperties; i++) {
-    objc_property_t property = properties[i];
-    const char *propName = property_getName(property);
-    if (propName) {
-      NSString *propertyName = [NSString stringWithUTF8String:propName];
-      NSString *propertyType = [self getPropertyType:property];
-      if (![propertyType containsString:kDashToHlsString]) {
-        if (![propertyName isEqualToString:@"pssh"]) {
-          if (![propertyType isEqualToString:kStreamingString]) {
-            NSString *propertyValue = [stream valueForKey:propertyName];
-            if (!propertyValue) {
-              CDMLogWarn(@"Property of type %@ not set for stream %@", propertyType, propertyName);
-              attributeExists = NO;
-            }
-          }
-        }
-      }
-    }
-  }
-  return attributeExists;
-}
-
-// Determine what type of Dash Template is being used.
-- (BOOL)setDashMediaType:(NSString *)elementName {
-  // SegmentBase
-  if ([elementName isEqualToString:kDashSegmentBase]) {
-    [_mpdDict setValue:@(SEGMENT_BASE) forKey:kDashMediaType];
-  }
-  // SegmentList w/Duration
-  if ([elementName isEqualToString:kDashSegmentList]) {
-    [_mpdDict setValue:@(SEGMENT_LIST_DURATION) forKey:kDashMediaType];
-  }
-  // SegmentTemplate w/Duration
-  if ([elementName isEqualToString:kDashSegmentTemplate]) {
-    [_mpdDict setValue:@(SEGMENT_TEMPLATE_DURATION) forKey:kDashMediaType];
-  }
-  // SegmentTimeline
-  if ([elementName isEqualToString:kDashSegmentTimeline]) {
-    // SegmentTimeline is sub-section to SegmentList
-    if ([[_mpdDict valueForKey:kDashMediaType] isEqual:@(SEGMENT_LIST_DURATION)]) {
-      [_mpdDict setValue:[NSNumber numberWithUnsignedInteger:SEGMENT_LIST_TIMELINE]
-                  forKey:kDashMediaType];
-    }
-    // SegmentTimeline is sub-section to SegmentTemplate
-    if ([[_mpdDict valueForKey:kDashMediaType] isEqual:@(SEGMENT_TEMPLATE_DURATION)]) {
-      [_mpdDict setValue:[NSNumber numberWithUnsignedInteger:SEGMENT_TEMPLATE_TIMELINE]
-                  forKey:kDashMediaType];
-    }
-  }
-  if ([_mpdDict objectForKey:kDashMediaType]) {
-    return YES;
-  }
-  // DashMediaType has not been set.
-  return NO;
-}
-
-// Extract ranges from Dictionary, then parse and create Initialization Range.
-- (NSRange)extractInitialRange {
-  NSString *range = [_mpdDict objectForKey:kDashSegmentBaseInitializationRange];
-  [_mpdDict removeObjectForKey:kDashSegmentBaseInitializationRange];
-  NSArray *rangeValues = [range componentsSeparatedByString:kDashSeparator];
-  NSInteger startRange = [rangeValues[0] intValue];
-  NSString *indexRange = [_mpdDict objectForKey:kAttrIndexRange];
-  [_mpdDict removeObjectForKey:kAttrIndexRange];
-  NSArray *indexRangeValues = [indexRange componentsSeparatedByString:kDashSeparator];
-
-  NSInteger length = 0;
-  if (indexRangeValues && rangeValues) {
-    // Add 1 to avoid overlap in bytes to the length.
-    length = [indexRangeValues[1] intValue] + 1;
-    if (startRange >= length) {
-      CDMLogError(@"start range %zd is greater than length %zd", startRange, length);
-      return NSMakeRange(0, 0);
-    }
-    if (length == 0) {
-      CDMLogError(@"length %zd is not valid", length);
-    }
-  }
-  NSRange initialRange = NSMakeRange(startRange, length);
-  return initialRange;
-}
-
-// Parse MPEG Dash duration format and return seconds.
-// https://en.wikipedia.org/wiki/ISO_8601#Durations
-// TODO(seawardt): Implement support for Leap year and months that are not 30 days.
-- (NSUInteger)convertDurationToSeconds:(NSString *)string {
-  if (!string) {
-    return 0;
-  }
-  NSUInteger duration = 0;
-  NSRange searchRange = NSMakeRange(0, [string length]);
-
-  int years = 0;
-  int months = 0;
-  int days = 0;
-  int hours = 0;
-  int minutes = 0;
-  float seconds = 0;
-  if (!_regex) {
-    _regex = [NSRegularExpression regularExpressionWithPattern:kRegexPattern
-                                                       options:0
-                                                         error:nil];
-  }
-  NSTextCheckingResult *match =
-      [_regex firstMatchInString:string options:0 range:searchRange];
-  if (match) {
-    NSRange matchGroup1 = [match rangeAtIndex:1];
-    NSRange matchGroup2 = [match rangeAtIndex:2];
-    NSRange matchGroup3 = [match rangeAtIndex:3];
-    NSRange matchGroup4 = [match rangeAtIndex:4];
-    NSRange matchGroup5 = [match rangeAtIndex:5];
-    NSRange matchGroup6 = [match rangeAtIndex:6];
-    years = matchGroup1.length > 0 ? [[string substringWithRange:matchGroup1] intValue] : 0;
-    months = matchGroup2.length > 0 ? [[string substringWithRange:matchGroup2] intValue] : 0;
-    days = matchGroup3.length > 0 ? [[string substringWithRange:matchGroup3] intValue] : 0;
-    hours = matchGroup4.length > 0 ? [[string substringWithRange:matchGroup4] intValue] : 0;
-    minutes = matchGroup5.length > 0 ? [[string substringWithRange:matchGroup5] intValue] : 0;
-    seconds = matchGroup6.length > 0 ? [[string substringWithRange:matchGroup6] floatValue] : 0;
-  }
-  duration = (60 * 60 * 24 * 365) * years + (60 * 60 * 24 * 30) * months + (60 * 60 * 24) * days +
-             (60 * 60) * hours + 60 * minutes + seconds;
-  return duration;
-}
-
-// Builds Stream.LiveStream object. May be used for Non-Live streams depending on Manifest.
-- (void)setLiveProperties:(Stream *)stream {
-  if (![_mpdDict objectForKey:kDashMediaType]) {
-    // MediaType is unset. Skipping and assuming on-demand.
-    return;
-  }
-  if ([[_mpdDict objectForKey:kDashMediaType] isEqual:@(SEGMENT_BASE)]) {
-    // Ignore if SegmentBase manifest is being used.
-    return;
-  }
-
-  LiveStream *liveStream = stream.liveStream;
-  NSString *availableStartTimeString = _mpdDict[@"availabilityStartTime"];
-  // Check if Available Start Time exists in manifest, then changes to NSDate.
-  if (availableStartTimeString) {
-    if (!_dateFormat) {
-      _dateFormat = [[NSDateFormatter alloc] init];
-      [_dateFormat setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss'Z'"];
-      [_dateFormat setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-    }
-    stream.liveStream.availabilityStartTime = [_dateFormat dateFromString:availableStartTimeString];
-  }
-  liveStream.duration = [_mpdDict[@"duration"] integerValue];
-  liveStream.initializationURL = [self makeStreamURL:_mpdDict[@"initialization"] init:YES];
-  liveStream.mediaFileName = _mpdDict[@"media"];
-  liveStream.minBufferTime = [self convertDurationToSeconds:_mpdDict[@"minBufferTime"]];
-  liveStream.minimumUpdatePeriod = [_mpdDict[@"minimumUpdatePeriod"]integerValue];
-  liveStream.representationId = _mpdDict[@"id"];
-  liveStream.startNumber = [_mpdDict[@"startNumber"] integerValue];
-  liveStream.timescale = [_mpdDict[@"timescale"] integerValue];
-  liveStream.timeShiftBufferDepth = [_mpdDict[@"timeShiftBufferDepth"] integerValue];
-  liveStream.segmentDuration = (float)liveStream.duration / (float)liveStream.timescale;
-}
-
-// Adds a complete URL for each stream.
-- (NSURL *)makeStreamURL:(NSString *)URLString init:(BOOL)init {
-  // BaseURL and Initialization URLs were not found. Use media URL then.
-  if (!URLString) {
-    URLString = [_mpdDict objectForKey:@"media"];
-  }
-  if (_playOffline) {
-    return CDMDocumentFileURLForFilename(URLString.lastPathComponent);
-  }
-  // URL is already complete. Move on.
-  if ([URLString containsString:kHttpString]) {
-    return [[NSURL alloc] initWithString:URLString];
-  }
-  NSString *rootURL = [_mpdDict objectForKey:kRootURL];
-  if (rootURL) {
-    // The root URL can start with // as opposed to a scheme, appends http(s)
-    if ([rootURL rangeOfString:kHttpString].location == NSNotFound) {
-      rootURL = [_mpdURL.scheme stringByAppendingFormat:@":%@", rootURL];
-    }
-    // Removes trailing path component (if present).
-    NSURL *URL = [[NSURL alloc] initWithString:rootURL];
-    if ([URL pathExtension]) {
-      URL = [URL URLByDeletingLastPathComponent];
-    }
-    return [URL URLByAppendingPathComponent:URLString];
-  }
-  // Removes query arguments to properly append the last component path.
-  NSURLComponents *URLComponents =
-      [[NSURLComponents alloc] initWithURL:_mpdURL resolvingAgainstBaseURL:YES];
-  URLComponents.query = nil;
-  URLComponents.fragment = nil;
-  _mpdURL = URLComponents.URL;
-  if (init) {
-    URLString = [URLString stringByReplacingOccurrencesOfString:@"$RepresentationID$"
-                                                     withString:[_mpdDict valueForKey:@"id"]];
-  }
-  return [[_mpdURL URLByDeletingLastPathComponent] URLByAppendingPathComponent:URLString];
-}
-
-// Offline usage to delete files listed in MPD.
-+ (void)deleteFilesInMpd:(NSURL *)mpdURL {
-  NSData *mpdData = [NSData dataWithContentsOfURL:mpdURL];
-  if (!mpdData) {
-    CDMLogError(@"no mpdData for %@", mpdURL);
-    return;
-  }
-  NSError *error = nil;
-  NSArray *remoteURLs =
-      [MpdParser parseMpdWithStreaming:nil mpdData:mpdData baseURL:mpdURL storeOffline:YES];
-  NSFileManager *defaultFileManager = [NSFileManager defaultManager];
-  for (Stream *stream in remoteURLs) {
-    NSURL *fileURL = CDMDocumentFileURLForFilename(stream.sourceURL.lastPathComponent);
-    [defaultFileManager removeItemAtURL:fileURL error:&error];
-    if (error) {
-      CDMLogNSError(error, @"deleting existing file at %@", fileURL);
-      return;
-    }
-    CDMLogInfo(@"Deleting %@", fileURL);
-  }
-  [defaultFileManager removeItemAtURL:mpdURL error:nil];
-}
-
-@end
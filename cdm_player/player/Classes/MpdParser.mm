@@ -0,0 +1,589 @@
+// Copyright 2015 Google Inc. All rights reserved.
+
+#import "MpdParser.h"
+
+#import "Logging.h"
+#import "CdmPlayerHelpers.h"
+#include "MpdDocument.h"
+#include "MpdTime.h"
+
+static const char kAttrCodecAvc1[] = "avc1";
+static const char kAttrCodecEc3[] = "ec-3";
+static const char kAttrCodecHev1[] = "hev1";
+static const char kAttrCodecHvc1[] = "hvc1";
+static const char kAttrCodecMp4a[] = "mp4a";
+static const char kAttrMimeTypeAudio[] = "audio/";
+static const char kAttrMimeTypeVideo[] = "video/";
+static const char kVideoString[] = "video";
+static const char kWidevineSchemeIdUri[] = "urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed";
+
+static NSString *const kHttpString = @"http";
+
+// Largest number of segments a SegmentTimeline is expanded to.
+static const NSUInteger kMaxTimelineSegments = 100000;
+
+// Returns |piece| as an NSString, or nil if it is empty.
+static NSString *StringFromPiece(MpdStringPiece piece) {
+  if (piece.empty()) {
+    return nil;
+  }
+  return [[NSString alloc] initWithBytes:piece.data()
+                                  length:piece.size()
+                                encoding:NSUTF8StringEncoding];
+}
+
+// Returns the xs:duration |piece| in seconds, or 0 if it is absent, malformed or negative.
+static NSTimeInterval SecondsFromDuration(MpdStringPiece piece) {
+  double seconds = 0;
+  if (!ParseMpdDuration(piece, &seconds) || seconds < 0) {
+    return 0;
+  }
+  return seconds;
+}
+
+// Returns the frameRate |piece|, either a number of frames per second or a fraction such as
+// "30000/1001", or 0 if it is absent or malformed.
+static double FrameRateFromPiece(MpdStringPiece piece) {
+  NSArray<NSString *> *parts = [StringFromPiece(piece) componentsSeparatedByString:@"/"];
+  if (parts.count < 1 || parts.count > 2) {
+    return 0;
+  }
+  double frameRate = parts[0].doubleValue;
+  if (parts.count == 2) {
+    double denominator = parts[1].doubleValue;
+    frameRate = denominator > 0 ? frameRate / denominator : 0;
+  }
+  return frameRate > 0 ? frameRate : 0;
+}
+
+// Sets the Stream property bound to a DASH attribute from the parsed |representation| of |mpd|.
+typedef void (*MpdAttributeSetter)(Stream *stream,
+                                   const MpdRepresentation &representation,
+                                   const Mpd &mpd);
+
+static void SetBandwidth(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.bandwidth = (NSUInteger)representation.bandwidth;
+}
+
+static void SetCodecs(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.codecs = StringFromPiece(representation.codecs);
+}
+
+static void SetFrameRate(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.frameRate = FrameRateFromPiece(representation.frame_rate);
+}
+
+static void SetHeight(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.height = representation.height;
+}
+
+static void SetMediaPresentationDuration(Stream *stream,
+                                         const MpdRepresentation &,
+                                         const Mpd &mpd) {
+  stream.mediaPresentationDuration =
+      (NSUInteger)SecondsFromDuration(mpd.media_presentation_duration);
+}
+
+static void SetMimeType(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.mimeType = StringFromPiece(representation.mime_type);
+}
+
+static void SetWidth(Stream *stream, const MpdRepresentation &representation, const Mpd &) {
+  stream.width = representation.width;
+}
+
+// The DASH attributes copied to every Stream. Properties derived from several attributes or from
+// parser state are set in addStreamForRepresentation:period:mpd:.
+static const MpdAttributeSetter kMpdAttributeSetters[] = {
+    SetBandwidth,
+    SetCodecs,
+    SetFrameRate,
+    SetHeight,
+    SetMediaPresentationDuration,
+    SetMimeType,
+    SetWidth,
+};
+
+// availabilityTimeOffset is in seconds. INF makes every segment available at once, which says
+// nothing about its chunks, so it is ignored like any other invalid value.
+static NSTimeInterval AvailabilityTimeOffsetFromPiece(MpdStringPiece piece) {
+  double offset = StringFromPiece(piece).doubleValue;
+  return isfinite(offset) && offset > 0 ? offset : 0;
+}
+
+// H.264 video and AAC audio are transmuxed; HEVC video and E-AC-3 audio are served as fragmented
+// MP4.
+static BOOL IsSupportedRepresentation(const MpdRepresentation &representation) {
+  const MpdStringPiece &codecs = representation.codecs;
+  if (representation.mime_type.contains(kAttrMimeTypeVideo)) {
+    return codecs.contains(kAttrCodecAvc1) || codecs.contains(kAttrCodecHvc1) ||
+           codecs.contains(kAttrCodecHev1);
+  }
+  if (representation.mime_type.contains(kAttrMimeTypeAudio)) {
+    return codecs.contains(kAttrCodecMp4a) || codecs.contains(kAttrCodecEc3);
+  }
+  return NO;
+}
+
+static DashMediaType DashMediaTypeForSegment(const MpdSegmentInfo &segment) {
+  switch (segment.type) {
+    case MpdSegmentInfo::kList:
+      return segment.has_timeline ? SEGMENT_LIST_TIMELINE : SEGMENT_LIST_DURATION;
+    case MpdSegmentInfo::kTemplate:
+      return segment.has_timeline ? SEGMENT_TEMPLATE_TIMELINE : SEGMENT_TEMPLATE_DURATION;
+    default:
+      return SEGMENT_BASE;
+  }
+}
+
+// Returns the PSSH of the Widevine ContentProtection, or of the first one carrying a PSSH.
+static NSData *PsshForRepresentation(const MpdRepresentation &representation) {
+  MpdStringPiece pssh;
+  for (const MpdContentProtection &protection : representation.content_protection) {
+    if (protection.pssh.empty()) {
+      continue;
+    }
+    if (protection.scheme_id_uri.EqualsIgnoreCase(kWidevineSchemeIdUri)) {
+      pssh = protection.pssh;
+      break;
+    }
+    if (pssh.empty()) {
+      pssh = protection.pssh;
+    }
+  }
+  NSString *psshString = StringFromPiece(pssh);
+  NSData *psshData = nil;
+  if (psshString) {
+    psshData = [[NSData alloc] initWithBase64EncodedString:psshString options:0];
+  }
+  return psshData ? psshData : [[NSData alloc] init];
+}
+
+// Expands the SegmentTimeline of |segment| into the start time of every segment followed by the
+// end of the last one. A negative repeat count lasts until the next S element, or until the end of
+// |period| if its duration is known.
+static NSArray<NSNumber *> *TimelineForSegment(const MpdSegmentInfo &segment,
+                                               const MpdPeriod &period) {
+  if (!segment.has_timeline) {
+    return nil;
+  }
+  double periodDuration = 0;
+  uint64_t periodEnd = 0;
+  if (ParseMpdDuration(period.duration, &periodDuration) && periodDuration > 0) {
+    periodEnd = segment.presentation_time_offset + (uint64_t)(periodDuration * segment.timescale);
+  }
+  const std::vector<MpdTimelineEntry> &entries = segment.timeline;
+  NSMutableArray<NSNumber *> *timeline = [NSMutableArray arrayWithCapacity:entries.size() + 1];
+  uint64_t time = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const MpdTimelineEntry &entry = entries[i];
+    if (entry.has_start) {
+      time = entry.start;
+    }
+    if (!entry.duration) {
+      CDMLogWarn(@"ignoring SegmentTimeline entry without a duration");
+      break;
+    }
+    uint64_t count = 1;
+    if (entry.repeat >= 0) {
+      count += entry.repeat;
+    } else {
+      uint64_t end = (i + 1 < entries.size() && entries[i + 1].has_start) ? entries[i + 1].start
+                                                                          : periodEnd;
+      if (end > time) {
+        count = (end - time + entry.duration - 1) / entry.duration;
+      }
+    }
+    for (uint64_t n = 0; n < count && timeline.count < kMaxTimelineSegments; ++n) {
+      [timeline addObject:@(time)];
+      time += entry.duration;
+    }
+    if (timeline.count >= kMaxTimelineSegments) {
+      CDMLogWarn(@"SegmentTimeline truncated to %tu segments", kMaxTimelineSegments);
+      break;
+    }
+  }
+  if (timeline.count) {
+    [timeline addObject:@(time)];
+  }
+  return timeline;
+}
+
+// Builds the Periods of |mpd|. A Period without a start begins where the previous one ends, and
+// one without a duration lasts until the next one starts or the presentation ends.
+static NSArray<Period *> *PeriodsForMpd(const Mpd &mpd) {
+  NSMutableArray<Period *> *periods = [NSMutableArray arrayWithCapacity:mpd.periods.size()];
+  NSTimeInterval start = 0;
+  for (const MpdPeriod &mpdPeriod : mpd.periods) {
+    Period *period = [[Period alloc] init];
+    double seconds = 0;
+    if (ParseMpdDuration(mpdPeriod.start, &seconds) && seconds >= 0) {
+      start = seconds;
+    }
+    period.index = periods.count;
+    period.periodId = StringFromPiece(mpdPeriod.id);
+    period.start = start;
+    period.duration = SecondsFromDuration(mpdPeriod.duration);
+    Period *previous = periods.lastObject;
+    if (previous && !previous.duration && start > previous.start) {
+      previous.duration = start - previous.start;
+    }
+    [periods addObject:period];
+    start += period.duration;
+  }
+  Period *last = periods.lastObject;
+  NSTimeInterval presentationDuration = SecondsFromDuration(mpd.media_presentation_duration);
+  if (last && !last.duration && presentationDuration > last.start) {
+    last.duration = presentationDuration - last.start;
+  }
+  return periods;
+}
+
+// Identifies the Stream of a Representation across updates of a live manifest.
+static NSString *StreamKey(NSString *periodId, NSString *representationId) {
+  return [NSString stringWithFormat:@"%@/%@", periodId ?: @"", representationId];
+}
+
+@implementation MpdParser {
+  NSUInteger _maxAudioBandwidth;
+  NSUInteger _maxVideoBandwidth;
+  NSURL *_mpdURL;
+  NSInteger _offlineAudioIndex;
+  NSInteger _offlineVideoIndex;
+  BOOL _playOffline;
+  // Period of the Representations being added.
+  Period *_period;
+  NSString *_rootURL;
+  BOOL _storeOffline;
+  NSInteger _streamCount;
+  Streaming *_streaming;
+}
+
+// Init methods.
+- (instancetype)initWithMpdData:(NSData *)mpdData {
+  return [self initWithStreaming:nil mpdData:mpdData baseURL:nil storeOffline:NO];
+}
+
+- (instancetype)initWithStreaming:(Streaming *)streaming
+                          mpdData:(NSData *)mpdData
+                          baseURL:(NSURL *)baseURL
+                     storeOffline:(BOOL)storeOffline {
+  self = [super init];
+  if (self) {
+    _mpdURL = baseURL;
+    _streams = [[NSMutableArray alloc] init];
+    _streaming = streaming;
+    _storeOffline = storeOffline;
+    // Only files in the "Documents" path are considered offline files, for testing purposes.
+    _playOffline = [_mpdURL isFileURL] && [_mpdURL.pathComponents containsObject:@"Documents"];
+    if (mpdData) {
+      // The document points into |mpdData|, which outlives it.
+      MpdDocument document;
+      if (!document.Parse((const char *)mpdData.bytes, mpdData.length)) {
+        CDMLogError(@"parsing MPD failed at offset %zu: %s",
+                    document.error_offset(),
+                    document.error());
+      }
+      [self addStreamsFromMpd:document.mpd()];
+    }
+  }
+  return self;
+}
+
+// External methods to be used to begin parsing.
++ (NSArray *)parseMpdWithStreaming:(Streaming *)streaming
+                           mpdData:(NSData *)mpdData
+                           baseURL:(NSURL *)baseURL
+                      storeOffline:(BOOL)storeOffline {
+  // TODO(seawardt): Implement as a class method of Stream.
+  return [[MpdParser alloc] initWithStreaming:streaming
+                                      mpdData:mpdData
+                                      baseURL:baseURL
+                                 storeOffline:storeOffline]
+    .streams;
+}
+
++ (NSArray<Stream *> *)updateStreams:(NSArray<Stream *> *)streams
+                         withMpdData:(NSData *)mpdData
+                             baseURL:(NSURL *)baseURL {
+  MpdParser *parser =
+      [[MpdParser alloc] initWithStreaming:nil mpdData:nil baseURL:baseURL storeOffline:NO];
+  return [parser updateStreams:streams withMpdData:mpdData];
+}
+
+// Applies the timing of a refreshed manifest to the matching |streams|. Nothing else about a
+// stream is allowed to change, so its session and playlist stay valid.
+- (NSArray<Stream *> *)updateStreams:(NSArray<Stream *> *)streams withMpdData:(NSData *)mpdData {
+  MpdDocument document;
+  if (!document.Parse((const char *)mpdData.bytes, mpdData.length)) {
+    CDMLogError(@"parsing refreshed MPD failed at offset %zu: %s",
+                document.error_offset(),
+                document.error());
+    return @[];
+  }
+  const Mpd &mpd = document.mpd();
+  _rootURL = StringFromPiece(mpd.base_url);
+  NSMutableDictionary<NSString *, Stream *> *streamsByKey = [NSMutableDictionary dictionary];
+  for (Stream *stream in streams) {
+    NSString *representationId = stream.liveStream.representationId;
+    if (representationId) {
+      streamsByKey[StreamKey(stream.period.periodId, representationId)] = stream;
+    }
+  }
+  NSUInteger mediaPresentationDuration =
+      (NSUInteger)SecondsFromDuration(mpd.media_presentation_duration);
+  NSMutableArray<Stream *> *changedStreams = [NSMutableArray array];
+  for (const MpdPeriod &period : mpd.periods) {
+    NSString *periodId = StringFromPiece(period.id);
+    for (const MpdAdaptationSet &adaptationSet : period.adaptation_sets) {
+      for (const MpdRepresentation &representation : adaptationSet.representations) {
+        NSString *representationId = StringFromPiece(representation.id);
+        if (!representationId || !IsSupportedRepresentation(representation)) {
+          continue;
+        }
+        Stream *stream = streamsByKey[StreamKey(periodId, representationId)];
+        if (!stream) {
+          CDMLogInfo(@"ignoring representation %@ of period %@ added by refresh",
+                     representationId,
+                     periodId);
+          continue;
+        }
+        LiveStream *liveStream =
+            [self liveStreamForRepresentation:representation period:period mpd:mpd];
+        if ([liveStream isEqualToLiveStream:stream.liveStream] &&
+            stream.mediaPresentationDuration == mediaPresentationDuration) {
+          continue;
+        }
+        stream.liveStream = liveStream;
+        stream.mediaPresentationDuration = mediaPresentationDuration;
+        [changedStreams addObject:stream];
+      }
+    }
+  }
+  return changedStreams;
+}
+
+// Creates a Stream for every supported Representation of |mpd|.
+- (void)addStreamsFromMpd:(const Mpd &)mpd {
+  _rootURL = StringFromPiece(mpd.base_url);
+  _periods = PeriodsForMpd(mpd);
+  for (size_t periodIndex = 0; periodIndex < mpd.periods.size(); ++periodIndex) {
+    const MpdPeriod &period = mpd.periods[periodIndex];
+    _period = _periods[periodIndex];
+    for (const MpdAdaptationSet &adaptationSet : period.adaptation_sets) {
+      for (const MpdRepresentation &representation : adaptationSet.representations) {
+        if (!IsSupportedRepresentation(representation)) {
+          continue;
+        }
+        if (![self addStreamForRepresentation:representation period:period mpd:mpd]) {
+          return;
+        }
+      }
+    }
+  }
+}
+
+// Populates a new Stream from |representation|. Returns NO if it lacks required properties.
+- (BOOL)addStreamForRepresentation:(const MpdRepresentation &)representation
+                            period:(const MpdPeriod &)period
+                               mpd:(const Mpd &)mpd {
+  Stream *stream = [[Stream alloc] initWithStreaming:_streaming];
+  for (MpdAttributeSetter setter : kMpdAttributeSetters) {
+    setter(stream, representation, mpd);
+  }
+  stream.dashMediaType = DashMediaTypeForSegment(representation.segment);
+  stream.isVideo = representation.mime_type.contains(kVideoString);
+  stream.initialRange = [self initialRangeForSegment:representation.segment];
+  stream.liveStream = [self liveStreamForRepresentation:representation period:period mpd:mpd];
+  stream.m3u8 = [[NSData alloc] init];
+  stream.period = _period;
+  stream.pssh = PsshForRepresentation(representation);
+  stream.sourceURL = [self makeStreamURL:StringFromPiece(representation.base_url)
+                          representation:representation
+                                    init:NO];
+  stream.streamIndex = _streamCount;
+  // Stream Complete
+  // TODO: Enable _storeOffline by downloading single video/audio stream (b/27264914)
+  _storeOffline = NO;
+  if (_storeOffline) {
+    [self storeOfflineStream:stream];
+  } else {
+    [_streams addObject:stream];
+    _streamCount++;
+  }
+  if ([self validateStreamAttributes:stream]) {
+    return YES;
+  }
+  return NO;
+}
+
+// Check each stream and store highest rates for video/audio.
+- (void)storeOfflineStream:(Stream *)stream {
+  // Look up higest bitrate
+  if (stream.isVideo) {
+    if (stream.bandwidth > _maxVideoBandwidth) {
+      if (_maxVideoBandwidth) {
+        [_streams replaceObjectAtIndex:_offlineVideoIndex withObject:stream];
+      } else {
+        [_streams addObject:stream];
+        _offlineVideoIndex = _streamCount;
+      }
+      _maxVideoBandwidth = stream.bandwidth;
+    }
+  } else {
+    if (stream.bandwidth > _maxAudioBandwidth) {
+      if (_maxAudioBandwidth) {
+        [_streams replaceObjectAtIndex:_offlineAudioIndex withObject:stream];
+      } else {
+        [_streams addObject:stream];
+        _offlineAudioIndex = _streamCount;
+      }
+      _maxAudioBandwidth = stream.bandwidth;
+    }
+  }
+}
+
+// Ensure the properties required for transmuxing are populated from the MPD, otherwise return
+// false.
+- (BOOL)validateStreamAttributes:(Stream *)stream {
+  BOOL attributeExists = YES;
+  if (!stream.codecs) {
+    CDMLogWarn(@"Property of type NSString not set for stream codecs");
+    attributeExists = NO;
+  }
+  if (!stream.mimeType) {
+    CDMLogWarn(@"Property of type NSString not set for stream mimeType");
+    attributeExists = NO;
+  }
+  if (!stream.sourceURL) {
+    CDMLogWarn(@"Property of type NSURL not set for stream sourceURL");
+    attributeExists = NO;
+  }
+  return attributeExists;
+}
+
+// Create the Initialization Range of SegmentBase, which covers the Initialization and the index.
+- (NSRange)initialRangeForSegment:(const MpdSegmentInfo &)segment {
+  NSUInteger startRange =
+      segment.initialization_range.present ? (NSUInteger)segment.initialization_range.first : 0;
+  NSUInteger length = 0;
+  if (segment.index_range.present) {
+    // Add 1 to avoid overlap in bytes to the length.
+    length = (NSUInteger)segment.index_range.last + 1;
+    if (startRange >= length) {
+      CDMLogError(@"start range %tu is greater than length %tu", startRange, length);
+      return NSMakeRange(0, 0);
+    }
+  }
+  return NSMakeRange(startRange, length);
+}
+
+// Parse MPEG Dash duration format and return whole seconds.
+// https://en.wikipedia.org/wiki/ISO_8601#Durations
+- (NSUInteger)convertDurationToSeconds:(NSString *)string {
+  return (NSUInteger)SecondsFromDuration(string.UTF8String);
+}
+
+// Builds Stream.LiveStream object. May be used for Non-Live streams depending on Manifest.
+- (LiveStream *)liveStreamForRepresentation:(const MpdRepresentation &)representation
+                                     period:(const MpdPeriod &)period
+                                        mpd:(const Mpd &)mpd {
+  LiveStream *liveStream = [[LiveStream alloc] init];
+  const MpdSegmentInfo &segment = representation.segment;
+  if (segment.type == MpdSegmentInfo::kNone || segment.type == MpdSegmentInfo::kBase) {
+    // Ignore if SegmentBase manifest is being used, or assume on-demand if none is.
+    return liveStream;
+  }
+
+  // Check if Available Start Time exists in manifest, then changes to NSDate.
+  double availabilityStartTime = 0;
+  if (ParseMpdDateTime(mpd.availability_start_time, &availabilityStartTime)) {
+    liveStream.availabilityStartTime =
+        [NSDate dateWithTimeIntervalSince1970:availabilityStartTime];
+  } else if (!mpd.availability_start_time.empty()) {
+    CDMLogWarn(@"invalid availabilityStartTime %@", StringFromPiece(mpd.availability_start_time));
+  }
+  liveStream.availabilityTimeOffset =
+      AvailabilityTimeOffsetFromPiece(segment.availability_time_offset);
+  liveStream.duration = segment.duration;
+  liveStream.initializationURL = [self makeStreamURL:StringFromPiece(segment.initialization_url)
+                                      representation:representation
+                                                init:YES];
+  liveStream.mediaFileName = StringFromPiece(segment.media);
+  liveStream.minBufferTime = SecondsFromDuration(mpd.min_buffer_time);
+  liveStream.minimumUpdatePeriod = SecondsFromDuration(mpd.minimum_update_period);
+  liveStream.representationId = StringFromPiece(representation.id);
+  liveStream.segmentTimeline = TimelineForSegment(segment, period);
+  liveStream.startNumber = segment.start_number;
+  liveStream.timescale = segment.timescale;
+  liveStream.timeShiftBufferDepth = SecondsFromDuration(mpd.time_shift_buffer_depth);
+  liveStream.segmentDuration = (float)liveStream.duration / (float)liveStream.timescale;
+  return liveStream;
+}
+
+// Adds a complete URL for each stream.
+- (NSURL *)makeStreamURL:(NSString *)URLString
+          representation:(const MpdRepresentation &)representation
+                    init:(BOOL)init {
+  // BaseURL and Initialization URLs were not found. Use media URL then.
+  if (!URLString) {
+    URLString = StringFromPiece(representation.segment.media);
+  }
+  if (_playOffline) {
+    return CDMDocumentFileURLForFilename(URLString.lastPathComponent);
+  }
+  // URL is already complete. Move on.
+  if ([URLString containsString:kHttpString]) {
+    return [[NSURL alloc] initWithString:URLString];
+  }
+  NSString *rootURL = _rootURL;
+  if (rootURL) {
+    // The root URL can start with // as opposed to a scheme, appends http(s)
+    if ([rootURL rangeOfString:kHttpString].location == NSNotFound) {
+      rootURL = [_mpdURL.scheme stringByAppendingFormat:@":%@", rootURL];
+    }
+    // Removes trailing path component (if present).
+    NSURL *URL = [[NSURL alloc] initWithString:rootURL];
+    if ([URL pathExtension]) {
+      URL = [URL URLByDeletingLastPathComponent];
+    }
+    return [URL URLByAppendingPathComponent:URLString];
+  }
+  // Removes query arguments to properly append the last component path.
+  NSURLComponents *URLComponents =
+      [[NSURLComponents alloc] initWithURL:_mpdURL resolvingAgainstBaseURL:YES];
+  URLComponents.query = nil;
+  URLComponents.fragment = nil;
+  _mpdURL = URLComponents.URL;
+  if (init) {
+    NSString *representationId = StringFromPiece(representation.id);
+    URLString = [URLString stringByReplacingOccurrencesOfString:@"$RepresentationID$"
+                                                     withString:representationId ?: @""];
+  }
+  return [[_mpdURL URLByDeletingLastPathComponent] URLByAppendingPathComponent:URLString];
+}
+
+// Offline usage to delete files listed in MPD.
++ (void)deleteFilesInMpd:(NSURL *)mpdURL {
+  NSData *mpdData = [NSData dataWithContentsOfURL:mpdURL];
+  if (!mpdData) {
+    CDMLogError(@"no mpdData for %@", mpdURL);
+    return;
+  }
+  NSError *error = nil;
+  NSArray *remoteURLs =
+      [MpdParser parseMpdWithStreaming:nil mpdData:mpdData baseURL:mpdURL storeOffline:YES];
+  NSFileManager *defaultFileManager = [NSFileManager defaultManager];
+  for (Stream *stream in remoteURLs) {
+    NSURL *fileURL = CDMDocumentFileURLForFilename(stream.sourceURL.lastPathComponent);
+    [defaultFileManager removeItemAtURL:fileURL error:&error];
+    if (error) {
+      CDMLogNSError(error, @"deleting existing file at %@", fileURL);
+      return;
+    }
+    CDMLogInfo(@"Deleting %@", fileURL);
+  }
+  [defaultFileManager removeItemAtURL:mpdURL error:nil];
+}
+
+@end
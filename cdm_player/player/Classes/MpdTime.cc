@@ -0,0 +1,252 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "MpdTime.h"
+
+namespace {
+
+const double kSecondsPerMinute = 60;
+const double kSecondsPerHour = 60 * kSecondsPerMinute;
+const double kSecondsPerDay = 24 * kSecondsPerHour;
+
+// Fraction digits past this add nothing a double can hold.
+const size_t kMaxFractionDigits = 9;
+
+// Duration designators in the order they must appear.
+struct DurationUnit {
+  char designator;
+  bool time;
+  double seconds;
+};
+
+const DurationUnit kDurationUnits[] = {
+    {'Y', false, 365 * kSecondsPerDay}, {'M', false, 30 * kSecondsPerDay},
+    {'D', false, kSecondsPerDay},       {'H', true, kSecondsPerHour},
+    {'M', true, kSecondsPerMinute},     {'S', true, 1},
+};
+const size_t kFirstTimeUnit = 3;
+const size_t kDurationUnitCount =
+    sizeof(kDurationUnits) / sizeof(kDurationUnits[0]);
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Reads the digits at |*position|, if any. Returns false on overflow.
+bool ReadUnsigned(MpdStringPiece value, size_t *position, uint64_t *result) {
+  uint64_t number = 0;
+  while (*position < value.size() && IsDigit(value[*position])) {
+    uint64_t digit = value[*position] - '0';
+    if (number > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    number = number * 10 + digit;
+    ++*position;
+  }
+  *result = number;
+  return true;
+}
+
+// Reads exactly |count| digits at |*position|.
+bool ReadFixedDigits(MpdStringPiece value, size_t *position, size_t count,
+                     uint32_t *result) {
+  if (value.size() - *position < count) {
+    return false;
+  }
+  uint32_t number = 0;
+  for (size_t i = 0; i < count; ++i) {
+    char c = value[*position + i];
+    if (!IsDigit(c)) {
+      return false;
+    }
+    number = number * 10 + (c - '0');
+  }
+  *position += count;
+  *result = number;
+  return true;
+}
+
+// Reads the digits after a decimal point as a fraction of one. Returns the
+// number of digits read.
+size_t ReadFraction(MpdStringPiece value, size_t *position, double *result) {
+  size_t start = *position;
+  uint64_t numerator = 0;
+  uint64_t denominator = 1;
+  while (*position < value.size() && IsDigit(value[*position])) {
+    if (*position - start < kMaxFractionDigits) {
+      numerator = numerator * 10 + (value[*position] - '0');
+      denominator *= 10;
+    }
+    ++*position;
+  }
+  *result = static_cast<double>(numerator) / denominator;
+  return *position - start;
+}
+
+bool Consume(MpdStringPiece value, size_t *position, char c) {
+  if (*position >= value.size() || value[*position] != c) {
+    return false;
+  }
+  ++*position;
+  return true;
+}
+
+bool IsLeapYear(int64_t year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+uint32_t DaysInMonth(int64_t year, uint32_t month) {
+  static const uint32_t kDays[] = {31, 28, 31, 30, 31, 30,
+                                   31, 31, 30, 31, 30, 31};
+  return month == 2 && IsLeapYear(year) ? 29 : kDays[month - 1];
+}
+
+// Days from 1970-01-01 to the given date of the proleptic Gregorian calendar.
+// http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+int64_t DaysFromCivil(int64_t year, uint32_t month, uint32_t day) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t year_of_era = static_cast<uint32_t>(year - era * 400);
+  uint32_t day_of_year =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+                        year_of_era / 100 + day_of_year;
+  return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+}  // namespace
+
+bool ParseMpdDuration(MpdStringPiece value, double *seconds) {
+  value = value.Trim();
+  size_t position = 0;
+  bool negative = Consume(value, &position, '-');
+  if (!Consume(value, &position, 'P')) {
+    return false;
+  }
+  double total = 0;
+  size_t next_unit = 0;
+  bool in_time = false;
+  bool has_component = false;
+  bool has_time_component = false;
+  while (position < value.size()) {
+    if (Consume(value, &position, 'T')) {
+      if (in_time) {
+        return false;
+      }
+      in_time = true;
+      next_unit = kFirstTimeUnit;
+      continue;
+    }
+    size_t start = position;
+    uint64_t integer = 0;
+    if (!ReadUnsigned(value, &position, &integer)) {
+      return false;
+    }
+    size_t digits = position - start;
+    double fraction = 0;
+    bool has_fraction = Consume(value, &position, '.');
+    if (has_fraction) {
+      digits += ReadFraction(value, &position, &fraction);
+    }
+    if (digits == 0 || position >= value.size()) {
+      return false;
+    }
+    char designator = value[position++];
+    size_t unit = next_unit;
+    while (unit < kDurationUnitCount &&
+           (kDurationUnits[unit].designator != designator ||
+            kDurationUnits[unit].time != in_time)) {
+      ++unit;
+    }
+    // Only seconds may have a fraction.
+    if (unit == kDurationUnitCount ||
+        (has_fraction && kDurationUnits[unit].designator != 'S')) {
+      return false;
+    }
+    total += (integer + fraction) * kDurationUnits[unit].seconds;
+    next_unit = unit + 1;
+    has_component = true;
+    has_time_component |= in_time;
+  }
+  if (!has_component || (in_time && !has_time_component)) {
+    return false;
+  }
+  *seconds = negative ? -total : total;
+  return true;
+}
+
+bool ParseMpdDateTime(MpdStringPiece value, double *seconds) {
+  value = value.Trim();
+  size_t position = 0;
+  bool negative_year = Consume(value, &position, '-');
+  uint64_t year_digits = 0;
+  size_t year_start = position;
+  if (!ReadUnsigned(value, &position, &year_digits)) {
+    return false;
+  }
+  size_t year_length = position - year_start;
+  // Years have at least four digits, and no leading zero beyond that.
+  if (year_length < 4 || year_length > 9 ||
+      (year_length > 4 && value[year_start] == '0')) {
+    return false;
+  }
+  int64_t year = negative_year ? -static_cast<int64_t>(year_digits)
+                               : static_cast<int64_t>(year_digits);
+  uint32_t month = 0;
+  uint32_t day = 0;
+  uint32_t hour = 0;
+  uint32_t minute = 0;
+  uint32_t second = 0;
+  if (!Consume(value, &position, '-') ||
+      !ReadFixedDigits(value, &position, 2, &month) ||
+      !Consume(value, &position, '-') ||
+      !ReadFixedDigits(value, &position, 2, &day) ||
+      !Consume(value, &position, 'T') ||
+      !ReadFixedDigits(value, &position, 2, &hour) ||
+      !Consume(value, &position, ':') ||
+      !ReadFixedDigits(value, &position, 2, &minute) ||
+      !Consume(value, &position, ':') ||
+      !ReadFixedDigits(value, &position, 2, &second)) {
+    return false;
+  }
+  double fraction = 0;
+  if (Consume(value, &position, '.') &&
+      ReadFraction(value, &position, &fraction) == 0) {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > DaysInMonth(year, month) ||
+      minute > 59 || second > 59) {
+    return false;
+  }
+  // 24:00:00 is the first instant of the next day.
+  if (hour > 24 || (hour == 24 && (minute || second || fraction != 0))) {
+    return false;
+  }
+  int64_t offset_minutes = 0;
+  if (position < value.size()) {
+    char sign = value[position++];
+    if (sign == '+' || sign == '-') {
+      uint32_t offset_hour = 0;
+      uint32_t offset_minute = 0;
+      if (!ReadFixedDigits(value, &position, 2, &offset_hour) ||
+          !Consume(value, &position, ':') ||
+          !ReadFixedDigits(value, &position, 2, &offset_minute) ||
+          offset_minute > 59 || offset_hour * 60 + offset_minute > 14 * 60) {
+        return false;
+      }
+      offset_minutes = offset_hour * 60 + offset_minute;
+      if (sign == '-') {
+        offset_minutes = -offset_minutes;
+      }
+    } else if (sign != 'Z') {
+      return false;
+    }
+  }
+  if (position != value.size()) {
+    return false;
+  }
+  int64_t whole_seconds = DaysFromCivil(year, month, day) * 86400 +
+                          hour * 3600 + minute * 60 + second -
+                          offset_minutes * 60;
+  *seconds = static_cast<double>(whole_seconds) + fraction;
+  return true;
+}
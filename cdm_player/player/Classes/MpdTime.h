@@ -0,0 +1,26 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Parsers for the xs:duration and xs:dateTime values of MPD timing attributes.
+//
+// Both walk the value once and allocate nothing, so they can be used on every
+// manifest refresh. Durations follow the DASH convention of a year being 365
+// days and a month 30 days, as a duration is not anchored to a date.
+//
+// Only the C++ standard library is used so the parsers can be built and
+// tested off device.
+
+#ifndef CDM_PLAYER_MPDTIME_H_
+#define CDM_PLAYER_MPDTIME_H_
+
+#include "MpdXmlReader.h"
+
+// Parses an xs:duration such as "PT1H2M3.5S" into |seconds|. Returns false and
+// leaves |seconds| unchanged if |value| is malformed.
+bool ParseMpdDuration(MpdStringPiece value, double *seconds);
+
+// Parses an xs:dateTime such as "2017-01-01T00:00:00.5Z" into seconds since
+// the Unix epoch. A value without a time zone is taken as UTC, as required for
+// MPD@availabilityStartTime. Returns false and leaves |seconds| unchanged if
+// |value| is malformed.
+bool ParseMpdDateTime(MpdStringPiece value, double *seconds);
+
+#endif  // CDM_PLAYER_MPDTIME_H_
@@ -0,0 +1,378 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "MpdXmlReader.h"
+
+#include <algorithm>
+
+namespace {
+
+const char kUtf8Bom[] = "\xEF\xBB\xBF";
+
+bool IsXmlWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool IsNameDelimiter(char c) {
+  return IsXmlWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '<' ||
+         c == '"' || c == '\'';
+}
+
+char ToLowerAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Appends |code_point| to |out| as UTF-8. Returns false if it is not a valid
+// XML character.
+bool AppendUtf8(uint32_t code_point, std::string *out) {
+  if (code_point == 0 || code_point > 0x10FFFF ||
+      (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+    return false;
+  }
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+  return true;
+}
+
+// Decodes the character reference |entity|, without '&' and ';', into |out|.
+bool AppendEntity(MpdStringPiece entity, std::string *out) {
+  if (entity == "lt") {
+    out->push_back('<');
+  } else if (entity == "gt") {
+    out->push_back('>');
+  } else if (entity == "amp") {
+    out->push_back('&');
+  } else if (entity == "quot") {
+    out->push_back('"');
+  } else if (entity == "apos") {
+    out->push_back('\'');
+  } else if (entity.size() > 1 && entity[0] == '#') {
+    bool hex = entity[1] == 'x';
+    MpdStringPiece digits = entity.substr(hex ? 2 : 1);
+    if (digits.empty() || digits.size() > 8) {
+      return false;
+    }
+    uint32_t code_point = 0;
+    for (char c : digits) {
+      uint32_t digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (hex && ToLowerAscii(c) >= 'a' && ToLowerAscii(c) <= 'f') {
+        digit = ToLowerAscii(c) - 'a' + 10;
+      } else {
+        return false;
+      }
+      code_point = code_point * (hex ? 16 : 10) + digit;
+    }
+    return AppendUtf8(code_point, out);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const size_t MpdStringPiece::npos;
+const size_t MpdXmlReader::kMaxDepth;
+
+MpdStringPiece MpdStringPiece::substr(size_t pos, size_t n) const {
+  if (pos > size_) {
+    pos = size_;
+  }
+  return MpdStringPiece(data_ + pos, std::min(n, size_ - pos));
+}
+
+size_t MpdStringPiece::find(char c, size_t pos) const {
+  if (pos >= size_) {
+    return npos;
+  }
+  const void *found = memchr(data_ + pos, c, size_ - pos);
+  return found ? static_cast<const char *>(found) - data_ : npos;
+}
+
+size_t MpdStringPiece::find(MpdStringPiece s, size_t pos) const {
+  if (pos > size_ || s.size_ > size_ - pos) {
+    return npos;
+  }
+  if (s.empty()) {
+    return pos;
+  }
+  const char *found = std::search(data_ + pos, end(), s.begin(), s.end());
+  return found == end() ? npos : found - data_;
+}
+
+bool MpdStringPiece::starts_with(MpdStringPiece prefix) const {
+  return size_ >= prefix.size_ &&
+         (prefix.empty() || memcmp(data_, prefix.data_, prefix.size_) == 0);
+}
+
+bool MpdStringPiece::EqualsIgnoreCase(MpdStringPiece other) const {
+  if (size_ != other.size_) {
+    return false;
+  }
+  for (size_t i = 0; i < size_; ++i) {
+    if (ToLowerAscii(data_[i]) != ToLowerAscii(other.data_[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MpdStringPiece MpdStringPiece::Trim() const {
+  size_t start = 0;
+  size_t end = size_;
+  while (start < end && IsXmlWhitespace(data_[start])) {
+    ++start;
+  }
+  while (end > start && IsXmlWhitespace(data_[end - 1])) {
+    --end;
+  }
+  return MpdStringPiece(data_ + start, end - start);
+}
+
+MpdStringPiece MpdStringPiece::LocalName() const {
+  size_t colon = find(':');
+  return colon == npos ? *this : substr(colon + 1);
+}
+
+bool operator==(MpdStringPiece a, MpdStringPiece b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+MpdXmlReader::MpdXmlReader(MpdXmlHandler *handler)
+    : handler_(handler),
+      data_(nullptr),
+      length_(0),
+      position_(0),
+      error_(nullptr),
+      error_offset_(0),
+      seen_root_(false) {}
+
+void MpdXmlReader::Unescape(MpdStringPiece value, std::string *out) {
+  size_t position = 0;
+  while (position < value.size()) {
+    size_t amp = value.find('&', position);
+    if (amp == MpdStringPiece::npos) {
+      break;
+    }
+    out->append(value.data() + position, amp - position);
+    size_t semicolon = value.find(';', amp);
+    if (semicolon == MpdStringPiece::npos ||
+        !AppendEntity(value.substr(amp + 1, semicolon - amp - 1), out)) {
+      out->push_back('&');
+      position = amp + 1;
+      continue;
+    }
+    position = semicolon + 1;
+  }
+  out->append(value.data() + position, value.size() - position);
+}
+
+bool MpdXmlReader::Fail(const char *error, size_t offset) {
+  error_ = error;
+  error_offset_ = offset;
+  return false;
+}
+
+void MpdXmlReader::SkipWhitespace() {
+  while (position_ < length_ && IsXmlWhitespace(data_[position_])) {
+    ++position_;
+  }
+}
+
+MpdStringPiece MpdXmlReader::ReadName() {
+  size_t start = position_;
+  while (position_ < length_ && !IsNameDelimiter(data_[position_])) {
+    ++position_;
+  }
+  return MpdStringPiece(data_ + start, position_ - start);
+}
+
+bool MpdXmlReader::Parse(const char *data, size_t length) {
+  data_ = data;
+  length_ = data ? length : 0;
+  position_ = 0;
+  error_ = nullptr;
+  error_offset_ = 0;
+  seen_root_ = false;
+  open_elements_.clear();
+
+  MpdStringPiece document(data_, length_);
+  if (document.starts_with(kUtf8Bom)) {
+    position_ = 3;
+  }
+  while (position_ < length_) {
+    MpdStringPiece rest = document.substr(position_);
+    if (rest[0] != '<') {
+      size_t end = rest.find('<');
+      MpdStringPiece text = rest.substr(0, end);
+      if (open_elements_.empty()) {
+        if (!text.Trim().empty()) {
+          return Fail("text outside of the root element", position_);
+        }
+      } else if (!handler_->Text(text)) {
+        return Fail("stopped by handler", position_);
+      }
+      position_ += text.size();
+    } else if (rest.starts_with("<!--")) {
+      size_t end = rest.find("-->", 4);
+      if (end == MpdStringPiece::npos) {
+        return Fail("unterminated comment", position_);
+      }
+      position_ += end + 3;
+    } else if (rest.starts_with("<![CDATA[")) {
+      size_t end = rest.find("]]>", 9);
+      if (end == MpdStringPiece::npos) {
+        return Fail("unterminated CDATA section", position_);
+      }
+      if (open_elements_.empty()) {
+        return Fail("CDATA section outside of the root element", position_);
+      }
+      if (!handler_->Text(rest.substr(9, end - 9))) {
+        return Fail("stopped by handler", position_);
+      }
+      position_ += end + 3;
+    } else if (rest.starts_with("<?")) {
+      size_t end = rest.find("?>", 2);
+      if (end == MpdStringPiece::npos) {
+        return Fail("unterminated processing instruction", position_);
+      }
+      position_ += end + 2;
+    } else if (rest.starts_with("<!")) {
+      size_t end = rest.find('>');
+      if (end == MpdStringPiece::npos) {
+        return Fail("unterminated declaration", position_);
+      }
+      if (rest.substr(0, end).find('[') != MpdStringPiece::npos) {
+        return Fail("DOCTYPE internal subsets are not supported", position_);
+      }
+      if (seen_root_) {
+        return Fail("declaration after the root element", position_);
+      }
+      position_ += end + 1;
+    } else if (rest.starts_with("</")) {
+      if (!ParseEndTag()) {
+        return false;
+      }
+    } else if (!ParseStartTag()) {
+      return false;
+    }
+  }
+  if (!open_elements_.empty()) {
+    return Fail("unclosed element", length_);
+  }
+  if (!seen_root_) {
+    return Fail("no root element", length_);
+  }
+  return true;
+}
+
+bool MpdXmlReader::ParseStartTag() {
+  size_t tag_start = position_;
+  ++position_;
+  MpdStringPiece name = ReadName();
+  if (name.empty()) {
+    return Fail("missing element name", tag_start);
+  }
+  if (open_elements_.empty()) {
+    if (seen_root_) {
+      return Fail("more than one root element", tag_start);
+    }
+    seen_root_ = true;
+  }
+  if (open_elements_.size() >= kMaxDepth) {
+    return Fail("elements nested too deeply", tag_start);
+  }
+  attributes_.clear();
+  for (;;) {
+    SkipWhitespace();
+    if (position_ >= length_) {
+      return Fail("unterminated start tag", tag_start);
+    }
+    char c = data_[position_];
+    if (c == '>' || c == '/') {
+      bool empty_element = c == '/';
+      if (empty_element &&
+          (position_ + 1 >= length_ || data_[position_ + 1] != '>')) {
+        return Fail("expected '>' after '/'", position_);
+      }
+      position_ += empty_element ? 2 : 1;
+      if (!handler_->StartElement(name, attributes_.data(),
+                                  attributes_.size())) {
+        return Fail("stopped by handler", tag_start);
+      }
+      if (empty_element) {
+        if (!handler_->EndElement(name)) {
+          return Fail("stopped by handler", tag_start);
+        }
+      } else {
+        open_elements_.push_back(name);
+      }
+      return true;
+    }
+    size_t attribute_start = position_;
+    MpdXmlAttribute attribute;
+    attribute.name = ReadName();
+    if (attribute.name.empty()) {
+      return Fail("missing attribute name", attribute_start);
+    }
+    SkipWhitespace();
+    if (position_ >= length_ || data_[position_] != '=') {
+      return Fail("expected '=' after attribute name", position_);
+    }
+    ++position_;
+    SkipWhitespace();
+    if (position_ >= length_ ||
+        (data_[position_] != '"' && data_[position_] != '\'')) {
+      return Fail("expected quoted attribute value", position_);
+    }
+    char quote = data_[position_++];
+    size_t value_start = position_;
+    while (position_ < length_ && data_[position_] != quote) {
+      if (data_[position_] == '<') {
+        return Fail("'<' in attribute value", position_);
+      }
+      ++position_;
+    }
+    if (position_ >= length_) {
+      return Fail("unterminated attribute value", value_start);
+    }
+    attribute.value =
+        MpdStringPiece(data_ + value_start, position_ - value_start);
+    ++position_;
+    attributes_.push_back(attribute);
+  }
+}
+
+bool MpdXmlReader::ParseEndTag() {
+  size_t tag_start = position_;
+  position_ += 2;
+  MpdStringPiece name = ReadName();
+  SkipWhitespace();
+  if (position_ >= length_ || data_[position_] != '>') {
+    return Fail("unterminated end tag", tag_start);
+  }
+  ++position_;
+  if (open_elements_.empty() || open_elements_.back() != name) {
+    return Fail("mismatched end tag", tag_start);
+  }
+  open_elements_.pop_back();
+  if (!handler_->EndElement(name)) {
+    return Fail("stopped by handler", tag_start);
+  }
+  return true;
+}
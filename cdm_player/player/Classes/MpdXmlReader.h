@@ -0,0 +1,130 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Minimal non-validating SAX reader for DASH manifests.
+//
+// MpdXmlReader walks a buffer it does not own and reports elements, their
+// attributes and text to a handler as MpdStringPiece views into that buffer,
+// so reading a manifest copies no strings and, once its scratch vectors have
+// grown, allocates nothing. Only what manifests use is supported: elements,
+// attributes, text, comments, CDATA, processing instructions and a DOCTYPE
+// without an internal subset. Entity references are passed through as is;
+// values that contain '&' can be decoded with MpdXmlReader::Unescape.
+//
+// Only the C++ standard library is used so the reader can be built, tested
+// and fuzzed off device.
+
+#ifndef CDM_PLAYER_MPDXMLREADER_H_
+#define CDM_PLAYER_MPDXMLREADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Non-owning view of |size| characters at |data|.
+class MpdStringPiece {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  MpdStringPiece() : data_(nullptr), size_(0) {}
+  MpdStringPiece(const char *data, size_t size) : data_(data), size_(size) {}
+  MpdStringPiece(const char *str) : data_(str), size_(str ? strlen(str) : 0) {}
+  MpdStringPiece(const std::string &str)
+      : data_(str.data()), size_(str.size()) {}
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+  char operator[](size_t i) const { return data_[i]; }
+
+  // Returns at most |n| characters starting at |pos|.
+  MpdStringPiece substr(size_t pos, size_t n = npos) const;
+  size_t find(char c, size_t pos = 0) const;
+  size_t find(MpdStringPiece s, size_t pos = 0) const;
+  bool contains(MpdStringPiece s) const { return find(s) != npos; }
+  bool starts_with(MpdStringPiece prefix) const;
+  // Case insensitive for ASCII letters.
+  bool EqualsIgnoreCase(MpdStringPiece other) const;
+  // Without leading and trailing XML whitespace.
+  MpdStringPiece Trim() const;
+  // The part after the namespace prefix, if any.
+  MpdStringPiece LocalName() const;
+  std::string ToString() const { return std::string(data_, size_); }
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+bool operator==(MpdStringPiece a, MpdStringPiece b);
+inline bool operator!=(MpdStringPiece a, MpdStringPiece b) {
+  return !(a == b);
+}
+
+struct MpdXmlAttribute {
+  MpdStringPiece name;
+  // Raw value between the quotes.
+  MpdStringPiece value;
+};
+
+// Receives the events of MpdXmlReader::Parse. Returning false from any method
+// stops parsing.
+class MpdXmlHandler {
+ public:
+  virtual ~MpdXmlHandler() {}
+
+  // |attributes| is only valid for the duration of the call.
+  virtual bool StartElement(MpdStringPiece name,
+                            const MpdXmlAttribute *attributes,
+                            size_t attribute_count) = 0;
+  virtual bool EndElement(MpdStringPiece name) = 0;
+  // Raw character data of the innermost open element. Text interrupted by a
+  // comment or CDATA section is reported in several calls.
+  virtual bool Text(MpdStringPiece text) = 0;
+};
+
+class MpdXmlReader {
+ public:
+  // Elements nested deeper than this are rejected.
+  static const size_t kMaxDepth = 64;
+
+  explicit MpdXmlReader(MpdXmlHandler *handler);
+
+  // Reads the document in |data| and calls the handler for it. Returns false
+  // if the document is malformed or the handler stopped parsing; error() and
+  // error_offset() then say why and where.
+  bool Parse(const char *data, size_t length);
+
+  // Static description of the last error, or nullptr.
+  const char *error() const { return error_; }
+  size_t error_offset() const { return error_offset_; }
+
+  // Appends |value| to |out| with the predefined and numeric character
+  // references replaced. Unknown references are copied unchanged.
+  static void Unescape(MpdStringPiece value, std::string *out);
+
+ private:
+  bool Fail(const char *error, size_t offset);
+  bool ParseStartTag();
+  bool ParseEndTag();
+  MpdStringPiece ReadName();
+  void SkipWhitespace();
+
+  MpdXmlHandler *handler_;
+  const char *data_;
+  size_t length_;
+  size_t position_;
+  const char *error_;
+  size_t error_offset_;
+  bool seen_root_;
+  // Reused between elements so that parsing does not allocate.
+  std::vector<MpdXmlAttribute> attributes_;
+  std::vector<MpdStringPiece> open_elements_;
+
+  MpdXmlReader(const MpdXmlReader &) = delete;
+  MpdXmlReader &operator=(const MpdXmlReader &) = delete;
+};
+
+#endif  // CDM_PLAYER_MPDXMLREADER_H_
@@ -0,0 +1,17 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+// A Period of a DASH manifest. Shared by the Stream objects of the Representations it contains.
+@interface Period : NSObject <NSSecureCoding>
+
+// Duration in seconds, or 0 if neither the manifest nor the following Period give it.
+@property NSTimeInterval duration;
+// Position of the Period in the manifest, starting at 0.
+@property NSUInteger index;
+// ID of the Period, if the manifest gives one.
+@property(strong) NSString *periodId;
+// Start in seconds from the beginning of the presentation.
+@property NSTimeInterval start;
+
+@end
@@ -0,0 +1,37 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "Period.h"
+
+@implementation Period
+
++ (BOOL)supportsSecureCoding {
+  return YES;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+  self = [super init];
+  if (self) {
+    _duration = [decoder decodeDoubleForKey:@"duration"];
+    _index = (NSUInteger)[decoder decodeInt64ForKey:@"index"];
+    _periodId = [decoder decodeObjectOfClass:[NSString class] forKey:@"periodId"];
+    _start = [decoder decodeDoubleForKey:@"start"];
+  }
+  return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+  [coder encodeDouble:_duration forKey:@"duration"];
+  [coder encodeInt64:_index forKey:@"index"];
+  [coder encodeObject:_periodId forKey:@"periodId"];
+  [coder encodeDouble:_start forKey:@"start"];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"Period%lu: id=%@ start=%.3f duration=%.3f",
+                                    (unsigned long)_index,
+                                    _periodId,
+                                    _start,
+                                    _duration];
+}
+
+@end
@@ -2,16 +2,21 @@
 
 #import "CdmWrapper.h"
 #import "LiveStream.h"
+#import "Period.h"
 #import "UDTApi.h"
 
 struct DashToHlsIndex;
 struct DashToHlsSession;
 @class Streaming;
 
+// Rate of the PTS clock, which UDT uses for the PTS and durations of the segments it transmuxes.
+extern const uint32_t kPtsClock;
+
 // Object that contains an individual stream within an HLS playlist before being transmuxed to DASH
 // content via the UDT.
 // Initialized via the Streaming object.
-@interface Stream : NSObject
+// Archiving keeps only what was read from the manifest; transmuxing state is not archived.
+@interface Stream : NSObject <NSSecureCoding>
 
 typedef NS_ENUM(NSUInteger, DashMediaType) {
   SEGMENT_BASE = 0,
@@ -26,6 +31,18 @@ typedef NS_ENUM(NSUInteger, DashMediaType) {
 // Method that initiates the Transmuxing of content by passing DASH data.
 // Data can be locally stored or retrived remotely.
 - (BOOL)initialize:(NSData *)initializationData;
+// Records the PTS and duration, in PTS clock (90khz), read from |segment| when it was served, so
+// that playlists list its actual duration. Also sets pts and actualDurationInPts. Thread safe.
+- (void)setPts:(NSUInteger)pts duration:(NSUInteger)duration ofSegment:(NSUInteger)segment;
+// Records the duration, in PTS clock, of |segment| measured before it was served. Thread safe.
+- (void)setDuration:(NSUInteger)duration ofSegment:(NSUInteger)segment;
+// Actual duration in seconds of |segment|, or 0 if it has not been measured or served yet.
+- (NSTimeInterval)actualDurationOfSegment:(NSUInteger)segment;
+// Duration in seconds that |segment| of a live playlist is listed with. The first call returns
+// its actual duration, or |nominalDuration| if it has none yet, and later calls return the same
+// value, as a playlist may not change the duration of a segment it already lists. Thread safe.
+- (NSTimeInterval)listedDurationOfSegment:(NSUInteger)segment
+                          nominalDuration:(NSTimeInterval)nominalDuration;
 // Actual duration of the segment, will not be populated until after the segment has been
 // transmuxed. This value is in PTS clock (90khz)
 @property(nonatomic) NSUInteger actualDurationInPts;
@@ -37,6 +54,8 @@ typedef NS_ENUM(NSUInteger, DashMediaType) {
 @property DashMediaType dashMediaType;
 // Stores the complete status of the stream.
 @property BOOL done;
+// Video frame rate in frames per second, or 0 if the manifest does not give it.
+@property double frameRate;
 // Maintains the index (or count) of dash segments that will be used to determine how many TS
 // segments will need to be created.
 @property struct DashToHlsIndex *dashIndex;
@@ -44,10 +63,16 @@ typedef NS_ENUM(NSUInteger, DashMediaType) {
 @property NSUInteger height;
 // Contains the byte range to be used for transmuxing.
 @property NSRange initialRange;
+// Initialization segment of a stream served as fragmented MP4, as downloaded. Set by Streaming
+// once the stream is initialized; not archived.
+@property(strong) NSData *initializationSegment;
 // Determines what path to take when Transmuxing.
 @property BOOL isVideo;
 // Indicates whether stream is live or on-demand.
 @property BOOL isLive;
+// YES if the segments of the stream are served as fragmented MP4 instead of being transmuxed to TS,
+// as UDT only transmuxes H.264 and AAC. Derived from the codecs.
+@property(readonly) BOOL isPassthrough;
 // Streaming object that contains the Stream object.
 @property LiveStream *liveStream;
 // Assigned name to be used when creating the output M3U8.
@@ -57,6 +82,11 @@ typedef NS_ENUM(NSUInteger, DashMediaType) {
 // MimeType of the stream (typically, but not limited to: video/mp4 or
 // audio/mp4).
 @property(strong) NSString *mimeType;
+// Period containing the stream.
+@property(strong) Period *period;
+// Streams carrying this stream's track in each following Period, in order. Only set on streams of
+// the first Period, and only if the manifest has more than one. Set by Streaming; not archived.
+@property(copy) NSArray<Stream *> *periodStreams;
 // Value of PSSH to be passed into UDT (Dash Transmuxer).
 @property(strong) NSData *pssh;
 // PTS of the segment, will not be populated until after the segment has been transmuxed.
@@ -64,6 +94,9 @@ typedef NS_ENUM(NSUInteger, DashMediaType) {
 @property(nonatomic) NSUInteger pts;
 // Session to be used when Transmuxing with UDT (Dash Transmuxer).
 @property struct DashToHlsSession *session;
+// Stream of an earlier Period whose session is reused because it has the same initialization
+// segment, codec and key, or nil if the stream has its own session. Set by Streaming; not archived.
+@property(weak) Stream *sessionStream;
 // URL of the physical media file.
 @property(strong) NSURL *sourceURL;
 // Streaming object that contains the Stream object.
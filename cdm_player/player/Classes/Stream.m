@@ -9,20 +9,37 @@
 NSString *kAudioMimeType = @"audio/mp4";
 NSString *kVideoMimeType = @"video/mp4";
 
+// HEVC and E-AC-3 sample entries, which UDT cannot transmux.
+static NSString *const kPassthroughCodecs[] = {@"hvc1", @"hev1", @"ec-3"};
+
+const uint32_t kPtsClock = 90000;
+// Segments around the last one recorded whose durations are kept. Live streams never stop adding
+// segments.
+static const NSUInteger kMaxSegmentDurations = 1024;
+
 // Handler used to hold pass the PSSH (License Key) to the DASH Transmuxer as part of
 // Udt_SetPsshHandler.
 static DashToHlsStatus dashPsshHandler(void *context, const uint8_t *pssh, size_t pssh_length) {
   NSData *psshData = [NSData dataWithBytes:pssh length:pssh_length];
   Stream *stream = (__bridge Stream *)(context);
-  [[iOSCdm sharedInstance] processPsshKey:psshData
-                             isOfflineVod:[stream.sourceURL isFileURL]
-                          completionBlock:^(NSError *error) {
-                            if (error) {
-                              CDMLogNSError(error, @"obtaining PSSH key");
-                              return;
-                            }
-                            [stream.streaming streamReady:stream];
-                          }];
+  void (^processPssh)(void) = ^{
+    [[iOSCdm sharedInstance] processPsshKey:psshData
+                               isOfflineVod:[stream.sourceURL isFileURL]
+                            completionBlock:^(NSError *error) {
+                              if (error) {
+                                CDMLogNSError(error, @"obtaining PSSH key");
+                                return;
+                              }
+                              [stream.streaming streamReady:stream];
+                            }];
+  };
+  // Streams are parsed concurrently; CDM session bookkeeping happens on the streaming queue.
+  dispatch_queue_t streamingQ = stream.streaming.streamingQ;
+  if (streamingQ) {
+    dispatch_async(streamingQ, processPssh);
+  } else {
+    processPssh();
+  }
   return kDashToHlsStatus_OK;
 }
 
@@ -36,67 +53,197 @@ static DashToHlsStatus dashDecryptionHandler(void *context,
                                              const uint8_t *key_id,
                                              struct SampleEntry *sampleEntry,
                                              size_t sampleEntrySize) {
-  NSData *decrypted =
-      [[iOSCdm sharedInstance] decrypt:[NSData dataWithBytes:encrypted length:length]
-                                 keyId:[NSData dataWithBytes:key_id length:16]
-                                    IV:[NSData dataWithBytes:iv length:iv_length]];
-  if (!decrypted) {
+  if (![[iOSCdm sharedInstance] decrypt:encrypted
+                                 length:length
+                                 output:clear
+                                  keyId:key_id
+                                     IV:iv
+                               IVLength:iv_length]) {
     return kDashToHlsStatus_BadDashContents;
   }
-  memcpy(clear, [decrypted bytes], length);
   return kDashToHlsStatus_OK;
 }
 
+// Returns YES if both objects are nil or equal.
+static BOOL ObjectsEqual(id first, id second) {
+  return first == second || [first isEqual:second];
+}
+
 @implementation LiveStream
+
++ (BOOL)supportsSecureCoding {
+  return YES;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+  self = [super init];
+  if (self) {
+    _availabilityStartTime = [decoder decodeObjectOfClass:[NSDate class]
+                                                   forKey:@"availabilityStartTime"];
+    _availabilityTimeOffset = [decoder decodeDoubleForKey:@"availabilityTimeOffset"];
+    _duration = (NSUInteger)[decoder decodeInt64ForKey:@"duration"];
+    _initializationURL = [decoder decodeObjectOfClass:[NSURL class] forKey:@"initializationURL"];
+    _mediaFileName = [decoder decodeObjectOfClass:[NSString class] forKey:@"mediaFileName"];
+    _minBufferTime = [decoder decodeDoubleForKey:@"minBufferTime"];
+    _minimumUpdatePeriod = [decoder decodeDoubleForKey:@"minimumUpdatePeriod"];
+    _representationId = [decoder decodeObjectOfClass:[NSString class] forKey:@"representationId"];
+    _segmentDuration = [decoder decodeFloatForKey:@"segmentDuration"];
+    _segmentTimeline =
+        [decoder decodeObjectOfClasses:[NSSet setWithObjects:[NSArray class], [NSNumber class], nil]
+                                forKey:@"segmentTimeline"];
+    _startNumber = (NSUInteger)[decoder decodeInt64ForKey:@"startNumber"];
+    _timescale = (NSUInteger)[decoder decodeInt64ForKey:@"timescale"];
+    _timeShiftBufferDepth = [decoder decodeDoubleForKey:@"timeShiftBufferDepth"];
+  }
+  return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+  [coder encodeObject:_availabilityStartTime forKey:@"availabilityStartTime"];
+  [coder encodeDouble:_availabilityTimeOffset forKey:@"availabilityTimeOffset"];
+  [coder encodeInt64:_duration forKey:@"duration"];
+  [coder encodeObject:_initializationURL forKey:@"initializationURL"];
+  [coder encodeObject:_mediaFileName forKey:@"mediaFileName"];
+  [coder encodeDouble:_minBufferTime forKey:@"minBufferTime"];
+  [coder encodeDouble:_minimumUpdatePeriod forKey:@"minimumUpdatePeriod"];
+  [coder encodeObject:_representationId forKey:@"representationId"];
+  [coder encodeFloat:_segmentDuration forKey:@"segmentDuration"];
+  [coder encodeObject:_segmentTimeline forKey:@"segmentTimeline"];
+  [coder encodeInt64:_startNumber forKey:@"startNumber"];
+  [coder encodeInt64:_timescale forKey:@"timescale"];
+  [coder encodeDouble:_timeShiftBufferDepth forKey:@"timeShiftBufferDepth"];
+}
+
+- (BOOL)isEqualToLiveStream:(LiveStream *)liveStream {
+  return ObjectsEqual(_availabilityStartTime, liveStream.availabilityStartTime) &&
+         _availabilityTimeOffset == liveStream.availabilityTimeOffset &&
+         _duration == liveStream.duration &&
+         ObjectsEqual(_initializationURL, liveStream.initializationURL) &&
+         ObjectsEqual(_mediaFileName, liveStream.mediaFileName) &&
+         _minBufferTime == liveStream.minBufferTime &&
+         _minimumUpdatePeriod == liveStream.minimumUpdatePeriod &&
+         ObjectsEqual(_representationId, liveStream.representationId) &&
+         _segmentDuration == liveStream.segmentDuration &&
+         ObjectsEqual(_segmentTimeline, liveStream.segmentTimeline) &&
+         _startNumber == liveStream.startNumber && _timescale == liveStream.timescale &&
+         _timeShiftBufferDepth == liveStream.timeShiftBufferDepth;
+}
+
 @end
 
-@implementation Stream
+@implementation Stream {
+  // Actual durations of the segments measured or served, in PTS clock, by segment number.
+  NSMutableDictionary<NSNumber *, NSNumber *> *_segmentDurations;
+  // Durations in seconds that segments of a live playlist were first listed with.
+  NSMutableDictionary<NSNumber *, NSNumber *> *_listedDurations;
+}
 
 - (id)initWithStreaming:(Streaming *)streaming {
   self = [super init];
   if (self) {
     _liveStream = [[LiveStream alloc] init];
+    _segmentDurations = [NSMutableDictionary dictionary];
+    _listedDurations = [NSMutableDictionary dictionary];
     _streaming = streaming;
   }
   return self;
 }
 
++ (BOOL)supportsSecureCoding {
+  return YES;
+}
+
+// Decoded streams belong to no Streaming object; the owner sets |streaming| before use.
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+  self = [self initWithStreaming:nil];
+  if (self) {
+    _bandwidth = (NSUInteger)[decoder decodeInt64ForKey:@"bandwidth"];
+    _codecs = [decoder decodeObjectOfClass:[NSString class] forKey:@"codecs"];
+    _dashMediaType = (DashMediaType)[decoder decodeInt64ForKey:@"dashMediaType"];
+    _frameRate = [decoder decodeDoubleForKey:@"frameRate"];
+    _height = (NSUInteger)[decoder decodeInt64ForKey:@"height"];
+    _initialRange = NSMakeRange((NSUInteger)[decoder decodeInt64ForKey:@"initialRangeLocation"],
+                                (NSUInteger)[decoder decodeInt64ForKey:@"initialRangeLength"]);
+    _isVideo = [decoder decodeBoolForKey:@"isVideo"];
+    LiveStream *liveStream = [decoder decodeObjectOfClass:[LiveStream class] forKey:@"liveStream"];
+    if (liveStream) {
+      _liveStream = liveStream;
+    }
+    _m3u8 = [[NSData alloc] init];
+    _mediaPresentationDuration =
+        (NSUInteger)[decoder decodeInt64ForKey:@"mediaPresentationDuration"];
+    _mimeType = [decoder decodeObjectOfClass:[NSString class] forKey:@"mimeType"];
+    _period = [decoder decodeObjectOfClass:[Period class] forKey:@"period"];
+    _pssh = [decoder decodeObjectOfClass:[NSData class] forKey:@"pssh"];
+    _sourceURL = [decoder decodeObjectOfClass:[NSURL class] forKey:@"sourceURL"];
+    _streamIndex = (NSUInteger)[decoder decodeInt64ForKey:@"streamIndex"];
+    _width = (NSUInteger)[decoder decodeInt64ForKey:@"width"];
+  }
+  return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+  [coder encodeInt64:_bandwidth forKey:@"bandwidth"];
+  [coder encodeObject:_codecs forKey:@"codecs"];
+  [coder encodeInt64:_dashMediaType forKey:@"dashMediaType"];
+  [coder encodeDouble:_frameRate forKey:@"frameRate"];
+  [coder encodeInt64:_height forKey:@"height"];
+  [coder encodeInt64:_initialRange.location forKey:@"initialRangeLocation"];
+  [coder encodeInt64:_initialRange.length forKey:@"initialRangeLength"];
+  [coder encodeBool:_isVideo forKey:@"isVideo"];
+  [coder encodeObject:_liveStream forKey:@"liveStream"];
+  [coder encodeInt64:_mediaPresentationDuration forKey:@"mediaPresentationDuration"];
+  [coder encodeObject:_mimeType forKey:@"mimeType"];
+  [coder encodeObject:_period forKey:@"period"];
+  [coder encodeObject:_pssh forKey:@"pssh"];
+  [coder encodeObject:_sourceURL forKey:@"sourceURL"];
+  [coder encodeInt64:_streamIndex forKey:@"streamIndex"];
+  [coder encodeInt64:_width forKey:@"width"];
+}
+
 - (BOOL)initialize:(NSData *)initializationData {
   NSParameterAssert(initializationData);
 
+  // The stream only takes the session once it has parsed the initialization data, so that a
+  // stream that failed to initialize is not mistaken for an initialized one and can be retried.
   struct DashToHlsSession *session = NULL;
   DashToHlsStatus status = Udt_CreateSession(&session);
   if (status != kDashToHlsStatus_OK) {
     CDMLogError(@"failed to initialize session");
     return NO;
   }
-  _session = session;
-  status = [self setPsshHandler:dashPsshHandler];
+  status = [self setPsshHandler:dashPsshHandler session:session];
   if (status != kDashToHlsStatus_OK) {
     CDMLogError(@"failed to set PSSH handler");
+    Udt_ReleaseSession(session);
     return NO;
   }
-  status = [self setDecryptionHandler:dashDecryptionHandler];
+  status = [self setDecryptionHandler:dashDecryptionHandler session:session];
   if (status != kDashToHlsStatus_OK) {
     CDMLogError(@"failed to set decrypt handler");
+    Udt_ReleaseSession(session);
     return NO;
   }
-  status = [self parseInitData:initializationData];
-  if (status == kDashToHlsStatus_ClearContent) {
-    [_streaming streamReady:self];
-  } else if (status == kDashToHlsStatus_OK) {
-  } else {
+  struct DashToHlsIndex *dashIndex = NULL;
+  status = [self parseInitData:initializationData session:session index:&dashIndex];
+  if (status != kDashToHlsStatus_OK && status != kDashToHlsStatus_ClearContent) {
     CDMLogError(@"failed to parse dash");
-    Udt_PrettyPrint(_session);
+    Udt_PrettyPrint(session);
+    Udt_ReleaseSession(session);
     return NO;
   }
+  _dashIndex = dashIndex;
+  _session = session;
+  if (status == kDashToHlsStatus_ClearContent) {
+    [_streaming streamReady:self];
+  }
   return YES;
 }
 
 - (void)hlsFromDashData:(NSData *)dashData {
   DashToHlsStatus status;
   // Parse Data to setup UDT Session properties.
-  status = [self parseInitData:dashData];
+  status = [self parseInitData:dashData session:_session index:&_dashIndex];
   if (status == kDashToHlsStatus_ClearContent) {
     [_streaming streamReady:self];
   } else if (kDashToHlsStatus_OK == status) {
@@ -109,24 +256,88 @@ static DashToHlsStatus dashDecryptionHandler(void *context,
   return;
 }
 
-- (DashToHlsStatus)setPsshHandler:(DashToHlsContext)handler {
-  return DashToHls_SetCenc_PsshHandler(_session, (__bridge DashToHlsContext)(self), handler);
+// Drops the entries of |durations| far from |segment| once it holds more than
+// kMaxSegmentDurations. The caller synchronizes on |durations|.
+static void PruneDurations(NSMutableDictionary<NSNumber *, NSNumber *> *durations,
+                           NSUInteger segment) {
+  if (durations.count <= kMaxSegmentDurations) {
+    return;
+  }
+  for (NSNumber *key in durations.allKeys) {
+    NSUInteger other = key.unsignedIntegerValue;
+    if (MAX(other, segment) - MIN(other, segment) > kMaxSegmentDurations / 2) {
+      [durations removeObjectForKey:key];
+    }
+  }
+}
+
+- (void)setPts:(NSUInteger)pts duration:(NSUInteger)duration ofSegment:(NSUInteger)segment {
+  self.pts = pts;
+  self.actualDurationInPts = duration;
+  [self setDuration:duration ofSegment:segment];
+}
+
+- (void)setDuration:(NSUInteger)duration ofSegment:(NSUInteger)segment {
+  @synchronized(_segmentDurations) {
+    _segmentDurations[@(segment)] = @(duration);
+    PruneDurations(_segmentDurations, segment);
+  }
+}
+
+- (NSTimeInterval)actualDurationOfSegment:(NSUInteger)segment {
+  @synchronized(_segmentDurations) {
+    return _segmentDurations[@(segment)].unsignedIntegerValue / (double)kPtsClock;
+  }
+}
+
+- (NSTimeInterval)listedDurationOfSegment:(NSUInteger)segment
+                          nominalDuration:(NSTimeInterval)nominalDuration {
+  @synchronized(_listedDurations) {
+    NSNumber *listed = _listedDurations[@(segment)];
+    if (listed) {
+      return listed.doubleValue;
+    }
+    NSTimeInterval duration = [self actualDurationOfSegment:segment];
+    if (duration <= 0) {
+      duration = nominalDuration;
+    }
+    _listedDurations[@(segment)] = @(duration);
+    PruneDurations(_listedDurations, segment);
+    return duration;
+  }
+}
+
+- (BOOL)isPassthrough {
+  for (size_t i = 0; i < sizeof(kPassthroughCodecs) / sizeof(kPassthroughCodecs[0]); ++i) {
+    if ([_codecs hasPrefix:kPassthroughCodecs[i]]) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+- (DashToHlsStatus)setPsshHandler:(DashToHlsContext)handler
+                           session:(struct DashToHlsSession *)session {
+  return DashToHls_SetCenc_PsshHandler(session, (__bridge DashToHlsContext)(self), handler);
 }
 
-- (DashToHlsStatus)setDecryptionHandler:(DashToHlsContext)handler {
+- (DashToHlsStatus)setDecryptionHandler:(DashToHlsContext)handler
+                                session:(struct DashToHlsSession *)session {
   return DashToHls_SetCenc_DecryptSample(
-      _session, (__bridge DashToHlsContext)(self), handler, false);
+      session, (__bridge DashToHlsContext)(self), handler, false);
 }
 
-- (DashToHlsStatus)parseInitData:(NSData *)data {
+- (DashToHlsStatus)parseInitData:(NSData *)data
+                         session:(struct DashToHlsSession *)session
+                           index:(struct DashToHlsIndex **)index {
   // If SegmentBase, use 0 to pass as Stream Index.
-  return Udt_ParseDash(_session,
+  return Udt_ParseDash(session,
                        _dashMediaType == SEGMENT_BASE ? 0 : _streamIndex,
                        (uint8_t *)[data bytes],
                        [data length],
                        (uint8_t *)[_pssh bytes],
                        [_pssh length],
-                       &_dashIndex);
+                       index);
 }
 
 // Debug logging formatting.
@@ -0,0 +1,31 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+@class Stream;
+
+// Chooses the representations of a manifest that the current output can use, so that renditions
+// the device would never select are neither initialized nor listed in the variant playlist.
+@interface StreamSelector : NSObject
+
+// Largest video width and height in pixels, with the width the longer side. Renditions are
+// compared regardless of orientation. 0 for no limit.
+@property NSUInteger maxWidth;
+@property NSUInteger maxHeight;
+// Highest video frame rate the output displays. 0 for no limit.
+@property double maxFrameRate;
+// Highest bandwidth in bits per second of any stream. 0 for no limit.
+@property NSUInteger maxBandwidth;
+// YES if media is decoded on this device, so streams whose codecs it cannot play are dropped.
+// AirPlay receivers decode the media themselves.
+@property BOOL decodesLocally;
+
+// Selector for the main screen, or for an AirPlay receiver when |isAirplayActive|.
++ (StreamSelector *)selectorForAirplay:(BOOL)isAirplayActive;
+
+// Returns the streams of |streams| to play, in the same order. Video larger than the output is
+// dropped, except for the smallest such rendition when none fills the output. Each Period keeps
+// at least one audio and one video stream, the lowest bandwidth one, even if none fits.
+- (NSArray<Stream *> *)selectStreams:(NSArray<Stream *> *)streams;
+
+@end
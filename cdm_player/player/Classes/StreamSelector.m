@@ -0,0 +1,138 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "StreamSelector.h"
+
+#import <AVFoundation/AVFoundation.h>
+#import <UIKit/UIKit.h>
+
+#import "Logging.h"
+#import "Stream.h"
+
+// Assumed for AirPlay receivers without a screen attached as an external display.
+static const NSUInteger kAirplayWidth = 1920;
+static const NSUInteger kAirplayHeight = 1080;
+// Assumed when the screen does not report its maximum frame rate.
+static const double kDefaultMaxFrameRate = 60;
+
+@implementation StreamSelector
+
++ (StreamSelector *)selectorForAirplay:(BOOL)isAirplayActive {
+  StreamSelector *selector = [[StreamSelector alloc] init];
+  UIScreen *screen = [UIScreen mainScreen];
+  selector.decodesLocally = !isAirplayActive;
+  if (isAirplayActive) {
+    // Mirrored or presented AirPlay video shows up as a second screen.
+    NSArray<UIScreen *> *screens = [UIScreen screens];
+    screen = screens.count > 1 ? screens[1] : nil;
+  }
+  CGSize size = screen ? screen.nativeBounds.size : CGSizeMake(kAirplayWidth, kAirplayHeight);
+  selector.maxWidth = (NSUInteger)MAX(size.width, size.height);
+  selector.maxHeight = (NSUInteger)MIN(size.width, size.height);
+  selector.maxFrameRate = kDefaultMaxFrameRate;
+  if ([screen respondsToSelector:@selector(maximumFramesPerSecond)] &&
+      screen.maximumFramesPerSecond > 0) {
+    selector.maxFrameRate = screen.maximumFramesPerSecond;
+  }
+  return selector;
+}
+
+- (NSArray<Stream *> *)selectStreams:(NSArray<Stream *> *)streams {
+  // Streams of each Period and type, keyed by "<period index>-<isVideo>".
+  NSMutableDictionary<NSString *, NSMutableArray<Stream *> *> *groups =
+      [NSMutableDictionary dictionary];
+  for (Stream *stream in streams) {
+    NSString *key =
+        [NSString stringWithFormat:@"%lu-%d", (unsigned long)stream.period.index, stream.isVideo];
+    if (!groups[key]) {
+      groups[key] = [NSMutableArray array];
+    }
+    [groups[key] addObject:stream];
+  }
+  NSMutableSet<Stream *> *selected = [NSMutableSet set];
+  for (NSArray<Stream *> *group in groups.allValues) {
+    [selected addObjectsFromArray:[self selectFromGroup:group]];
+  }
+  NSMutableArray<Stream *> *result = [NSMutableArray array];
+  for (Stream *stream in streams) {
+    if ([selected containsObject:stream]) {
+      [result addObject:stream];
+    } else {
+      CDMLogInfo(@"Pruned stream %lu: %lux%lu %.3ffps %lubps %@",
+                 (unsigned long)stream.streamIndex,
+                 (unsigned long)stream.width,
+                 (unsigned long)stream.height,
+                 stream.frameRate,
+                 (unsigned long)stream.bandwidth,
+                 stream.codecs);
+    }
+  }
+  return result;
+}
+
+// Selects from |group|, streams of a single Period and type.
+- (NSArray<Stream *> *)selectFromGroup:(NSArray<Stream *> *)group {
+  NSMutableArray<Stream *> *candidates = [NSMutableArray array];
+  for (Stream *stream in group) {
+    if ([self canDecodeStream:stream]) {
+      [candidates addObject:stream];
+    }
+  }
+  if (!candidates.count) {
+    // Better to attempt playback than to fail before starting.
+    CDMLogWarn(@"No playable codec among %lu streams, keeping them all",
+               (unsigned long)group.count);
+    [candidates addObjectsFromArray:group];
+  }
+  NSMutableArray<Stream *> *selected = [NSMutableArray array];
+  // Smallest rendition larger than the output.
+  Stream *cover = nil;
+  BOOL filled = NO;
+  for (Stream *stream in candidates) {
+    if ((_maxFrameRate && stream.frameRate > _maxFrameRate) ||
+        (_maxBandwidth && stream.bandwidth > _maxBandwidth)) {
+      continue;
+    }
+    if ([self fitsStream:stream]) {
+      [selected addObject:stream];
+      filled = filled || [self fillsWithStream:stream];
+    } else if (!cover || stream.width * stream.height < cover.width * cover.height ||
+               (stream.width * stream.height == cover.width * cover.height &&
+                stream.bandwidth < cover.bandwidth)) {
+      cover = stream;
+    }
+  }
+  if (cover && !filled) {
+    [selected addObject:cover];
+  }
+  if (!selected.count) {
+    Stream *lowest = candidates[0];
+    for (Stream *stream in candidates) {
+      if (stream.bandwidth < lowest.bandwidth) {
+        lowest = stream;
+      }
+    }
+    [selected addObject:lowest];
+  }
+  return selected;
+}
+
+- (BOOL)canDecodeStream:(Stream *)stream {
+  if (!_decodesLocally || !stream.mimeType.length || !stream.codecs.length) {
+    return YES;
+  }
+  NSString *type = [NSString stringWithFormat:@"%@; codecs=\"%@\"", stream.mimeType, stream.codecs];
+  return [AVURLAsset isPlayableExtendedMIMEType:type];
+}
+
+- (BOOL)fitsStream:(Stream *)stream {
+  return (!_maxWidth || MAX(stream.width, stream.height) <= _maxWidth) &&
+         (!_maxHeight || MIN(stream.width, stream.height) <= _maxHeight);
+}
+
+// YES if |stream|, which fits, is as large as the output in either dimension.
+- (BOOL)fillsWithStream:(Stream *)stream {
+  return (_maxWidth && MAX(stream.width, stream.height) >= _maxWidth) ||
+         (_maxHeight && MIN(stream.width, stream.height) >= _maxHeight);
+}
+
+@end
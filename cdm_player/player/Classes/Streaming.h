@@ -1,5 +1,6 @@
 // Copyright 2015 Google Inc. All rights reserved.
 
+#import <AVFoundation/AVFoundation.h>
 #import <Foundation/Foundation.h>
 
 #import "HTTPConnection.h"
@@ -10,6 +11,7 @@
 @class HTTPServer;
 @class LocalWebServer;
 @class Stream;
+@class StreamSelector;
 
 @protocol HTTPResponse;
 // Delegate to access DetailViewController to pull player time.
@@ -21,33 +23,40 @@ extern NSString *kStreamingReadyNotification;
 // Contains a collection of Stream Objects.
 // The individual streams are used to create an HLS Playlist, then the data is passed to the UDT
 // (Dash Transmuxer) to be converted to DASH.
-@interface Streaming : NSObject
+// Also the resource loader delegate that hands AVPlayer the key of the fragmented MP4 data it
+// serves; pass it to Udt_SetAVURLAsset along with the asset of |playlistURL|.
+@interface Streaming : NSObject <AVAssetResourceLoaderDelegate>
 @property(nonatomic, weak) id<StreamingDelegate> streamingDelegate;
 // Internal IP address to be used for streaming locally.
 // Typically localhost or 127.0.0.1, unless using Airplay which will then be the IP Address of the
 // device.
 @property(strong) NSString *address;
-// HTTP Port to be used for the local web server that delivers the HLS content.
-// Stored here to create the HLS Playlist correctly.
-@property int httpPort;
 // URL of the incoming DASH Manifest (MPD) file.
 @property(strong) NSURL *mpdURL;
 // Holds value if license has been stored offline.
 // Determines where to fetch the license.
 @property BOOL offline;
-// Value used to determine when all streams have been processed.
-// _streams is the mutex.
+// URL of the variant playlist, under the path prefix this object is served at by the shared
+// LocalWebServer. Follows |address|, and over AirPlay uses the port of the listener serving this
+// object on the network, so it changes when restart: switches to or from AirPlay.
+@property(readonly) NSURL *playlistURL;
+// Number of streams that have not been processed yet.
+// Only modified on streamingQ.
 @property NSUInteger preloadCount;
 // Dispatch queue to handle processing of all streams.
 @property(strong) dispatch_queue_t streamingQ;
 // Array containing all the child streams within the DASH Manifest (MPD).
 @property NSArray *streams;
+// Picks the streams that are initialized and listed in the variant playlist, from the capabilities
+// of the output. Set up for the current route by init and restart:, which keeps maxBandwidth. May
+// be adjusted before processMpd:withCompletion:, e.g. to cap the bandwidth.
+@property(strong) StreamSelector *streamSelector;
 // Master HLS Playlist that is created to contain high level info about the child streams
 // (bandwidth, codec, URL of stream, etc.)
 @property NSString *variantPlaylist;
 
-// Init method. isAirplayActive determines what local address to be used when setting up the local
-// web server.
+// Init method. isAirplayActive determines what local address the playlist URL uses. The object is
+// served by the shared LocalWebServer until stop.
 - (id)initWithAirplay:(BOOL)isAirplayActive
      licenseServerURL:(NSURL *)licenseServerURL;
 // Creates the Master/Variant Playlist
@@ -55,17 +64,27 @@ extern NSString *kStreamingReadyNotification;
 // Creates an HLS playlist that lists all of the TS segments within the stream.
 // Requires an input stream to be used.
 - (NSData *)buildChildPlaylist:(Stream *)stream;
-// Obtains the actual data for the given stream.
+// Creates the I-frame playlist of a video stream with a segment index, which lists the key frame
+// starting each segment. Returns nil for other streams and until the stream is initialized.
+- (NSData *)buildIFramePlaylist:(Stream *)stream;
+// Links the streams of a multi-Period manifest into tracks that play through every Period, and
+// picks the streams that can reuse the session of an earlier Period. Called by processMpd.
+- (void)linkPeriodStreams:(NSArray<Stream *> *)streams;
+// Obtains the actual data for the given stream. Returns before the data has been fetched.
 - (void)loadStream:(Stream *)stream;
-// XML Parsing of the DASH Manifest that populates the Stream object values.
+// XML Parsing of the DASH Manifest that populates the Stream object values. The initialization
+// data of all streams is then fetched concurrently and |completion| is called once every stream
+// has been initialized. The manifest is fetched conditionally; if it is unchanged since it was
+// last parsed the streams are read from MpdCache instead.
 - (void)processMpd:(NSURL *)mpdURL withCompletion:(void (^)(NSError *))completion;
 // Re-creates the Streaming object.
 // Used primarily when switching between AirPlay and non-Airplay usage.
 - (void)restart:(BOOL)isAirplayActive;
 // Destroys the Streaming object.
 - (void)stop;
-// Verifies all Streams have been processed and initiates a Notification to begin playack of the
-// transmuxed HLS content.
+// Marks |stream| as processed and initiates a Notification to begin playback of the transmuxed HLS
+// content once the lowest video and default audio streams are ready. Other streams finish
+// initializing in the background or when first requested.
 - (void)streamReady:(Stream *)stream;
 
 // Returns a HTTPResponse for the webserver to return data for the |method| and |path|.
@@ -3,58 +3,279 @@
 #import "Streaming.h"
 
 #import <arpa/inet.h>
+#import <CommonCrypto/CommonCryptor.h>
 #import <ifaddrs.h>
 #import <string.h>
 
 #import <Responses/HTTPDataResponse.h>
+#import <Security/Security.h>
 
+#import "CdmPssh.h"
 #import "DashToHlsApiAVFramework.h"
 #import "Downloader.h"
+#include "Fmp4Passthrough.h"
 #import "LicenseManager.h"
+#import "LicenseRenewalScheduler.h"
 #import "LocalWebServer.h"
+#import "MpdCache.h"
 #import "MpdParser.h"
 #import "Logging.h"
+#import "StreamSelector.h"
 
 NSString *kStreamingReadyNotification = @"StreamingReadyNotificaiton";
 
+// A segment of a chunked CMAF stream, downloaded as the packager writes it. Each moof and mdat pair
+// is a part of the segment, which can be served as soon as it has been received.
+@interface ChunkedSegment : NSObject
+@property(nonatomic, readonly) NSURL *URL;
+@property(nonatomic, readonly) NSUInteger streamIndex;
+@property(nonatomic, readonly) int segment;
+// YES once the download or the parsing of the segment has failed.
+@property(nonatomic, readonly) BOOL failed;
+
+- (instancetype)initWithURL:(NSURL *)URL streamIndex:(NSUInteger)streamIndex segment:(int)segment;
+- (void)start;
+// Waits for chunk |index| of the segment. Returns nil if the segment ends or fails before it.
+- (NSData *)waitForChunk:(NSUInteger)index;
+// Waits for the whole segment. Returns nil if the download fails.
+- (NSData *)waitForData;
+@end
+
+@implementation ChunkedSegment {
+  // Guards everything below, and is signalled whenever it changes.
+  NSCondition *_condition;
+  NSMutableData *_data;
+  std::vector<Fmp4Chunk> _chunks;
+  BOOL _finished;
+  BOOL _failed;
+}
+
+- (instancetype)initWithURL:(NSURL *)URL streamIndex:(NSUInteger)streamIndex segment:(int)segment {
+  self = [super init];
+  if (self) {
+    _URL = URL;
+    _streamIndex = streamIndex;
+    _segment = segment;
+    _condition = [[NSCondition alloc] init];
+    _data = [NSMutableData data];
+  }
+  return self;
+}
+
+- (void)start {
+  [[Downloader sharedInstance] downloadStreamingData:_URL
+      received:^(NSData *data) {
+        [self appendData:data];
+      }
+      completion:^(NSError *error) {
+        [self finishWithError:error];
+      }];
+}
+
+- (BOOL)failed {
+  [_condition lock];
+  BOOL failed = _failed;
+  [_condition unlock];
+  return failed;
+}
+
+- (void)appendData:(NSData *)data {
+  [_condition lock];
+  [_data appendData:data];
+  // Chunks already found do not change, so only the bytes after them are parsed again.
+  size_t parsed = _chunks.empty() ? 0 : _chunks.back().offset + _chunks.back().size;
+  std::vector<Fmp4Chunk> chunks;
+  if (ParseFmp4Chunks((const uint8_t *)_data.bytes + parsed, _data.length - parsed, &chunks)) {
+    for (Fmp4Chunk &chunk : chunks) {
+      chunk.offset += parsed;
+      _chunks.push_back(chunk);
+    }
+  } else if (!_failed) {
+    CDMLogError(@"failed to parse the chunks of %@", _URL);
+    _failed = YES;
+  }
+  [_condition broadcast];
+  [_condition unlock];
+}
+
+- (void)finishWithError:(NSError *)error {
+  [_condition lock];
+  if (error) {
+    CDMLogNSError(error, @"downloading %@", _URL);
+    _failed = YES;
+  }
+  _finished = YES;
+  [_condition broadcast];
+  [_condition unlock];
+}
+
+- (NSData *)waitForChunk:(NSUInteger)index {
+  [_condition lock];
+  while (index >= _chunks.size() && !_finished && !_failed) {
+    [_condition wait];
+  }
+  NSData *chunk = nil;
+  if (index < _chunks.size()) {
+    chunk = [_data subdataWithRange:NSMakeRange(_chunks[index].offset, _chunks[index].size)];
+  }
+  [_condition unlock];
+  return chunk;
+}
+
+- (NSData *)waitForData {
+  [_condition lock];
+  while (!_finished) {
+    [_condition wait];
+  }
+  NSData *data = _failed ? nil : [_data copy];
+  [_condition unlock];
+  return data;
+}
+
+@end
+
 @implementation Streaming {
-  LocalWebServer *_localWebServer;
+  // Downloads of the segments of chunked streams, shared by their parts. Guarded by itself.
+  NSMutableArray<ChunkedSegment *> *_chunkedSegments;
+  // Path prefix the shared LocalWebServer serves this object under.
+  NSString *_sessionPrefix;
+  // Port of the LocalWebServer listener serving this object over AirPlay, 0 when not on AirPlay.
+  UInt16 _airplayPort;
+  // AES-128 key of the fragmented MP4 data served.
+  NSData *_fmp4Key;
   NSUInteger _currentAudioSegment;
   NSUInteger _currentVideoSegment;
+  dispatch_queue_t _initQ;
+  // Dispatch group of the initialization download in flight for each stream, left once the stream
+  // has been initialized or has failed to. Guarded by itself.
+  NSMapTable<Stream *, dispatch_group_t> *_streamLoads;
+  // Fires when a live manifest is due to be fetched again. Only used on streamingQ.
+  dispatch_source_t _mpdRefreshTimer;
+  // Validators of the last response for _mpdURL, sent with the next request for it.
+  NSDictionary<NSString *, NSString *> *_mpdValidators;
+  BOOL _playbackReady;
+  // Streams chosen by the streamSelector, in manifest order. Only these are initialized and
+  // listed; _streams keeps every stream so playlist indexes stay the same. Only used on streamingQ.
+  NSArray<Stream *> *_selectedStreams;
+  NSArray<Stream *> *_startupStreams;
 }
 
-static int sHttpPort = 8000;
 static NSString *const kLocalPlaylist = @"dash2hls.m3u8";
+static NSString *const kPlaylistURLFormat = @"http://%@:%d%@/%@";
 static NSString *const kLocalHost = @"localhost";
 static NSString *const kNumberPlaceholder = @"$Number";
 // Regex to look for $Number$ or $Number<number padding>$
 static NSString *const kNumberRegexPattern = @"\\$Number(%[^$]+)?\\$";
 static NSString *const kNumberFormat = @"%d";
+// Refreshes are not sample accurate; let the system coalesce the wake up a little.
+static const NSTimeInterval kMpdRefreshLeeway = 0.1;
 
 static NSString *kAudioPlaylistFormat =
-    @"#EXT-X-MEDIA:URI=\"%d.m3u8\",TYPE=AUDIO,GROUP-ID=\"audio\",NAME=\"audio%"
+    @"#EXT-X-MEDIA:URI=\"%d.m3u8\",TYPE=AUDIO,GROUP-ID=\"%@\",NAME=\"audio%"
     @"d\","
     @"DEFAULT=%@,AUTOSELECT=YES\n";
 static NSString *kAudioSegmentFormat = @"#EXTINF:%0.06f,\n%d-%d.ts\n";
+// Audio groups are named after their codec, except AAC which keeps the original name.
+static NSString *const kAudioGroupId = @"audio";
+static NSString *const kAacCodec = @"mp4a";
+
+// Playlists of TS segments need version 3, and EXT-X-MAP needs version 6 or above.
+static const int kPlaylistVersion = 3;
+static const int kFmp4PlaylistVersion = 7;
 
 static NSString *const kDynamicPlaylistHeader = @"#EXTM3U\n"
-                                                @"#EXT-X-VERSION:3\n"
+                                                @"#EXT-X-VERSION:%d\n"
                                                 @"#EXT-X-MEDIA-SEQUENCE:%d\n"
                                                 @"#EXT-X-TARGETDURATION:%d\n";
 
 static NSString *const kPlaylistVOD = @"#EXTM3U\n"
-                                      @"#EXT-X-VERSION:3\n"
+                                      @"#EXT-X-VERSION:%d\n"
                                       @"#EXT-X-MEDIA-SEQUENCE:%d\n"
                                       @"#EXT-X-TARGETDURATION:%llu\n";
 
+// Fragmented MP4 streams are served as their initialization segment and media segments. These are
+// decrypted by the player, so like UDT does for TS they are encrypted again with AES-128 before
+// being served. The key is random per Streaming object and only reaches AVPlayer through its
+// resource loader. Every resource gets its own IV, listed in a key tag before it: the resource type
+// below, the stream index, the segment and the part, as big-endian 32-bit words.
+typedef NS_ENUM(uint32_t, Fmp4Resource) {
+  kFmp4SegmentResource = 1,
+  kFmp4KeyFrameResource = 2,
+  kFmp4PartResource = 3,
+  kFmp4InitializationResource = 4,
+};
+static NSString *const kFmp4KeyScheme = @"cdmplayer-fmp4-key";
+static NSString *const kFmp4MapFormat =
+    @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\","
+    @"IV=0x00000004%1$08X0000000000000000\n"
+    @"#EXT-X-MAP:URI=\"%1$d-init.mp4\"\n";
+static NSString *const kFmp4SegmentFormat =
+    @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\","
+    @"IV=0x00000001%2$08X%3$08X00000000\n"
+    @"#EXTINF:%1$0.06f,\n%2$d-%3$d.m4s\n";
+
+// I-frame playlists list the key frame starting each segment, which is served on its own so that
+// scrubbing only fetches the start of each segment. They need version 4.
+static const int kIFramePlaylistVersion = 4;
+static NSString *const kIFramesOnly = @"#EXT-X-I-FRAMES-ONLY\n";
+static NSString *const kIFrameSegmentFormat = @"#EXTINF:%0.06f,\n%d-%d-iframe.ts\n";
+static NSString *const kFmp4IFrameSegmentFormat =
+    @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\","
+    @"IV=0x00000002%2$08X%3$08X00000000\n"
+    @"#EXTINF:%1$0.06f,\n%2$d-%3$d-iframe.m4s\n";
+// The key frames of a stream are part of its segments, so its bandwidth bounds theirs.
+static NSString *const kIFramePlaylistFormat =
+    @"#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=%lu,CODECS=\"%@\",RESOLUTION=%lux%lu,"
+    @"URI=\"%d-iframe.m3u8\"\n";
+// Bytes fetched for a key frame before the size of its moof and first sample are known.
+static const NSUInteger kKeyFramePrefixSize = 16 * 1024;
+// Requests made for a key frame before falling back to its whole segment.
+static const int kKeyFrameMaxRequests = 3;
+
+// Low-latency HLS: chunked CMAF streams also list each chunk of their last segments as a part,
+// which is served as soon as it has been received, and hint at the next part to preload.
+static NSString *const kServerControlFormat =
+    @"#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%0.06f\n";
+static NSString *const kPartInfFormat = @"#EXT-X-PART-INF:PART-TARGET=%0.06f\n";
+static NSString *const kPartFormat = @"#EXT-X-PART:DURATION=%0.06f,URI=\"%d-%d.%d.ts\"%@\n";
+static NSString *const kFmp4PartFormat =
+    @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\","
+    @"IV=0x00000003%2$08X%3$08X%4$08X\n"
+    @"#EXT-X-PART:DURATION=%1$0.06f,URI=\"%2$d-%3$d.%4$d.m4s\"%5$@\n";
+static NSString *const kIndependentPart = @",INDEPENDENT=YES";
+static NSString *const kPreloadHintFormat = @"#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%d-%d.%d.ts\"\n";
+static NSString *const kFmp4PreloadHintFormat =
+    @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\","
+    @"IV=0x00000003%1$08X%2$08X%3$08X\n"
+    @"#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%1$d-%2$d.%3$d.m4s\"\n";
+// Query parameters of a blocking playlist reload.
+static NSString *const kMediaSequenceParameter = @"_HLS_msn";
+static NSString *const kPartParameter = @"_HLS_part";
+// Players stay at least three part targets behind the live edge.
+static const int kPartHoldBackParts = 3;
+// Segments behind the live edge whose parts are still listed.
+static const int kPartSegments = 3;
+// Blocking reloads may ask for segments up to two beyond the last complete one.
+static const int kBlockingReloadSegments = 2;
+// Chunk durations computed from float segment durations are only this precise, in seconds.
+static const NSTimeInterval kPartPrecision = 0.001;
+
+// On-demand SegmentTemplate streams with up to this many segments have the durations of their
+// segments measured in the background. Longer streams list the nominal durations.
+static const NSUInteger kMaxMeasuredSegments = 256;
+// Bytes fetched from the start of each segment to measure it; enough for its first moof.
+static const NSUInteger kMeasuredSegmentHeadLength = 16 * 1024;
+
 static NSString *const kDiscontinuity = @"#EXT-X-DISCONTINUITY\n";
+// Ties the first segment of a live playlist to the wall clock, so that AVPlayer can seek by date.
+static NSString *const kProgramDateTimeFormat = @"#EXT-X-PROGRAM-DATE-TIME:%@\n";
 static NSString *const kPlaylistVODEnd = @"#EXT-X-ENDLIST";
 
-static NSString *kVariantPlaylist = @"#EXTM3U\n#EXT-X-VERSION:3\n";
+static NSString *kVariantPlaylist = @"#EXTM3U\n#EXT-X-VERSION:%d\n";
 
 static NSString *kVideoPlaylistFormat =
     @"#EXT-X-STREAM-INF:BANDWIDTH=%lu,CODECS=\"%@\",RESOLUTION=%.0lux%.0lu,"
-    @"AUDIO=\"audio\""
+    @"AUDIO=\"%@\""
     @"\n%d.m3u8\n";
 
 static NSString *kVideoSegmentFormat = @"#EXTINF:%0.06f,\n%d-%d.ts\n";
@@ -62,6 +283,195 @@ static NSString *kVideoSegmentFormat = @"#EXTINF:%0.06f,\n%d-%d.ts\n";
 static NSString *kLiveBandwidth = @"$Bandwidth$";
 static NSString *kLiveNumber = @"$Number$";
 static NSString *kLiveRepresentationID = @"$RepresentationID$";
+static NSString *kLiveTime = @"$Time$";
+
+// Returns YES if both objects are nil or equal.
+static BOOL ObjectsEqual(id first, id second) {
+  return first == second || [first isEqual:second];
+}
+
+// Returns YES once |stream| has been initialized, either with a UDT session or, for fragmented MP4
+// streams, with its initialization segment.
+static BOOL IsInitialized(Stream *stream) {
+  return stream.session || stream.initializationSegment;
+}
+
+static int PlaylistVersion(Stream *stream) {
+  return stream.isPassthrough ? kFmp4PlaylistVersion : kPlaylistVersion;
+}
+
+static NSString *SegmentFormat(Stream *stream) {
+  if (stream.isPassthrough) {
+    return kFmp4SegmentFormat;
+  }
+  return stream.isVideo ? kVideoSegmentFormat : kAudioSegmentFormat;
+}
+
+// Video with a segment index gets an I-frame playlist. Tracks spanning several Periods do not.
+static BOOL HasIFramePlaylist(Stream *stream) {
+  return stream.isVideo && stream.dashMediaType == SEGMENT_BASE && !stream.periodStreams.count;
+}
+
+static NSString *IFrameSegmentFormat(Stream *stream) {
+  return stream.isPassthrough ? kFmp4IFrameSegmentFormat : kIFrameSegmentFormat;
+}
+
+// Live SegmentTemplate streams whose segments can be requested before they end are chunked CMAF,
+// and are served as low-latency HLS. Each chunk lasts segmentDuration - availabilityTimeOffset.
+static BOOL IsChunked(Stream *stream) {
+  LiveStream *liveStream = stream.liveStream;
+  return stream.dashMediaType == SEGMENT_TEMPLATE_DURATION && !stream.mediaPresentationDuration &&
+         !stream.periodStreams.count && liveStream.availabilityStartTime &&
+         liveStream.availabilityTimeOffset > 0 &&
+         liveStream.availabilityTimeOffset < liveStream.segmentDuration;
+}
+
+static NSTimeInterval PartTarget(Stream *stream) {
+  return stream.liveStream.segmentDuration - stream.liveStream.availabilityTimeOffset;
+}
+
+// The last part of a segment is cut short when its chunks do not divide it evenly.
+static int PartsPerSegment(Stream *stream) {
+  return (int)ceil(stream.liveStream.segmentDuration / PartTarget(stream) - kPartPrecision);
+}
+
+static NSTimeInterval PartDuration(Stream *stream, int part) {
+  return MIN(PartTarget(stream), stream.liveStream.segmentDuration - part * PartTarget(stream));
+}
+
+// Every audio chunk starts with a sync sample; video chunks are only known to when they start a
+// segment.
+static BOOL IsIndependentPart(Stream *stream, int part) {
+  return !stream.isVideo || part == 0;
+}
+
+// Finds the live edge of a chunked stream at |date|: the |segment| being written, of which |parts|
+// are complete.
+static void LiveEdge(Stream *stream, NSDate *date, int *segment, int *parts) {
+  LiveStream *liveStream = stream.liveStream;
+  NSTimeInterval elapsed = MAX(0, [date timeIntervalSinceDate:liveStream.availabilityStartTime]);
+  int index = (int)(elapsed / liveStream.segmentDuration);
+  *segment = (int)liveStream.startNumber + index;
+  *parts = MIN(PartsPerSegment(stream) - 1,
+               (int)((elapsed - index * liveStream.segmentDuration) / PartTarget(stream)));
+}
+
+// Returns when |part| of |segment| of a chunked stream is complete, or the whole segment when
+// |part| is negative.
+static NSDate *AvailabilityDate(Stream *stream, int segment, int part) {
+  LiveStream *liveStream = stream.liveStream;
+  NSTimeInterval start = (segment - (NSInteger)liveStream.startNumber) * liveStream.segmentDuration;
+  NSTimeInterval end = part < 0 ? liveStream.segmentDuration
+                                : MIN(liveStream.segmentDuration, (part + 1) * PartTarget(stream));
+  return [liveStream.availabilityStartTime dateByAddingTimeInterval:start + end];
+}
+
+// Returns the duration of |segment| of |stream| measured up front or when it was served, or
+// |nominalDuration| until it has been.
+static double SegmentDuration(Stream *stream, int segment, double nominalDuration) {
+  NSTimeInterval duration = [stream actualDurationOfSegment:segment];
+  return duration > 0 ? duration : nominalDuration;
+}
+
+// Tag giving the wall clock time at which |segment| of a live stream with a SegmentTemplate
+// duration starts, on the availability timeline of the manifest. Empty without one.
+static NSString *ProgramDateTimeTag(Stream *stream, int segment) {
+  LiveStream *liveStream = stream.liveStream;
+  if (!liveStream.availabilityStartTime) {
+    return @"";
+  }
+  static NSDateFormatter *formatter = nil;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+    formatter.dateFormat = @"yyyy'-'MM'-'dd'T'HH':'mm':'ss.SSS'Z'";
+  });
+  NSTimeInterval start = (segment - (NSInteger)liveStream.startNumber) * liveStream.segmentDuration;
+  NSDate *date = [liveStream.availabilityStartTime dateByAddingTimeInterval:start];
+  return [NSString stringWithFormat:kProgramDateTimeFormat, [formatter stringFromDate:date]];
+}
+
+// Converts |time| in |timescale| to the PTS clock.
+static uint64_t PtsFromTime(uint64_t time, uint32_t timescale) {
+  return time / timescale * kPtsClock + time % timescale * kPtsClock / timescale;
+}
+
+// Tag preceding the segments of |stream|: the key of its TS segments, or the initialization segment
+// of its fragmented MP4 ones with the IV it is encrypted with.
+static NSString *MediaInitializationTag(Stream *stream) {
+  if (stream.isPassthrough) {
+    return [NSString stringWithFormat:kFmp4MapFormat, (int)stream.streamIndex];
+  }
+  return GetKeyUrl(stream.session);
+}
+
+// Audio is grouped by codec so that each variant lists the audio codecs it can switch to.
+static NSString *AudioGroupId(Stream *stream) {
+  NSString *codec = [stream.codecs componentsSeparatedByString:@"."].firstObject;
+  if (!codec.length || [codec isEqualToString:kAacCodec]) {
+    return kAudioGroupId;
+  }
+  return [NSString stringWithFormat:@"%@-%@", kAudioGroupId, codec];
+}
+
+// Decrypts the samples of a fragmented MP4 track fragment, all in one call into the CDM.
+static bool Fmp4DecryptionHandler(void *context,
+                                  const uint8_t *keyId,
+                                  const Fmp4EncryptedSample *samples,
+                                  size_t sampleCount) {
+  size_t subsampleCount = 0;
+  for (size_t i = 0; i < sampleCount; ++i) {
+    subsampleCount += samples[i].subsample_count;
+  }
+  // Reserved up front so the samples can point into it while it is filled.
+  std::vector<iOSCdmSubsample> subsamples;
+  subsamples.reserve(subsampleCount);
+  std::vector<iOSCdmSample> cdmSamples(sampleCount);
+  for (size_t i = 0; i < sampleCount; ++i) {
+    const Fmp4EncryptedSample &sample = samples[i];
+    iOSCdmSample &cdmSample = cdmSamples[i];
+    cdmSample.data = sample.data;
+    cdmSample.length = sample.size;
+    cdmSample.iv = sample.iv;
+    cdmSample.ivLength = (uint32_t)sample.iv_size;
+    cdmSample.subsamples = subsamples.data() + subsamples.size();
+    cdmSample.subsampleCount = sample.subsample_count;
+    for (size_t j = 0; j < sample.subsample_count; ++j) {
+      subsamples.push_back({sample.subsamples[j].clear_size, sample.subsamples[j].protected_size});
+    }
+  }
+  return [[iOSCdm sharedInstance] decryptSamples:cdmSamples.data()
+                                            count:cdmSamples.size()
+                                            keyId:keyId];
+}
+
+// Picks the stream of |candidates| that continues the track of |stream| in another Period: the same
+// Representation if it is there, otherwise the stream of the same type with the closest bandwidth.
+// TS and fragmented MP4 streams are not mixed in one track.
+static Stream *MatchingStream(Stream *stream, NSArray<Stream *> *candidates) {
+  Stream *match = nil;
+  NSUInteger matchDistance = NSUIntegerMax;
+  for (Stream *candidate in candidates) {
+    if (candidate.isVideo != stream.isVideo || candidate.isPassthrough != stream.isPassthrough) {
+      continue;
+    }
+    NSString *representationId = stream.liveStream.representationId;
+    if (representationId &&
+        [candidate.liveStream.representationId isEqualToString:representationId]) {
+      return candidate;
+    }
+    NSUInteger distance = candidate.bandwidth > stream.bandwidth
+                              ? candidate.bandwidth - stream.bandwidth
+                              : stream.bandwidth - candidate.bandwidth;
+    if (distance < matchDistance) {
+      match = candidate;
+      matchDistance = distance;
+    }
+  }
+  return match;
+}
 
 // Create streaming object with local IP address if Airplay is off or network IP if on.
 - (id)initWithAirplay:(BOOL)isAirplayActive
@@ -77,40 +487,83 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
               licMgrURL);
       }
     }
-    _address = kLocalHost;
-    if (isAirplayActive) {
-      _address = [self getIPAddress];
+    _sessionPrefix = [[LocalWebServer sharedInstance] addStreaming:self];
+    [self listenForAirplay:isAirplayActive];
+    NSMutableData *fmp4Key = [NSMutableData dataWithLength:kCCKeySizeAES128];
+    if (SecRandomCopyBytes(kSecRandomDefault, fmp4Key.length, fmp4Key.mutableBytes)) {
+      CDMLogError(@"failed to generate the fragmented MP4 key");
+      fmp4Key = nil;
     }
-    _localWebServer = [[LocalWebServer alloc] initWithStreaming:self];
-    NSError *error = nil;
-    // Random HTTP Port generator.
-    // Avoids issues when multiple streams are selected quickly.
-    _httpPort = sHttpPort++;
-
-    [_localWebServer start:&error];
+    _fmp4Key = fmp4Key;
     _streamingQ = dispatch_queue_create("com.google.widevine.cdm-ref-player.Streaming", NULL);
+    _initQ = dispatch_queue_create("com.google.widevine.cdm-ref-player.StreamInit",
+                                   DISPATCH_QUEUE_CONCURRENT);
     _streams = [NSMutableArray array];
+    _streamSelector = [StreamSelector selectorForAirplay:isAirplayActive];
+    _chunkedSegments = [NSMutableArray array];
+    _streamLoads = [NSMapTable
+        mapTableWithKeyOptions:NSPointerFunctionsStrongMemory |
+                               NSPointerFunctionsObjectPointerPersonality
+                  valueOptions:NSPointerFunctionsStrongMemory];
+    [[LicenseManager sharedInstance].renewalScheduler playbackDidStart];
   }
   return self;
 }
 
+- (NSURL *)playlistURL {
+  UInt16 port = _airplayPort ?: [LocalWebServer sharedInstance].listeningPort;
+  return [NSURL URLWithString:[NSString stringWithFormat:kPlaylistURLFormat,
+                                                         _address,
+                                                         (int)port,
+                                                         _sessionPrefix,
+                                                         kLocalPlaylist]];
+}
+
 // Recreates the streaming object with a different IP address.
 - (void)restart:(BOOL)isAirplayActive {
-  if (isAirplayActive) {
-    _address = [self getIPAddress];
-  } else {
-    _address = kLocalHost;
+  [self listenForAirplay:isAirplayActive];
+  // The bandwidth cap is a setting of the app rather than of the output.
+  StreamSelector *streamSelector = [StreamSelector selectorForAirplay:isAirplayActive];
+  streamSelector.maxBandwidth = _streamSelector.maxBandwidth;
+  _streamSelector = streamSelector;
+  [self reselectStreams];
+}
+
+// Serves this object on the network interface while |isAirplayActive|, and only on the loopback
+// interface otherwise. Sets the address and port of playlistURL.
+- (void)listenForAirplay:(BOOL)isAirplayActive {
+  LocalWebServer *server = [LocalWebServer sharedInstance];
+  _address = kLocalHost;
+  _airplayPort = 0;
+  if (!isAirplayActive) {
+    [server stopListeningForPrefix:_sessionPrefix];
+    return;
   }
+  NSString *address = [self getIPAddress];
   NSError *error = nil;
-  [_localWebServer stop];
-  [_localWebServer start:&error];
+  _airplayPort = [server listenForPrefix:_sessionPrefix onAddress:address error:&error];
+  if (!_airplayPort) {
+    CDMLogNSError(error, @"listening on %@", address);
+    return;
+  }
+  _address = address;
 }
 
-// Stops the local web server.
+// Stops serving the playlists and segments.
 - (void)stop {
-  [_localWebServer stop];
+  [[LocalWebServer sharedInstance] removeStreamingWithPrefix:_sessionPrefix];
+  dispatch_queue_t streamingQ = _streamingQ;
   _streams = nil;
   _streamingQ = nil;
+  if (streamingQ) {
+    [[LicenseManager sharedInstance].renewalScheduler playbackDidStop];
+    dispatch_async(streamingQ, ^{
+      if (_mpdRefreshTimer) {
+        dispatch_source_cancel(_mpdRefreshTimer);
+        _mpdRefreshTimer = nil;
+      }
+    });
+  }
 }
 
 // Finds external facing IP address to use for Airplay streaming.
@@ -146,19 +599,48 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
         withCompletionBlock:(void (^)(NSArray<Stream *> *streams, NSError *error))completion {
   NSParameterAssert(mpdURL);
   CDMLogInfo(@"Processing %@", mpdURL);
-  dispatch_async(_streamingQ, ^{
-    NSError *error = nil;
-    NSData *mpdData =
-        [NSData dataWithContentsOfURL:mpdURL options:NSDataReadingUncached error:&error];
-    if (error) {
-      completion(nil, error);
-    } else {
-      _streams =
-          [MpdParser parseMpdWithStreaming:self mpdData:mpdData baseURL:mpdURL storeOffline:NO];
-      _preloadCount = _streams.count;
-      _variantPlaylist = [self buildVariantPlaylist:_streams];
-      completion(_streams, nil);
-    }
+  dispatch_queue_t streamingQ = _streamingQ;
+  dispatch_async(streamingQ, ^{
+    // A cached manifest is only used once the server confirms it has not changed.
+    NSDictionary<NSString *, NSString *> *cachedValidators = nil;
+    NSArray<Stream *> *cachedStreams =
+        [[MpdCache sharedInstance] streamsForMpdURL:mpdURL
+                                          streaming:self
+                                         validators:&cachedValidators];
+    [[Downloader sharedInstance]
+        downloadData:mpdURL
+          validators:cachedStreams ? cachedValidators : nil
+          completion:^(NSData *mpdData,
+                       NSDictionary<NSString *, NSString *> *validators,
+                       BOOL notModified,
+                       NSError *error) {
+            dispatch_async(streamingQ, ^{
+              if (error) {
+                completion(nil, error);
+                return;
+              }
+              NSArray<Stream *> *streams = cachedStreams;
+              if (notModified) {
+                CDMLogInfo(@"Using cached streams of %@", mpdURL);
+              } else {
+                streams = [MpdParser parseMpdWithStreaming:self
+                                                   mpdData:mpdData
+                                                   baseURL:mpdURL
+                                              storeOffline:NO];
+                [[MpdCache sharedInstance] setStreams:streams
+                                           validators:validators
+                                            forMpdURL:mpdURL];
+              }
+              _mpdURL = mpdURL;
+              _mpdValidators = validators;
+              _streams = streams;
+              _playbackReady = NO;
+              [self selectStreams];
+              _preloadCount = _selectedStreams.count;
+              [self prefetchLicenses:_selectedStreams];
+              completion(_streams, nil);
+            });
+          }];
   });
 }
 
@@ -170,46 +652,459 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
           CDMLogNSError(error, @"reading %@", mpdURL);
           completion(error);
         } else {
-          for (Stream *stream in _streams) {
-            [self loadStream:stream];
+          // All initialization fetches are issued at once so startup is bounded by the slowest
+          // one. Streams needed to start playback are issued first.
+          // Streams reusing the session of an earlier Period have nothing to fetch.
+          dispatch_group_t group = dispatch_group_create();
+          for (Stream *stream in [self streamsInLoadOrder]) {
+            if (stream.sessionStream) {
+              continue;
+            }
+            dispatch_group_enter(group);
+            [self loadStream:stream
+                  completion:^{
+                    dispatch_group_leave(group);
+                  }];
           }
-          completion(nil);
+          dispatch_group_notify(group, _streamingQ, ^{
+            for (Stream *stream in _selectedStreams) {
+              if (stream.sessionStream) {
+                [self adoptSessionForStream:stream];
+              }
+            }
+            [self scheduleMpdRefresh];
+            completion(nil);
+          });
         }
       }];
 }
 
+// Picks the streams the output can use with the streamSelector, then links them into tracks and
+// lists them in the variant playlist. Called on streamingQ.
+- (void)selectStreams {
+  _selectedStreams = [_streamSelector selectStreams:_streams];
+  [self linkPeriodStreams:_selectedStreams];
+  _startupStreams = [self startupStreams:[self firstPeriodStreams]];
+  // AVPlayer starts with the first variant listed, so list the startup video first.
+  _variantPlaylist = [self buildVariantPlaylist:[self firstPeriodStreamsInLoadOrder]];
+}
+
+// Selects streams again after the output changed, e.g. to or from AirPlay. Streams that are newly
+// selected are loaded; the player picks them up when it next reads the variant playlist.
+- (void)reselectStreams {
+  dispatch_queue_t streamingQ = _streamingQ;
+  if (!streamingQ) {
+    return;
+  }
+  dispatch_async(streamingQ, ^{
+    if (!_selectedStreams) {
+      // The manifest has not been read yet; selection happens once it is.
+      return;
+    }
+    NSArray<Stream *> *previousStreams = _selectedStreams;
+    [self selectStreams];
+    NSMutableArray<Stream *> *sessionStreams = [NSMutableArray array];
+    dispatch_group_t group = dispatch_group_create();
+    for (Stream *stream in _selectedStreams) {
+      if ([previousStreams containsObject:stream] || stream.done) {
+        continue;
+      }
+      ++_preloadCount;
+      Stream *sessionOwner = stream.sessionStream;
+      if (sessionOwner && !sessionOwner.done && ![_selectedStreams containsObject:sessionOwner]) {
+        // Linked for an earlier output whose owner is no longer selected nor loaded.
+        stream.sessionStream = nil;
+      }
+      if (stream.sessionStream) {
+        [sessionStreams addObject:stream];
+        continue;
+      }
+      dispatch_group_enter(group);
+      [self loadStream:stream
+            completion:^{
+              dispatch_group_leave(group);
+            }];
+    }
+    dispatch_group_notify(group, streamingQ, ^{
+      for (Stream *stream in sessionStreams) {
+        [self adoptSessionForStream:stream];
+      }
+    });
+    CDMLogInfo(@"Selected %tu of %tu streams for the new output",
+               _selectedStreams.count,
+               _streams.count);
+  });
+}
+
+// Shortest minimumUpdatePeriod of the streams that are still live, or 0 if none need refreshing.
+- (NSTimeInterval)mpdRefreshPeriod {
+  NSTimeInterval refreshPeriod = 0;
+  for (Stream *stream in _streams) {
+    NSTimeInterval updatePeriod = stream.liveStream.minimumUpdatePeriod;
+    if (stream.mediaPresentationDuration || updatePeriod <= 0) {
+      continue;
+    }
+    if (!refreshPeriod || updatePeriod < refreshPeriod) {
+      refreshPeriod = updatePeriod;
+    }
+  }
+  return refreshPeriod;
+}
+
+// Fetches a live manifest again once its minimumUpdatePeriod has passed. Manifests without one, or
+// that have ended, are not fetched again.
+// Called on _streamingQ.
+- (void)scheduleMpdRefresh {
+  NSTimeInterval refreshPeriod = [self mpdRefreshPeriod];
+  if (!refreshPeriod || !_streamingQ || !_mpdURL) {
+    return;
+  }
+  BOOL created = NO;
+  if (!_mpdRefreshTimer) {
+    _mpdRefreshTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _streamingQ);
+    __weak Streaming *weakSelf = self;
+    dispatch_source_set_event_handler(_mpdRefreshTimer, ^{
+      [weakSelf refreshMpd];
+    });
+    created = YES;
+  }
+  // One shot, so a slow fetch never overlaps the next one.
+  dispatch_source_set_timer(_mpdRefreshTimer,
+                            dispatch_time(DISPATCH_TIME_NOW, refreshPeriod * NSEC_PER_SEC),
+                            DISPATCH_TIME_FOREVER,
+                            kMpdRefreshLeeway * NSEC_PER_SEC);
+  if (created) {
+    dispatch_resume(_mpdRefreshTimer);
+  }
+}
+
+// Downloads the manifest again and applies it to the existing streams.
+// Called on _streamingQ.
+- (void)refreshMpd {
+  dispatch_queue_t streamingQ = _streamingQ;
+  if (!streamingQ) {
+    return;
+  }
+  __weak Streaming *weakSelf = self;
+  [[Downloader sharedInstance] downloadData:_mpdURL
+                                 validators:_mpdValidators
+                                 completion:^(NSData *data,
+                                              NSDictionary<NSString *, NSString *> *validators,
+                                              BOOL notModified,
+                                              NSError *error) {
+                                   dispatch_async(streamingQ, ^{
+                                     Streaming *strongSelf = weakSelf;
+                                     if (!strongSelf) {
+                                       return;
+                                     }
+                                     if (!error) {
+                                       strongSelf->_mpdValidators = validators;
+                                     }
+                                     [strongSelf applyRefreshedMpd:data error:error];
+                                   });
+                                 }];
+}
+
+// Updates the timing of the streams from a refreshed manifest and rebuilds the playlists of the
+// streams that changed. Streams keep their sessions; nothing is initialized again. |mpdData| is
+// nil when the server reported the manifest unchanged.
+// Called on _streamingQ.
+- (void)applyRefreshedMpd:(NSData *)mpdData error:(NSError *)error {
+  if (!_streamingQ) {
+    return;
+  }
+  if (error) {
+    CDMLogNSError(error, @"refreshing %@", _mpdURL);
+  } else if (mpdData.length) {
+    NSArray<Stream *> *changedStreams =
+        [MpdParser updateStreams:_streams withMpdData:mpdData baseURL:_mpdURL];
+    for (Stream *stream in changedStreams) {
+      @synchronized(stream) {
+        if (IsInitialized(stream)) {
+          stream.m3u8 = [self buildChildPlaylist:stream];
+        }
+      }
+    }
+    if (changedStreams.count) {
+      CDMLogInfo(@"Refreshed %tu streams of %@", changedStreams.count, _mpdURL);
+    }
+  }
+  [self scheduleMpdRefresh];
+}
+
+// Links every stream of the first Period to the streams continuing its track in the following
+// Periods, and lets a later stream reuse the session of an earlier one of its track when they have
+// the same initialization segment, codec and key. Live manifests only play their first Period.
+// Called on _streamingQ.
+- (void)linkPeriodStreams:(NSArray<Stream *> *)streams {
+  NSMutableArray<NSMutableArray<Stream *> *> *streamsByPeriod = [NSMutableArray array];
+  for (Stream *stream in streams) {
+    NSUInteger periodIndex = stream.period.index;
+    while (streamsByPeriod.count <= periodIndex) {
+      [streamsByPeriod addObject:[NSMutableArray array]];
+    }
+    [streamsByPeriod[periodIndex] addObject:stream];
+  }
+  if (streamsByPeriod.count < 2) {
+    return;
+  }
+  if (!streams.firstObject.mediaPresentationDuration) {
+    CDMLogWarn(@"only the first of %tu periods of live %@ is played",
+               streamsByPeriod.count,
+               _mpdURL);
+    return;
+  }
+  for (Stream *stream in streamsByPeriod.firstObject) {
+    NSMutableArray<Stream *> *periodStreams = [NSMutableArray array];
+    Stream *previous = stream;
+    for (NSUInteger periodIndex = 1; periodIndex < streamsByPeriod.count; ++periodIndex) {
+      Stream *next = MatchingStream(stream, streamsByPeriod[periodIndex]);
+      if (!next) {
+        CDMLogWarn(@"period %tu has no stream for the track of stream %tu",
+                   periodIndex,
+                   stream.streamIndex);
+        continue;
+      }
+      Stream *sessionOwner = previous.sessionStream ?: previous;
+      if (!next.sessionStream && [self stream:next canShareSessionOfStream:sessionOwner]) {
+        next.sessionStream = sessionOwner;
+      }
+      [periodStreams addObject:next];
+      previous = next;
+    }
+    stream.periodStreams = periodStreams;
+  }
+}
+
+// Returns YES if |stream| can be transmuxed with the session of |sessionOwner|. UDT keeps the
+// codec configuration and default key of the initialization segment in the session, so both
+// streams must be initialized from the same segment with the same codec and key.
+- (BOOL)stream:(Stream *)stream canShareSessionOfStream:(Stream *)sessionOwner {
+  // SegmentBase sessions hold the segment index of their own file, and fragmented MP4 streams have
+  // no session.
+  if (stream == sessionOwner || stream.dashMediaType == SEGMENT_BASE || stream.isPassthrough ||
+      stream.dashMediaType != sessionOwner.dashMediaType) {
+    return NO;
+  }
+  return stream.isVideo == sessionOwner.isVideo &&
+         ObjectsEqual(stream.codecs, sessionOwner.codecs) &&
+         ObjectsEqual(stream.pssh, sessionOwner.pssh) &&
+         stream.liveStream.timescale == sessionOwner.liveStream.timescale &&
+         ObjectsEqual([self initializationURLForStream:stream],
+                      [self initializationURLForStream:sessionOwner]);
+}
+
+// Gives |stream| the session of its sessionStream once that has been initialized.
+- (BOOL)adoptSessionForStream:(Stream *)stream {
+  Stream *sessionOwner = stream.sessionStream;
+  struct DashToHlsSession *session = NULL;
+  // Waits for an initialization of |sessionOwner| in progress.
+  @synchronized(sessionOwner) {
+    session = sessionOwner.session;
+  }
+  if (!session) {
+    CDMLogError(@"stream %tu has no session to share with stream %tu",
+                sessionOwner.streamIndex,
+                stream.streamIndex);
+    return NO;
+  }
+  @synchronized(stream) {
+    if (!stream.session) {
+      stream.session = session;
+      stream.m3u8 = [self buildChildPlaylist:stream];
+    }
+  }
+  [self streamReady:stream];
+  [self periodStreamInitialized:stream];
+  return YES;
+}
+
+// Builds the playlists of the tracks that were waiting on |stream|, a stream of a later Period.
+- (void)periodStreamInitialized:(Stream *)stream {
+  if (!stream.period.index) {
+    return;
+  }
+  for (Stream *firstStream in [self firstPeriodStreams]) {
+    if (![firstStream.periodStreams containsObject:stream]) {
+      continue;
+    }
+    @synchronized(firstStream) {
+      if (IsInitialized(firstStream) && firstStream.m3u8.length == 0) {
+        firstStream.m3u8 = [self buildChildPlaylist:firstStream];
+      }
+    }
+  }
+}
+
+// Streams of the first Period, which carry the tracks listed in the variant playlist.
+- (NSArray<Stream *> *)firstPeriodStreams {
+  NSMutableArray<Stream *> *streams = [NSMutableArray array];
+  for (Stream *stream in _selectedStreams) {
+    if (!stream.period.index) {
+      [streams addObject:stream];
+    }
+  }
+  return streams;
+}
+
+// Streams of the first Period, with the startup streams first.
+- (NSArray<Stream *> *)firstPeriodStreamsInLoadOrder {
+  NSMutableArray<Stream *> *streams = [NSMutableArray array];
+  for (Stream *stream in [self streamsInLoadOrder]) {
+    if (!stream.period.index) {
+      [streams addObject:stream];
+    }
+  }
+  return streams;
+}
+
+// Starts license acquisition from the PSSH boxes in the manifest so it runs alongside the
+// initialization fetches. The keys of all representations are asked for in one license request
+// where possible. When UDT later finds the same box in the init segment, iOSCdm joins that request
+// to the pending session instead of sending a second one.
+// Called on _streamingQ.
+- (void)prefetchLicenses:(NSArray<Stream *> *)streams {
+  NSMutableOrderedSet<NSData *> *psshKeys = [NSMutableOrderedSet orderedSet];
+  BOOL isOfflineVod = NO;
+  for (Stream *stream in streams) {
+    if (CDMIsWidevinePssh(stream.pssh)) {
+      [psshKeys addObject:stream.pssh];
+      isOfflineVod = [stream.sourceURL isFileURL];
+    }
+  }
+  if (!psshKeys.count) {
+    return;
+  }
+  CDMLogInfo(@"Prefetching licenses for %tu PSSHs of %@", psshKeys.count, self.mpdURL);
+  [[iOSCdm sharedInstance] processPsshKeys:psshKeys.array
+                              isOfflineVod:isOfflineVod
+                           completionBlock:^(NSError *error) {
+                             if (error) {
+                               CDMLogNSError(error, @"prefetching licenses");
+                             }
+                           }];
+}
+
+// Picks the streams playback cannot start without: the lowest bandwidth video and the default
+// audio, or the first audio when none matches the preferred language.
+- (NSArray<Stream *> *)startupStreams:(NSArray<Stream *> *)streams {
+  Stream *video = nil;
+  Stream *audio = nil;
+  for (Stream *stream in streams) {
+    if (stream.isVideo) {
+      if (!video || stream.bandwidth < video.bandwidth) {
+        video = stream;
+      }
+    } else if (!audio || (![self isDefaultAudio:audio] && [self isDefaultAudio:stream])) {
+      audio = stream;
+    }
+  }
+  NSMutableArray<Stream *> *startupStreams = [NSMutableArray array];
+  if (video) {
+    [startupStreams addObject:video];
+  }
+  if (audio) {
+    [startupStreams addObject:audio];
+  }
+  return startupStreams;
+}
+
+// Selected streams, with the startup streams first.
+- (NSArray<Stream *> *)streamsInLoadOrder {
+  NSMutableArray<Stream *> *streams = [NSMutableArray arrayWithArray:_startupStreams];
+  for (Stream *stream in _selectedStreams) {
+    if (![streams containsObject:stream]) {
+      [streams addObject:stream];
+    }
+  }
+  return streams;
+}
+
+// Returns YES if |stream| is audio in the user's preferred language.
+- (BOOL)isDefaultAudio:(Stream *)stream {
+  if (stream.isVideo) {
+    return NO;
+  }
+  NSString *langAbbreviation = [[[NSLocale preferredLanguages] firstObject] substringToIndex:2];
+  NSString *langString = [langAbbreviation stringByAppendingString:@"_"];
+  return [[stream.sourceURL absoluteString] containsString:langString];
+}
+
 // Sends global notification that the streams are ready to start playback.
 - (void)startVideoPlayer {
   [[NSNotificationCenter defaultCenter] postNotificationName:kStreamingReadyNotification
                                                       object:self];
 }
 
-// Create Variant playlist that contains all video and audio streams.
+// Create Variant playlist that contains all video and audio streams. Each video is listed once per
+// audio group, with the codecs of the video and of that group.
 - (NSString *)buildVariantPlaylist:(NSArray *)parsedMpd {
   Stream *stream = nil;
-  NSString *playlist = kVariantPlaylist;
+  int version = kPlaylistVersion;
+  // Codecs of each audio group, in the order the groups are first listed.
+  NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *audioCodecs =
+      [NSMutableDictionary dictionary];
+  NSMutableArray<NSString *> *audioGroups = [NSMutableArray array];
+  for (stream in parsedMpd) {
+    version = MAX(version, PlaylistVersion(stream));
+    if (HasIFramePlaylist(stream)) {
+      version = MAX(version, kIFramePlaylistVersion);
+    }
+    if (stream.isVideo) {
+      continue;
+    }
+    NSString *groupId = AudioGroupId(stream);
+    if (!audioCodecs[groupId]) {
+      audioCodecs[groupId] = [NSMutableOrderedSet orderedSet];
+      [audioGroups addObject:groupId];
+    }
+    if (stream.codecs) {
+      [audioCodecs[groupId] addObject:stream.codecs];
+    }
+  }
+  if (!audioGroups.count) {
+    [audioGroups addObject:kAudioGroupId];
+  }
+  NSMutableString *playlist = [NSMutableString stringWithFormat:kVariantPlaylist, version];
   NSString *defaultAudioString = @"NO";
   for (stream in parsedMpd) {
     if (stream.isVideo) {
-      playlist = [playlist stringByAppendingString:[NSString stringWithFormat:kVideoPlaylistFormat,
-                                                                              stream.bandwidth,
-                                                                              stream.codecs,
-                                                                              stream.width,
-                                                                              stream.height,
-                                                                              stream.streamIndex]];
+      for (NSString *groupId in audioGroups) {
+        NSMutableArray<NSString *> *codecs = [NSMutableArray array];
+        if (stream.codecs) {
+          [codecs addObject:stream.codecs];
+        }
+        [codecs addObjectsFromArray:audioCodecs[groupId].array];
+        [playlist appendFormat:kVideoPlaylistFormat,
+                               stream.bandwidth,
+                               [codecs componentsJoinedByString:@","],
+                               stream.width,
+                               stream.height,
+                               groupId,
+                               stream.streamIndex];
+      }
     } else {
-      NSString *langAbbreviation = [[[NSLocale preferredLanguages] firstObject] substringToIndex:2];
-      NSString *langString = [langAbbreviation stringByAppendingString:@"_"];
-      if ([[stream.sourceURL absoluteString] containsString:langString]) {
+      if ([self isDefaultAudio:stream]) {
         defaultAudioString = @"YES";
       }
-      playlist = [playlist stringByAppendingString:[NSString stringWithFormat:kAudioPlaylistFormat,
-                                                                              stream.streamIndex,
-                                                                              stream.streamIndex,
-                                                                              defaultAudioString]];
+      [playlist appendFormat:kAudioPlaylistFormat,
+                             stream.streamIndex,
+                             AudioGroupId(stream),
+                             stream.streamIndex,
+                             defaultAudioString];
       defaultAudioString = @"NO";
     }
   }
+  for (stream in parsedMpd) {
+    if (HasIFramePlaylist(stream)) {
+      [playlist appendFormat:kIFramePlaylistFormat,
+                             stream.bandwidth,
+                             stream.codecs ?: @"",
+                             stream.width,
+                             stream.height,
+                             (int)stream.streamIndex];
+    }
+  }
   return playlist;
 }
 
@@ -224,7 +1119,7 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     }
   }
   NSMutableString *playlist = [NSMutableString
-      stringWithFormat:kPlaylistVOD, 0, (maxDuration / timescale) + 1];
+      stringWithFormat:kPlaylistVOD, kPlaylistVersion, 0, (maxDuration / timescale) + 1];
   [playlist appendString:GetKeyUrl(stream.session)];
 
   for (uint64_t count = 0; count < dashIndex->index_count; ++count) {
@@ -256,12 +1151,8 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     currentSegment = liveStream.startNumber;
   }
 
-  // Set End Segment based on how often the playlist needs to be refreshed.
-  if (!liveStream.minimumUpdatePeriod) {
-    // Set the amount of segments to retain (default to 3 segments ahead).
-    liveStream.minimumUpdatePeriod = liveStream.segmentDuration * segmentBuffer;
-  }
-
+  // List segmentBuffer segments ahead of the playhead. The manifest's minimumUpdatePeriod is left
+  // as parsed; a manifest without one is not refreshed.
   endSegment = (currentTime / liveStream.segmentDuration) + currentSegment +
                segmentBuffer;
 
@@ -295,18 +1186,28 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     }
   }
 
-  // Create Playlist by looping through segment list.
+  // Create Playlist by looping through segment list. Segments are listed with their actual
+  // duration if it is known; a live playlist keeps the duration it first listed a segment with.
+  NSMutableString *segments = [NSMutableString string];
+  double targetDuration = liveStream.segmentDuration;
+  for (uint64_t count = currentSegment; count < endSegment; ++count) {
+    double duration =
+        stream.mediaPresentationDuration
+            ? SegmentDuration(stream, (int)count, liveStream.segmentDuration)
+            : [stream listedDurationOfSegment:(NSUInteger)count
+                              nominalDuration:liveStream.segmentDuration];
+    targetDuration = MAX(targetDuration, duration);
+    [segments appendFormat:SegmentFormat(stream), duration, (int)stream.streamIndex, (int)count];
+  }
   NSMutableString *playlist = nil;
   playlist = [NSMutableString
-      stringWithFormat:kDynamicPlaylistHeader, (int)currentSegment,
-                       (int)liveStream.segmentDuration + 1];
-  [playlist appendString:GetKeyUrl(stream.session)];
-  for (uint64_t count = currentSegment; count < endSegment; ++count) {
-    [playlist
-        appendFormat:stream.isVideo ? kVideoSegmentFormat : kAudioSegmentFormat,
-                     (float)liveStream.segmentDuration, stream.streamIndex,
-                     count, NULL];
+      stringWithFormat:kDynamicPlaylistHeader, PlaylistVersion(stream), (int)currentSegment,
+                       (int)targetDuration + 1];
+  [playlist appendString:MediaInitializationTag(stream)];
+  if (!stream.mediaPresentationDuration) {
+    [playlist appendString:ProgramDateTimeTag(stream, (int)currentSegment)];
   }
+  [playlist appendString:segments];
   // Known length of stream is known. End Playlist.
   if (stream.mediaPresentationDuration) {
     [playlist appendString:kPlaylistVODEnd];
@@ -317,138 +1218,651 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
   return playlist;
 }
 
+// Build low-latency playlist of a chunked CMAF stream. [Live stream]
+// Lists the segments of the time shift buffer, the parts of the last few and of the segment being
+// written, and hints at the part after them.
+- (NSString *)buildLowLatencyPlaylist:(Stream *)stream {
+  LiveStream *liveStream = stream.liveStream;
+  int liveSegment = 0;
+  int liveParts = 0;
+  LiveEdge(stream, [NSDate date], &liveSegment, &liveParts);
+  int windowSegments = MAX(kPartSegments,
+                           (int)(liveStream.timeShiftBufferDepth / liveStream.segmentDuration));
+  int firstSegment = MAX((int)liveStream.startNumber, liveSegment - windowSegments);
+  NSTimeInterval partTarget = PartTarget(stream);
+  NSMutableString *playlist = [NSMutableString
+      stringWithFormat:kDynamicPlaylistHeader,
+                       PlaylistVersion(stream),
+                       firstSegment,
+                       (int)ceil(liveStream.segmentDuration)];
+  [playlist appendFormat:kServerControlFormat, partTarget * kPartHoldBackParts];
+  [playlist appendFormat:kPartInfFormat, partTarget];
+  [playlist appendString:MediaInitializationTag(stream)];
+  [playlist appendString:ProgramDateTimeTag(stream, firstSegment)];
+  NSString *partFormat = stream.isPassthrough ? kFmp4PartFormat : kPartFormat;
+  for (int segment = firstSegment; segment <= liveSegment; ++segment) {
+    int parts = segment < liveSegment ? PartsPerSegment(stream) : liveParts;
+    if (liveSegment - segment > kPartSegments) {
+      parts = 0;
+    }
+    for (int part = 0; part < parts; ++part) {
+      [playlist appendFormat:partFormat,
+                             PartDuration(stream, part),
+                             (int)stream.streamIndex,
+                             segment,
+                             part,
+                             IsIndependentPart(stream, part) ? kIndependentPart : @""];
+    }
+    if (segment < liveSegment) {
+      [playlist appendFormat:SegmentFormat(stream),
+                             [stream listedDurationOfSegment:segment
+                                             nominalDuration:liveStream.segmentDuration],
+                             (int)stream.streamIndex,
+                             segment];
+    }
+  }
+  [playlist appendFormat:stream.isPassthrough ? kFmp4PreloadHintFormat : kPreloadHintFormat,
+                         (int)stream.streamIndex,
+                         liveSegment,
+                         liveParts];
+  stream.isLive = YES;
+  return playlist;
+}
+
+// Build playlist from the SegmentTimeline of the manifest. [On-Demand or Live stream]
+- (NSString *)buildSegmentTimelinePlaylist:(Stream *)stream {
+  LiveStream *liveStream = stream.liveStream;
+  NSArray<NSNumber *> *timeline = liveStream.segmentTimeline;
+  if (timeline.count < 2 || !liveStream.timescale) {
+    CDMLogError(@"stream %tu has no SegmentTimeline", stream.streamIndex);
+    return nil;
+  }
+  double timescale = liveStream.timescale;
+  NSUInteger segmentCount = timeline.count - 1;
+  NSUInteger firstSegment = 0;
+  // Only keep timeShiftBufferDepth worth of segments behind the live edge.
+  if (liveStream.timeShiftBufferDepth && !stream.mediaPresentationDuration) {
+    double windowStart =
+        timeline.lastObject.doubleValue - liveStream.timeShiftBufferDepth * timescale;
+    while (firstSegment + 1 < segmentCount &&
+           timeline[firstSegment + 1].doubleValue <= windowStart) {
+      ++firstSegment;
+    }
+  }
+  double maxDuration = 0;
+  for (NSUInteger index = firstSegment; index < segmentCount; ++index) {
+    maxDuration = MAX(maxDuration, timeline[index + 1].doubleValue - timeline[index].doubleValue);
+  }
+  NSMutableString *playlist = [NSMutableString
+      stringWithFormat:kDynamicPlaylistHeader,
+                       PlaylistVersion(stream),
+                       (int)(liveStream.startNumber + firstSegment),
+                       (int)ceil(maxDuration / timescale)];
+  [playlist appendString:MediaInitializationTag(stream)];
+  for (NSUInteger index = firstSegment; index < segmentCount; ++index) {
+    double duration = (timeline[index + 1].doubleValue - timeline[index].doubleValue) / timescale;
+    [playlist appendFormat:SegmentFormat(stream),
+                           duration,
+                           (int)stream.streamIndex,
+                           (int)(liveStream.startNumber + index)];
+  }
+  if (stream.mediaPresentationDuration) {
+    [playlist appendString:kPlaylistVODEnd];
+  } else {
+    stream.isLive = YES;
+  }
+  return playlist;
+}
+
+// Appends the segments of |stream| to |playlist|, each with |segmentFormat|, and raises
+// |targetDuration| to the longest one, in seconds. Returns NO if the segments of |stream| are not
+// known.
+- (BOOL)appendSegmentsOfStream:(Stream *)stream
+                    withFormat:(NSString *)segmentFormat
+                    toPlaylist:(NSMutableString *)playlist
+                targetDuration:(double *)targetDuration {
+  LiveStream *liveStream = stream.liveStream;
+  switch (stream.dashMediaType) {
+    case SEGMENT_BASE: {
+      if (stream.isPassthrough) {
+        Fmp4SegmentIndex index;
+        if (![self segmentIndex:&index ofStream:stream] || !index.timescale) {
+          return NO;
+        }
+        for (size_t count = 0; count < index.references.size(); ++count) {
+          double duration = (double)index.references[count].duration / index.timescale;
+          *targetDuration = MAX(*targetDuration, duration);
+          [playlist appendFormat:segmentFormat, duration, (int)stream.streamIndex, (int)count];
+        }
+        return YES;
+      }
+      DashToHlsIndex *dashIndex = stream.dashIndex;
+      if (!dashIndex) {
+        return NO;
+      }
+      for (uint32_t count = 0; count < dashIndex->index_count; ++count) {
+        const DashToHlsSegment &segment = dashIndex->segments[count];
+        double duration = segment.timescale ? (double)segment.duration / segment.timescale : 0;
+        *targetDuration = MAX(*targetDuration, duration);
+        [playlist appendFormat:segmentFormat, duration, (int)stream.streamIndex, (int)count];
+      }
+      return YES;
+    }
+    case SEGMENT_TEMPLATE_TIMELINE: {
+      NSArray<NSNumber *> *timeline = liveStream.segmentTimeline;
+      if (timeline.count < 2 || !liveStream.timescale) {
+        return NO;
+      }
+      for (NSUInteger index = 0; index + 1 < timeline.count; ++index) {
+        double duration = (timeline[index + 1].doubleValue - timeline[index].doubleValue) /
+                          liveStream.timescale;
+        *targetDuration = MAX(*targetDuration, duration);
+        [playlist appendFormat:segmentFormat,
+                               duration,
+                               (int)stream.streamIndex,
+                               (int)(liveStream.startNumber + index)];
+      }
+      return YES;
+    }
+    case SEGMENT_TEMPLATE_DURATION: {
+      double segmentDuration = liveStream.segmentDuration;
+      double periodDuration = stream.period.duration;
+      if (segmentDuration <= 0 || periodDuration <= 0) {
+        return NO;
+      }
+      // The last segment is cut short by the end of the Period.
+      for (NSUInteger index = 0; index * segmentDuration < periodDuration; ++index) {
+        int segment = (int)(liveStream.startNumber + index);
+        double duration = SegmentDuration(
+            stream, segment, MIN(segmentDuration, periodDuration - index * segmentDuration));
+        *targetDuration = MAX(*targetDuration, duration);
+        [playlist appendFormat:segmentFormat, duration, (int)stream.streamIndex, segment];
+      }
+      return YES;
+    }
+    default:
+      return NO;
+  }
+}
+
+// Build playlist that plays the track of |stream| through every Period, with a discontinuity at
+// each Period join. Returns nil until the streams of every Period have been initialized. Also lists
+// the segments of single Period fragmented MP4 SegmentBase streams, which have no UDT index.
+// [On-Demand stream]
+- (NSString *)buildMultiPeriodPlaylist:(Stream *)stream {
+  NSMutableString *segments = [NSMutableString string];
+  double targetDuration = 0;
+  for (Stream *periodStream in [@[ stream ] arrayByAddingObjectsFromArray:stream.periodStreams]) {
+    if (!IsInitialized(periodStream)) {
+      return nil;
+    }
+    if (periodStream != stream) {
+      [segments appendString:kDiscontinuity];
+    }
+    [segments appendString:MediaInitializationTag(periodStream)];
+    if (![self appendSegmentsOfStream:periodStream
+                           withFormat:SegmentFormat(periodStream)
+                           toPlaylist:segments
+                       targetDuration:&targetDuration]) {
+      CDMLogError(@"segments of stream %tu in %@ are not known",
+                  periodStream.streamIndex,
+                  periodStream.period);
+      return nil;
+    }
+  }
+  NSMutableString *playlist =
+      [NSMutableString stringWithFormat:kPlaylistVOD,
+                                        PlaylistVersion(stream),
+                                        0,
+                                        (unsigned long long)ceil(targetDuration)];
+  [playlist appendString:segments];
+  [playlist appendString:kPlaylistVODEnd];
+  return playlist;
+}
+
+- (NSData *)buildIFramePlaylist:(Stream *)stream {
+  if (!HasIFramePlaylist(stream) || !IsInitialized(stream)) {
+    return nil;
+  }
+  NSMutableString *segments = [NSMutableString stringWithString:MediaInitializationTag(stream)];
+  double targetDuration = 0;
+  if (![self appendSegmentsOfStream:stream
+                         withFormat:IFrameSegmentFormat(stream)
+                         toPlaylist:segments
+                     targetDuration:&targetDuration]) {
+    CDMLogError(@"segments of stream %tu are not known", stream.streamIndex);
+    return nil;
+  }
+  NSMutableString *playlist =
+      [NSMutableString stringWithFormat:kPlaylistVOD,
+                                        MAX(kIFramePlaylistVersion, PlaylistVersion(stream)),
+                                        0,
+                                        (unsigned long long)ceil(targetDuration)];
+  [playlist appendString:kIFramesOnly];
+  [playlist appendString:segments];
+  [playlist appendString:kPlaylistVODEnd];
+  return [playlist dataUsingEncoding:NSUTF8StringEncoding];
+}
+
 // Creates the TS playlist with segments and durations.
 - (NSData *)buildChildPlaylist:(Stream *)stream {
+  if (stream.periodStreams.count ||
+      (stream.isPassthrough && stream.dashMediaType == SEGMENT_BASE)) {
+    return [[self buildMultiPeriodPlaylist:stream] dataUsingEncoding:NSUTF8StringEncoding];
+  }
   if (stream.dashMediaType == SEGMENT_BASE) {
     return [[self buildSegmentBasePlaylist:stream] dataUsingEncoding:NSUTF8StringEncoding];
   }
+  if (IsChunked(stream)) {
+    return [[self buildLowLatencyPlaylist:stream] dataUsingEncoding:NSUTF8StringEncoding];
+  }
   if (stream.dashMediaType == SEGMENT_TEMPLATE_DURATION) {
     return [[self buildSegmentTemplatePlaylist:stream] dataUsingEncoding:NSUTF8StringEncoding];
   }
+  if (stream.dashMediaType == SEGMENT_TEMPLATE_TIMELINE) {
+    return [[self buildSegmentTimelinePlaylist:stream] dataUsingEncoding:NSUTF8StringEncoding];
+  }
   return nil;
 }
 
-// Downloads requested byte range for the stream.
-// Called on _streamingQ.
-- (void)loadStream:(Stream *)stream {
+// Returns the URL holding the initialization data of a non-SegmentBase stream.
+- (NSURL *)initializationURLForStream:(Stream *)stream {
+  // Determine if stream has Init segment that contains stream data.
+  NSURL *initURL = stream.liveStream.initializationURL;
+  if (initURL) {
+    return initURL;
+  }
+  NSString *URLString = [stream.sourceURL absoluteString];
+  NSString *number = [NSString stringWithFormat:@"%tu", stream.liveStream.startNumber];
+  URLString = [URLString stringByReplacingOccurrencesOfString:kLiveRepresentationID
+                                                   withString:stream.liveStream.representationId];
+  URLString = [URLString stringByReplacingOccurrencesOfString:kLiveNumber withString:number];
+  return [[NSURL alloc] initWithString:URLString];
+}
+
+// Returns the URL holding the initialization data of |stream|.
+- (NSURL *)initializationRequestURLForStream:(Stream *)stream {
   // Check if Stream is Segment Base and does not have a duration, then Live
   // stream.
   if (stream.dashMediaType != SEGMENT_BASE && !stream.mediaPresentationDuration) {
     stream.isLive = YES;
   }
-  NSURL *requestURL = stream.sourceURL;
-  Downloader *downloader = [Downloader sharedInstance];
-  // Check if Dash Type is something other than Segment Base.
   if (stream.dashMediaType != SEGMENT_BASE) {
-    // Determine if stream has Init segment that contains stream data.
-    NSURL *initURL = stream.liveStream.initializationURL;
-    if (initURL) {
-      requestURL = initURL;
-    } else {
-      NSString *URLString = [stream.sourceURL absoluteString];
-      NSString *number = [NSString stringWithFormat:@"%tu", stream.liveStream.startNumber];
-      URLString =
-          [URLString stringByReplacingOccurrencesOfString:kLiveRepresentationID
-                                               withString:stream.liveStream.representationId];
-      URLString = [URLString stringByReplacingOccurrencesOfString:kLiveNumber withString:number];
-      requestURL = [[NSURL alloc] initWithString:URLString];
-    }
-    NSData *data = [downloader downloadPartialDataSync:requestURL range:stream.initialRange];
-    if (data == nil) {
-      CDMLogError(@"failed to load data from %@", requestURL);
-      return;
+    return [self initializationURLForStream:stream];
+  }
+  return stream.sourceURL;
+}
+
+// Initializes |stream| with its downloaded initialization |data| and builds its playlist.
+// Streams are initialized concurrently, but each stream only once.
+- (BOOL)initializeStream:(Stream *)stream withData:(NSData *)data fromURL:(NSURL *)URL {
+  @synchronized(stream) {
+    if (IsInitialized(stream)) {
+      // Already initialized, e.g. on first request from the player.
+      return YES;
     }
-    if (![stream initialize:data]) {
-      CDMLogError(@"failed to initialize stream from %@", requestURL);
-      return;
+    if (!data) {
+      CDMLogError(@"failed to load data from %@", URL);
+      return NO;
+    }
+    BOOL initialized = stream.isPassthrough
+                           ? [self initializePassthroughStream:stream withData:data]
+                           : [stream initialize:data];
+    if (!initialized) {
+      CDMLogError(@"failed to initialize stream from %@", URL);
+      return NO;
     }
     stream.m3u8 = [self buildChildPlaylist:stream];
-  } else {
-    [downloader
-        downloadPartialData:requestURL
-               range:stream.initialRange
-                 completion:^(NSData *data, NSError *connectionError) {
-                   dispatch_async(_streamingQ, ^{
-                     if (!data) {
-                       CDMLogNSError(connectionError, @"downloading %@", requestURL);
-                     }
-                     if (![stream initialize:data]) {
-                       return;
+  }
+  [self periodStreamInitialized:stream];
+  [self measureSegmentsOfStream:stream initializationData:data];
+  return YES;
+}
+
+// Measures the durations of the segments of the on-demand SegmentTemplate |stream|, whose
+// initialization segment is |data|, in the background: a segment lasts until the tfdt of the next
+// one. The playlist is published with the nominal durations first and rebuilt once every segment
+// has been measured. Segments are measured one at a time from their first bytes, each download
+// bounded by the Downloader timeout. The last segment, and those next to a segment that could not
+// be measured, keep their nominal duration.
+- (void)measureSegmentsOfStream:(Stream *)stream initializationData:(NSData *)data {
+  LiveStream *liveStream = stream.liveStream;
+  double duration =
+      stream.period.duration > 0 ? stream.period.duration : stream.mediaPresentationDuration;
+  if (stream.dashMediaType != SEGMENT_TEMPLATE_DURATION || !stream.mediaPresentationDuration ||
+      IsChunked(stream) || liveStream.segmentDuration <= 0) {
+    return;
+  }
+  NSUInteger count = (NSUInteger)ceil(duration / liveStream.segmentDuration);
+  Fmp4Track track;
+  if (count < 2 || count > kMaxMeasuredSegments ||
+      !ParseFmp4Track((const uint8_t *)data.bytes, data.length, &track) || !track.timescale) {
+    return;
+  }
+  uint32_t timescale = track.timescale;
+  NSUInteger startNumber = liveStream.startNumber;
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+    uint64_t previousStart = 0;
+    BOOL previousMeasured = NO;
+    NSUInteger measuredCount = 0;
+    for (NSUInteger index = 0; index < count && _streamingQ; ++index) {
+      int segment = (int)(startNumber + index);
+      NSURL *URL = [self URLOfSegment:segment stream:stream];
+      NSData *head = URL ? [[Downloader sharedInstance]
+                               downloadPartialDataSync:URL
+                                                 range:NSMakeRange(0, kMeasuredSegmentHeadLength)]
+                         : nil;
+      uint64_t start = 0;
+      BOOL measured = ParseFmp4SegmentStart((const uint8_t *)head.bytes, head.length, &start);
+      if (measured && previousMeasured && start > previousStart) {
+        [stream setDuration:(NSUInteger)PtsFromTime(start - previousStart, timescale)
+                  ofSegment:segment - 1];
+        ++measuredCount;
+      }
+      previousStart = start;
+      previousMeasured = measured;
+    }
+    CDMLogInfo(@"measured %tu of %tu segments of stream %tu",
+               measuredCount,
+               count,
+               stream.streamIndex);
+    if (measuredCount) {
+      [self rebuildPublishedPlaylistOfStream:stream];
+    }
+  });
+}
+
+// Rebuilds the playlist listing |stream|, its own or that of the track it belongs to in the first
+// Period, if it has already been published.
+- (void)rebuildPublishedPlaylistOfStream:(Stream *)stream {
+  Stream *owner = stream;
+  if (stream.period.index) {
+    owner = nil;
+    for (Stream *firstStream in [self firstPeriodStreams]) {
+      if ([firstStream.periodStreams containsObject:stream]) {
+        owner = firstStream;
+        break;
+      }
+    }
+  }
+  @synchronized(owner) {
+    if (owner.m3u8.length) {
+      owner.m3u8 = [self buildChildPlaylist:owner];
+    }
+  }
+}
+
+// Initializes |stream|, whose segments are served as fragmented MP4, with its initialization
+// segment |data|. An encrypted stream is ready once the license for its key has been added.
+- (BOOL)initializePassthroughStream:(Stream *)stream withData:(NSData *)data {
+  Fmp4Track track;
+  if (!ParseFmp4Track((const uint8_t *)data.bytes, data.length, &track)) {
+    CDMLogError(@"failed to parse the initialization segment of stream %tu", stream.streamIndex);
+    return NO;
+  }
+  if (track.encrypted && track.scheme != Fmp4FourCC('c', 'e', 'n', 'c')) {
+    CDMLogError(@"stream %tu is not protected with the cenc scheme", stream.streamIndex);
+    return NO;
+  }
+  NSData *pssh = stream.pssh;
+  for (const std::vector<uint8_t> &box : track.psshs) {
+    NSData *candidate = [NSData dataWithBytes:box.data() length:box.size()];
+    if (CDMIsWidevinePssh(candidate)) {
+      pssh = candidate;
+      break;
+    }
+  }
+  if (track.encrypted && !pssh.length) {
+    CDMLogError(@"stream %tu has no PSSH", stream.streamIndex);
+    return NO;
+  }
+  stream.initializationSegment = data;
+  Fmp4SegmentIndex index;
+  if (stream.dashMediaType == SEGMENT_BASE && ![self segmentIndex:&index ofStream:stream]) {
+    CDMLogError(@"failed to parse the sidx of stream %tu", stream.streamIndex);
+    stream.initializationSegment = nil;
+    return NO;
+  }
+  if (!track.encrypted) {
+    [self streamReady:stream];
+    return YES;
+  }
+  dispatch_queue_t streamingQ = _streamingQ;
+  if (!streamingQ) {
+    return YES;
+  }
+  // CDM session bookkeeping happens on the streaming queue, as for streams transmuxed by UDT.
+  dispatch_async(streamingQ, ^{
+    [[iOSCdm sharedInstance] processPsshKey:pssh
+                               isOfflineVod:[stream.sourceURL isFileURL]
+                            completionBlock:^(NSError *error) {
+                              if (error) {
+                                CDMLogNSError(error, @"obtaining PSSH key");
+                                return;
+                              }
+                              [self streamReady:stream];
+                            }];
+  });
+  return YES;
+}
+
+// Reads the sidx of a fragmented MP4 SegmentBase stream from its initialization segment.
+- (BOOL)segmentIndex:(Fmp4SegmentIndex *)index ofStream:(Stream *)stream {
+  NSData *initializationSegment = stream.initializationSegment;
+  return ParseFmp4SegmentIndex((const uint8_t *)initializationSegment.bytes,
+                               initializationSegment.length,
+                               stream.initialRange.location,
+                               index);
+}
+
+// Downloads the initialization data of |stream| and initializes it before returning.
+- (BOOL)loadStreamSync:(Stream *)stream {
+  if (stream.sessionStream) {
+    return [self loadStreamSync:stream.sessionStream] && [self adoptSessionForStream:stream];
+  }
+  // Waits for the download started by loadStream: instead of fetching the data again, and only
+  // downloads it here if there was none or the stream still failed to initialize.
+  dispatch_group_t load = nil;
+  @synchronized(_streamLoads) {
+    load = [_streamLoads objectForKey:stream];
+  }
+  if (load) {
+    dispatch_group_wait(load, DISPATCH_TIME_FOREVER);
+  }
+  @synchronized(stream) {
+    if (IsInitialized(stream)) {
+      return YES;
+    }
+  }
+  NSURL *requestURL = [self initializationRequestURLForStream:stream];
+  NSData *data = [[Downloader sharedInstance] downloadPartialDataSync:requestURL
+                                                                range:stream.initialRange];
+  return [self initializeStream:stream withData:data fromURL:requestURL];
+}
+
+- (void)loadStream:(Stream *)stream {
+  [self loadStream:stream completion:nil];
+}
+
+// Issues the initialization fetch for |stream| without waiting for it. Parsing and initialization
+// run on _initQ so several streams are processed at once. |completion| is called once the stream
+// has been initialized or has failed to.
+- (void)loadStream:(Stream *)stream completion:(dispatch_block_t)completion {
+  NSURL *requestURL = [self initializationRequestURLForStream:stream];
+  dispatch_queue_t initQ = _initQ;
+  NSMapTable<Stream *, dispatch_group_t> *streamLoads = _streamLoads;
+  dispatch_group_t load = dispatch_group_create();
+  dispatch_group_enter(load);
+  @synchronized(streamLoads) {
+    [streamLoads setObject:load forKey:stream];
+  }
+  [[Downloader sharedInstance]
+      downloadPartialData:requestURL
+                    range:stream.initialRange
+               completion:^(NSData *data, NSError *connectionError) {
+                 dispatch_async(initQ, ^{
+                   if (!data) {
+                     CDMLogNSError(connectionError, @"downloading %@", requestURL);
+                   }
+                   if (_streamingQ) {
+                     [self initializeStream:stream withData:data fromURL:requestURL];
+                   }
+                   @synchronized(streamLoads) {
+                     if ([streamLoads objectForKey:stream] == load) {
+                       [streamLoads removeObjectForKey:stream];
                      }
-                     stream.m3u8 = [self buildChildPlaylist:stream];
-                   });
-                 }];
+                   }
+                   dispatch_group_leave(load);
+                   if (completion) {
+                     completion();
+                   }
+                 });
+               }];
+}
+
+// Initializes a stream that was not needed to start playback when the player first asks for it.
+// Blocks the calling connection until the stream's playlist is available.
+- (void)waitForStream:(Stream *)stream {
+  if (stream.m3u8.length == 0) {
+    [self loadStreamSync:stream];
+  }
+  if (stream.m3u8.length == 0 && stream.periodStreams.count) {
+    // The playlist of a multi-Period track needs the streams of every Period.
+    for (Stream *periodStream in stream.periodStreams) {
+      [self loadStreamSync:periodStream];
+    }
+    @synchronized(stream) {
+      if (stream.m3u8.length == 0) {
+        stream.m3u8 = [self buildChildPlaylist:stream];
+      }
+    }
   }
 }
 
-// Validates that all streams are complete and playback is ready.
+// Marks |stream| ready and starts playback once every startup stream is ready. The remaining
+// streams keep initializing in the background.
 - (void)streamReady:(Stream *)stream {
-  stream.done = YES;
-  --_preloadCount;
-  if (_preloadCount == 0 && _streamingQ) {
-    // streamReady is called in the middle of processing a stream.
-    // Ensure all streams have been processed before sending to video player.
-    dispatch_async(_streamingQ, ^() {
-      dispatch_async(dispatch_get_main_queue(), ^() {
-        [self startVideoPlayer];
-      });
+  dispatch_queue_t streamingQ = _streamingQ;
+  if (!streamingQ) {
+    return;
+  }
+  // streamReady is called in the middle of processing a stream and from the licensing queue.
+  // Hop onto _streamingQ so the stream's playlist is built before it is counted.
+  dispatch_async(streamingQ, ^() {
+    if (stream.done) {
+      return;
+    }
+    stream.done = YES;
+    --_preloadCount;
+    if (_playbackReady) {
+      return;
+    }
+    for (Stream *startupStream in _startupStreams) {
+      if (!startupStream.done) {
+        return;
+      }
+    }
+    _playbackReady = YES;
+    dispatch_async(dispatch_get_main_queue(), ^() {
+      [self startVideoPlayer];
     });
+  });
+}
+
+// Sets |range| to the bytes of |segment| of the SegmentBase |stream| in its file, from the UDT
+// index or, for fragmented MP4 streams, the sidx. Returns NO if the segment is not indexed.
+- (BOOL)range:(NSRange *)range ofSegment:(int)segment stream:(Stream *)stream {
+  if (stream.isPassthrough) {
+    Fmp4SegmentIndex index;
+    if (![self segmentIndex:&index ofStream:stream] || index.references.size() <= (size_t)segment ||
+        segment < 0) {
+      CDMLogError(@"segment %d is not in the sidx of %@", segment, stream.sourceURL);
+      return NO;
+    }
+    const Fmp4SegmentReference &reference = index.references[segment];
+    *range = NSMakeRange((NSUInteger)reference.offset, reference.size);
+    return YES;
   }
+  if (!stream.dashIndex) {
+    CDMLogError(@"dashIndex is empty from %@", stream.sourceURL);
+    return NO;
+  }
+  if (segment < 0 || (int)stream.dashIndex->index_count <= segment) {
+    CDMLogError(@"segment %d is out of range %u from %@",
+                segment,
+                stream.dashIndex->index_count,
+                stream.sourceURL);
+    return NO;
+  }
+  const auto &segments = stream.dashIndex->segments[segment];
+  *range = NSMakeRange(segments.location, segments.length);
+  return YES;
 }
 
-// Creates TS segments based on downloading a specific byte range.
-- (NSData *)tsDataForIndex:(int)index segment:(int)segment {
-  if ((int)_streams.count <= index) {
-    return nil;
+// Returns the URL of |segment| of a stream with a SegmentTemplate or SegmentList, with the
+// placeholders of the manifest filled in.
+- (NSURL *)URLOfSegment:(int)segment stream:(Stream *)stream {
+  NSString *urlString = [stream.sourceURL absoluteString];
+
+  // Swap Placeholder $RepresentationID$ with variable stored in stream.
+  urlString = [urlString stringByReplacingOccurrencesOfString:kLiveRepresentationID
+                                                   withString:stream.liveStream.representationId];
+  // Swap Placeholder $Time$ with the start of the segment in the SegmentTimeline.
+  if ([urlString containsString:kLiveTime]) {
+    NSArray<NSNumber *> *timeline = stream.liveStream.segmentTimeline;
+    NSInteger timelineIndex = segment - (NSInteger)stream.liveStream.startNumber;
+    if (timelineIndex < 0 || timelineIndex + 1 >= (NSInteger)timeline.count) {
+      CDMLogError(@"segment %d is not in the SegmentTimeline of %@", segment, urlString);
+      return nil;
+    }
+    NSString *time = timeline[timelineIndex].stringValue;
+    urlString = [urlString stringByReplacingOccurrencesOfString:kLiveTime withString:time];
   }
-  Stream *stream = _streams[index];
+  // Check if there is numbered padding to $Number variable.
+  if ([urlString containsString:kNumberPlaceholder]) {
+    NSRegularExpression *numberRegex =
+        [[NSRegularExpression alloc] initWithPattern:kNumberRegexPattern options:0 error:nil];
+    urlString = [urlString stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    NSTextCheckingResult *numberMatch =
+        [numberRegex firstMatchInString:urlString
+                                options:0
+                                  range:NSMakeRange(0, urlString.length)];
+    if (numberMatch) {
+      NSRange formatRange = [numberMatch rangeAtIndex:1];
+
+      NSString *segmentFormat = formatRange.location != NSNotFound
+                                    ? [urlString substringWithRange:formatRange]
+                                    : kNumberFormat;
+      NSString *segmentString = [NSString stringWithFormat:segmentFormat, segment];
+      urlString = [urlString stringByReplacingCharactersInRange:numberMatch.range
+                                                     withString:segmentString];
+    }
+  }
+  return [[NSURL alloc] initWithString:urlString];
+}
 
+// Downloads |segment| of |stream| as it is in the manifest.
+- (NSData *)dashDataForStream:(Stream *)stream segment:(int)segment {
   NSURL *requestURL = nil;
   NSData *data = nil;
-  if (stream.dashMediaType != SEGMENT_BASE) {
-    NSString *urlString = [stream.sourceURL absoluteString];
-
-    // Swap Placeholder $RepresentationID$ with variable stored in stream.
-    urlString = [urlString stringByReplacingOccurrencesOfString:kLiveRepresentationID
-                                                     withString:stream.liveStream.representationId];
-    // Check if there is numbered padding to $Number variable.
-    if ([urlString containsString:kNumberPlaceholder]) {
-      NSRegularExpression *numberRegex =
-          [[NSRegularExpression alloc] initWithPattern:kNumberRegexPattern options:0 error:nil];
-      urlString = [urlString stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
-      NSTextCheckingResult *numberMatch =
-          [numberRegex firstMatchInString:urlString
-                                  options:0
-                                    range:NSMakeRange(0, urlString.length)];
-      if (numberMatch) {
-        NSRange formatRange = [numberMatch rangeAtIndex:1];
-
-        NSString *segmentFormat = formatRange.location != NSNotFound
-                                      ? [urlString substringWithRange:formatRange]
-                                      : kNumberFormat;
-        NSString *segmentString = [NSString stringWithFormat:segmentFormat, segment];
-        urlString = [urlString stringByReplacingCharactersInRange:numberMatch.range
-                                                       withString:segmentString];
-      }
-    }
-    requestURL = [[NSURL alloc] initWithString:urlString];
+  if (IsChunked(stream)) {
+    // Parts of the segment may already be downloading it.
+    ChunkedSegment *chunkedSegment = [self chunkedSegment:segment ofStream:stream];
+    requestURL = chunkedSegment.URL;
+    data = [chunkedSegment waitForData];
+  } else if (stream.dashMediaType != SEGMENT_BASE) {
+    requestURL = [self URLOfSegment:segment stream:stream];
+    if (!requestURL) {
+      return nil;
+    }
     data = [[Downloader sharedInstance] downloadPartialDataSync:requestURL
                                                           range:stream.initialRange];
   } else {
     requestURL = stream.sourceURL;
-    if (!stream.dashIndex) {
-      CDMLogError(@"dashIndex is empty from %@", requestURL);
-      return nil;
-    }
-    if ((int)stream.dashIndex->index_count <= segment) {
-      CDMLogError(@"segment %d is out of range %u from %@",
-                  segment,
-                  stream.dashIndex->index_count,
-                  requestURL);
+    NSRange range;
+    if (![self range:&range ofSegment:segment stream:stream]) {
       return nil;
     }
-    const auto &segments = stream.dashIndex->segments[segment];
-    NSRange range = NSMakeRange(segments.location, segments.length);
     data = [[Downloader sharedInstance] downloadPartialDataSync:requestURL range:range];
   }
   if ([data length] == 0) {
@@ -460,22 +1874,341 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     CDMLogError(@"key for %@ not found on Google Storage", requestURL);
     return nil;
   }
+  return data;
+}
+
+// Downloads the start of |segment| of the SegmentBase |stream|, up to the end of its first sample,
+// and cuts the fragment down to that sample, the key frame starting the segment. Falls back to the
+// whole segment when the fragment cannot be cut.
+- (NSData *)keyFrameDataForStream:(Stream *)stream segment:(int)segment {
+  NSRange range;
+  if (![self range:&range ofSegment:segment stream:stream]) {
+    return nil;
+  }
+  // The first request usually holds the moof, and often the key frame as well.
+  NSUInteger length = MIN(range.length, kKeyFramePrefixSize);
+  for (int request = 0; request < kKeyFrameMaxRequests; ++request) {
+    NSData *data = [[Downloader sharedInstance]
+        downloadPartialDataSync:stream.sourceURL
+                          range:NSMakeRange(range.location, length)];
+    size_t extent = 0;
+    if (data.length < length ||
+        !Fmp4KeyFrameExtent((const uint8_t *)data.bytes, data.length, &extent) ||
+        extent > range.length) {
+      break;
+    }
+    if (extent <= data.length) {
+      std::vector<uint8_t> keyFrame;
+      if (!CutFmp4KeyFrame((const uint8_t *)data.bytes, extent, &keyFrame)) {
+        break;
+      }
+      return [NSData dataWithBytes:keyFrame.data() length:keyFrame.size()];
+    }
+    length = extent;
+  }
+  CDMLogWarn(@"serving all of segment %d of stream %tu as its key frame",
+             segment,
+             stream.streamIndex);
+  return [self dashDataForStream:stream segment:segment];
+}
 
+// Remembers the last segment served of each type, from which live playlists are built.
+- (void)segmentServed:(int)segment ofStream:(Stream *)stream {
+  if (stream.isVideo) {
+    _currentVideoSegment = segment;
+  } else {
+    _currentAudioSegment = segment;
+  }
+}
+
+// Returns the download of |segment| of the chunked |stream|, starting it unless an earlier request
+// for the segment or one of its parts already has. Downloads of older segments are dropped.
+- (ChunkedSegment *)chunkedSegment:(int)segment ofStream:(Stream *)stream {
+  @synchronized(_chunkedSegments) {
+    ChunkedSegment *chunkedSegment = nil;
+    for (ChunkedSegment *candidate in [_chunkedSegments copy]) {
+      if (candidate.streamIndex != stream.streamIndex) {
+        continue;
+      }
+      if (candidate.segment == segment && !candidate.failed) {
+        chunkedSegment = candidate;
+      } else if (candidate.segment == segment || candidate.segment + kPartSegments < segment) {
+        [_chunkedSegments removeObject:candidate];
+      }
+    }
+    if (!chunkedSegment) {
+      NSURL *URL = [self URLOfSegment:segment stream:stream];
+      if (!URL) {
+        return nil;
+      }
+      chunkedSegment = [[ChunkedSegment alloc] initWithURL:URL
+                                               streamIndex:stream.streamIndex
+                                                   segment:segment];
+      [_chunkedSegments addObject:chunkedSegment];
+      [chunkedSegment start];
+    }
+    return chunkedSegment;
+  }
+}
+
+// Waits for |part| of |segment| of the chunked |stream|, its chunk of the same index, and returns
+// it as it is in the segment.
+- (NSData *)partDataForStream:(Stream *)stream segment:(int)segment part:(int)part {
+  if (!IsChunked(stream) || part < 0 || part >= PartsPerSegment(stream)) {
+    CDMLogError(@"stream %tu has no part %d", stream.streamIndex, part);
+    return nil;
+  }
+  NSData *data = [[self chunkedSegment:segment ofStream:stream] waitForChunk:part];
+  if (!data) {
+    CDMLogError(@"part %d of segment %d of stream %tu was not received",
+                part,
+                segment,
+                stream.streamIndex);
+  }
+  return data;
+}
+
+// Records the PTS and duration of |data|, the whole of |segment| of |stream|, for the playlists.
+- (void)recordTimingOfData:(NSData *)data stream:(Stream *)stream segment:(int)segment {
+  uint64_t pts = 0;
+  uint64_t duration = 0;
+  if (stream.isPassthrough) {
+    NSData *initializationSegment = stream.initializationSegment;
+    Fmp4Track track;
+    if (!ParseFmp4Track((const uint8_t *)initializationSegment.bytes,
+                        initializationSegment.length,
+                        &track) ||
+        !track.timescale ||
+        !ParseFmp4SegmentTiming((const uint8_t *)data.bytes, data.length, &pts, &duration)) {
+      CDMLogWarn(@"no timing in segment %d of stream %tu", segment, stream.streamIndex);
+      return;
+    }
+    pts = PtsFromTime(pts, track.timescale);
+    duration = PtsFromTime(duration, track.timescale);
+  } else {
+    DashToHlsStatus status;
+    @synchronized(stream.sessionStream ?: stream) {
+      status = DashToHls_ParseSegmentPTS(
+          stream.session, (const uint8_t *)data.bytes, data.length, &pts, &duration);
+    }
+    if (status != kDashToHlsStatus_OK) {
+      CDMLogWarn(@"no timing in segment %d of stream %tu", segment, stream.streamIndex);
+      return;
+    }
+  }
+  [stream setPts:(NSUInteger)pts duration:(NSUInteger)duration ofSegment:segment];
+}
+
+// Transmuxes |data|, all or part of |segment| of |stream|, to TS.
+- (NSData *)transmuxData:(NSData *)data ofStream:(Stream *)stream segment:(int)segment {
   const uint8_t *hlsSegment;
   size_t hlsSize;
-  DashToHlsStatus status = Udt_ConvertDash(
-      stream.session, segment, (const uint8_t *)[data bytes], [data length], &hlsSegment, &hlsSize);
-  if (kDashToHlsStatus_OK == status) {
-    NSData *response_data = [NSData dataWithBytes:hlsSegment length:hlsSize];
-    Udt_ReleaseHlsSegment(stream.session, segment);
-    if (stream.isVideo) {
-      _currentVideoSegment = segment;
-    } else {
-      _currentAudioSegment = segment;
+  NSData *response_data = nil;
+  // Segments of different Periods may have the same number, and are converted one at a time when
+  // they share a session.
+  @synchronized(stream.sessionStream ?: stream) {
+    DashToHlsStatus status = Udt_ConvertDash(stream.session,
+                                             segment,
+                                             (const uint8_t *)[data bytes],
+                                             [data length],
+                                             &hlsSegment,
+                                             &hlsSize);
+    if (kDashToHlsStatus_OK == status) {
+      response_data = [NSData dataWithBytes:hlsSegment length:hlsSize];
+      Udt_ReleaseHlsSegment(stream.session, segment);
     }
-    return response_data;
   }
-  return nil;
+  return response_data;
+}
+
+// Creates TS segments based on downloading a specific byte range. With |keyFrameOnly|, only the key
+// frame starting the segment is downloaded and transmuxed, for the I-frame playlist.
+- (NSData *)tsDataForIndex:(int)index segment:(int)segment keyFrameOnly:(BOOL)keyFrameOnly {
+  if (index < 0 || (int)_streams.count <= index) {
+    return nil;
+  }
+  Stream *stream = _streams[index];
+  NSData *data = keyFrameOnly ? [self keyFrameDataForStream:stream segment:segment]
+                              : [self dashDataForStream:stream segment:segment];
+  if (!data) {
+    return nil;
+  }
+  NSData *response_data = [self transmuxData:data ofStream:stream segment:segment];
+  if (response_data && !keyFrameOnly) {
+    [self recordTimingOfData:data stream:stream segment:segment];
+    [self segmentServed:segment ofStream:stream];
+  }
+  return response_data;
+}
+
+// Creates the TS of |part| of |segment| of a chunked stream as soon as its chunk is received.
+- (NSData *)tsDataForIndex:(int)index segment:(int)segment part:(int)part {
+  if (index < 0 || (int)_streams.count <= index) {
+    return nil;
+  }
+  Stream *stream = _streams[index];
+  NSData *data = [self partDataForStream:stream segment:segment part:part];
+  if (!data) {
+    return nil;
+  }
+  return [self transmuxData:data ofStream:stream segment:segment];
+}
+
+// Returns the initialization segment of a fragmented MP4 stream, describing clear samples.
+- (NSData *)fmp4InitializationDataForIndex:(int)index {
+  if (index < 0 || (int)_streams.count <= index) {
+    return nil;
+  }
+  Stream *stream = _streams[index];
+  if (!stream.isPassthrough || !stream.initializationSegment) {
+    CDMLogError(@"stream %d has no initialization segment", index);
+    return nil;
+  }
+  NSData *initializationSegment = stream.initializationSegment;
+  std::vector<uint8_t> clear;
+  if (!ClearFmp4Initialization((const uint8_t *)initializationSegment.bytes,
+                               initializationSegment.length,
+                               &clear)) {
+    CDMLogError(@"failed to rewrite the initialization segment of stream %d", index);
+    return nil;
+  }
+  return [self encryptFmp4Data:[NSData dataWithBytes:clear.data() length:clear.size()]
+                      resource:kFmp4InitializationResource
+                         index:index
+                       segment:0
+                          part:0];
+}
+
+// Encrypts fragmented MP4 |data| with the key and the IV the playlists list for the |resource| of
+// |segment| and |part| of stream |index|.
+- (NSData *)encryptFmp4Data:(NSData *)data
+                   resource:(Fmp4Resource)resource
+                      index:(int)index
+                    segment:(int)segment
+                       part:(int)part {
+  const uint32_t iv[] = {CFSwapInt32HostToBig(resource),
+                         CFSwapInt32HostToBig((uint32_t)index),
+                         CFSwapInt32HostToBig((uint32_t)segment),
+                         CFSwapInt32HostToBig((uint32_t)part)};
+  NSMutableData *encrypted = [NSMutableData dataWithLength:data.length + kCCBlockSizeAES128];
+  size_t encryptedLength = 0;
+  CCCryptorStatus status = _fmp4Key ? CCCrypt(kCCEncrypt,
+                                              kCCAlgorithmAES,
+                                              kCCOptionPKCS7Padding,
+                                              _fmp4Key.bytes,
+                                              _fmp4Key.length,
+                                              iv,
+                                              data.bytes,
+                                              data.length,
+                                              encrypted.mutableBytes,
+                                              encrypted.length,
+                                              &encryptedLength)
+                                    : kCCParamError;
+  if (status != kCCSuccess) {
+    CDMLogError(@"failed to encrypt segment %d of stream %d: %d", segment, index, (int)status);
+    return nil;
+  }
+  encrypted.length = encryptedLength;
+  return encrypted;
+}
+
+// Decrypts |data|, all or part of |segment| of the fragmented MP4 stream |index|, in place.
+- (BOOL)decryptData:(NSMutableData *)data ofIndex:(int)index segment:(int)segment {
+  NSData *initializationSegment = _streams[index].initializationSegment;
+  Fmp4Track track;
+  if (!ParseFmp4Track((const uint8_t *)initializationSegment.bytes,
+                      initializationSegment.length,
+                      &track)) {
+    CDMLogError(@"stream %d has no initialization segment", index);
+    return NO;
+  }
+  if (!DecryptFmp4Segment(
+          track, (uint8_t *)data.mutableBytes, data.length, Fmp4DecryptionHandler, NULL)) {
+    CDMLogError(@"failed to decrypt segment %d of stream %d", segment, index);
+    return NO;
+  }
+  return YES;
+}
+
+// Creates fragmented MP4 segments by downloading and decrypting the segments in the manifest. With
+// |keyFrameOnly|, only the key frame starting the segment is, for the I-frame playlist.
+- (NSData *)fmp4DataForIndex:(int)index segment:(int)segment keyFrameOnly:(BOOL)keyFrameOnly {
+  if (index < 0 || (int)_streams.count <= index || !_streams[index].isPassthrough) {
+    CDMLogError(@"stream %d has no initialization segment", index);
+    return nil;
+  }
+  Stream *stream = _streams[index];
+  NSMutableData *data = [(keyFrameOnly ? [self keyFrameDataForStream:stream segment:segment]
+                                        : [self dashDataForStream:stream segment:segment])
+      mutableCopy];
+  if (!data || ![self decryptData:data ofIndex:index segment:segment]) {
+    return nil;
+  }
+  if (!keyFrameOnly) {
+    [self recordTimingOfData:data stream:stream segment:segment];
+    [self segmentServed:segment ofStream:stream];
+  }
+  return [self encryptFmp4Data:data
+                      resource:keyFrameOnly ? kFmp4KeyFrameResource : kFmp4SegmentResource
+                         index:index
+                       segment:segment
+                          part:0];
+}
+
+// Creates |part| of |segment| of a chunked fragmented MP4 stream as soon as its chunk is received.
+- (NSData *)fmp4DataForIndex:(int)index segment:(int)segment part:(int)part {
+  if (index < 0 || (int)_streams.count <= index || !_streams[index].isPassthrough) {
+    CDMLogError(@"stream %d has no initialization segment", index);
+    return nil;
+  }
+  NSMutableData *data =
+      [[self partDataForStream:_streams[index] segment:segment part:part] mutableCopy];
+  if (!data || ![self decryptData:data ofIndex:index segment:segment]) {
+    return nil;
+  }
+  return [self encryptFmp4Data:data
+                      resource:kFmp4PartResource
+                         index:index
+                       segment:segment
+                          part:part];
+}
+
+// Holds a blocking reload of the playlist of the chunked |stream| until the segment and part it
+// asks for with _HLS_msn and _HLS_part are complete. Returns NO if the request is invalid or asks
+// for a segment too far ahead of the live edge.
+- (BOOL)waitForPlaylistUpdate:(NSArray<NSURLQueryItem *> *)queryItems ofStream:(Stream *)stream {
+  NSString *mediaSequence = nil;
+  NSString *part = nil;
+  for (NSURLQueryItem *item in queryItems) {
+    if ([item.name isEqualToString:kMediaSequenceParameter]) {
+      mediaSequence = item.value;
+    } else if ([item.name isEqualToString:kPartParameter]) {
+      part = item.value;
+    }
+  }
+  if (!mediaSequence) {
+    // A part alone does not say which segment it is in.
+    return part == nil;
+  }
+  int segment = mediaSequence.intValue;
+  int liveSegment = 0;
+  int liveParts = 0;
+  LiveEdge(stream, [NSDate date], &liveSegment, &liveParts);
+  // The last complete segment is the one before the live edge.
+  if (segment > liveSegment - 1 + kBlockingReloadSegments) {
+    CDMLogError(@"segment %d of stream %tu is too far ahead of the live edge %d",
+                segment,
+                stream.streamIndex,
+                liveSegment);
+    return NO;
+  }
+  NSDate *date = AvailabilityDate(stream, segment, part ? part.intValue : -1);
+  // Wake up a little late so the playlist built next surely holds the part.
+  NSTimeInterval wait = [date timeIntervalSinceNow] + kPartPrecision;
+  if (wait > 0) {
+    [NSThread sleepForTimeInterval:wait];
+  }
+  return YES;
 }
 
 // Intercept HTTP response for M3U8 and TS files and respond with created data.
@@ -483,6 +2216,11 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
                                          path:(NSString *)path
                                    connection:(HTTPConnection *)connection {
   NSData *response_data = nil;
+  // Blocking playlist reloads add their parameters to the playlist URL.
+  NSURLComponents *components = [NSURLComponents componentsWithString:path];
+  if (components.path) {
+    path = components.path;
+  }
   // Check for incoming filename and return appropriate data.
   if ([path.lastPathComponent isEqualToString:kLocalPlaylist]) {
     CDMLogInfo(@"Requesting %@", path);
@@ -494,19 +2232,38 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     // Catches children playlist requests and provides the appropriate data in place of m3u8.
     NSScanner *scanner = [NSScanner scannerWithString:path];
     int index = 0;
-    if ([scanner scanString:@"/" intoString:NULL] && [scanner scanInt:&index]) {
+    if ([scanner scanString:@"/" intoString:NULL] && [scanner scanInt:&index] && index >= 0 &&
+        (NSUInteger)index < _streams.count) {
       Stream *stream = _streams[index];
-      if (!stream.m3u8) {
+      if (stream.m3u8.length == 0) {
+        [self waitForStream:stream];
+      }
+      if (stream.m3u8.length == 0) {
         CDMLogError(@"stream does not have m3u8");
         return nil;
       }
-      if (stream.isLive) {
-        // Loop through all streams to ensure all playlists are updated in the event of rate change.
-        for (Stream *stream in _streams) {
-          stream.m3u8 = [self buildChildPlaylist:stream];
+      if ([scanner scanString:@"-iframe.m3u8" intoString:NULL]) {
+        // I-frame playlists are only listed for on-demand streams, so they are never refreshed.
+        response_data = [self buildIFramePlaylist:stream];
+      } else {
+        if (IsChunked(stream) && ![self waitForPlaylistUpdate:components.queryItems
+                                                     ofStream:stream]) {
+          return nil;
         }
+        if (stream.isLive) {
+          // Loop through all streams to ensure all playlists are updated in the event of rate
+          // change. Streams that are not initialized yet keep an empty playlist, so that their
+          // first request initializes them.
+          for (Stream *stream in _streams) {
+            @synchronized(stream) {
+              if (IsInitialized(stream)) {
+                stream.m3u8 = [self buildChildPlaylist:stream];
+              }
+            }
+          }
+        }
+        response_data = stream.m3u8;
       }
-      response_data = stream.m3u8;
     }
   } else if ([path.pathExtension isEqualToString:@"ts"]) {
     CDMLogInfo(@"Requesting %@", path);
@@ -514,10 +2271,43 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
     NSScanner *scanner = [NSScanner scannerWithString:path];
     int index = 0;
     int segment = 0;
+    int part = 0;
+    if ([scanner scanString:@"/" intoString:NULL] && [scanner scanInt:&index] &&
+        [scanner scanString:@"-" intoString:NULL] && [scanner scanInt:&segment]) {
+      if ([scanner scanString:@".ts" intoString:NULL]) {
+        response_data = [self tsDataForIndex:index segment:segment keyFrameOnly:NO];
+      } else if ([scanner scanString:@"-iframe.ts" intoString:NULL]) {
+        response_data = [self tsDataForIndex:index segment:segment keyFrameOnly:YES];
+      } else if ([scanner scanString:@"." intoString:NULL] && [scanner scanInt:&part] &&
+                 [scanner scanString:@".ts" intoString:NULL]) {
+        response_data = [self tsDataForIndex:index segment:segment part:part];
+      }
+    }
+  } else if ([path.pathExtension isEqualToString:@"m4s"]) {
+    CDMLogInfo(@"Requesting %@", path);
+    // Handles fragmented MP4 segment requests by decrypting the source MP4.
+    NSScanner *scanner = [NSScanner scannerWithString:path];
+    int index = 0;
+    int segment = 0;
+    int part = 0;
     if ([scanner scanString:@"/" intoString:NULL] && [scanner scanInt:&index] &&
-        [scanner scanString:@"-" intoString:NULL] && [scanner scanInt:&segment] &&
-        [scanner scanString:@".ts" intoString:NULL]) {
-      response_data = [self tsDataForIndex:index segment:segment];
+        [scanner scanString:@"-" intoString:NULL] && [scanner scanInt:&segment]) {
+      if ([scanner scanString:@".m4s" intoString:NULL]) {
+        response_data = [self fmp4DataForIndex:index segment:segment keyFrameOnly:NO];
+      } else if ([scanner scanString:@"-iframe.m4s" intoString:NULL]) {
+        response_data = [self fmp4DataForIndex:index segment:segment keyFrameOnly:YES];
+      } else if ([scanner scanString:@"." intoString:NULL] && [scanner scanInt:&part] &&
+                 [scanner scanString:@".m4s" intoString:NULL]) {
+        response_data = [self fmp4DataForIndex:index segment:segment part:part];
+      }
+    }
+  } else if ([path.pathExtension isEqualToString:@"mp4"]) {
+    CDMLogInfo(@"Requesting %@", path);
+    NSScanner *scanner = [NSScanner scannerWithString:path];
+    int index = 0;
+    if ([scanner scanString:@"/" intoString:NULL] && [scanner scanInt:&index] &&
+        [scanner scanString:@"-init.mp4" intoString:NULL]) {
+      response_data = [self fmp4InitializationDataForIndex:index];
     }
   }
   if (response_data) {
@@ -526,4 +2316,16 @@ static NSString *kLiveRepresentationID = @"$RepresentationID$";
   return nil;
 }
 
+#pragma mark - AVAssetResourceLoaderDelegate
+
+- (BOOL)resourceLoader:(AVAssetResourceLoader *)resourceLoader
+    shouldWaitForLoadingOfRequestedResource:(AVAssetResourceLoadingRequest *)loadingRequest {
+  if (![loadingRequest.request.URL.scheme isEqualToString:kFmp4KeyScheme] || !_fmp4Key) {
+    return NO;
+  }
+  [loadingRequest.dataRequest respondWithData:_fmp4Key];
+  [loadingRequest finishLoading];
+  return YES;
+}
+
 @end
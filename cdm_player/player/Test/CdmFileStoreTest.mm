@@ -0,0 +1,137 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CdmFileStore.h"
+
+static const NSUInteger kStoredLicenses = 1000;
+static const NSUInteger kLicenseSize = 2048;
+
+@interface CdmFileStoreTest : XCTestCase {
+  std::string _path;
+}
+@end
+
+@implementation CdmFileStoreTest
+
+- (void)setUp {
+  NSString *path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  _path = path.UTF8String;
+}
+
+- (void)tearDown {
+  unlink(_path.c_str());
+}
+
+- (void)testReadWriteRemove {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertFalse(store.exists("license"));
+  XCTAssertEqual(store.size("license"), -1);
+
+  XCTAssertTrue(store.write("license", "first"));
+  XCTAssertTrue(store.write("license", "second"));
+  std::string data;
+  XCTAssertTrue(store.read("license", &data));
+  XCTAssertEqual(data, "second");
+  XCTAssertEqual(store.size("license"), 6);
+
+  XCTAssertTrue(store.remove("license"));
+  XCTAssertFalse(store.exists("license"));
+  XCTAssertFalse(store.read("license", &data));
+  XCTAssertFalse(store.remove("license"));
+}
+
+- (void)testReopen {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.write("kept", "value"));
+  XCTAssertTrue(store.write("removed", "value"));
+  XCTAssertTrue(store.remove("removed"));
+  store.Close();
+
+  XCTAssertTrue(store.Open(_path));
+  std::string data;
+  XCTAssertTrue(store.read("kept", &data));
+  XCTAssertEqual(data, "value");
+  XCTAssertFalse(store.exists("removed"));
+}
+
+- (void)testTornAppend {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.write("kept", "value"));
+  uint64_t validSize = store.file_size();
+  XCTAssertTrue(store.write("torn", "value"));
+  store.Close();
+  // Simulate a crash part way through the last append.
+  XCTAssertEqual(truncate(_path.c_str(), validSize + 10), 0);
+
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertEqual(store.file_size(), validSize);
+  XCTAssertTrue(store.exists("kept"));
+  XCTAssertFalse(store.exists("torn"));
+  // New records must follow the last valid one.
+  XCTAssertTrue(store.write("next", "value"));
+  store.Close();
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.exists("next"));
+}
+
+- (void)testCorruptRecord {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.write("kept", "value"));
+  uint64_t validSize = store.file_size();
+  XCTAssertTrue(store.write("corrupt", "value"));
+  uint64_t size = store.file_size();
+  store.Close();
+  int fd = open(_path.c_str(), O_WRONLY);
+  XCTAssertEqual(pwrite(fd, "X", 1, size - 1), 1);
+  close(fd);
+
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertEqual(store.file_size(), validSize);
+  XCTAssertTrue(store.exists("kept"));
+  XCTAssertFalse(store.exists("corrupt"));
+}
+
+- (void)testCompaction {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.write("kept", "value"));
+  for (NSUInteger i = 0; i < 100; ++i) {
+    XCTAssertTrue(store.write("renewed", std::string(kLicenseSize, 'a' + i % 26)));
+  }
+  // Superseded records are dropped once they dominate the file.
+  XCTAssertLessThan(store.file_size(), 100 * kLicenseSize);
+  XCTAssertTrue(store.Compact());
+  XCTAssertLessThan(store.file_size(), 2 * kLicenseSize);
+
+  std::string data;
+  XCTAssertTrue(store.read("kept", &data));
+  XCTAssertEqual(data, "value");
+  XCTAssertTrue(store.read("renewed", &data));
+  XCTAssertEqual(data, std::string(kLicenseSize, 'a' + 99 % 26));
+  store.Close();
+  XCTAssertTrue(store.Open(_path));
+  XCTAssertTrue(store.exists("renewed"));
+}
+
+- (void)testReadPerformance {
+  CdmFileStore store;
+  XCTAssertTrue(store.Open(_path));
+  std::string license(kLicenseSize, 'x');
+  for (NSUInteger i = 0; i < kStoredLicenses; ++i) {
+    XCTAssertTrue(store.write(std::to_string(i) + ".lic", license));
+  }
+  CdmFileStore *storePtr = &store;
+  [self measureBlock:^{
+    std::string data;
+    for (NSUInteger i = 0; i < kStoredLicenses; ++i) {
+      storePtr->read(std::to_string(i) + ".lic", &data);
+    }
+  }];
+}
+
+@end
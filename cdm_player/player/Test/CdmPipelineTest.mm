@@ -0,0 +1,355 @@
+#import <CommonCrypto/CommonCryptor.h>
+
+#include <vector>
+
+#import "CdmHost.h"
+#import "CdmPssh.h"
+#import "CdmWrapper.h"
+#import "FakeCdm.h"
+#import "LicenseManager.h"
+#import "Logging.h"
+#import "MockLicenseServer.h"
+#import "MpdParser.h"
+#import "Stream.h"
+#import "Streaming.h"
+
+static NSString *const kManifestURL_eDash = @"tears_cenc_small";
+static const size_t kDecryptSampleSize = 1024 * 1024;
+// A two second 30 fps video fragment, with a clear header in front of each encrypted sample.
+static const size_t kFragmentSamples = 60;
+static const uint32_t kFragmentSampleSize = 16 * 1024;
+static const uint32_t kFragmentClearBytes = 32;
+
+// Default key IDs of the audio and video tracks of tears_cenc_small.mpd.
+static const char kAudioKeyId[] = "0000000000000000";
+static const char kVideoKeyId[] = "5555555555555555";
+
+// Runs the MPD -> license -> init parse -> decrypt -> transmux -> HTTP pipeline against FakeCdm
+// and MockLicenseServer, logging the latency of each stage.
+@interface CdmPipelineTest : XCTestCase {
+  DDTTYLogger *_logger;
+  NSURL *_keyStoreURL;
+  LicenseManager *_licMgr;
+  FakeCdm *_fakeCdm;
+  widevine::Cdm *_cdm;
+  FakeCdm::KeyMap _keys;
+}
+@end
+
+@implementation CdmPipelineTest
+
+- (void)setUp {
+  _logger = [DDTTYLogger sharedInstance];
+  [DDLog addLogger:_logger];
+  for (const char *keyId : {kAudioKeyId, kVideoKeyId}) {
+    std::string key(16, 0);
+    arc4random_buf(&key[0], key.size());
+    _keys[keyId] = key;
+  }
+  std::string license = FakeCdm::BuildLicense(_keys, 0);
+  NSData *licenseData = [NSData dataWithBytes:license.data() length:license.size()];
+  [MockLicenseServer reset];
+  [MockLicenseServer setResponder:^NSData *(NSURLRequest *request, NSInteger *statusCode) {
+    return licenseData;
+  }];
+
+  // Licenses stored by the fake CDM stay out of the real key store.
+  NSString *path =
+      [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  _keyStoreURL = [NSURL fileURLWithPath:path isDirectory:YES];
+  _licMgr = [[LicenseManager alloc] initWithKeyStoreURL:_keyStoreURL];
+  _licMgr.licenseSession = [MockLicenseServer session];
+
+  iOSCdmHost *host = iOSCdmHost::GetHost();
+  [[iOSCdm sharedInstance] shutdownCdm];
+  _fakeCdm = new FakeCdm(host, host);
+  _cdm = host->ReplaceCdmForTesting(_fakeCdm);
+  [[iOSCdm sharedInstance] setupCdmWithDelegate:_licMgr];
+}
+
+- (void)tearDown {
+  [[iOSCdm sharedInstance] shutdownCdm];
+  iOSCdmHost::GetHost()->ReplaceCdmForTesting(_cdm);
+  delete _fakeCdm;
+  [[iOSCdm sharedInstance] setupCdmWithDelegate:[LicenseManager sharedInstance]];
+  [MockLicenseServer reset];
+  [[NSFileManager defaultManager] removeItemAtURL:_keyStoreURL error:nil];
+  [DDLog removeLogger:_logger];
+}
+
+// The license of every track is fetched in one round trip and decrypts CENC samples.
+- (void)testLicenseRoundTrip {
+  NSArray<NSData *> *psshKeys = [self psshKeys];
+  XCTAssertEqual(psshKeys.count, 2);
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [self processPsshKeys:psshKeys];
+  [self logStage:@"license" since:start];
+  XCTAssertEqual(_fakeCdm->license_requests(), 1);
+  XCTAssertEqual([MockLicenseServer requestCount], 1);
+
+  std::vector<uint8_t> clear(4096 + 7);
+  arc4random_buf(clear.data(), clear.size());
+  uint8_t iv[16];
+  arc4random_buf(iv, 8);
+  memset(iv + 8, 0, 8);
+  std::vector<uint8_t> encrypted = [self encrypt:clear keyId:kVideoKeyId iv:iv];
+  std::vector<uint8_t> decrypted(clear.size());
+  XCTAssertTrue([[iOSCdm sharedInstance] decrypt:encrypted.data()
+                                          length:encrypted.size()
+                                          output:decrypted.data()
+                                           keyId:(const uint8_t *)kVideoKeyId
+                                              IV:iv
+                                        IVLength:sizeof(iv)]);
+  XCTAssertTrue(decrypted == clear);
+}
+
+// Samples of a fragment are decrypted in one batch. Encrypted subsamples continue one AES-CTR
+// stream, and the CDM is told which of them start and end each sample, skipping clear-only ones.
+- (void)testDecryptSamples {
+  [self processPsshKeys:[self psshKeys]];
+  std::vector<uint8_t> clear(100);
+  arc4random_buf(clear.data(), clear.size());
+  uint8_t iv[16] = {0};
+  arc4random_buf(iv, 8);
+  // The first sample is 4 clear, 20 encrypted, 6 clear, 30 encrypted and 8 clear bytes; the second
+  // is encrypted as a whole with the same IV.
+  const iOSCdmSubsample subsamples[] = {{4, 20}, {6, 30}, {8, 0}};
+  std::vector<uint8_t> data = clear;
+  std::vector<uint8_t> stream(clear.begin() + 4, clear.begin() + 24);
+  stream.insert(stream.end(), clear.begin() + 30, clear.begin() + 60);
+  stream = [self encrypt:stream keyId:kVideoKeyId iv:iv];
+  std::copy(stream.begin(), stream.begin() + 20, data.begin() + 4);
+  std::copy(stream.begin() + 20, stream.end(), data.begin() + 30);
+  std::vector<uint8_t> whole(clear.begin() + 68, clear.end());
+  whole = [self encrypt:whole keyId:kVideoKeyId iv:iv];
+  std::copy(whole.begin(), whole.end(), data.begin() + 68);
+
+  iOSCdmSample samples[2] = {};
+  samples[0].data = data.data();
+  samples[0].length = 68;
+  samples[0].iv = iv;
+  samples[0].ivLength = sizeof(iv);
+  samples[0].subsamples = subsamples;
+  samples[0].subsampleCount = 3;
+  samples[1].data = data.data() + 68;
+  samples[1].length = 32;
+  samples[1].iv = iv;
+  samples[1].ivLength = sizeof(iv);
+  XCTAssertTrue([[iOSCdm sharedInstance] decryptSamples:samples
+                                                  count:2
+                                                  keyId:(const uint8_t *)kVideoKeyId]);
+  XCTAssertTrue(data == clear);
+  std::vector<std::pair<bool, bool>> flags = _fakeCdm->subsample_flags();
+  XCTAssertEqual(flags.size(), 3);
+  if (flags.size() == 3) {
+    XCTAssertTrue(flags[0] == std::make_pair(true, false));
+    XCTAssertTrue(flags[1] == std::make_pair(false, true));
+    XCTAssertTrue(flags[2] == std::make_pair(true, true));
+  }
+}
+
+- (void)testPipelineLatency {
+  NSURL *mpdURL = [[NSBundle mainBundle] URLForResource:kManifestURL_eDash withExtension:@"mpd"];
+  Streaming *streaming = [[Streaming alloc] initWithAirplay:NO licenseServerURL:nil];
+  streaming.mpdURL = mpdURL;
+
+  NSData *mpdData = [NSData dataWithContentsOfURL:mpdURL];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  NSArray<Stream *> *streams = [MpdParser parseMpdWithStreaming:streaming
+                                                        mpdData:mpdData
+                                                        baseURL:mpdURL
+                                                   storeOffline:NO];
+  [self logStage:@"manifest" since:start];
+  XCTAssertEqual(streams.count, 2);
+
+  start = CFAbsoluteTimeGetCurrent();
+  [self processPsshKeys:[self psshKeys]];
+  [self logStage:@"license" since:start];
+
+  start = CFAbsoluteTimeGetCurrent();
+  XCTestExpectation *loaded = [self expectationWithDescription:@"processMpd"];
+  [streaming processMpd:mpdURL withCompletion:^(NSError *error) {
+    XCTAssertNil(error);
+    [loaded fulfill];
+  }];
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  [self logStage:@"init" since:start];
+  for (Stream *stream in streaming.streams) {
+    XCTAssertGreaterThan(stream.m3u8.length, 0);
+  }
+
+  std::vector<uint8_t> sample(kDecryptSampleSize);
+  uint8_t iv[16] = {0};
+  start = CFAbsoluteTimeGetCurrent();
+  XCTAssertTrue([[iOSCdm sharedInstance] decrypt:sample.data()
+                                          length:sample.size()
+                                          output:sample.data()
+                                           keyId:(const uint8_t *)kAudioKeyId
+                                              IV:iv
+                                        IVLength:sizeof(iv)]);
+  [self logStage:@"decrypt 1MB" since:start];
+
+  start = CFAbsoluteTimeGetCurrent();
+  NSData *variant = [self fetch:streaming.playlistURL.absoluteString];
+  [self logStage:@"serve variant playlist" since:start];
+  XCTAssertGreaterThan(variant.length, 0);
+
+  NSUInteger videoIndex = [streaming.streams indexOfObjectPassingTest:^BOOL(Stream *stream,
+                                                                          NSUInteger index,
+                                                                          BOOL *stop) {
+    return stream.isVideo;
+  }];
+  NSString *childURL =
+      [NSURL URLWithString:[NSString stringWithFormat:@"%tu.m3u8", videoIndex]
+             relativeToURL:streaming.playlistURL].absoluteString;
+  start = CFAbsoluteTimeGetCurrent();
+  XCTAssertGreaterThan([self fetch:childURL].length, 0);
+  [self logStage:@"serve child playlist" since:start];
+
+  NSString *segmentURL =
+      [NSURL URLWithString:[NSString stringWithFormat:@"%tu-0.ts", videoIndex]
+             relativeToURL:streaming.playlistURL].absoluteString;
+  start = CFAbsoluteTimeGetCurrent();
+  XCTAssertGreaterThan([self fetch:segmentURL].length, 0);
+  [self logStage:@"decrypt, transmux and serve segment" since:start];
+  [streaming stop];
+}
+
+- (void)testDecryptPerformance {
+  [self processPsshKeys:[self psshKeys]];
+  std::vector<uint8_t> sample(kDecryptSampleSize);
+  std::vector<uint8_t> *samplePtr = &sample;
+  [self measureBlock:^{
+    uint8_t iv[16] = {0};
+    for (int i = 0; i < 10; ++i) {
+      [[iOSCdm sharedInstance] decrypt:samplePtr->data()
+                                length:samplePtr->size()
+                                output:samplePtr->data()
+                                 keyId:(const uint8_t *)kVideoKeyId
+                                    IV:iv
+                              IVLength:sizeof(iv)];
+    }
+  }];
+}
+
+// Decrypting a fragment one sample per call, as the transmuxer used to, is the baseline for
+// decrypting all of its samples in one batch.
+- (void)testDecryptPerformance_perSample {
+  [self processPsshKeys:[self psshKeys]];
+  [self measureFragmentDecryptInBatchesOf:1];
+}
+
+- (void)testDecryptPerformance_batch {
+  [self processPsshKeys:[self psshKeys]];
+  [self measureFragmentDecryptInBatchesOf:kFragmentSamples];
+}
+
+#pragma mark - private methods
+
+- (NSArray<NSData *> *)psshKeys {
+  NSURL *mpdURL = [[NSBundle mainBundle] URLForResource:kManifestURL_eDash withExtension:@"mpd"];
+  NSData *mpdData = [NSData dataWithContentsOfURL:mpdURL];
+  Streaming *streaming = [[Streaming alloc] initWithAirplay:NO licenseServerURL:nil];
+  NSArray<Stream *> *streams = [MpdParser parseMpdWithStreaming:streaming
+                                                        mpdData:mpdData
+                                                        baseURL:mpdURL
+                                                   storeOffline:NO];
+  [streaming stop];
+  NSMutableOrderedSet<NSData *> *psshKeys = [NSMutableOrderedSet orderedSet];
+  for (Stream *stream in streams) {
+    if (CDMIsWidevinePssh(stream.pssh)) {
+      [psshKeys addObject:stream.pssh];
+    }
+  }
+  return psshKeys.array;
+}
+
+- (void)processPsshKeys:(NSArray<NSData *> *)psshKeys {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"license"];
+  [[iOSCdm sharedInstance] processPsshKeys:psshKeys
+                              isOfflineVod:NO
+                           completionBlock:^(NSError *error) {
+                             XCTAssertNil(error);
+                             [expectation fulfill];
+                           }];
+  [self waitForExpectationsWithTimeout:2 handler:nil];
+}
+
+- (std::vector<uint8_t>)encrypt:(const std::vector<uint8_t> &)clear
+                          keyId:(const char *)keyId
+                             iv:(const uint8_t *)iv {
+  const std::string &key = _keys[keyId];
+  std::vector<uint8_t> encrypted(clear.size());
+  CCCryptorRef cryptor;
+  CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES, ccNoPadding, iv, key.data(),
+                          key.size(), NULL, 0, 0, kCCModeOptionCTR_BE, &cryptor);
+  size_t moved = 0;
+  CCCryptorUpdate(cryptor, clear.data(), clear.size(), encrypted.data(), encrypted.size(), &moved);
+  CCCryptorRelease(cryptor);
+  return encrypted;
+}
+
+// Measures decrypting a fragment of kFragmentSamples subsample encrypted samples, |batchSize|
+// samples per call to the CDM, and checks the result against the clear fragment.
+- (void)measureFragmentDecryptInBatchesOf:(size_t)batchSize {
+  std::vector<uint8_t> clear(kFragmentSamples * kFragmentSampleSize);
+  arc4random_buf(clear.data(), clear.size());
+  std::vector<uint8_t> encrypted = clear;
+  std::vector<uint8_t> ivs(kFragmentSamples * 16, 0);
+  const iOSCdmSubsample subsample = {kFragmentClearBytes,
+                                     kFragmentSampleSize - kFragmentClearBytes};
+  for (size_t i = 0; i < kFragmentSamples; ++i) {
+    uint8_t *iv = &ivs[i * 16];
+    arc4random_buf(iv, 8);
+    size_t offset = i * kFragmentSampleSize + kFragmentClearBytes;
+    std::vector<uint8_t> cipher(clear.begin() + offset,
+                                clear.begin() + offset + subsample.cipherBytes);
+    cipher = [self encrypt:cipher keyId:kVideoKeyId iv:iv];
+    std::copy(cipher.begin(), cipher.end(), encrypted.begin() + offset);
+  }
+
+  std::vector<uint8_t> data(encrypted.size());
+  std::vector<iOSCdmSample> samples(kFragmentSamples);
+  for (size_t i = 0; i < kFragmentSamples; ++i) {
+    samples[i].data = &data[i * kFragmentSampleSize];
+    samples[i].length = kFragmentSampleSize;
+    samples[i].iv = &ivs[i * 16];
+    samples[i].ivLength = 16;
+    samples[i].subsamples = &subsample;
+    samples[i].subsampleCount = 1;
+  }
+  std::vector<uint8_t> *dataPtr = &data;
+  const std::vector<uint8_t> *encryptedPtr = &encrypted;
+  const iOSCdmSample *samplesPtr = samples.data();
+  __block BOOL decrypted = YES;
+  [self measureBlock:^{
+    std::copy(encryptedPtr->begin(), encryptedPtr->end(), dataPtr->begin());
+    for (size_t i = 0; i < kFragmentSamples; i += batchSize) {
+      decrypted &= [[iOSCdm sharedInstance] decryptSamples:samplesPtr + i
+                                                     count:MIN(batchSize, kFragmentSamples - i)
+                                                     keyId:(const uint8_t *)kVideoKeyId];
+    }
+  }];
+  XCTAssertTrue(decrypted);
+  XCTAssertTrue(data == clear);
+}
+
+- (NSData *)fetch:(NSString *)url {
+  __block NSData *result = nil;
+  XCTestExpectation *expectation = [self expectationWithDescription:url];
+  [[[NSURLSession sharedSession] dataTaskWithURL:[NSURL URLWithString:url]
+                               completionHandler:^(NSData *data, NSURLResponse *response,
+                                                   NSError *error) {
+                                 XCTAssertNil(error, @"fetching %@", url);
+                                 result = data;
+                                 [expectation fulfill];
+                               }] resume];
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  return result;
+}
+
+- (void)logStage:(NSString *)stage since:(CFAbsoluteTime)start {
+  CDMLogInfo(@"Pipeline %@: %.2f ms", stage, (CFAbsoluteTimeGetCurrent() - start) * 1000);
+}
+
+@end
@@ -0,0 +1,104 @@
+#import "CdmPssh.h"
+
+// Widevine PSSH boxes of the audio and video tracks of tears_cenc_small.mpd. Both name the
+// provider widevine_test and content 2015_tears; the key IDs are "0" and "5".
+static NSString *const kAudioPssh =
+    @"AAAAR3Bzc2gAAAAA7e+LqXnWSs6jyCfc1R0h7QAAACcIARIBMBoNd2lkZXZpbmVfdGVzdCIKMjAxNV90ZWFycyoFQVVESU8=";
+static NSString *const kVideoPssh =
+    @"AAAARHBzc2gAAAAA7e+LqXnWSs6jyCfc1R0h7QAAACQIARIBNRoNd2lkZXZpbmVfdGVzdCIKMjAxNV90ZWFycyoCU0Q=";
+static const uint8_t kWidevineSystemId[] = {0xed, 0xef, 0x8b, 0xa9, 0x79, 0xd6, 0x4a, 0xce,
+                                            0xa3, 0xc8, 0x27, 0xdc, 0xd5, 0x1d, 0x21, 0xed};
+
+@interface CdmPsshTest : XCTestCase
+@end
+
+@implementation CdmPsshTest
+
+- (void)testKeyIds {
+  XCTAssertEqualObjects(CDMWidevinePsshKeyIds([self psshFromBase64:kAudioPssh]),
+                        @[ [self data:@"0"] ]);
+  XCTAssertEqualObjects(CDMWidevinePsshKeyIds([self psshFromBase64:kVideoPssh]),
+                        @[ [self data:@"5"] ]);
+}
+
+- (void)testCombine {
+  NSData *audio = [self psshFromBase64:kAudioPssh];
+  NSData *video = [self psshFromBase64:kVideoPssh];
+  NSData *combined = CDMCombineWidevinePssh(@[ audio, video ]);
+  XCTAssertTrue(CDMIsWidevinePssh(combined));
+  NSArray *expected = @[ [self data:@"0"], [self data:@"5"] ];
+  XCTAssertEqualObjects(CDMWidevinePsshKeyIds(combined), expected);
+  // Algorithm, provider, content ID and both key IDs; the track types are dropped.
+  XCTAssertEqual(combined.length, 32 + 2 + 15 + 12 + 3 + 3);
+  // Duplicates and an already combined box add nothing.
+  XCTAssertEqualObjects(CDMCombineWidevinePssh(@[ combined, audio, video ]), combined);
+}
+
+- (void)testCombineVersion1 {
+  NSData *kid = [@"0123456789abcdef" dataUsingEncoding:NSUTF8StringEncoding];
+  // Widevine data naming only the provider.
+  NSData *data = [NSData dataWithBytes:"\x1a\x02wv" length:4];
+  NSData *version1 = [self psshWithVersion:1 keyIds:@[ kid ] data:data];
+  NSData *combined = CDMCombineWidevinePssh(@[ version1, version1 ]);
+  XCTAssertEqualObjects(combined, version1);
+  XCTAssertEqualObjects(CDMWidevinePsshKeyIds(combined), @[ kid ]);
+}
+
+// Boxes for different content are not merged -- Negative Test.
+- (void)testCombineDifferentContent {
+  NSMutableData *other = [[self psshFromBase64:kVideoPssh] mutableCopy];
+  // Change the last byte of the content ID.
+  NSRange range = [other rangeOfData:[self data:@"2015_tears"]
+                             options:0
+                               range:NSMakeRange(0, other.length)];
+  ((uint8_t *)other.mutableBytes)[NSMaxRange(range) - 1] = 'x';
+  XCTAssertNil(CDMCombineWidevinePssh(@[ [self psshFromBase64:kAudioPssh], other ]));
+}
+
+// Truncated and foreign boxes are rejected -- Negative Test.
+- (void)testInvalidPssh {
+  NSData *audio = [self psshFromBase64:kAudioPssh];
+  XCTAssertNil(CDMWidevinePsshKeyIds([audio subdataWithRange:NSMakeRange(0, audio.length - 1)]));
+  XCTAssertNil(CDMWidevinePsshKeyIds([audio subdataWithRange:NSMakeRange(0, 30)]));
+  NSMutableData *playready = [audio mutableCopy];
+  ((uint8_t *)playready.mutableBytes)[12] = 0x9a;
+  XCTAssertFalse(CDMIsWidevinePssh(playready));
+  XCTAssertNil(CDMCombineWidevinePssh(@[ audio, playready ]));
+  XCTAssertNil(CDMCombineWidevinePssh(@[]));
+}
+
+#pragma mark - private methods
+
+- (NSData *)psshFromBase64:(NSString *)base64 {
+  return [[NSData alloc] initWithBase64EncodedString:base64 options:0];
+}
+
+- (NSData *)data:(NSString *)string {
+  return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSData *)psshWithVersion:(uint8_t)version
+                     keyIds:(NSArray<NSData *> *)keyIds
+                       data:(NSData *)data {
+  NSMutableData *box = [NSMutableData data];
+  uint32_t size = CFSwapInt32HostToBig(
+      (uint32_t)(32 + data.length + (version ? 4 + 16 * keyIds.count : 0)));
+  [box appendBytes:&size length:4];
+  [box appendBytes:"pssh" length:4];
+  uint8_t fullBoxHeader[4] = {version, 0, 0, 0};
+  [box appendBytes:fullBoxHeader length:4];
+  [box appendBytes:kWidevineSystemId length:sizeof(kWidevineSystemId)];
+  if (version) {
+    uint32_t count = CFSwapInt32HostToBig((uint32_t)keyIds.count);
+    [box appendBytes:&count length:4];
+    for (NSData *keyId in keyIds) {
+      [box appendData:keyId];
+    }
+  }
+  uint32_t dataSize = CFSwapInt32HostToBig((uint32_t)data.length);
+  [box appendBytes:&dataSize length:4];
+  [box appendData:data];
+  return box;
+}
+
+@end
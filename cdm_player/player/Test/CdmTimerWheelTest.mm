@@ -0,0 +1,138 @@
+#include <atomic>
+#include <vector>
+
+#include "CdmTimerWheel.h"
+
+namespace {
+
+// Counts expirations and optionally signals a semaphore on each.
+class TestClient : public widevine::Cdm::ITimer::IClient {
+ public:
+  TestClient() : fired_(0), semaphore_(NULL) {}
+  virtual void onTimerExpired(void *) override {
+    fired_++;
+    if (semaphore_) {
+      dispatch_semaphore_signal(semaphore_);
+    }
+  }
+  int fired() const { return fired_; }
+  void set_semaphore(dispatch_semaphore_t semaphore) { semaphore_ = semaphore; }
+
+ private:
+  std::atomic<int> fired_;
+  dispatch_semaphore_t semaphore_;
+};
+
+// Pops all timers expired at |now| and returns their contexts as integers.
+std::vector<uintptr_t> PopAll(CdmTimerWheel *wheel, uint64_t now) {
+  std::vector<uintptr_t> contexts;
+  CdmTimerWheel::Client *client;
+  void *context;
+  while (wheel->PopExpired(now, &client, &context)) {
+    contexts.push_back(reinterpret_cast<uintptr_t>(context));
+  }
+  return contexts;
+}
+
+void *Context(uintptr_t value) { return reinterpret_cast<void *>(value); }
+
+}  // namespace
+
+@interface CdmTimerWheelTest : XCTestCase
+@end
+
+@implementation CdmTimerWheelTest
+
+- (void)testExpirationOrder {
+  TestClient client;
+  CdmTimerWheel wheel(1000);
+  wheel.Schedule(1000 + 5000, &client, Context(3));
+  wheel.Schedule(1000 + 10, &client, Context(1));
+  wheel.Schedule(1000 + 300, &client, Context(2));
+  // Further out than the top level reaches in one round.
+  wheel.Schedule(1000 + (1ULL << 37), &client, Context(4));
+  XCTAssertEqual(wheel.size(), 4u);
+
+  XCTAssertTrue(PopAll(&wheel, 1009).empty());
+  XCTAssertLessThanOrEqual(wheel.NextWakeup(), 1010u);
+  XCTAssertTrue(PopAll(&wheel, 1010) == std::vector<uintptr_t>({1}));
+  XCTAssertTrue(PopAll(&wheel, 10000) == std::vector<uintptr_t>({2, 3}));
+  XCTAssertTrue(PopAll(&wheel, 1000 + (1ULL << 37) - 1).empty());
+  XCTAssertTrue(PopAll(&wheel, 1000 + (1ULL << 37)) == std::vector<uintptr_t>({4}));
+  XCTAssertEqual(wheel.size(), 0u);
+  XCTAssertEqual(wheel.NextWakeup(), CdmTimerWheel::kNever);
+}
+
+- (void)testCancel {
+  TestClient first;
+  TestClient second;
+  CdmTimerWheel wheel(0);
+  wheel.Schedule(10, &first, Context(1));
+  wheel.Schedule(100000, &first, Context(2));
+  wheel.Schedule(20, &second, Context(3));
+  wheel.Cancel(&first);
+  XCTAssertEqual(wheel.size(), 1u);
+  XCTAssertTrue(PopAll(&wheel, 1000000) == std::vector<uintptr_t>({3}));
+  // Expired but not yet popped timers are cancelled too.
+  wheel.Schedule(1000010, &first, Context(4));
+  wheel.Schedule(1000010, &second, Context(5));
+  CdmTimerWheel::Client *client;
+  void *context;
+  XCTAssertTrue(wheel.PopExpired(1000010, &client, &context));
+  wheel.Cancel(client == &first ? &second : &first);
+  XCTAssertFalse(wheel.PopExpired(1000010, &client, &context));
+}
+
+- (void)testDispatchTimerFires {
+  TestClient client;
+  dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+  client.set_semaphore(semaphore);
+  CdmDispatchTimer timer;
+  CdmDispatchTimer *timerPtr = &timer;
+  TestClient *clientPtr = &client;
+  // Scheduled from a thread without a run loop.
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+    timerPtr->setTimeout(10, clientPtr, NULL);
+    timerPtr->setTimeout(20, clientPtr, NULL);
+  });
+  for (int i = 0; i < 2; ++i) {
+    XCTAssertEqual(dispatch_semaphore_wait(
+        semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC)), 0);
+  }
+  XCTAssertEqual(client.fired(), 2);
+}
+
+- (void)testDispatchTimerCancelFromOtherThread {
+  TestClient cancelled;
+  TestClient kept;
+  dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+  kept.set_semaphore(semaphore);
+  CdmDispatchTimer timer;
+  timer.setTimeout(50, &cancelled, NULL);
+  timer.setTimeout(100, &kept, NULL);
+  CdmDispatchTimer *timerPtr = &timer;
+  TestClient *cancelledPtr = &cancelled;
+  dispatch_sync(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+    timerPtr->cancel(cancelledPtr);
+  });
+  XCTAssertEqual(dispatch_semaphore_wait(
+      semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC)), 0);
+  XCTAssertEqual(cancelled.fired(), 0);
+  XCTAssertEqual(kept.fired(), 1);
+}
+
+- (void)testSchedulePerformance {
+  std::vector<TestClient> clients(1000);
+  std::vector<TestClient> *clientsPtr = &clients;
+  [self measureBlock:^{
+    CdmTimerWheel wheel(0);
+    for (uint64_t i = 0; i < 100000; ++i) {
+      wheel.Schedule((i * 7919) % 3600000, &(*clientsPtr)[i % clientsPtr->size()], NULL);
+    }
+    for (TestClient &client : *clientsPtr) {
+      wheel.Cancel(&client);
+    }
+  }];
+}
+
+@end
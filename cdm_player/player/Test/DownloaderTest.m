@@ -261,6 +261,152 @@ extern NSString *const kRangeHeaderString;
   [[Downloader sharedInstance] downloadPartialDataSync:self.randomURL range:range];
 }
 
+- (void)testConditionalDownload {
+  NSURL *url = [NSURL URLWithString:@"https://example.com/manifest.mpd"];
+  NSDictionary *validators = @{
+    kDownloaderETagKey : @"\"v1\"",
+    kDownloaderLastModifiedKey : @"Sun, 01 Jan 2017 00:00:00 GMT"
+  };
+
+  void (^block)(NSInvocation *) = ^(NSInvocation *invocation) {
+    __unsafe_unretained NSMutableURLRequest *request;
+    __unsafe_unretained void (^callback)(NSData *data, NSURLResponse *response, NSError *error);
+    [invocation getArgument:&request atIndex:2];
+    [invocation getArgument:&callback atIndex:3];
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-None-Match"], @"\"v1\"");
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-Modified-Since"],
+                          @"Sun, 01 Jan 2017 00:00:00 GMT");
+    // Header names are matched regardless of case.
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url
+                                                               statusCode:304
+                                                              HTTPVersion:@"HTTP/1.1"
+                                                             headerFields:@{@"etag" : @"\"v2\""}];
+    callback(nil, response, nil);
+  };
+  id mock = [self mockDownloadSessionWithCallResult:block];
+
+  __block BOOL called = NO;
+  [[Downloader sharedInstance] downloadData:url
+                                 validators:validators
+                                 completion:^(NSData *data,
+                                              NSDictionary<NSString *, NSString *> *newValidators,
+                                              BOOL notModified,
+                                              NSError *error) {
+                                   XCTAssertNil(data);
+                                   XCTAssertNil(error);
+                                   XCTAssertTrue(notModified);
+                                   XCTAssertEqualObjects(newValidators[kDownloaderETagKey],
+                                                         @"\"v2\"");
+                                   XCTAssertEqualObjects(newValidators[kDownloaderLastModifiedKey],
+                                                         @"Sun, 01 Jan 2017 00:00:00 GMT");
+                                   called = YES;
+                                 }];
+  XCTAssertTrue(called);
+}
+
+// HTTP error statuses are reported as errors rather than as a manifest -- Negative Test.
+- (void)testConditionalDownloadHTTPError {
+  NSURL *url = [NSURL URLWithString:@"https://example.com/missing.mpd"];
+  void (^block)(NSInvocation *) = ^(NSInvocation *invocation) {
+    __unsafe_unretained NSMutableURLRequest *request;
+    __unsafe_unretained void (^callback)(NSData *data, NSURLResponse *response, NSError *error);
+    [invocation getArgument:&request atIndex:2];
+    [invocation getArgument:&callback atIndex:3];
+    XCTAssertNil([request valueForHTTPHeaderField:@"If-None-Match"]);
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url
+                                                               statusCode:404
+                                                              HTTPVersion:@"HTTP/1.1"
+                                                             headerFields:nil];
+    callback([@"Not Found" dataUsingEncoding:NSUTF8StringEncoding], response, nil);
+  };
+  id mock = [self mockDownloadSessionWithCallResult:block];
+
+  __block BOOL called = NO;
+  [[Downloader sharedInstance] downloadData:url
+                                 validators:nil
+                                 completion:^(NSData *data,
+                                              NSDictionary<NSString *, NSString *> *validators,
+                                              BOOL notModified,
+                                              NSError *error) {
+                                   XCTAssertNil(data);
+                                   XCTAssertFalse(notModified);
+                                   XCTAssertEqual(error.code, CdmPlayeriOSErrorCode_HTTPError);
+                                   called = YES;
+                                 }];
+  XCTAssertTrue(called);
+}
+
+- (void)testConditionalFileDownload {
+  NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory()
+                                              stringByAppendingPathComponent:@"conditional.mpd"]];
+  NSData *fileData = [@"<MPD/>" dataUsingEncoding:NSUTF8StringEncoding];
+  XCTAssertTrue([fileData writeToURL:fileURL atomically:YES]);
+
+  Downloader *downloader = [Downloader sharedInstance];
+  __block NSDictionary<NSString *, NSString *> *savedValidators = nil;
+  [downloader downloadData:fileURL
+                validators:nil
+                completion:^(NSData *data,
+                             NSDictionary<NSString *, NSString *> *validators,
+                             BOOL notModified,
+                             NSError *error) {
+                  XCTAssertEqualObjects(data, fileData);
+                  XCTAssertFalse(notModified);
+                  XCTAssertNotNil(validators[kDownloaderETagKey]);
+                  savedValidators = validators;
+                }];
+  [downloader downloadData:fileURL
+                validators:savedValidators
+                completion:^(NSData *data,
+                             NSDictionary<NSString *, NSString *> *validators,
+                             BOOL notModified,
+                             NSError *error) {
+                  XCTAssertNil(data);
+                  XCTAssertNil(error);
+                  XCTAssertTrue(notModified);
+                  XCTAssertEqualObjects(validators, savedValidators);
+                }];
+  [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+}
+
+- (void)testStreamingDownload {
+  Downloader *shared = [Downloader sharedInstance];
+  NSURL *url = self.randomURL;
+  NSArray<NSData *> *pieces = @[
+    [@"moof" dataUsingEncoding:NSUTF8StringEncoding],
+    [@"mdat" dataUsingEncoding:NSUTF8StringEncoding]
+  ];
+
+  // Each piece is handed to the delegate as it arrives, then the task completes.
+  NSURLSessionDataTask *template =
+      [shared.downloadSession dataTaskWithRequest:[NSURLRequest requestWithURL:url]];
+  id mockTask = [OCMockObject partialMockForObject:template];
+  void (^resumeBlock)(NSInvocation *) = ^(NSInvocation *invocation) {
+    id<NSURLSessionDataDelegate> del =
+        (id<NSURLSessionDataDelegate>)shared.downloadSession.delegate;
+    for (NSData *piece in pieces) {
+      [del URLSession:shared.downloadSession dataTask:template didReceiveData:piece];
+    }
+    [del URLSession:shared.downloadSession task:template didCompleteWithError:nil];
+  };
+  [[[mockTask stub] andDo:resumeBlock] resume];
+  id mockDS = [OCMockObject partialMockForObject:shared.downloadSession];
+  [[[mockDS stub] andReturn:template] dataTaskWithRequest:[OCMArg any]];
+
+  NSMutableArray<NSData *> *received = [NSMutableArray array];
+  __block int completions = 0;
+  [shared downloadStreamingData:url
+                       received:^(NSData *data) {
+                         [received addObject:data];
+                       }
+                     completion:^(NSError *error) {
+                       XCTAssertNil(error);
+                       ++completions;
+                     }];
+  XCTAssertEqualObjects(received, pieces);
+  XCTAssertEqual(completions, 1);
+}
+
 #pragma mark private methods
 
 - (void)downloadTestInnerFailure {
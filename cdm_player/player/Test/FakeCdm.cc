@@ -0,0 +1,307 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#include "FakeCdm.h"
+
+#include <CommonCrypto/CommonCryptor.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const size_t kAesBlockSize = 16;
+const size_t kKeySize = 16;
+const size_t kExpirationSize = 8;
+// Counter blocks encrypted per call to CommonCrypto.
+const size_t kKeystreamBlocks = 256;
+
+std::string LicenseFileName(const std::string &session_id) {
+  return session_id + ".fakelicense";
+}
+
+// Increments the 64 bit big endian block counter in the low half of |iv|.
+void IncrementCounter(uint8_t *iv) {
+  for (int i = kAesBlockSize - 1; i >= 8; --i) {
+    if (++iv[i]) {
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+std::string FakeCdm::BuildLicense(const KeyMap &keys, int64_t expiration) {
+  std::string license;
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    license.push_back(static_cast<char>(expiration >> shift));
+  }
+  for (KeyMap::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+    license.push_back(static_cast<char>(it->first.size()));
+    license.append(it->first);
+    license.append(it->second);
+  }
+  return license;
+}
+
+bool FakeCdm::ParseLicense(const std::string &license, Session *session) {
+  if (license.size() < kExpirationSize) {
+    return false;
+  }
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(license.data());
+  uint64_t expiration = 0;
+  for (size_t i = 0; i < kExpirationSize; ++i) {
+    expiration = expiration << 8 | bytes[i];
+  }
+  session->expiration = static_cast<int64_t>(expiration);
+  size_t position = kExpirationSize;
+  while (position < license.size()) {
+    size_t key_id_size = bytes[position++];
+    if (license.size() - position < key_id_size + kKeySize) {
+      return false;
+    }
+    std::string key_id = license.substr(position, key_id_size);
+    position += key_id_size;
+    session->keys[key_id] = license.substr(position, kKeySize);
+    position += kKeySize;
+  }
+  return true;
+}
+
+FakeCdm::FakeCdm(IEventListener *listener, IStorage *storage)
+    : listener_(listener),
+      storage_(storage),
+      next_session_id_(0),
+      license_requests_(0) {}
+
+FakeCdm::~FakeCdm() {}
+
+int FakeCdm::license_requests() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return license_requests_;
+}
+
+std::vector<std::pair<bool, bool>> FakeCdm::subsample_flags() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return subsample_flags_;
+}
+
+FakeCdm::Status FakeCdm::setServerCertificate(const std::string &) {
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::createSession(SessionType session_type,
+                                       std::string *session_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  *session_id = "fake-" + std::to_string(++next_session_id_);
+  Session &session = sessions_[*session_id];
+  session.type = session_type;
+  session.expiration = 0;
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::generateRequest(const std::string &session_id,
+                                         InitDataType init_data_type,
+                                         const std::string &init_data) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!sessions_.count(session_id)) {
+      return kSessionNotFound;
+    }
+    if (init_data_type != kCenc || init_data.empty()) {
+      return kNotSupported;
+    }
+    ++license_requests_;
+  }
+  // The real CDM calls back synchronously as well.
+  listener_->onMessage(session_id, kLicenseRequest, init_data);
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::load(const std::string &session_id) {
+  std::string license;
+  if (!storage_->read(LicenseFileName(session_id), &license)) {
+    return kSessionNotFound;
+  }
+  Session session;
+  session.type = kPersistentLicense;
+  if (!ParseLicense(license, &session)) {
+    return kUnexpectedError;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sessions_.count(session_id)) {
+    return kInvalidState;
+  }
+  sessions_[session_id] = session;
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::update(const std::string &session_id,
+                                const std::string &response) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Session>::iterator it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+      return kSessionNotFound;
+    }
+    if (!ParseLicense(response, &it->second)) {
+      return kTypeError;
+    }
+    if (it->second.type == kPersistentLicense &&
+        !storage_->write(LicenseFileName(session_id), response)) {
+      return kUnexpectedError;
+    }
+  }
+  listener_->onKeyStatusesChange(session_id);
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::getExpiration(const std::string &session_id,
+                                       int64_t *expiration) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Session>::iterator it = sessions_.find(session_id);
+  if (it == sessions_.end()) {
+    return kSessionNotFound;
+  }
+  *expiration = it->second.expiration ? it->second.expiration : -1;
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::getKeyStatuses(const std::string &session_id,
+                                        KeyStatusMap *key_statuses) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Session>::iterator it = sessions_.find(session_id);
+  if (it == sessions_.end()) {
+    return kSessionNotFound;
+  }
+  key_statuses->clear();
+  for (KeyMap::iterator key = it->second.keys.begin();
+       key != it->second.keys.end(); ++key) {
+    (*key_statuses)[key->first] = kUsable;
+  }
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::close(const std::string &session_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_.erase(session_id) ? kSuccess : kSessionNotFound;
+}
+
+FakeCdm::Status FakeCdm::remove(const std::string &session_id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Session>::iterator it = sessions_.find(session_id);
+    if (it == sessions_.end()) {
+      return kSessionNotFound;
+    }
+    if (it->second.type != kPersistentLicense) {
+      return kInvalidState;
+    }
+    storage_->remove(LicenseFileName(session_id));
+    sessions_.erase(it);
+  }
+  listener_->onRemoveComplete(session_id);
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::decrypt(const InputBuffer &input,
+                                 const OutputBuffer &output) {
+  if (output.data_length < input.data_length) {
+    return kRangeError;
+  }
+  if (!input.is_encrypted) {
+    memmove(output.data, input.data, input.data_length);
+    return kSuccess;
+  }
+  if (input.iv_length != kAesBlockSize || input.block_offset >= kAesBlockSize) {
+    return kTypeError;
+  }
+  std::string key;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    subsample_flags_.push_back(
+        std::make_pair(input.first_subsample, input.last_subsample));
+    std::string key_id(reinterpret_cast<const char *>(input.key_id),
+                       input.key_id_length);
+    for (std::map<std::string, Session>::iterator it = sessions_.begin();
+         it != sessions_.end() && key.empty(); ++it) {
+      KeyMap::iterator found = it->second.keys.find(key_id);
+      if (found != it->second.keys.end()) {
+        key = found->second;
+      }
+    }
+  }
+  if (key.empty()) {
+    return kNoKey;
+  }
+
+  CCCryptorRef cryptor;
+  if (CCCryptorCreate(kCCEncrypt, kCCAlgorithmAES128, kCCOptionECBMode,
+                      key.data(), key.size(), NULL, &cryptor) != kCCSuccess) {
+    return kDecryptError;
+  }
+  uint8_t counter[kAesBlockSize];
+  memcpy(counter, input.iv, kAesBlockSize);
+  uint8_t counters[kKeystreamBlocks * kAesBlockSize];
+  uint8_t keystream[kKeystreamBlocks * kAesBlockSize];
+  // |input.block_offset| bytes of the first block were used by the previous
+  // subsample.
+  size_t skip = input.block_offset;
+  size_t done = 0;
+  Status status = kSuccess;
+  while (done < input.data_length) {
+    size_t remaining = input.data_length - done;
+    size_t blocks = std::min(kKeystreamBlocks,
+                             (skip + remaining + kAesBlockSize - 1) /
+                                 kAesBlockSize);
+    for (size_t i = 0; i < blocks; ++i) {
+      memcpy(counters + i * kAesBlockSize, counter, kAesBlockSize);
+      IncrementCounter(counter);
+    }
+    size_t moved = 0;
+    if (CCCryptorUpdate(cryptor, counters, blocks * kAesBlockSize, keystream,
+                        sizeof(keystream), &moved) != kCCSuccess) {
+      status = kDecryptError;
+      break;
+    }
+    size_t length = std::min(remaining, blocks * kAesBlockSize - skip);
+    for (size_t i = 0; i < length; ++i) {
+      output.data[done + i] = input.data[done + i] ^ keystream[skip + i];
+    }
+    done += length;
+    skip = 0;
+  }
+  CCCryptorRelease(cryptor);
+  return status;
+}
+
+FakeCdm::Status FakeCdm::setAppParameter(const std::string &key,
+                                         const std::string &value) {
+  if (key.empty()) {
+    return kTypeError;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  app_parameters_[key] = value;
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::getAppParameter(const std::string &key,
+                                         std::string *result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, std::string>::iterator it = app_parameters_.find(key);
+  if (key.empty() || !result || it == app_parameters_.end()) {
+    return kTypeError;
+  }
+  *result = it->second;
+  return kSuccess;
+}
+
+FakeCdm::Status FakeCdm::removeAppParameter(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return app_parameters_.erase(key) ? kSuccess : kTypeError;
+}
+
+FakeCdm::Status FakeCdm::clearAppParameters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  app_parameters_.clear();
+  return kSuccess;
+}
@@ -0,0 +1,92 @@
+// Copyright 2017 Google Inc. All rights reserved.
+// Clear key stand-in for the Widevine CDM.
+//
+// FakeCdm implements widevine::Cdm without OEMCrypto so that the license and
+// decrypt paths can be driven end to end in tests. A license request is the
+// init data itself, and a license is a list of clear AES-128 keys (see
+// BuildLicense) that decrypt samples with CENC AES-CTR. Persistent sessions
+// keep their license in the IStorage given to the constructor.
+
+#ifndef WIDEVINE_BASE_CDM_HOST_IOS_FAKECDM_H_
+#define WIDEVINE_BASE_CDM_HOST_IOS_FAKECDM_H_
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CdmIncludes.h"
+
+class FakeCdm : public widevine::Cdm {
+ public:
+  // Key ID to 16 byte AES key.
+  typedef std::map<std::string, std::string> KeyMap;
+
+  // Returns a license granting |keys| until |expiration|, in milliseconds
+  // since 1970, or without expiration if |expiration| is 0. The license is
+  // the big endian expiration followed by each key as a one byte key ID
+  // length, the key ID and the key.
+  static std::string BuildLicense(const KeyMap &keys, int64_t expiration);
+
+  FakeCdm(IEventListener *listener, IStorage *storage);
+  virtual ~FakeCdm();
+
+  virtual Status setServerCertificate(const std::string &certificate) override;
+  virtual Status createSession(SessionType session_type,
+                               std::string *session_id) override;
+  // Sends |init_data| back to the listener as the license request.
+  virtual Status generateRequest(const std::string &session_id,
+                                 InitDataType init_data_type,
+                                 const std::string &init_data) override;
+  virtual Status load(const std::string &session_id) override;
+  virtual Status update(const std::string &session_id,
+                        const std::string &response) override;
+  virtual Status getExpiration(const std::string &session_id,
+                               int64_t *expiration) override;
+  virtual Status getKeyStatuses(const std::string &session_id,
+                                KeyStatusMap *key_statuses) override;
+  virtual Status close(const std::string &session_id) override;
+  virtual Status remove(const std::string &session_id) override;
+  virtual Status decrypt(const InputBuffer &input,
+                         const OutputBuffer &output) override;
+  virtual Status setAppParameter(const std::string &key,
+                                 const std::string &value) override;
+  virtual Status getAppParameter(const std::string &key,
+                                 std::string *result) override;
+  virtual Status removeAppParameter(const std::string &key) override;
+  virtual Status clearAppParameters() override;
+
+  virtual void onTimerExpired(void *context) override {}
+
+  // Number of license requests sent to the listener.
+  int license_requests() const;
+  // The first_subsample and last_subsample flags of each encrypted input
+  // decrypted, oldest first.
+  std::vector<std::pair<bool, bool>> subsample_flags() const;
+
+ private:
+  struct Session {
+    SessionType type;
+    KeyMap keys;
+    int64_t expiration;
+  };
+
+  // Parses |license| into |session|. Returns false if it is malformed.
+  static bool ParseLicense(const std::string &license, Session *session);
+
+  IEventListener *listener_;
+  IStorage *storage_;
+  mutable std::mutex mutex_;
+  std::map<std::string, Session> sessions_;
+  std::map<std::string, std::string> app_parameters_;
+  int next_session_id_;
+  int license_requests_;
+  std::vector<std::pair<bool, bool>> subsample_flags_;
+
+  FakeCdm(const FakeCdm &) = delete;
+  FakeCdm &operator=(const FakeCdm &) = delete;
+};
+
+#endif  // WIDEVINE_BASE_CDM_HOST_IOS_FAKECDM_H_
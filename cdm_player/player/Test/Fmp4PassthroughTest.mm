@@ -0,0 +1,599 @@
+#include "Fmp4Passthrough.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const uint8_t kKeyId[kFmp4KeyIdSize] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const uint32_t kTimescale = 90000;
+
+static void Append(Bytes *bytes, uint64_t value, size_t size) {
+  for (size_t i = size; i > 0; --i) {
+    bytes->push_back(static_cast<uint8_t>(value >> (8 * (i - 1))));
+  }
+}
+
+static void AppendBytes(Bytes *bytes, const Bytes &other) {
+  bytes->insert(bytes->end(), other.begin(), other.end());
+}
+
+static Bytes MakeBox(const char *type, const Bytes &payload) {
+  Bytes box;
+  Append(&box, 8 + payload.size(), 4);
+  box.insert(box.end(), type, type + 4);
+  AppendBytes(&box, payload);
+  return box;
+}
+
+static Bytes MakeBox(const char *type, const std::vector<Bytes> &children) {
+  Bytes payload;
+  for (const Bytes &child : children) {
+    AppendBytes(&payload, child);
+  }
+  return MakeBox(type, payload);
+}
+
+static Bytes MakeFullBoxHeader(uint8_t version, uint32_t flags) {
+  Bytes header;
+  Append(&header, (uint32_t)version << 24 | flags, 4);
+  return header;
+}
+
+// An hvc1 sample entry, or an encv one protected with |scheme| when |scheme| is set.
+static Bytes MakeSampleEntry(const char *scheme) {
+  Bytes entry(78, 0);
+  Bytes hvcC = MakeBox("hvcC", Bytes(23, 0x42));
+  AppendBytes(&entry, hvcC);
+  if (!scheme) {
+    return MakeBox("hvc1", entry);
+  }
+  Bytes schm = MakeFullBoxHeader(0, 0);
+  schm.insert(schm.end(), scheme, scheme + 4);
+  Append(&schm, 0x10000, 4);
+  Bytes tenc = MakeFullBoxHeader(0, 0);
+  Append(&tenc, 0, 2);
+  Append(&tenc, 1, 1);
+  Append(&tenc, 8, 1);
+  tenc.insert(tenc.end(), kKeyId, kKeyId + kFmp4KeyIdSize);
+  AppendBytes(&entry, MakeBox("sinf",
+                              std::vector<Bytes>{MakeBox("frma", Bytes{'h', 'v', 'c', '1'}),
+                                                 MakeBox("schm", schm),
+                                                 MakeBox("schi", std::vector<Bytes>{
+                                                                     MakeBox("tenc", tenc)})}));
+  return MakeBox("encv", entry);
+}
+
+static Bytes MakeInitialization(const char *scheme) {
+  Bytes mdhd = MakeFullBoxHeader(0, 0);
+  Append(&mdhd, 0, 8);
+  Append(&mdhd, kTimescale, 4);
+  Append(&mdhd, 0, 8);
+  Bytes stsd = MakeFullBoxHeader(0, 0);
+  Append(&stsd, 1, 4);
+  AppendBytes(&stsd, MakeSampleEntry(scheme));
+  Bytes stbl = MakeBox("stbl", std::vector<Bytes>{MakeBox("stsd", stsd)});
+  Bytes trak = MakeBox(
+      "trak",
+      std::vector<Bytes>{MakeBox(
+          "mdia",
+          std::vector<Bytes>{MakeBox("mdhd", mdhd),
+                             MakeBox("minf", std::vector<Bytes>{stbl})})});
+  std::vector<Bytes> moov{MakeBox("mvhd", Bytes(100, 0)), trak};
+  if (scheme) {
+    moov.push_back(MakeBox("pssh", Bytes(32, 0xed)));
+  }
+  Bytes init = MakeBox("ftyp", Bytes{'i', 's', 'o', '6', 0, 0, 0, 0});
+  AppendBytes(&init, MakeBox("moov", moov));
+  return init;
+}
+
+static Bytes MakeSegmentIndex(uint8_t version, uint32_t firstOffset, uint32_t reference) {
+  Bytes sidx = MakeFullBoxHeader(version, 0);
+  Append(&sidx, 1, 4);
+  Append(&sidx, kTimescale, 4);
+  Append(&sidx, 0, version ? 8 : 4);
+  Append(&sidx, firstOffset, version ? 8 : 4);
+  Append(&sidx, 0, 2);
+  Append(&sidx, 2, 2);
+  Append(&sidx, reference, 4);
+  Append(&sidx, 180000, 4);
+  Append(&sidx, 0x90000000, 4);
+  Append(&sidx, 2000, 4);
+  Append(&sidx, 90000, 4);
+  Append(&sidx, 0x90000000, 4);
+  return MakeBox("sidx", sidx);
+}
+
+// A segment of two 16 byte samples. The first has a 4 byte clear header and 12 protected bytes,
+// the second is entirely protected. With |auxInfo| the senc is also described by a saiz and saio.
+static Bytes MakeSegment(bool auxInfo = false) {
+  Bytes tfhd = MakeFullBoxHeader(0, 0x20000);
+  Append(&tfhd, 1, 4);
+  Bytes senc = MakeFullBoxHeader(0, 0x2);
+  Append(&senc, 2, 4);
+  Append(&senc, 0x1111111111111111, 8);
+  Append(&senc, 1, 2);
+  Append(&senc, 4, 2);
+  Append(&senc, 12, 4);
+  Append(&senc, 0x2222222222222222, 8);
+  Append(&senc, 1, 2);
+  Append(&senc, 0, 2);
+  Append(&senc, 16, 4);
+  // The trun data offset is patched once the moof size is known.
+  Bytes trun = MakeFullBoxHeader(0, 0x201);
+  Append(&trun, 2, 4);
+  Append(&trun, 0, 4);
+  Append(&trun, 16, 4);
+  Append(&trun, 16, 4);
+  Bytes saiz = MakeFullBoxHeader(0, 0);
+  Append(&saiz, 0, 1);
+  Append(&saiz, 2, 4);
+  Append(&saiz, 16, 1);
+  Append(&saiz, 16, 1);
+  // The saio offset is patched once the position of the senc is known.
+  Bytes saio = MakeFullBoxHeader(0, 0);
+  Append(&saio, 1, 4);
+  Append(&saio, 0, 4);
+  std::vector<Bytes> traf{MakeBox("tfhd", tfhd), MakeBox("trun", trun)};
+  if (auxInfo) {
+    traf.push_back(MakeBox("saiz", saiz));
+    traf.push_back(MakeBox("saio", saio));
+  }
+  traf.push_back(MakeBox("senc", senc));
+  Bytes moof = MakeBox(
+      "moof", std::vector<Bytes>{MakeBox("mfhd", Bytes(8, 0)), MakeBox("traf", traf)});
+  size_t dataOffset = moof.size() + 8;
+  size_t trunOffset = 8 + 16 + 8 + (8 + tfhd.size()) + 8 + 8;
+  for (size_t i = 0; i < 4; ++i) {
+    moof[trunOffset + i] = (uint8_t)(dataOffset >> (8 * (3 - i)));
+  }
+  if (auxInfo) {
+    size_t sencEntries = moof.size() - senc.size() + 8;
+    size_t saioOffset = trunOffset - 16 + (8 + trun.size()) + (8 + saiz.size()) + 8 + 8;
+    for (size_t i = 0; i < 4; ++i) {
+      moof[saioOffset + i] = (uint8_t)(sencEntries >> (8 * (3 - i)));
+    }
+  }
+  Bytes samples;
+  for (uint8_t i = 0; i < 32; ++i) {
+    samples.push_back(i);
+  }
+  Bytes segment = MakeBox("styp", Bytes{'m', 's', 'd', 'h', 0, 0, 0, 0});
+  AppendBytes(&segment, moof);
+  AppendBytes(&segment, MakeBox("mdat", samples));
+  return segment;
+}
+
+// Makes a moof and mdat starting at |decodeTime|. With |defaultDuration| the tfhd gives a duration
+// of 3000 to the two samples of a first trun and a second trun has one sample of 3003. Otherwise a
+// single trun has two samples of 3003.
+static Bytes MakeTimedFragment(uint8_t tfdtVersion, uint64_t decodeTime, bool defaultDuration) {
+  Bytes tfhd = MakeFullBoxHeader(0, defaultDuration ? 0x20008 : 0x20000);
+  Append(&tfhd, 1, 4);
+  if (defaultDuration) {
+    Append(&tfhd, 3000, 4);
+  }
+  Bytes tfdt = MakeFullBoxHeader(tfdtVersion, 0);
+  Append(&tfdt, decodeTime, tfdtVersion == 1 ? 8 : 4);
+  std::vector<Bytes> traf{MakeBox("tfhd", tfhd), MakeBox("tfdt", tfdt)};
+  Bytes trun = MakeFullBoxHeader(0, 0x300);
+  if (defaultDuration) {
+    Bytes defaulted = MakeFullBoxHeader(0, 0x200);
+    Append(&defaulted, 2, 4);
+    Append(&defaulted, 16, 4);
+    Append(&defaulted, 16, 4);
+    traf.push_back(MakeBox("trun", defaulted));
+    Append(&trun, 1, 4);
+  } else {
+    Append(&trun, 2, 4);
+    Append(&trun, 3003, 4);
+    Append(&trun, 16, 4);
+  }
+  Append(&trun, 3003, 4);
+  Append(&trun, 16, 4);
+  traf.push_back(MakeBox("trun", trun));
+  Bytes fragment = MakeBox(
+      "moof", std::vector<Bytes>{MakeBox("mfhd", Bytes(8, 0)), MakeBox("traf", traf)});
+  AppendBytes(&fragment, MakeBox("mdat", Bytes(48, 0)));
+  return fragment;
+}
+
+static bool ContainsType(const Bytes &bytes, const char *type) {
+  return std::string(bytes.begin(), bytes.end()).find(type) != std::string::npos;
+}
+
+// Position of the first |type| box of |bytes|.
+static size_t FindBox(const Bytes &bytes, const char *type) {
+  return std::string(bytes.begin(), bytes.end()).find(type) - 4;
+}
+
+// Reads the 32 bit field |offset| bytes into the first |type| box of |bytes|, header included.
+static uint32_t ReadField(const Bytes &bytes, const char *type, size_t offset) {
+  size_t position = FindBox(bytes, type) + offset;
+  uint32_t value = 0;
+  for (size_t i = 0; i < 4 && position + i < bytes.size(); ++i) {
+    value = value << 8 | bytes[position + i];
+  }
+  return value;
+}
+
+// Writes the 32 bit field |offset| bytes into the first |type| box of |bytes|, header included.
+static void WriteField(Bytes *bytes, const char *type, size_t offset, uint32_t value) {
+  size_t position = FindBox(*bytes, type) + offset;
+  for (size_t i = 0; i < 4; ++i) {
+    (*bytes)[position + i] = (uint8_t)(value >> (8 * (3 - i)));
+  }
+}
+
+// Inverts the protected bytes of each sample after checking the key and IV, standing in for the
+// CDM. Records the number of protected bytes of each sample.
+static bool InvertDecrypt(void *context,
+                          const uint8_t *keyId,
+                          const Fmp4EncryptedSample *samples,
+                          size_t sampleCount) {
+  std::vector<size_t> *lengths = (std::vector<size_t> *)context;
+  if (memcmp(keyId, kKeyId, kFmp4KeyIdSize)) {
+    return false;
+  }
+  for (size_t i = 0; i < sampleCount; ++i) {
+    const Fmp4EncryptedSample &sample = samples[i];
+    if (sample.iv_size != 8 || sample.iv[0] != sample.iv[7]) {
+      return false;
+    }
+    Fmp4Subsample whole;
+    whole.protected_size = sample.size;
+    const Fmp4Subsample *subsamples = sample.subsample_count ? sample.subsamples : &whole;
+    size_t subsampleCount = sample.subsample_count ? sample.subsample_count : 1;
+    size_t position = 0;
+    size_t length = 0;
+    for (size_t j = 0; j < subsampleCount; ++j) {
+      position += subsamples[j].clear_size;
+      for (size_t k = 0; k < subsamples[j].protected_size; ++k, ++position) {
+        sample.data[position] = ~sample.data[position];
+      }
+      length += subsamples[j].protected_size;
+    }
+    lengths->push_back(length);
+  }
+  return true;
+}
+
+// Records the number of samples handed over in each call.
+static bool CountDecrypt(void *context,
+                         const uint8_t *keyId,
+                         const Fmp4EncryptedSample *samples,
+                         size_t sampleCount) {
+  ((std::vector<size_t> *)context)->push_back(sampleCount);
+  return true;
+}
+
+static bool FailDecrypt(void *context,
+                        const uint8_t *keyId,
+                        const Fmp4EncryptedSample *samples,
+                        size_t sampleCount) {
+  return false;
+}
+
+@interface Fmp4PassthroughTest : XCTestCase
+@end
+
+@implementation Fmp4PassthroughTest
+
+- (void)testParseClearTrack {
+  Bytes init = MakeInitialization(nullptr);
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  XCTAssertEqual(track.timescale, kTimescale);
+  XCTAssertEqual(track.format, Fmp4FourCC('h', 'v', 'c', '1'));
+  XCTAssertFalse(track.encrypted);
+  XCTAssertEqual(track.psshs.size(), 0);
+
+  Bytes clear;
+  XCTAssertTrue(ClearFmp4Initialization(init.data(), init.size(), &clear));
+  XCTAssertTrue(clear == init);
+}
+
+- (void)testParseEncryptedTrack {
+  Bytes init = MakeInitialization("cenc");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  XCTAssertEqual(track.format, Fmp4FourCC('h', 'v', 'c', '1'));
+  XCTAssertTrue(track.encrypted);
+  XCTAssertEqual(track.scheme, Fmp4FourCC('c', 'e', 'n', 'c'));
+  XCTAssertEqual(track.default_iv_size, 8);
+  XCTAssertEqual(memcmp(track.default_key_id, kKeyId, kFmp4KeyIdSize), 0);
+  XCTAssertEqual(track.psshs.size(), 1);
+  XCTAssertEqual(track.psshs[0].size(), 40);
+}
+
+// The protection is removed and the sizes of every box up to the moov are rewritten.
+- (void)testClearInitialization {
+  Bytes init = MakeInitialization("cenc");
+  AppendBytes(&init, MakeSegmentIndex(0, 0, 1000));
+  Bytes clear;
+  XCTAssertTrue(ClearFmp4Initialization(init.data(), init.size(), &clear));
+  XCTAssertFalse(ContainsType(clear, "encv"));
+  XCTAssertFalse(ContainsType(clear, "sinf"));
+  XCTAssertFalse(ContainsType(clear, "sidx"));
+  XCTAssertTrue(ContainsType(clear, "hvcC"));
+
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(clear.data(), clear.size(), &track));
+  XCTAssertFalse(track.encrypted);
+  XCTAssertEqual(track.format, Fmp4FourCC('h', 'v', 'c', '1'));
+  XCTAssertEqual(track.timescale, kTimescale);
+}
+
+- (void)testSegmentIndex {
+  for (uint8_t version = 0; version < 2; ++version) {
+    Bytes init = MakeInitialization(nullptr);
+    Bytes sidx = MakeSegmentIndex(version, 10, 1000);
+    AppendBytes(&init, sidx);
+    Fmp4SegmentIndex index;
+    XCTAssertTrue(ParseFmp4SegmentIndex(init.data(), init.size(), 100, &index));
+    XCTAssertEqual(index.timescale, kTimescale);
+    XCTAssertEqual(index.references.size(), 2);
+    if (index.references.size() != 2) {
+      continue;
+    }
+    XCTAssertEqual(index.references[0].offset, 100 + init.size() + 10);
+    XCTAssertEqual(index.references[0].size, 1000);
+    XCTAssertEqual(index.references[0].duration, 180000);
+    XCTAssertEqual(index.references[1].offset, 100 + init.size() + 10 + 1000);
+    XCTAssertEqual(index.references[1].size, 2000);
+    XCTAssertEqual(index.references[1].duration, 90000);
+  }
+}
+
+// Indexes that point at other indexes are not supported -- Negative Test.
+- (void)testHierarchicalSegmentIndex {
+  Bytes sidx = MakeSegmentIndex(0, 0, 0x80000000 | 1000);
+  Fmp4SegmentIndex index;
+  XCTAssertFalse(ParseFmp4SegmentIndex(sidx.data(), sidx.size(), 0, &index));
+}
+
+// Only protected bytes are decrypted, each sample as one stream, and the samples of a fragment are
+// handed over at once.
+- (void)testDecryptSegment {
+  Bytes init = MakeInitialization("cenc");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  Bytes segment = MakeSegment();
+  std::vector<size_t> lengths;
+  XCTAssertTrue(
+      DecryptFmp4Segment(track, segment.data(), segment.size(), InvertDecrypt, &lengths));
+  XCTAssertEqual(lengths.size(), 2);
+  const uint8_t *samples = segment.data() + segment.size() - 32;
+  for (uint8_t i = 0; i < 32; ++i) {
+    XCTAssertEqual(samples[i], i < 4 ? i : (uint8_t)~i, @"byte %d", i);
+  }
+
+  segment = MakeSegment();
+  std::vector<size_t> batches;
+  XCTAssertTrue(DecryptFmp4Segment(track, segment.data(), segment.size(), CountDecrypt, &batches));
+  XCTAssertTrue(batches == std::vector<size_t>{2});
+}
+
+// Clear tracks are served as they are.
+- (void)testClearSegment {
+  Bytes init = MakeInitialization(nullptr);
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  Bytes segment = MakeSegment();
+  Bytes original = segment;
+  XCTAssertTrue(DecryptFmp4Segment(track, segment.data(), segment.size(), FailDecrypt, nullptr));
+  XCTAssertTrue(segment == original);
+}
+
+// CBC schemes cannot be decrypted by the CDM -- Negative Test.
+- (void)testUnsupportedScheme {
+  Bytes init = MakeInitialization("cbcs");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  Bytes segment = MakeSegment();
+  std::vector<size_t> lengths;
+  XCTAssertFalse(
+      DecryptFmp4Segment(track, segment.data(), segment.size(), InvertDecrypt, &lengths));
+  XCTAssertEqual(lengths.size(), 0);
+}
+
+// Truncated or failing segments are rejected -- Negative Test.
+- (void)testInvalidSegment {
+  Bytes init = MakeInitialization("cenc");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  Bytes segment = MakeSegment();
+  std::vector<size_t> lengths;
+  XCTAssertFalse(
+      DecryptFmp4Segment(track, segment.data(), segment.size() - 1, InvertDecrypt, &lengths));
+  segment = MakeSegment();
+  XCTAssertFalse(
+      DecryptFmp4Segment(track, segment.data(), segment.size(), FailDecrypt, nullptr));
+  XCTAssertFalse(ParseFmp4Track(segment.data(), segment.size(), &track));
+}
+
+// Sample counts that the trun or the segment cannot hold are rejected before the samples are
+// allocated -- Negative Test.
+- (void)testInvalidSampleCount {
+  Bytes init = MakeInitialization("cenc");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  std::vector<size_t> lengths;
+  size_t extent = 0;
+  Bytes keyFrame;
+  // More sample sizes than the trun has.
+  Bytes segment = MakeSegment();
+  WriteField(&segment, "trun", 12, 0xffffffff);
+  XCTAssertFalse(
+      DecryptFmp4Segment(track, segment.data(), segment.size(), InvertDecrypt, &lengths));
+  XCTAssertFalse(Fmp4KeyFrameExtent(segment.data(), segment.size(), &extent));
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), segment.size(), &keyFrame));
+  // No sample fields, so only the size of the segment bounds the count.
+  segment = MakeSegment();
+  WriteField(&segment, "trun", 8, 0x1);
+  WriteField(&segment, "trun", 12, 0xffffffff);
+  XCTAssertFalse(
+      DecryptFmp4Segment(track, segment.data(), segment.size(), InvertDecrypt, &lengths));
+  XCTAssertEqual(lengths.size(), 0u);
+}
+
+// Only the moof and the first sample are needed, which a prefix of the segment tells.
+- (void)testKeyFrameExtent {
+  Bytes segment = MakeSegment(true);
+  size_t moofStart = FindBox(segment, "moof");
+  size_t moofSize = ReadField(segment, "moof", 0);
+  size_t extent = 0;
+  XCTAssertTrue(Fmp4KeyFrameExtent(segment.data(), segment.size(), &extent));
+  XCTAssertEqual(extent, moofStart + moofSize + 8 + 16);
+  XCTAssertTrue(Fmp4KeyFrameExtent(segment.data(), moofStart + 8, &extent));
+  XCTAssertEqual(extent, moofStart + moofSize);
+  XCTAssertTrue(Fmp4KeyFrameExtent(segment.data(), 10, &extent));
+  XCTAssertEqual(extent, moofStart + 16);
+}
+
+// The cut fragment holds the first sample, with its encryption and auxiliary information.
+- (void)testCutKeyFrame {
+  Bytes segment = MakeSegment(true);
+  size_t extent = 0;
+  XCTAssertTrue(Fmp4KeyFrameExtent(segment.data(), segment.size(), &extent));
+  Bytes keyFrame;
+  XCTAssertTrue(CutFmp4KeyFrame(segment.data(), extent, &keyFrame));
+  XCTAssertFalse(ContainsType(keyFrame, "styp"));
+  XCTAssertEqual(ReadField(keyFrame, "trun", 12), 1);
+  XCTAssertEqual(ReadField(keyFrame, "saiz", 13), 1);
+  XCTAssertEqual(ReadField(keyFrame, "saio", 12), 1);
+  XCTAssertEqual(ReadField(keyFrame, "senc", 12), 1);
+  uint32_t auxInfoOffset = ReadField(keyFrame, "saio", 16);
+  XCTAssertEqual(auxInfoOffset, FindBox(keyFrame, "senc") + 16);
+  XCTAssertEqual(keyFrame[auxInfoOffset], 0x11);
+  XCTAssertEqual(ReadField(keyFrame, "trun", 16), keyFrame.size() - 16);
+  XCTAssertEqual(ReadField(keyFrame, "mdat", 0), 8 + 16);
+
+  Bytes init = MakeInitialization("cenc");
+  Fmp4Track track;
+  XCTAssertTrue(ParseFmp4Track(init.data(), init.size(), &track));
+  std::vector<size_t> lengths;
+  XCTAssertTrue(
+      DecryptFmp4Segment(track, keyFrame.data(), keyFrame.size(), InvertDecrypt, &lengths));
+  XCTAssertEqual(lengths.size(), 1);
+  const uint8_t *sample = keyFrame.data() + keyFrame.size() - 16;
+  for (uint8_t i = 0; i < 16; ++i) {
+    XCTAssertEqual(sample[i], i < 4 ? i : (uint8_t)~i, @"byte %d", i);
+  }
+}
+
+// Fragments cannot be cut without all of the first sample -- Negative Test.
+- (void)testCutTruncatedKeyFrame {
+  Bytes segment = MakeSegment();
+  size_t extent = 0;
+  XCTAssertTrue(Fmp4KeyFrameExtent(segment.data(), segment.size(), &extent));
+  Bytes keyFrame;
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), extent - 1, &keyFrame));
+  Bytes init = MakeInitialization(nullptr);
+  XCTAssertFalse(CutFmp4KeyFrame(init.data(), init.size(), &keyFrame));
+  // Without a moof the extent keeps growing past the data.
+  XCTAssertTrue(Fmp4KeyFrameExtent(init.data(), init.size(), &extent));
+  XCTAssertGreaterThan(extent, init.size());
+}
+
+// Sample ranges that wrap around or leave the mdat are rejected -- Negative Test.
+- (void)testInvalidKeyFrameRange {
+  size_t extent = 0;
+  Bytes keyFrame;
+  // A negative data offset puts the sample before the moof.
+  Bytes segment = MakeSegment();
+  WriteField(&segment, "trun", 16, 0xffffffff);
+  XCTAssertFalse(Fmp4KeyFrameExtent(segment.data(), segment.size(), &extent));
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), segment.size(), &keyFrame));
+  // A sample size that wraps the end of the sample around.
+  segment = MakeSegment();
+  WriteField(&segment, "trun", 20, 0xfffffff0);
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), segment.size(), &keyFrame));
+  // A sample past the end of the mdat.
+  segment = MakeSegment();
+  WriteField(&segment, "trun", 20, 64);
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), segment.size(), &keyFrame));
+  // A moof cut short.
+  segment = MakeSegment();
+  XCTAssertFalse(CutFmp4KeyFrame(segment.data(), FindBox(segment, "mdat") - 1, &keyFrame));
+}
+
+- (void)testChunks {
+  // A chunked segment is a styp followed by moof and mdat pairs.
+  Bytes segment = MakeSegment();
+  size_t chunkStart = FindBox(segment, "moof");
+  size_t chunkSize = segment.size() - chunkStart;
+  segment.insert(segment.end(), segment.begin() + chunkStart, segment.end());
+  std::vector<Fmp4Chunk> chunks;
+  XCTAssertTrue(ParseFmp4Chunks(segment.data(), segment.size(), &chunks));
+  XCTAssertEqual(chunks.size(), 2u);
+  XCTAssertEqual(chunks[0].offset, chunkStart);
+  XCTAssertEqual(chunks[0].size, chunkSize);
+  XCTAssertEqual(chunks[1].offset, chunkStart + chunkSize);
+  XCTAssertEqual(chunks[1].size, chunkSize);
+  // Chunks still being received are not listed.
+  XCTAssertTrue(ParseFmp4Chunks(segment.data(), segment.size() - 1, &chunks));
+  XCTAssertEqual(chunks.size(), 1u);
+  XCTAssertTrue(ParseFmp4Chunks(segment.data(), chunkStart + chunkSize + 3, &chunks));
+  XCTAssertEqual(chunks.size(), 1u);
+  XCTAssertTrue(ParseFmp4Chunks(segment.data(), chunkStart, &chunks));
+  XCTAssertEqual(chunks.size(), 0u);
+}
+
+// Boxes smaller than their header are rejected -- Negative Test.
+- (void)testInvalidChunks {
+  Bytes segment = MakeSegment();
+  segment[3] = 4;
+  std::vector<Fmp4Chunk> chunks;
+  XCTAssertFalse(ParseFmp4Chunks(segment.data(), segment.size(), &chunks));
+}
+
+- (void)testSegmentTiming {
+  Bytes segment = MakeBox("styp", Bytes{'m', 's', 'd', 'h', 0, 0, 0, 0});
+  AppendBytes(&segment, MakeTimedFragment(1, 0x100000000, false));
+  AppendBytes(&segment, MakeTimedFragment(0, 6006, true));
+  uint64_t start = 0;
+  uint64_t duration = 0;
+  XCTAssertTrue(ParseFmp4SegmentTiming(segment.data(), segment.size(), &start, &duration));
+  XCTAssertEqual(start, 0x100000000u);
+  XCTAssertEqual(duration, 2 * 3003u + 2 * 3000u + 3003u);
+}
+
+// Validate the start of a segment is read from the first moof of the start of the segment.
+- (void)testSegmentStart {
+  Bytes segment = MakeBox("styp", Bytes{'m', 's', 'd', 'h', 0, 0, 0, 0});
+  AppendBytes(&segment, MakeTimedFragment(1, 0x100000000, false));
+  AppendBytes(&segment, MakeTimedFragment(0, 6006, true));
+  uint64_t start = 0;
+  XCTAssertTrue(ParseFmp4SegmentStart(segment.data(), segment.size(), &start));
+  XCTAssertEqual(start, 0x100000000u);
+  // The rest of the segment is not needed.
+  start = 0;
+  XCTAssertTrue(ParseFmp4SegmentStart(segment.data(), segment.size() - 1, &start));
+  XCTAssertEqual(start, 0x100000000u);
+}
+
+// A segment cut short within its first moof has no start -- Negative Test.
+- (void)testTruncatedSegmentStart {
+  Bytes segment = MakeTimedFragment(1, 6006, false);
+  uint64_t start = 0;
+  XCTAssertFalse(ParseFmp4SegmentStart(segment.data(), 16, &start));
+  Bytes init = MakeInitialization("cenc");
+  XCTAssertFalse(ParseFmp4SegmentStart(init.data(), init.size(), &start));
+}
+
+// Segments without a tfdt or sample durations have no timing -- Negative Test.
+- (void)testInvalidSegmentTiming {
+  uint64_t start = 0;
+  uint64_t duration = 0;
+  Bytes segment = MakeSegment();
+  XCTAssertFalse(ParseFmp4SegmentTiming(segment.data(), segment.size(), &start, &duration));
+  Bytes init = MakeInitialization("cenc");
+  XCTAssertFalse(ParseFmp4SegmentTiming(init.data(), init.size(), &start, &duration));
+}
+
+@end
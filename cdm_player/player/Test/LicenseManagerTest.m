@@ -1,16 +1,20 @@
 #import "LicenseManager.h"
 #import "Logging.h"
+#import "MockLicenseServer.h"
 
 NSString *kMockLicenseFile = @"mockLicenseFile.lic";
 NSString *kMockWebSessionId = @"webSessionId12345";
 NSString *kNewWebSessionId = @"12345WebSessionId";
 NSString *kMockLicenseServerURL = @"http://146.148.35.45:8081";
 const char kMockBytes[2] = { 0, 1 };
+static const NSUInteger kConcurrentLicenseRequests = 16;
+static const NSUInteger kStoredOfflineTitles = 5000;
 
 @interface LicenseManagerTest : XCTestCase {
   LicenseManager *_licMgr;
   NSData *_mockData;
   DDTTYLogger *_logger;
+  NSURLSession *_licenseSession;
 }
 @end
 
@@ -21,9 +25,12 @@ const char kMockBytes[2] = { 0, 1 };
   _logger = [DDTTYLogger sharedInstance];
   [DDLog addLogger:_logger];
   _mockData = [NSData dataWithBytes:kMockBytes length:sizeof(kMockBytes)];
+  _licenseSession = _licMgr.licenseSession;
+  [MockLicenseServer reset];
 }
 
 - (void)tearDown {
+  _licMgr.licenseSession = _licenseSession;
   [DDLog removeLogger:_logger];
 }
 
@@ -88,4 +95,146 @@ const char kMockBytes[2] = { 0, 1 };
   XCTAssertFalse([_licMgr fileExists:badFileName]);
 }
 
+// Validate license requests are sent concurrently and all complete.
+- (void)testConcurrentLicenseRequests {
+  _licMgr.licenseSession = [MockLicenseServer session];
+  [MockLicenseServer setResponseDelay:0.2];
+  NSUInteger metricsBefore = _licMgr.requestMetrics.count;
+  for (NSUInteger i = 0; i < kConcurrentLicenseRequests; ++i) {
+    XCTestExpectation *expectation =
+        [self expectationWithDescription:[NSString stringWithFormat:@"license %tu", i]];
+    [_licMgr iOSCdm:[iOSCdm sharedInstance]
+        fetchLicenseWithData:_mockData
+             completionBlock:^(NSData *data, NSError *error) {
+               XCTAssertNil(error);
+               XCTAssertEqualObjects(data, _mockData);
+               [expectation fulfill];
+             }];
+  }
+  // Serial requests would take kConcurrentLicenseRequests * 0.2s.
+  [self waitForExpectationsWithTimeout:2 handler:nil];
+  XCTAssertEqual([MockLicenseServer requestCount], kConcurrentLicenseRequests);
+  XCTAssertGreaterThan([MockLicenseServer maxConcurrentRequests], 1);
+  XCTAssertGreaterThan(_licMgr.requestMetrics.count, metricsBefore);
+  CDMLogInfo(@"Last license request took %.3fs", _licMgr.requestMetrics.lastObject.duration);
+}
+
+// Validate server errors are retried and the final response is delivered.
+- (void)testLicenseRequestRetry {
+  _licMgr.licenseSession = [MockLicenseServer session];
+  __block NSUInteger attempts = 0;
+  [MockLicenseServer setResponder:^NSData *(NSURLRequest *request, NSInteger *statusCode) {
+    if (++attempts < 2) {
+      *statusCode = 503;
+      return nil;
+    }
+    return request.HTTPBody;
+  }];
+  XCTestExpectation *expectation = [self expectationWithDescription:@"license"];
+  [_licMgr iOSCdm:[iOSCdm sharedInstance]
+      fetchLicenseWithData:_mockData
+           completionBlock:^(NSData *data, NSError *error) {
+             XCTAssertNil(error);
+             XCTAssertEqualObjects(data, _mockData);
+             [expectation fulfill];
+           }];
+  [self waitForExpectationsWithTimeout:5 handler:nil];
+  XCTAssertEqual(_licMgr.requestMetrics.lastObject.attempts, 2);
+  XCTAssertEqual(_licMgr.requestMetrics.lastObject.statusCode, 200);
+}
+
+// Validate client errors fail without retrying -- Negative Test.
+- (void)testLicenseRequestNoRetry {
+  _licMgr.licenseSession = [MockLicenseServer session];
+  [MockLicenseServer setResponder:^NSData *(NSURLRequest *request, NSInteger *statusCode) {
+    *statusCode = 403;
+    return nil;
+  }];
+  XCTestExpectation *expectation = [self expectationWithDescription:@"license"];
+  [_licMgr iOSCdm:[iOSCdm sharedInstance]
+      fetchLicenseWithData:_mockData
+           completionBlock:^(NSData *data, NSError *error) {
+             XCTAssertNotNil(error);
+             XCTAssertNil(data);
+             [expectation fulfill];
+           }];
+  [self waitForExpectationsWithTimeout:2 handler:nil];
+  XCTAssertEqual([MockLicenseServer requestCount], 1);
+}
+
+// Validate the KeyMap survives a reload from the compacted map plus journal.
+- (void)testKeyMapJournalReload {
+  NSURL *keyStoreURL = [self temporaryKeyStoreURL];
+  LicenseManager *licMgr = [[LicenseManager alloc] initWithKeyStoreURL:keyStoreURL];
+  // Enough changes to force at least one compaction.
+  for (NSUInteger i = 0; i < 100; ++i) {
+    [licMgr onSessionCreatedWithPssh:[self psshForIndex:i]
+                           sessionId:[NSString stringWithFormat:@"session%tu", i]];
+  }
+  XCTAssertTrue([licMgr removePssh:[self psshForIndex:0]]);
+  XCTAssertFalse([licMgr removePssh:[self psshForIndex:0]]);
+  [licMgr synchronizeKeyMap];
+
+  LicenseManager *reloaded = [[LicenseManager alloc] initWithKeyStoreURL:keyStoreURL];
+  XCTAssertNil([reloaded sessionIdFromPssh:[self psshForIndex:0]]);
+  XCTAssertEqualObjects([reloaded sessionIdFromPssh:[self psshForIndex:99]], @"session99");
+  [[NSFileManager defaultManager] removeItemAtURL:keyStoreURL error:nil];
+}
+
+// Validate offline titles are ordered by last use, also after a reload.
+- (void)testRecentlyUsedPsshKeys {
+  NSURL *keyStoreURL = [self temporaryKeyStoreURL];
+  LicenseManager *licMgr = [[LicenseManager alloc] initWithKeyStoreURL:keyStoreURL];
+  for (NSUInteger i = 0; i < 4; ++i) {
+    [licMgr onSessionCreatedWithPssh:[self psshForIndex:i]
+                           sessionId:[NSString stringWithFormat:@"session%tu", i]];
+  }
+  [licMgr onSessionUsedWithPssh:[self psshForIndex:1]];
+  [licMgr onSessionUsedWithPssh:[self psshForIndex:5]];
+  XCTAssertTrue([licMgr removePssh:[self psshForIndex:3]]);
+  NSArray *expected = @[ [self psshForIndex:1], [self psshForIndex:2] ];
+  XCTAssertEqualObjects([licMgr recentlyUsedPsshKeys:2], expected);
+  XCTAssertEqual([licMgr recentlyUsedPsshKeys:10].count, 3);
+  [licMgr synchronizeKeyMap];
+
+  LicenseManager *reloaded = [[LicenseManager alloc] initWithKeyStoreURL:keyStoreURL];
+  XCTAssertEqualObjects([reloaded recentlyUsedPsshKeys:2], expected);
+  [[NSFileManager defaultManager] removeItemAtURL:keyStoreURL error:nil];
+}
+
+// Benchmark PSSH lookups with thousands of stored offline titles.
+- (void)testSessionIdLookupPerformance {
+  NSURL *keyStoreURL = [self temporaryKeyStoreURL];
+  LicenseManager *licMgr = [[LicenseManager alloc] initWithKeyStoreURL:keyStoreURL];
+  NSMutableArray<NSData *> *psshKeys = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kStoredOfflineTitles; ++i) {
+    NSData *pssh = [self psshForIndex:i];
+    [psshKeys addObject:pssh];
+    [licMgr onSessionCreatedWithPssh:pssh sessionId:[NSString stringWithFormat:@"session%tu", i]];
+  }
+  [licMgr synchronizeKeyMap];
+  [self measureBlock:^{
+    for (NSData *pssh in psshKeys) {
+      XCTAssertNotNil([licMgr sessionIdFromPssh:pssh]);
+    }
+  }];
+  [[NSFileManager defaultManager] removeItemAtURL:keyStoreURL error:nil];
+}
+
+#pragma mark - private methods
+
+- (NSURL *)temporaryKeyStoreURL {
+  NSString *path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  return [NSURL fileURLWithPath:path isDirectory:YES];
+}
+
+// Returns a PSSH-sized blob unique to |index|.
+- (NSData *)psshForIndex:(NSUInteger)index {
+  NSMutableData *pssh = [NSMutableData dataWithLength:52];
+  uint64_t value = index;
+  [pssh replaceBytesInRange:NSMakeRange(36, sizeof(value)) withBytes:&value];
+  return pssh;
+}
+
 @end
@@ -0,0 +1,144 @@
+#import "LicenseManager.h"
+#import "LicenseRenewalScheduler.h"
+
+static const int64_t kMillisecondsPerHour = 60 * 60 * 1000;
+
+// Stands in for iOSCdm, reporting fixed expirations and recording renewals.
+@interface FakeRenewalCdm : NSObject <LicenseRenewalCdm>
+@property(nonatomic) NSMutableDictionary<NSData *, NSNumber *> *expirations;
+@property(atomic) NSMutableArray<NSData *> *renewed;
+@property(atomic) NSUInteger infoRequests;
+@end
+
+@implementation FakeRenewalCdm
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _expirations = [NSMutableDictionary dictionary];
+    _renewed = [NSMutableArray array];
+  }
+  return self;
+}
+
+- (void)getLicenseInfo:(NSData *)psshKey
+       completionBlock:(void (^)(int64_t *expiration, NSError *))completionBlock {
+  self.infoRequests++;
+  int64_t expiration = _expirations[psshKey].longLongValue;
+  completionBlock(&expiration, nil);
+}
+
+- (void)renewOfflineLicenseForPsshKey:(NSData *)psshKey
+                      completionBlock:(void (^)(NSError *))completionBlock {
+  @synchronized(self) {
+    [_renewed addObject:psshKey];
+  }
+  completionBlock(nil);
+}
+
+@end
+
+@interface LicenseRenewalSchedulerTest : XCTestCase {
+  NSURL *_keyStoreURL;
+  LicenseManager *_licMgr;
+  FakeRenewalCdm *_cdm;
+  LicenseRenewalScheduler *_scheduler;
+}
+@end
+
+@implementation LicenseRenewalSchedulerTest
+
+- (void)setUp {
+  NSString *path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  _keyStoreURL = [NSURL fileURLWithPath:path isDirectory:YES];
+  _licMgr = [[LicenseManager alloc] initWithKeyStoreURL:_keyStoreURL];
+  _cdm = [[FakeRenewalCdm alloc] init];
+  _scheduler = [[LicenseRenewalScheduler alloc] initWithLicenseManager:_licMgr cdm:_cdm];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeItemAtURL:_keyStoreURL error:nil];
+}
+
+- (void)testRenewsLicensesInWindow {
+  int64_t now = (int64_t)([[NSDate date] timeIntervalSince1970] * 1000);
+  NSData *expired = [self addLicense:@"expired" expiration:now - kMillisecondsPerHour];
+  NSData *urgent = [self addLicense:@"urgent" expiration:now + kMillisecondsPerHour];
+  NSData *later = [self addLicense:@"later" expiration:now + 48 * kMillisecondsPerHour];
+  [self addLicense:@"distant" expiration:now + 30 * 24 * kMillisecondsPerHour];
+  [self addLicense:@"unlimited" expiration:0];
+
+  // Not charging: only licenses inside the urgent window are renewed.
+  XCTAssertEqual([self check], 2);
+  XCTAssertEqualObjects([NSSet setWithArray:_cdm.renewed], ([NSSet setWithObjects:expired, urgent, nil]));
+
+  // Charging: licenses inside the regular window are renewed too.
+  [_cdm.renewed removeAllObjects];
+  _cdm.expirations[expired] = @(now + 30 * 24 * kMillisecondsPerHour);
+  _cdm.expirations[urgent] = @(now + 30 * 24 * kMillisecondsPerHour);
+  _scheduler.charging = YES;
+  XCTAssertEqual([self check], 1);
+  XCTAssertEqualObjects(_cdm.renewed, @[ later ]);
+}
+
+- (void)testExpirationIsCached {
+  int64_t now = (int64_t)([[NSDate date] timeIntervalSince1970] * 1000);
+  [self addLicense:@"distant" expiration:now + 30 * 24 * kMillisecondsPerHour];
+  XCTAssertEqual([self check], 0);
+  XCTAssertEqual([self check], 0);
+  XCTAssertEqual(_cdm.infoRequests, 1);
+}
+
+// Expirations are kept in the KeyMap, so a later launch does not ask the CDM again.
+- (void)testExpirationIsPersisted {
+  int64_t now = (int64_t)([[NSDate date] timeIntervalSince1970] * 1000);
+  NSData *pssh = [self addLicense:@"distant" expiration:now + 30 * 24 * kMillisecondsPerHour];
+  XCTAssertEqual([self check], 0);
+  [_licMgr synchronizeKeyMap];
+
+  _licMgr = [[LicenseManager alloc] initWithKeyStoreURL:_keyStoreURL];
+  XCTAssertEqualObjects([_licMgr licenseExpirationForPssh:pssh], _cdm.expirations[pssh]);
+  _scheduler = [[LicenseRenewalScheduler alloc] initWithLicenseManager:_licMgr cdm:_cdm];
+  XCTAssertEqual([self check], 0);
+  XCTAssertEqual(_cdm.infoRequests, 1);
+
+  // A new session holds a new license, whose expiration is read again.
+  [_licMgr onSessionCreatedWithPssh:pssh sessionId:@"renewed"];
+  XCTAssertNil([_licMgr licenseExpirationForPssh:pssh]);
+  XCTAssertEqual([self check], 0);
+  XCTAssertEqual(_cdm.infoRequests, 2);
+}
+
+- (void)testNotIdleDuringPlayback {
+  // Just launched.
+  XCTAssertFalse(_scheduler.idle);
+  _scheduler.idleDelay = 0;
+  XCTAssertTrue(_scheduler.idle);
+  [_scheduler playbackDidStart];
+  XCTAssertFalse(_scheduler.idle);
+  [_scheduler playbackDidStop];
+  XCTAssertTrue(_scheduler.idle);
+}
+
+#pragma mark - private methods
+
+- (NSData *)addLicense:(NSString *)name expiration:(int64_t)expiration {
+  NSData *pssh = [name dataUsingEncoding:NSUTF8StringEncoding];
+  [_licMgr onSessionCreatedWithPssh:pssh sessionId:name];
+  _cdm.expirations[pssh] = @(expiration);
+  return pssh;
+}
+
+- (NSUInteger)check {
+  __block NSUInteger renewed = 0;
+  XCTestExpectation *expectation = [self expectationWithDescription:@"check"];
+  [_scheduler checkLicensesWithCompletion:^(NSUInteger count) {
+    renewed = count;
+    [expectation fulfill];
+  }];
+  [self waitForExpectationsWithTimeout:2 handler:nil];
+  return renewed;
+}
+
+@end
@@ -0,0 +1,25 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+// Returns the body for a license |request| and sets |statusCode| (defaults to 200).
+typedef NSData *(^MockLicenseResponder)(NSURLRequest *request, NSInteger *statusCode);
+
+// In-process license endpoint for exercising the license path without a network. Requests sent
+// through +session are answered by the responder after the configured delay.
+@interface MockLicenseServer : NSURLProtocol
+
+// Session whose requests are all served by the mock server.
++ (NSURLSession *)session;
+// Clears the responder, delay and counters.
++ (void)reset;
+// Sets the block producing responses. Without one, requests are echoed back with status 200.
++ (void)setResponder:(MockLicenseResponder)responder;
+// Simulated server round trip time.
++ (void)setResponseDelay:(NSTimeInterval)delay;
+// Number of requests received since the last reset.
++ (NSUInteger)requestCount;
+// Highest number of requests that were in flight at the same time since the last reset.
++ (NSUInteger)maxConcurrentRequests;
+
+@end
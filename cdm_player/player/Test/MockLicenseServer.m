@@ -0,0 +1,122 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "MockLicenseServer.h"
+
+static MockLicenseResponder sResponder;
+static NSTimeInterval sResponseDelay;
+static NSUInteger sRequestCount;
+static NSUInteger sInFlight;
+static NSUInteger sMaxInFlight;
+
+@implementation MockLicenseServer {
+  BOOL _stopped;
+}
+
++ (NSURLSession *)session {
+  NSURLSessionConfiguration *config = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+  config.protocolClasses = @[ [MockLicenseServer class] ];
+  return [NSURLSession sessionWithConfiguration:config];
+}
+
++ (void)reset {
+  @synchronized(self) {
+    sResponder = nil;
+    sResponseDelay = 0;
+    sRequestCount = 0;
+    sInFlight = 0;
+    sMaxInFlight = 0;
+  }
+}
+
++ (void)setResponder:(MockLicenseResponder)responder {
+  @synchronized(self) {
+    sResponder = [responder copy];
+  }
+}
+
++ (void)setResponseDelay:(NSTimeInterval)delay {
+  @synchronized(self) {
+    sResponseDelay = delay;
+  }
+}
+
++ (NSUInteger)requestCount {
+  @synchronized(self) {
+    return sRequestCount;
+  }
+}
+
++ (NSUInteger)maxConcurrentRequests {
+  @synchronized(self) {
+    return sMaxInFlight;
+  }
+}
+
+#pragma mark - NSURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+  return YES;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+  return request;
+}
+
+- (void)startLoading {
+  MockLicenseResponder responder;
+  NSTimeInterval delay;
+  @synchronized([MockLicenseServer class]) {
+    responder = sResponder;
+    delay = sResponseDelay;
+    sRequestCount++;
+    sInFlight++;
+    sMaxInFlight = MAX(sMaxInFlight, sInFlight);
+  }
+  NSMutableURLRequest *request = [self.request mutableCopy];
+  // Sessions hand the body to protocols as a stream.
+  if (!request.HTTPBody && request.HTTPBodyStream) {
+    request.HTTPBody = [self readStream:request.HTTPBodyStream];
+  }
+  dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
+  dispatch_after(when, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    NSInteger statusCode = 200;
+    NSData *body = responder ? responder(request, &statusCode) : request.HTTPBody;
+    @synchronized([MockLicenseServer class]) {
+      sInFlight--;
+    }
+    if (_stopped) {
+      return;
+    }
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:request.URL
+                                                              statusCode:statusCode
+                                                             HTTPVersion:@"HTTP/1.1"
+                                                            headerFields:nil];
+    [self.client URLProtocol:self
+          didReceiveResponse:response
+          cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    if (body) {
+      [self.client URLProtocol:self didLoadData:body];
+    }
+    [self.client URLProtocolDidFinishLoading:self];
+  });
+}
+
+- (void)stopLoading {
+  _stopped = YES;
+}
+
+#pragma mark - private methods
+
+- (NSData *)readStream:(NSInputStream *)stream {
+  NSMutableData *data = [NSMutableData data];
+  uint8_t buffer[4096];
+  [stream open];
+  NSInteger length;
+  while ((length = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+    [data appendBytes:buffer length:length];
+  }
+  [stream close];
+  return data;
+}
+
+@end
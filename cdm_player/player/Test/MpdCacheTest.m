@@ -0,0 +1,126 @@
+#import "MpdCache.h"
+#import "MpdParser.h"
+#import "Stream.h"
+
+static NSString *const kMpdName = @"tears_cenc_small";
+static NSString *const kMpdURLString = @"https://example.com/tears_cenc_small.mpd";
+
+@interface MpdCacheTest : XCTestCase
+@end
+
+@implementation MpdCacheTest {
+  NSURL *_directoryURL;
+  MpdCache *_cache;
+  NSURL *_mpdURL;
+  NSData *_mpdData;
+}
+
+- (void)setUp {
+  [super setUp];
+  NSString *name = [NSProcessInfo processInfo].globallyUniqueString;
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+  _directoryURL = [NSURL fileURLWithPath:path isDirectory:YES];
+  _cache = [[MpdCache alloc] initWithDirectoryURL:_directoryURL];
+  _mpdURL = [NSURL URLWithString:kMpdURLString];
+  _mpdData = [NSData dataWithContentsOfFile:[[NSBundle mainBundle] pathForResource:kMpdName
+                                                                             ofType:@"mpd"]];
+}
+
+- (void)tearDown {
+  [_cache synchronize];
+  [[NSFileManager defaultManager] removeItemAtURL:_directoryURL error:nil];
+  [super tearDown];
+}
+
+- (NSArray<Stream *> *)parseMpd {
+  return [MpdParser parseMpdWithStreaming:nil mpdData:_mpdData baseURL:_mpdURL storeOffline:NO];
+}
+
+- (void)testRoundTrip {
+  NSArray<Stream *> *parsed = [self parseMpd];
+  XCTAssertGreaterThan(parsed.count, 0);
+  NSDictionary *validators = @{@"ETag" : @"\"1234\""};
+  [_cache setStreams:parsed validators:validators forMpdURL:_mpdURL];
+  [_cache synchronize];
+
+  NSDictionary<NSString *, NSString *> *cachedValidators = nil;
+  NSArray<Stream *> *cached =
+      [_cache streamsForMpdURL:_mpdURL streaming:nil validators:&cachedValidators];
+  XCTAssertEqualObjects(cachedValidators, validators);
+  XCTAssertEqual(cached.count, parsed.count);
+  for (NSUInteger i = 0; i < MIN(cached.count, parsed.count); ++i) {
+    Stream *expected = parsed[i];
+    Stream *stream = cached[i];
+    XCTAssertNotEqual(stream, expected);
+    XCTAssertEqual(stream.bandwidth, expected.bandwidth);
+    XCTAssertEqualObjects(stream.codecs, expected.codecs);
+    XCTAssertEqual(stream.dashMediaType, expected.dashMediaType);
+    XCTAssertEqual(stream.frameRate, expected.frameRate);
+    XCTAssertEqual(stream.height, expected.height);
+    XCTAssertTrue(NSEqualRanges(stream.initialRange, expected.initialRange));
+    XCTAssertEqual(stream.isVideo, expected.isVideo);
+    XCTAssertTrue([stream.liveStream isEqualToLiveStream:expected.liveStream]);
+    XCTAssertEqual(stream.mediaPresentationDuration, expected.mediaPresentationDuration);
+    XCTAssertEqualObjects(stream.mimeType, expected.mimeType);
+    XCTAssertEqualObjects(stream.period.periodId, expected.period.periodId);
+    XCTAssertEqualObjects(stream.pssh, expected.pssh);
+    XCTAssertEqualObjects(stream.sourceURL, expected.sourceURL);
+    XCTAssertEqual(stream.streamIndex, expected.streamIndex);
+    XCTAssertEqual(stream.width, expected.width);
+    XCTAssertNotNil(stream.m3u8);
+    XCTAssertTrue(stream.session == NULL);
+  }
+}
+
+// Responses without validators cannot be revalidated, so they are not cached.
+- (void)testNoValidators {
+  [_cache setStreams:[self parseMpd] validators:@{} forMpdURL:_mpdURL];
+  [_cache synchronize];
+  XCTAssertNil([_cache streamsForMpdURL:_mpdURL streaming:nil validators:nil]);
+}
+
+- (void)testRemove {
+  [_cache setStreams:[self parseMpd] validators:@{@"ETag" : @"\"1\""} forMpdURL:_mpdURL];
+  [_cache removeStreamsForMpdURL:_mpdURL];
+  [_cache synchronize];
+  XCTAssertNil([_cache streamsForMpdURL:_mpdURL streaming:nil validators:nil]);
+}
+
+// Unreadable entries are misses and are removed -- Negative Test.
+- (void)testCorruptEntry {
+  [_cache setStreams:[self parseMpd] validators:@{@"ETag" : @"\"1\""} forMpdURL:_mpdURL];
+  [_cache synchronize];
+  NSArray<NSURL *> *entries =
+      [[NSFileManager defaultManager] contentsOfDirectoryAtURL:_directoryURL
+                                    includingPropertiesForKeys:nil
+                                                       options:0
+                                                         error:nil];
+  XCTAssertEqual(entries.count, 1);
+  NSData *garbage = [@"not an archive" dataUsingEncoding:NSUTF8StringEncoding];
+  XCTAssertTrue([garbage writeToURL:entries.firstObject atomically:YES]);
+
+  XCTAssertNil([_cache streamsForMpdURL:_mpdURL streaming:nil validators:nil]);
+  [_cache synchronize];
+  XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:entries.firstObject.path]);
+}
+
+// Entries of one manifest are never returned for another -- Negative Test.
+- (void)testOtherURL {
+  [_cache setStreams:[self parseMpd] validators:@{@"ETag" : @"\"1\""} forMpdURL:_mpdURL];
+  [_cache synchronize];
+  NSURL *otherURL = [NSURL URLWithString:@"https://example.com/other.mpd"];
+  XCTAssertNil([_cache streamsForMpdURL:otherURL streaming:nil validators:nil]);
+}
+
+// Reading a cached manifest is what reopening a title costs instead of parsing the MPD.
+- (void)testReadPerformance {
+  [_cache setStreams:[self parseMpd] validators:@{@"ETag" : @"\"1\""} forMpdURL:_mpdURL];
+  [_cache synchronize];
+  [self measureBlock:^{
+    for (int i = 0; i < 100; ++i) {
+      XCTAssertNotNil([_cache streamsForMpdURL:_mpdURL streaming:nil validators:nil]);
+    }
+  }];
+}
+
+@end
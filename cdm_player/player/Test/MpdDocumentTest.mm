@@ -0,0 +1,263 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MpdDocument.h"
+
+static NSString *const kManifestURL_eDash = @"tears_cenc_small";
+static const char kWidevineSchemeIdUri[] = "urn:uuid:edef8ba9-79d6-4ace-a3c8-27dcd51d21ed";
+
+// Exercises inheritance from the Period and AdaptationSet, every kind of segment information,
+// namespaced elements, CDATA and character references.
+static const char kLiveMpd[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!-- Generated for MpdDocumentTest -->\n"
+    "<MPD xmlns:cenc=\"urn:mpeg:cenc:2013\" type=\"dynamic\" minimumUpdatePeriod=\"PT2S\" "
+        "availabilityStartTime=\"2017-01-01T00:00:00Z\">"
+      "<BaseURL>//cdn.example.com/live/</BaseURL>"
+      "<Period id=\"p0\" start=\"PT0S\">"
+        "<SegmentTemplate timescale=\"90000\" duration=\"180000\" startNumber=\"5\" "
+            "availabilityTimeOffset=\"1.5\" "
+            "media=\"$RepresentationID$/$Number$.m4s?a=1&amp;b=2\" "
+            "initialization=\"$RepresentationID$/init.mp4\"/>"
+        "<AdaptationSet mimeType=\"video/mp4\" codecs=\"avc1.4d401f\" frameRate=\"30000/1001\">"
+          "<ContentProtection schemeIdUri=\"urn:uuid:EDEF8BA9-79D6-4ACE-A3C8-27DCD51D21ED\" "
+              "cenc:default_KID=\"kid\">"
+            "<cenc:pssh> QUJD </cenc:pssh>"
+          "</ContentProtection>"
+          "<Representation id=\"v1\" bandwidth=\"1000\" width=\"640\" height=\"360\"/>"
+          "<Representation id=\"v2\" bandwidth=\"2000\" width=\"1280\" height=\"720\">"
+            "<SegmentTemplate startNumber=\"7\">"
+              "<SegmentTimeline><S t=\"10\" d=\"5\" r=\"-1\"/><S d=\"6\"/></SegmentTimeline>"
+            "</SegmentTemplate>"
+          "</Representation>"
+        "</AdaptationSet>"
+        "<AdaptationSet mimeType=\"audio/mp4\">"
+          "<SegmentList duration=\"4\">"
+            "<Initialization sourceURL=\"init.mp4\"/>"
+            "<SegmentURL media=\"1.mp4\" mediaRange=\"0-9\"/>"
+            "<SegmentURL media=\"2.mp4\"/>"
+          "</SegmentList>"
+          "<Representation id=\"a1\" codecs=\"mp4a.40.2\" bandwidth=\"64000\">"
+            "<BaseURL><![CDATA[audio.mp4]]></BaseURL>"
+            "<SegmentBase indexRange=\"10-20\"><Initialization range=\"0-9\"/></SegmentBase>"
+          "</Representation>"
+        "</AdaptationSet>"
+      "</Period>"
+      "<Period id=\"p1\"/>"
+    "</MPD>";
+
+@interface MpdDocumentTest : XCTestCase
+@end
+
+@implementation MpdDocumentTest
+
+- (void)testModel {
+  std::string data(kLiveMpd);
+  MpdDocument document;
+  XCTAssertTrue(document.Parse(data.data(), data.size()));
+  XCTAssertTrue(document.error() == nullptr);
+  const Mpd &mpd = document.mpd();
+  XCTAssertTrue(mpd.type == "dynamic");
+  XCTAssertTrue(mpd.minimum_update_period == "PT2S");
+  XCTAssertTrue(mpd.base_url == "//cdn.example.com/live/");
+  XCTAssertEqual(mpd.periods.size(), 2);
+  const MpdPeriod &period = mpd.periods[0];
+  XCTAssertTrue(period.id == "p0");
+  XCTAssertEqual(period.adaptation_sets.size(), 2);
+  XCTAssertTrue(mpd.periods[1].adaptation_sets.empty());
+
+  // Attributes and the SegmentTemplate are inherited from the AdaptationSet and Period.
+  const MpdRepresentation &video = period.adaptation_sets[0].representations[0];
+  XCTAssertTrue(video.id == "v1");
+  XCTAssertTrue(video.mime_type == "video/mp4");
+  XCTAssertTrue(video.codecs == "avc1.4d401f");
+  XCTAssertTrue(video.frame_rate == "30000/1001");
+  XCTAssertEqual(video.bandwidth, 1000);
+  XCTAssertEqual(video.width, 640);
+  XCTAssertEqual(video.height, 360);
+  XCTAssertEqual(video.segment.type, MpdSegmentInfo::kTemplate);
+  XCTAssertEqual(video.segment.timescale, 90000);
+  XCTAssertEqual(video.segment.duration, 180000);
+  XCTAssertEqual(video.segment.start_number, 5);
+  XCTAssertTrue(video.segment.availability_time_offset == "1.5");
+  XCTAssertFalse(video.segment.has_timeline);
+  XCTAssertTrue(video.segment.initialization_url == "$RepresentationID$/init.mp4");
+  XCTAssertEqual(video.content_protection.size(), 1);
+  XCTAssertTrue(video.content_protection[0].scheme_id_uri.EqualsIgnoreCase(kWidevineSchemeIdUri));
+  XCTAssertTrue(video.content_protection[0].default_kid == "kid");
+  XCTAssertTrue(video.content_protection[0].pssh == "QUJD");
+
+  // Values point into the manifest unless they had to be decoded.
+  XCTAssertTrue(video.codecs.data() >= data.data() &&
+                video.codecs.end() <= data.data() + data.size());
+  XCTAssertTrue(video.segment.media == "$RepresentationID$/$Number$.m4s?a=1&b=2");
+
+  // A Representation overrides what it inherits.
+  const MpdRepresentation &timeline = period.adaptation_sets[0].representations[1];
+  XCTAssertEqual(timeline.segment.start_number, 7);
+  XCTAssertEqual(timeline.segment.timescale, 90000);
+  XCTAssertTrue(timeline.segment.has_timeline);
+  XCTAssertEqual(timeline.segment.timeline.size(), 2);
+  XCTAssertTrue(timeline.segment.timeline[0].has_start);
+  XCTAssertEqual(timeline.segment.timeline[0].start, 10);
+  XCTAssertEqual(timeline.segment.timeline[0].duration, 5);
+  XCTAssertEqual(timeline.segment.timeline[0].repeat, -1);
+  XCTAssertFalse(timeline.segment.timeline[1].has_start);
+  XCTAssertEqual(timeline.segment.timeline[1].duration, 6);
+
+  // A different kind of segment information replaces the inherited one.
+  const MpdAdaptationSet &audioSet = period.adaptation_sets[1];
+  XCTAssertEqual(audioSet.segment.segment_urls.size(), 2);
+  XCTAssertTrue(audioSet.segment.segment_urls[0].media == "1.mp4");
+  XCTAssertEqual(audioSet.segment.segment_urls[0].media_range.last, 9);
+  XCTAssertFalse(audioSet.segment.segment_urls[1].media_range.present);
+  XCTAssertTrue(audioSet.segment.initialization_url == "init.mp4");
+  const MpdRepresentation &audio = audioSet.representations[0];
+  XCTAssertTrue(audio.base_url == "audio.mp4");
+  XCTAssertEqual(audio.segment.type, MpdSegmentInfo::kBase);
+  XCTAssertTrue(audio.segment.segment_urls.empty());
+  XCTAssertEqual(audio.segment.index_range.first, 10);
+  XCTAssertEqual(audio.segment.index_range.last, 20);
+  XCTAssertEqual(audio.segment.initialization_range.last, 9);
+  XCTAssertTrue(audio.content_protection.empty());
+}
+
+- (void)testBundledManifest {
+  NSData *data = [self bundledManifest];
+  MpdDocument document;
+  XCTAssertTrue(document.Parse((const char *)data.bytes, data.length));
+  const Mpd &mpd = document.mpd();
+  XCTAssertTrue(mpd.media_presentation_duration == "PT734S");
+  XCTAssertEqual(mpd.periods.size(), 1);
+  XCTAssertEqual(mpd.periods[0].adaptation_sets.size(), 2);
+  const MpdRepresentation &video = mpd.periods[0].adaptation_sets[1].representations[0];
+  XCTAssertTrue(video.base_url == "tears_h264_baseline_240p_800.mp4");
+  XCTAssertEqual(video.content_protection.size(), 2);
+  XCTAssertTrue(video.content_protection[1].scheme_id_uri == kWidevineSchemeIdUri);
+  XCTAssertFalse(video.content_protection[1].pssh.empty());
+  XCTAssertEqual(video.segment.index_range.last, 1902);
+}
+
+- (void)testUnescape {
+  std::string decoded;
+  MpdXmlReader::Unescape("a&lt;&#65;&#x42;&#x1F600;&bogus;&", &decoded);
+  XCTAssertEqual(decoded, "a<AB\xF0\x9F\x98\x80&bogus;&");
+}
+
+// Malformed documents are rejected with an error -- Negative Test.
+- (void)testMalformed {
+  std::string deep = "<MPD>";
+  for (size_t i = 0; i <= MpdXmlReader::kMaxDepth; ++i) {
+    deep += "<a>";
+  }
+  const std::vector<std::string> malformed = {
+      "",
+      "<MPD>",
+      "<MPD></Period>",
+      "<MPD/><MPD/>",
+      "<HTML/>",
+      "<MPD type=static/>",
+      "<MPD type=\"<\"/>",
+      "<MPD><!-- </MPD>",
+      "text<MPD/>",
+      "<MPD><![CDATA[</MPD>",
+      "<!DOCTYPE MPD [ <!ENTITY a \"b\"> ]><MPD/>",
+      "<MPD /",
+      "<MPD type=\"static\"",
+      "</MPD>",
+      deep,
+  };
+  for (const std::string &data : malformed) {
+    MpdDocument document;
+    XCTAssertFalse(document.Parse(data.data(), data.size()), @"%s", data.c_str());
+    XCTAssertTrue(document.error() != nullptr);
+  }
+}
+
+// Randomly mutated manifests never read outside the buffer or the document -- Negative Test.
+- (void)testFuzz {
+  NSData *bundled = [self bundledManifest];
+  const std::vector<std::string> seeds = {
+      std::string((const char *)bundled.bytes, bundled.length),
+      kLiveMpd,
+  };
+  const char tokens[] = "<>/=\"'&#;![]-?: \n";
+  std::mt19937 random(1);
+  for (int i = 0; i < 20000; ++i) {
+    std::string data = seeds[i % seeds.size()];
+    for (int mutations = 1 + random() % 8; mutations > 0 && !data.empty(); --mutations) {
+      size_t position = random() % data.size();
+      switch (random() % 4) {
+        case 0:
+          data[position] = tokens[random() % (sizeof(tokens) - 1)];
+          break;
+        case 1:
+          data.erase(position, 1 + random() % 16);
+          break;
+        case 2:
+          data.insert(position, data.substr(random() % data.size(), random() % 32));
+          break;
+        default:
+          data.resize(position);
+          break;
+      }
+    }
+    // An exact size copy so that reads past the end hit the guard of a malloc'd block.
+    std::vector<char> buffer(data.begin(), data.end());
+    MpdDocument document;
+    if (!document.Parse(buffer.data(), buffer.size())) {
+      XCTAssertTrue(document.error() != nullptr);
+      continue;
+    }
+    // Every value is either a view into the buffer or decoded from one, so none can be longer.
+    for (const MpdPeriod &period : document.mpd().periods) {
+      for (const MpdAdaptationSet &adaptationSet : period.adaptation_sets) {
+        for (const MpdRepresentation &representation : adaptationSet.representations) {
+          XCTAssertLessThanOrEqual(representation.base_url.ToString().size(), buffer.size());
+          XCTAssertLessThanOrEqual(representation.segment.media.ToString().size(), buffer.size());
+          for (const MpdContentProtection &protection : representation.content_protection) {
+            XCTAssertLessThanOrEqual(protection.pssh.ToString().size(), buffer.size());
+          }
+        }
+      }
+    }
+  }
+}
+
+- (void)testParsePerformance {
+  std::string data = "<MPD type=\"static\" mediaPresentationDuration=\"PT1H\">"
+                     "<BaseURL>//google.com/test/content/</BaseURL>";
+  for (int period = 0; period < 100; ++period) {
+    data += "<Period id=\"" + std::to_string(period) + "\">";
+    for (const char *type : {"video", "audio"}) {
+      data += std::string("<AdaptationSet mimeType=\"") + type + "/mp4\">";
+      for (int index = 0; index < 4; ++index) {
+        data += "<Representation id=\"" + std::to_string(period) + "-" + std::to_string(index) +
+                "\" codecs=\"avc1.4d4015\" width=\"426\" height=\"240\" bandwidth=\"254027\">"
+                "<BaseURL>video.mp4</BaseURL>"
+                "<SegmentBase indexRange=\"1555-1766\"><Initialization range=\"0-1554\"/>"
+                "</SegmentBase></Representation>";
+      }
+      data += "</AdaptationSet>";
+    }
+    data += "</Period>";
+  }
+  data += "</MPD>";
+  std::string *dataPtr = &data;
+  [self measureBlock:^{
+    for (int i = 0; i < 10; ++i) {
+      MpdDocument document;
+      XCTAssertTrue(document.Parse(dataPtr->data(), dataPtr->size()));
+    }
+  }];
+}
+
+#pragma mark - private methods
+
+- (NSData *)bundledManifest {
+  NSURL *URL = [[NSBundle mainBundle] URLForResource:kManifestURL_eDash withExtension:@"mpd"];
+  return [NSData dataWithContentsOfURL:URL];
+}
+
+@end
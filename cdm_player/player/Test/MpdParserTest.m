@@ -1,4 +1,5 @@
 #import "MpdParser.h"
+#import "MpdTestData.h"
 #import "Streaming.h"
 #import "Logging.h"
 
@@ -9,9 +10,6 @@ static NSString *kClearContentMpdURL =
     @"http://yt-dash-mse-test.commondatastorage.googleapis.com/media/"
     @"oops-20120802-manifest.mpd";
 
-static NSString *kEncContentMpdURL =
-    @"http://storage.googleapis.com/wvmedia/cenc/tears.mpd";
-
 static NSString *const kSplitBaseMpdData =
     @"<MPD type=\"static\">"
       @"<BaseURL>//google.com/test/content/</BaseURL>"
@@ -88,7 +86,7 @@ static NSString *const kInvalidParamsMpdData =
                 @"<Initialization range=\"1555-1766\"/>"
               @"</SegmentBase>"
             @"</Representation>"
-            @"<Representation bandwidth=\"4190760\" codecs=\"hev1.2.4.L63.90\" height=\"1080\" "
+            @"<Representation bandwidth=\"4190760\" codecs=\"vp09.00.40.08\" height=\"1080\" "
                 @"id=\"3\" mimeType=\"video/mp4\" width=\"1920\">"
               @"<BaseURL>oops-20120802-89.mp4</BaseURL>"
                 @"<SegmentBase indexRange=\"1555-1766\">"
@@ -121,6 +119,20 @@ static NSString *const kInvalidParamsMpdData =
       @"</Period>"
     @"</MPD>";
 
+// Format arguments are the startNumber, the S elements and the Representation id.
+static NSString *const kLiveTimelineMpdFormat =
+    @"<MPD type=\"dynamic\" minimumUpdatePeriod=\"PT2S\" timeShiftBufferDepth=\"PT30S\">"
+      @"<Period id=\"p0\" start=\"PT0S\">"
+        @"<AdaptationSet mimeType=\"video/mp4\" codecs=\"avc1.4d401f\">"
+          @"<SegmentTemplate timescale=\"1000\" startNumber=\"%d\" "
+              @"media=\"$RepresentationID$/$Time$.m4s\" "
+              @"initialization=\"$RepresentationID$/init.mp4\">"
+            @"<SegmentTimeline>%@</SegmentTimeline>"
+          @"</SegmentTemplate>"
+          @"<Representation id=\"%@\" bandwidth=\"1000000\" width=\"1280\" height=\"720\"/>"
+        @"</AdaptationSet>"
+      @"</Period>"
+    @"</MPD>";
 
 @interface MpdParserTest : XCTestCase {
   DDTTYLogger *_logger;
@@ -142,8 +154,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate Parents attributes in Adaptation set are propogated down.
 - (void)testDownwardPropagation {
-  _streaming.streams =
-      [self parseStaticMPD:kSplitBaseMpdData URLString:kEncContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSplitBaseMpdData, kEncContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       XCTAssertEqualObjects(stream.mimeType, @"video/mp4");
@@ -153,8 +164,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate lower attributes take precendence over higher ones.
 - (void)testOverwritingAttributes {
-  _streaming.streams = [self parseStaticMPD:kSubParamOverrideMpdData
-                                  URLString:kEncContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSubParamOverrideMpdData, kEncContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       XCTAssertEqualObjects(stream.mimeType, @"video/mp4");
@@ -165,8 +175,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate Index Range is being parsed and set correctly.
 - (void)testIndexRange {
-  _streaming.streams =
-      [self parseStaticMPD:kSplitBaseMpdData URLString:kEncContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSplitBaseMpdData, kEncContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       XCTAssertEqual(stream.initialRange.length, 1767);
@@ -176,8 +185,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate Failure when InitRange is missing or invalid.
 - (void)testInvalidIndexRange {
-  _streaming.streams =
-      [self parseStaticMPD:kInvalidParamsMpdData URLString:kClearContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kInvalidParamsMpdData, kClearContentMpdURL);
   XCTAssertEqual(_streaming.streams.count, 3);
   for (Stream *stream in _streaming.streams) {
     if (stream.streamIndex == 0) {
@@ -194,21 +202,19 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate Failure with Missing or Invalid MimeType and Codecs
 - (void)testInvalidCodeMimeType {
-  _streaming.streams =
-      [self parseStaticMPD:kInvalidParamsMpdData URLString:kClearContentMpdURL];
-  // Verify only 1 streams out of 5 were loaded. (Skip HEVC and missing MimeType)
+  _streaming.streams = ParseStaticMpd(_streaming, kInvalidParamsMpdData, kClearContentMpdURL);
+  // Verify only 3 streams out of 5 were loaded. (Skip VP9 and missing MimeType)
   XCTAssertEqual(_streaming.streams.count, 3);
   for (Stream *stream in _streaming.streams) {
-    XCTAssertNotEqual(stream.codecs, @"hev1.2.4.L63.90");
+    XCTAssertNotEqualObjects(stream.codecs, @"vp09.00.40.08");
     XCTAssertNotEqual(stream.mimeType, @"application/mp4");
   }
 }
 
 // Validate Failure with bad PSSH
 - (void)testInvalidPSSH {
-  _streaming.streams =
-      [self parseStaticMPD:kInvalidParamsMpdData URLString:kClearContentMpdURL];
-  // Verify only 3 streams out of 5 were loaded. (Skip HEVC and missing MimeType)
+  _streaming.streams = ParseStaticMpd(_streaming, kInvalidParamsMpdData, kClearContentMpdURL);
+  // Verify only 3 streams out of 5 were loaded. (Skip VP9 and missing MimeType)
   XCTAssertEqual(_streaming.streams.count, 3);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
@@ -222,8 +228,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate having a Base URL that is different than the MPD source.
 - (void)testSplitURL {
-  _streaming.streams =
-      [self parseStaticMPD:kSplitBaseMpdData URLString:kEncContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSplitBaseMpdData, kEncContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       XCTAssertEqualObjects([stream.sourceURL absoluteString],
@@ -252,10 +257,100 @@ static NSString *const kInvalidParamsMpdData =
   XCTAssertEqual([parser convertDurationToSeconds:@"PT.1S"], 0);
 }
 
+// Validate the timing attributes of a live manifest keep their sub-second precision.
+- (void)testLiveTiming {
+  _streaming.streams = ParseStaticMpd(_streaming, kLiveMpdData, kEncContentMpdURL);
+  XCTAssertEqual(_streaming.streams.count, 1);
+  LiveStream *liveStream = _streaming.streams.firstObject.liveStream;
+  XCTAssertEqualWithAccuracy(liveStream.availabilityStartTime.timeIntervalSince1970,
+                             1483228800.25, 0.001);
+  XCTAssertEqual(liveStream.minimumUpdatePeriod, 2.5);
+  XCTAssertEqual(liveStream.timeShiftBufferDepth, 90);
+  XCTAssertEqual(liveStream.minBufferTime, 4);
+  XCTAssertEqual(liveStream.segmentDuration, 2);
+}
+
+// Validate SegmentTimeline expansion, including repeats that last until the next S element.
+- (void)testSegmentTimeline {
+  NSString *mpd = [NSString stringWithFormat:kLiveTimelineMpdFormat, 1,
+                                             @"<S t=\"0\" d=\"1000\" r=\"-1\"/>"
+                                             @"<S t=\"3000\" d=\"500\" r=\"1\"/>", @"v1"];
+  _streaming.streams = ParseStaticMpd(_streaming, mpd, kEncContentMpdURL);
+  Stream *stream = _streaming.streams.firstObject;
+  XCTAssertEqual(stream.dashMediaType, SEGMENT_TEMPLATE_TIMELINE);
+  XCTAssertEqualObjects(stream.period.periodId, @"p0");
+  XCTAssertEqualObjects(stream.liveStream.segmentTimeline,
+                        (@[ @0, @1000, @2000, @3000, @3500, @4000 ]));
+}
+
+// Validate Periods get their timing and are shared by their streams.
+- (void)testPeriods {
+  NSString *mpd = @"<MPD type=\"static\" mediaPresentationDuration=\"PT70S\">"
+                  @"<Period id=\"a\" start=\"PT0S\"/>"
+                  @"<Period id=\"b\" start=\"PT30S\" duration=\"PT20S\"/>"
+                  @"<Period/>"
+                  @"</MPD>";
+  MpdParser *parser =
+      [[MpdParser alloc] initWithMpdData:[mpd dataUsingEncoding:NSUTF8StringEncoding]];
+  XCTAssertEqual(parser.periods.count, 3);
+  NSArray *ids = @[ @"a", @"b", [NSNull null] ];
+  NSTimeInterval starts[] = {0, 30, 50};
+  NSTimeInterval durations[] = {30, 20, 20};
+  for (NSUInteger index = 0; index < MIN(parser.periods.count, 3); ++index) {
+    Period *period = parser.periods[index];
+    XCTAssertEqual(period.index, index);
+    XCTAssertEqualObjects(period.periodId ?: [NSNull null], ids[index]);
+    XCTAssertEqual(period.start, starts[index]);
+    XCTAssertEqual(period.duration, durations[index]);
+  }
+
+  _streaming.streams = ParseStaticMpd(_streaming, kMultiPeriodMpdData, kEncContentMpdURL);
+  XCTAssertEqual(_streaming.streams.count, 4);
+  Stream *firstVideo = _streaming.streams[0];
+  XCTAssertEqual(firstVideo.period, _streaming.streams[1].period);
+  XCTAssertEqualObjects(firstVideo.period.periodId, @"p0");
+  XCTAssertEqualObjects(_streaming.streams[2].period.periodId, @"p1");
+  XCTAssertEqual(_streaming.streams[2].period.start, 4);
+  XCTAssertEqual(_streaming.streams[2].period.duration, 6);
+}
+
+// Validate a refreshed live manifest only updates the timing of the existing streams.
+- (void)testLiveRefresh {
+  NSString *mpd = [NSString stringWithFormat:kLiveTimelineMpdFormat, 10,
+                                             @"<S t=\"0\" d=\"2000\" r=\"2\"/>", @"v1"];
+  NSArray<Stream *> *streams = ParseStaticMpd(_streaming, mpd, kEncContentMpdURL);
+  XCTAssertEqual(streams.count, 1);
+  Stream *stream = streams.firstObject;
+  LiveStream *liveStream = stream.liveStream;
+  XCTAssertEqual(liveStream.minimumUpdatePeriod, 2);
+  XCTAssertEqualObjects(liveStream.segmentTimeline, (@[ @0, @2000, @4000, @6000 ]));
+
+  // An unchanged manifest leaves the stream alone.
+  XCTAssertEqual([self refreshStreams:streams withMPD:mpd].count, 0);
+  XCTAssertEqual(stream.liveStream, liveStream);
+
+  // New segments only update the timeline of the same Stream object.
+  NSString *refreshedMpd = [NSString
+      stringWithFormat:kLiveTimelineMpdFormat, 11,
+                       @"<S t=\"2000\" d=\"2000\" r=\"2\"/><S d=\"1000\"/>", @"v1"];
+  NSArray<Stream *> *changedStreams = [self refreshStreams:streams withMPD:refreshedMpd];
+  XCTAssertEqual(changedStreams.count, 1);
+  XCTAssertEqual(changedStreams.firstObject, stream);
+  XCTAssertEqual(stream.liveStream.startNumber, 11);
+  XCTAssertEqualObjects(stream.liveStream.segmentTimeline,
+                        (@[ @2000, @4000, @6000, @8000, @9000 ]));
+  XCTAssertEqual(stream.streamIndex, 0);
+
+  // Representations that were not parsed before are not added.
+  NSString *renamedMpd = [NSString stringWithFormat:kLiveTimelineMpdFormat, 12,
+                                                    @"<S t=\"4000\" d=\"2000\"/>", @"v2"];
+  XCTAssertEqual([self refreshStreams:streams withMPD:renamedMpd].count, 0);
+  XCTAssertEqual(stream.liveStream.startNumber, 11);
+}
+
 // Validate total streams are accounted for and the indexValue increments correctly
 - (void)testStreamCount {
-  _streaming.streams = [self parseStaticMPD:kSubParamOverrideMpdData
-                                  URLString:kClearContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSubParamOverrideMpdData, kClearContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       XCTAssertEqual(stream.streamIndex, 1);
@@ -267,8 +362,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate changing scheme from HTTP to HTTPS based on MPD URL.
 - (void)testURLScheme {
-  _streaming.streams = [self parseStaticMPD:kSubParamOverrideMpdData
-                                  URLString:kMultiAudioMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSubParamOverrideMpdData, kMultiAudioMpdURL);
   for (Stream *stream in _streaming.streams) {
     CDMLogInfo(@"Stream %@", stream);
     if (stream.isVideo) {
@@ -284,8 +378,7 @@ static NSString *const kInvalidParamsMpdData =
 
 // Validate Parents attributes for BaseURL are propogated down correctly.
 - (void)testRepresentationBaseURL {
-  _streaming.streams = [self parseStaticMPD:kSubParamOverrideMpdData
-                                  URLString:kEncContentMpdURL];
+  _streaming.streams = ParseStaticMpd(_streaming, kSubParamOverrideMpdData, kEncContentMpdURL);
   for (Stream *stream in _streaming.streams) {
     if (stream.isVideo) {
       // Validate this URL is same as Representation BaseURL.
@@ -299,16 +392,73 @@ static NSString *const kInvalidParamsMpdData =
   }
 }
 
+// Validate DASH attributes are bound to the typed Stream properties.
+- (void)testAttributeBinding {
+  _streaming.streams = ParseStaticMpd(_streaming, kInvalidParamsMpdData, kClearContentMpdURL);
+  Stream *video = _streaming.streams.firstObject;
+  XCTAssertTrue(video.isVideo);
+  XCTAssertEqual(video.bandwidth, 4190760);
+  XCTAssertEqual(video.width, 1920);
+  XCTAssertEqual(video.height, 1080);
+  XCTAssertEqualObjects(video.codecs, @"avc1");
+  XCTAssertEqualObjects(video.mimeType, @"video/mp4");
+  XCTAssertEqual(video.dashMediaType, SEGMENT_BASE);
+  XCTAssertEqual(video.mediaPresentationDuration, 242);
+  XCTAssertNotNil(video.m3u8);
+  Stream *audio = _streaming.streams.lastObject;
+  XCTAssertFalse(audio.isVideo);
+  XCTAssertEqual(audio.bandwidth, 127236);
+  XCTAssertEqual(audio.streamIndex, 2);
+}
+
+// Parses a manifest with hundreds of periods and representations.
+- (void)testParsePerformance {
+  NSUInteger periods = 100;
+  NSUInteger representations = 4;
+  NSString *mpd = [self syntheticMPDWithPeriods:periods representations:representations];
+  [self measureBlock:^{
+    NSArray<Stream *> *streams = ParseStaticMpd(_streaming, mpd, kEncContentMpdURL);
+    XCTAssertEqual(streams.count, periods * representations * 2);
+  }];
+}
+
 # pragma mark - Private Methods
 
-- (NSArray<Stream *> *)parseStaticMPD:(NSString *)mpd
-                         URLString:(NSString *)URLString {
-  NSURL *mpdURL = [[NSURL alloc] initWithString:URLString];
-  NSData *mockData = [mpd dataUsingEncoding:NSUTF8StringEncoding];
-  return [MpdParser parseMpdWithStreaming:_streaming
-                                  mpdData:mockData
-                                  baseURL:mpdURL
-                             storeOffline:NO];
+- (NSArray<Stream *> *)refreshStreams:(NSArray<Stream *> *)streams withMPD:(NSString *)mpd {
+  return [MpdParser updateStreams:streams
+                      withMpdData:[mpd dataUsingEncoding:NSUTF8StringEncoding]
+                          baseURL:[[NSURL alloc] initWithString:kEncContentMpdURL]];
+}
+
+// Each period has a video and an audio adaptation set of |representations| each.
+- (NSString *)syntheticMPDWithPeriods:(NSUInteger)periods
+                      representations:(NSUInteger)representations {
+  NSMutableString *mpd = [NSMutableString
+      stringWithString:@"<MPD type=\"static\" mediaPresentationDuration=\"PT1H0M0.00S\">"
+                       @"<BaseURL>//google.com/test/content/</BaseURL>"];
+  for (NSUInteger period = 0; period < periods; ++period) {
+    [mpd appendFormat:@"<Period id=\"%tu\" duration=\"PT36S\">", period];
+    for (NSString *type in @[ @"video", @"audio" ]) {
+      BOOL isVideo = [type isEqualToString:@"video"];
+      [mpd appendFormat:@"<AdaptationSet mimeType=\"%@/mp4\">", type];
+      for (NSUInteger index = 0; index < representations; ++index) {
+        [mpd appendFormat:@"<Representation id=\"%@-%tu-%tu\" codecs=\"%@\" "
+                          @"width=\"%tu\" height=\"%tu\" bandwidth=\"%tu\">"
+                          @"<BaseURL>%@-%tu-%tu.mp4</BaseURL>"
+                          @"<SegmentBase indexRange=\"1555-1766\">"
+                          @"<Initialization range=\"0-1554\"/>"
+                          @"</SegmentBase>"
+                          @"</Representation>",
+                          type, period, index, isVideo ? @"avc1.4d4015" : @"mp4a.40.2",
+                          isVideo ? 426 * (index + 1) : 0, isVideo ? 240 * (index + 1) : 0,
+                          (index + 1) * 100000, type, period, index];
+      }
+      [mpd appendString:@"</AdaptationSet>"];
+    }
+    [mpd appendString:@"</Period>"];
+  }
+  [mpd appendString:@"</MPD>"];
+  return mpd;
 }
 
 - (NSArray<Stream *> *)parseMPDURL:(NSString *)mpdURL {
@@ -0,0 +1,21 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import <Foundation/Foundation.h>
+
+@class Stream;
+@class Streaming;
+
+// Manifests shared by the parser and playlist tests.
+
+// URL the manifests are parsed as if downloaded from.
+extern NSString *const kEncContentMpdURL;
+
+// Two Periods of the same video Representation, and an audio Representation that changes.
+extern NSString *const kMultiPeriodMpdData;
+
+// Live video with a SegmentTemplate of 2 second segments and a 90 second time shift buffer,
+// available from 2017-01-01T00:00:00.25Z.
+extern NSString *const kLiveMpdData;
+
+// Parses the manifest |mpd| as if downloaded from |URLString| into the streams of |streaming|.
+NSArray<Stream *> *ParseStaticMpd(Streaming *streaming, NSString *mpd, NSString *URLString);
@@ -0,0 +1,66 @@
+// Copyright 2017 Google Inc. All rights reserved.
+
+#import "MpdTestData.h"
+
+#import "MpdParser.h"
+
+NSString *const kEncContentMpdURL = @"http://storage.googleapis.com/wvmedia/cenc/tears.mpd";
+
+NSString *const kMultiPeriodMpdData =
+    @"<MPD type=\"static\" mediaPresentationDuration=\"PT10S\">"
+      @"<Period id=\"p0\" duration=\"PT4S\">"
+        @"<AdaptationSet mimeType=\"video/mp4\" codecs=\"avc1.4d401f\">"
+          @"<SegmentTemplate timescale=\"1000\" media=\"$RepresentationID$/$Time$.m4s\" "
+              @"initialization=\"$RepresentationID$/init.mp4\">"
+            @"<SegmentTimeline><S t=\"0\" d=\"2000\" r=\"1\"/></SegmentTimeline>"
+          @"</SegmentTemplate>"
+          @"<Representation id=\"v1\" bandwidth=\"1000000\" width=\"1280\" height=\"720\"/>"
+        @"</AdaptationSet>"
+        @"<AdaptationSet mimeType=\"audio/mp4\" codecs=\"mp4a.40.2\">"
+          @"<SegmentTemplate timescale=\"1000\" media=\"$RepresentationID$/$Time$.m4s\" "
+              @"initialization=\"$RepresentationID$/init.mp4\">"
+            @"<SegmentTimeline><S t=\"0\" d=\"2000\" r=\"1\"/></SegmentTimeline>"
+          @"</SegmentTemplate>"
+          @"<Representation id=\"a0\" bandwidth=\"128000\"/>"
+        @"</AdaptationSet>"
+      @"</Period>"
+      @"<Period id=\"p1\">"
+        @"<AdaptationSet mimeType=\"video/mp4\" codecs=\"avc1.4d401f\">"
+          @"<SegmentTemplate timescale=\"1000\" media=\"$RepresentationID$/$Time$.m4s\" "
+              @"initialization=\"$RepresentationID$/init.mp4\">"
+            @"<SegmentTimeline><S t=\"4000\" d=\"3000\" r=\"1\"/></SegmentTimeline>"
+          @"</SegmentTemplate>"
+          @"<Representation id=\"v1\" bandwidth=\"1000000\" width=\"1280\" height=\"720\"/>"
+        @"</AdaptationSet>"
+        @"<AdaptationSet mimeType=\"audio/mp4\" codecs=\"mp4a.40.2\">"
+          @"<SegmentTemplate timescale=\"1000\" media=\"$RepresentationID$/$Time$.m4s\" "
+              @"initialization=\"$RepresentationID$/init.mp4\">"
+            @"<SegmentTimeline><S t=\"4000\" d=\"3000\" r=\"1\"/></SegmentTimeline>"
+          @"</SegmentTemplate>"
+          @"<Representation id=\"a1\" bandwidth=\"96000\"/>"
+        @"</AdaptationSet>"
+      @"</Period>"
+    @"</MPD>";
+
+NSString *const kLiveMpdData =
+    @"<MPD type=\"dynamic\" availabilityStartTime=\"2017-01-01T00:00:00.25Z\" "
+        @"minimumUpdatePeriod=\"PT2.5S\" timeShiftBufferDepth=\"PT1M30S\" "
+        @"minBufferTime=\"PT4S\">"
+      @"<Period start=\"PT0S\">"
+        @"<AdaptationSet mimeType=\"video/mp4\" codecs=\"avc1.4d401f\">"
+          @"<SegmentTemplate timescale=\"90000\" duration=\"180000\" startNumber=\"1\" "
+              @"media=\"$RepresentationID$-$Number$.m4s\" "
+              @"initialization=\"$RepresentationID$-init.mp4\"/>"
+          @"<Representation id=\"v1\" bandwidth=\"1000000\" width=\"1280\" height=\"720\"/>"
+        @"</AdaptationSet>"
+      @"</Period>"
+    @"</MPD>";
+
+NSArray<Stream *> *ParseStaticMpd(Streaming *streaming, NSString *mpd, NSString *URLString) {
+  NSURL *mpdURL = [[NSURL alloc] initWithString:URLString];
+  NSData *mockData = [mpd dataUsingEncoding:NSUTF8StringEncoding];
+  return [MpdParser parseMpdWithStreaming:streaming
+                                  mpdData:mockData
+                                  baseURL:mpdURL
+                             storeOffline:NO];
+}
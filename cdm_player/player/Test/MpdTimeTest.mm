@@ -0,0 +1,174 @@
+#include "MpdTime.h"
+
+// 2017-01-01T00:00:00Z in seconds since the Unix epoch.
+static const double kNewYear2017 = 1483228800;
+
+struct TimeCase {
+  const char *value;
+  double seconds;
+};
+
+static const TimeCase kDurations[] = {
+    {"PT0S", 0},
+    {"PT1S", 1},
+    {"PT1.5S", 1.5},
+    {"PT.1S", 0.1},
+    {"PT1.S", 1},
+    {"PT0.000001S", 0.000001},
+    {"PT2.93S", 2.93},
+    {"PT0H4M2.93S", 242.93},
+    {"PT0H10M", 600},
+    {"PT1H0M0.00S", 3600},
+    {"PT36H", 129600},
+    {"P1D", 86400},
+    {"P1DT0H10M0.00S", 87000},
+    {"P1M1DT1H2M3.00S", 30 * 86400 + 90123},
+    {"P1Y", 365 * 86400},
+    {"P1Y2M3DT4H5M6.7S", 365 * 86400 + 60 * 86400 + 3 * 86400 + 14706.7},
+    {"P0Y0M0DT0H0M0S", 0},
+    {"-PT1.25S", -1.25},
+    {" PT5S\n", 5},
+    {"PT123456789S", 123456789},
+};
+
+static const char *const kInvalidDurations[] = {
+    "",
+    "P",
+    "PT",
+    "P1DT",
+    "T1S",
+    "1S",
+    "PT1",
+    "PT1.5",
+    "PTS",
+    "PT.S",
+    "PT1.5M",
+    "P1.5D",
+    "PT1S2M",
+    "P1D1Y",
+    "PT1H1H",
+    "P1H",
+    "PT1D",
+    "P1DTT1S",
+    "PT-1S",
+    "+PT1S",
+    "pt1s",
+    "PT1,5S",
+    "PT99999999999999999999S",
+};
+
+static const TimeCase kDateTimes[] = {
+    {"1970-01-01T00:00:00Z", 0},
+    {"1970-01-01T00:00:00", 0},
+    {"2017-01-01T00:00:00Z", kNewYear2017},
+    {"2017-01-01T00:00:00.5Z", kNewYear2017 + 0.5},
+    {"2017-01-01T00:00:00.125", kNewYear2017 + 0.125},
+    {"2017-01-01T00:00:00.0000001Z", kNewYear2017 + 0.0000001},
+    {"2017-01-01T01:00:00+01:00", kNewYear2017},
+    {"2016-12-31T19:30:00-04:30", kNewYear2017},
+    {"2016-12-31T24:00:00Z", kNewYear2017},
+    {"2016-02-29T00:00:00Z", 1456704000},
+    {"2000-02-29T12:00:00Z", 951825600},
+    {"1969-12-31T23:59:59Z", -1},
+    {"1900-01-01T00:00:00Z", -2208988800},
+    {"2038-01-19T03:14:08Z", 2147483648},
+    {"10000-01-01T00:00:00Z", 253402300800},
+    {"-0001-01-01T00:00:00Z", -62198755200},
+};
+
+static const char *const kInvalidDateTimes[] = {
+    "",
+    "2017",
+    "2017-01-01",
+    "2017-01-01T00:00Z",
+    "2017-1-01T00:00:00Z",
+    "17-01-01T00:00:00Z",
+    "02017-01-01T00:00:00Z",
+    "2017-00-01T00:00:00Z",
+    "2017-13-01T00:00:00Z",
+    "2017-01-00T00:00:00Z",
+    "2017-01-32T00:00:00Z",
+    "2017-02-29T00:00:00Z",
+    "1900-02-29T00:00:00Z",
+    "2017-04-31T00:00:00Z",
+    "2017-01-01T25:00:00Z",
+    "2017-01-01T24:00:01Z",
+    "2017-01-01T24:00:00.5Z",
+    "2017-01-01T00:60:00Z",
+    "2017-01-01T00:00:60Z",
+    "2017-01-01T00:00:00.Z",
+    "2017-01-01T00:00:00ZZ",
+    "2017-01-01T00:00:00+1:00",
+    "2017-01-01T00:00:00+01",
+    "2017-01-01T00:00:00+14:01",
+    "2017-01-01T00:00:00+01:60",
+    "2017-01-01 00:00:00Z",
+    "2017-01-01T00:00:00 Z",
+    "2017-01-01t00:00:00Z",
+};
+
+@interface MpdTimeTest : XCTestCase
+@end
+
+@implementation MpdTimeTest
+
+- (void)testDuration {
+  for (const TimeCase &durationCase : kDurations) {
+    double seconds = -12345;
+    XCTAssertTrue(ParseMpdDuration(durationCase.value, &seconds), @"%s", durationCase.value);
+    XCTAssertEqualWithAccuracy(seconds, durationCase.seconds, 1e-9, @"%s", durationCase.value);
+  }
+}
+
+// Malformed durations are rejected and leave the output alone -- Negative Test.
+- (void)testInvalidDuration {
+  for (const char *value : kInvalidDurations) {
+    double seconds = -12345;
+    XCTAssertFalse(ParseMpdDuration(value, &seconds), @"%s", value);
+    XCTAssertEqual(seconds, -12345, @"%s", value);
+  }
+}
+
+- (void)testDateTime {
+  for (const TimeCase &dateTimeCase : kDateTimes) {
+    double seconds = -12345;
+    XCTAssertTrue(ParseMpdDateTime(dateTimeCase.value, &seconds), @"%s", dateTimeCase.value);
+    XCTAssertEqualWithAccuracy(seconds, dateTimeCase.seconds, 1e-6, @"%s", dateTimeCase.value);
+  }
+}
+
+// Malformed or impossible dates are rejected and leave the output alone -- Negative Test.
+- (void)testInvalidDateTime {
+  for (const char *value : kInvalidDateTimes) {
+    double seconds = -12345;
+    XCTAssertFalse(ParseMpdDateTime(value, &seconds), @"%s", value);
+    XCTAssertEqual(seconds, -12345, @"%s", value);
+  }
+}
+
+// The values agree with the Foundation parsers they replace.
+- (void)testMatchesFoundation {
+  NSDateFormatter *dateFormat = [[NSDateFormatter alloc] init];
+  [dateFormat setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss'Z'"];
+  [dateFormat setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
+  NSDate *date = [dateFormat dateFromString:@"2017-06-15T12:34:56Z"];
+  double seconds = 0;
+  XCTAssertTrue(ParseMpdDateTime("2017-06-15T12:34:56Z", &seconds));
+  XCTAssertEqual(seconds, date.timeIntervalSince1970);
+}
+
+- (void)testParsePerformance {
+  [self measureBlock:^{
+    double total = 0;
+    for (int i = 0; i < 100000; ++i) {
+      double seconds = 0;
+      ParseMpdDuration("P1Y2M3DT4H5M6.7S", &seconds);
+      total += seconds;
+      ParseMpdDateTime("2017-01-01T00:00:00.5+01:00", &seconds);
+      total += seconds;
+    }
+    XCTAssertGreaterThan(total, 0);
+  }];
+}
+
+@end
@@ -0,0 +1,140 @@
+#import "MpdParser.h"
+#import "Period.h"
+#import "Stream.h"
+#import "StreamSelector.h"
+
+static NSString *const kMpdURLString = @"http://www.google.com/path/to.mpd";
+
+static NSString *const kFrameRateMpd =
+    @"<MPD type=\"static\" mediaPresentationDuration=\"PT10S\">"
+    @"  <Period>"
+    @"    <AdaptationSet contentType=\"video\" mimeType=\"video/mp4\" frameRate=\"30000/1001\">"
+    @"      <Representation id=\"0\" bandwidth=\"500000\" codecs=\"avc1.42c01e\" width=\"640\" "
+    @"          height=\"360\">"
+    @"        <BaseURL>360.mp4</BaseURL>"
+    @"        <SegmentBase indexRange=\"800-900\"><Initialization range=\"0-799\"/></SegmentBase>"
+    @"      </Representation>"
+    @"      <Representation id=\"1\" bandwidth=\"4000000\" codecs=\"avc1.640028\" width=\"1920\" "
+    @"          height=\"1080\" frameRate=\"60\">"
+    @"        <BaseURL>1080.mp4</BaseURL>"
+    @"        <SegmentBase indexRange=\"800-900\"><Initialization range=\"0-799\"/></SegmentBase>"
+    @"      </Representation>"
+    @"    </AdaptationSet>"
+    @"  </Period>"
+    @"</MPD>";
+
+@interface StreamSelectorTest : XCTestCase
+@end
+
+@implementation StreamSelectorTest {
+  StreamSelector *_selector;
+  Period *_period;
+}
+
+- (void)setUp {
+  [super setUp];
+  _selector = [[StreamSelector alloc] init];
+  _selector.maxWidth = 1334;
+  _selector.maxHeight = 750;
+  _selector.maxFrameRate = 60;
+  _period = [[Period alloc] init];
+}
+
+- (Stream *)videoWithWidth:(NSUInteger)width
+                    height:(NSUInteger)height
+                 bandwidth:(NSUInteger)bandwidth {
+  Stream *stream = [[Stream alloc] initWithStreaming:nil];
+  stream.isVideo = YES;
+  stream.width = width;
+  stream.height = height;
+  stream.bandwidth = bandwidth;
+  stream.frameRate = 30;
+  stream.period = _period;
+  return stream;
+}
+
+- (Stream *)audioWithBandwidth:(NSUInteger)bandwidth {
+  Stream *stream = [[Stream alloc] initWithStreaming:nil];
+  stream.bandwidth = bandwidth;
+  stream.period = _period;
+  return stream;
+}
+
+- (void)testFrameRateParsing {
+  NSArray<Stream *> *streams =
+      [MpdParser parseMpdWithStreaming:nil
+                               mpdData:[kFrameRateMpd dataUsingEncoding:NSUTF8StringEncoding]
+                               baseURL:[NSURL URLWithString:kMpdURLString]
+                          storeOffline:NO];
+  XCTAssertEqual(streams.count, 2);
+  XCTAssertEqualWithAccuracy(streams[0].frameRate, 29.97, 0.001);
+  XCTAssertEqual(streams[1].frameRate, 60);
+}
+
+// Video larger than the screen is dropped, apart from the smallest rendition that fills it.
+- (void)testResolution {
+  Stream *sd = [self videoWithWidth:640 height:360 bandwidth:500000];
+  Stream *hd = [self videoWithWidth:1280 height:720 bandwidth:2000000];
+  Stream *fhd = [self videoWithWidth:1920 height:1080 bandwidth:4000000];
+  Stream *uhd = [self videoWithWidth:3840 height:2160 bandwidth:12000000];
+  Stream *audio = [self audioWithBandwidth:128000];
+  NSArray<Stream *> *selected = [_selector selectStreams:@[ uhd, sd, audio, fhd, hd ]];
+  NSArray<Stream *> *expected = @[ sd, audio, fhd, hd ];
+  XCTAssertEqualObjects(selected, expected);
+
+  // Once a rendition fills the screen nothing larger is needed.
+  _selector.maxWidth = 1920;
+  _selector.maxHeight = 1080;
+  selected = [_selector selectStreams:@[ uhd, sd, audio, fhd, hd ]];
+  XCTAssertEqualObjects(selected, expected);
+}
+
+// Portrait renditions are compared with the screen turned the same way.
+- (void)testPortrait {
+  Stream *portrait = [self videoWithWidth:720 height:1280 bandwidth:2000000];
+  XCTAssertEqualObjects([_selector selectStreams:@[ portrait ]], @[ portrait ]);
+}
+
+- (void)testFrameRateAndBandwidth {
+  Stream *sd = [self videoWithWidth:640 height:360 bandwidth:500000];
+  Stream *hd = [self videoWithWidth:1280 height:720 bandwidth:2000000];
+  Stream *hdHfr = [self videoWithWidth:1280 height:720 bandwidth:3000000];
+  hdHfr.frameRate = 120;
+  Stream *audio = [self audioWithBandwidth:128000];
+  Stream *surround = [self audioWithBandwidth:640000];
+  NSArray<Stream *> *selected = [_selector selectStreams:@[ sd, hd, hdHfr, audio, surround ]];
+  NSArray<Stream *> *expected = @[ sd, hd, audio, surround ];
+  XCTAssertEqualObjects(selected, expected);
+
+  _selector.maxBandwidth = 600000;
+  selected = [_selector selectStreams:@[ sd, hd, hdHfr, audio, surround ]];
+  expected = @[ sd, audio ];
+  XCTAssertEqualObjects(selected, expected);
+}
+
+// Limits of 0 select every stream.
+- (void)testUnlimited {
+  StreamSelector *selector = [[StreamSelector alloc] init];
+  Stream *uhd = [self videoWithWidth:3840 height:2160 bandwidth:12000000];
+  uhd.frameRate = 120;
+  Stream *audio = [self audioWithBandwidth:128000];
+  NSArray<Stream *> *expected = @[ uhd, audio ];
+  XCTAssertEqualObjects([selector selectStreams:expected], expected);
+}
+
+// Each Period keeps its lowest bandwidth video and audio when nothing fits -- Negative Test.
+- (void)testNothingFits {
+  _selector.maxBandwidth = 1000;
+  Stream *hd = [self videoWithWidth:1280 height:720 bandwidth:2000000];
+  Stream *sd = [self videoWithWidth:640 height:360 bandwidth:500000];
+  Stream *audio = [self audioWithBandwidth:128000];
+  Period *secondPeriod = [[Period alloc] init];
+  secondPeriod.index = 1;
+  Stream *secondHd = [self videoWithWidth:1280 height:720 bandwidth:2000000];
+  secondHd.period = secondPeriod;
+  NSArray<Stream *> *selected = [_selector selectStreams:@[ hd, sd, audio, secondHd ]];
+  NSArray<Stream *> *expected = @[ sd, audio, secondHd ];
+  XCTAssertEqualObjects(selected, expected);
+}
+
+@end
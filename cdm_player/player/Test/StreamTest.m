@@ -57,6 +57,15 @@ static NSString *const kVideoMpd =
   XCTAssertTrue([stream initialize:initData]);
 }
 
+// A stream whose initialization data cannot be parsed keeps no session -- Negative Test.
+- (void)testStreamInitFailure {
+  Stream *stream = [[Stream alloc] initWithStreaming:_streaming];
+  NSData *initData = [@"not an initialization segment" dataUsingEncoding:NSUTF8StringEncoding];
+  XCTAssertFalse([stream initialize:initData]);
+  XCTAssertTrue(stream.session == NULL);
+  XCTAssertTrue(stream.dashIndex == NULL);
+}
+
 - (void)testStreamDescription {
   Stream *stream = [[Stream alloc] initWithStreaming:_streaming];
   stream.sourceURL = [[NSURL alloc] initWithString:kMpdURLString];
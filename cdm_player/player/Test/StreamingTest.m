@@ -1,4 +1,9 @@
+#import "CdmWrapper.h"
 #import "Downloader.h"
+#import "LicenseManager.h"
+#import "LocalWebServer.h"
+#import "MockLicenseServer.h"
+#import "MpdTestData.h"
 #import "Stream.h"
 #import "Streaming.h"
 #import "Logging.h"
@@ -6,9 +11,34 @@
 static NSString *const kManifestURL_eDash = @"tears_cenc_small";
 static NSString *const kManifestURL_Clear = @"tears_clear_small";
 static NSInteger const kExpectedStreams = 2;
+static NSUInteger const kConcurrentStreams = 16;
+static NSUInteger const kConcurrentPsshRequests = 64;
 
 extern float kPartialDownloadTimeout;
 
+// HEVC and H.264 video with AAC and E-AC-3 audio.
+static NSString *const kHevcMpdData =
+    @"<MPD type=\"static\" mediaPresentationDuration=\"PT4S\">"
+      @"<Period id=\"p0\">"
+        @"<AdaptationSet mimeType=\"video/mp4\">"
+          @"<SegmentTemplate timescale=\"90000\" duration=\"180000\" startNumber=\"1\" "
+              @"media=\"$RepresentationID$-$Number$.m4s\" "
+              @"initialization=\"$RepresentationID$-init.mp4\"/>"
+          @"<Representation id=\"h1\" codecs=\"hvc1.2.4.L120.90\" bandwidth=\"2000000\" "
+              @"width=\"1920\" height=\"1080\"/>"
+          @"<Representation id=\"v1\" codecs=\"avc1.4d401f\" bandwidth=\"1000000\" "
+              @"width=\"1280\" height=\"720\"/>"
+        @"</AdaptationSet>"
+        @"<AdaptationSet mimeType=\"audio/mp4\">"
+          @"<SegmentTemplate timescale=\"90000\" duration=\"180000\" startNumber=\"1\" "
+              @"media=\"$RepresentationID$-$Number$.m4s\" "
+              @"initialization=\"$RepresentationID$-init.mp4\"/>"
+          @"<Representation id=\"a1\" codecs=\"mp4a.40.2\" bandwidth=\"128000\"/>"
+          @"<Representation id=\"e1\" codecs=\"ec-3\" bandwidth=\"384000\"/>"
+        @"</AdaptationSet>"
+      @"</Period>"
+    @"</MPD>";
+
 @interface StreamingTest : XCTestCase {
   DDTTYLogger *_logger;
   Streaming *_streaming;
@@ -35,6 +65,328 @@ extern float kPartialDownloadTimeout;
   [self convertMPDtoHLS:kManifestURL_eDash expectedStreams:kExpectedStreams];
 }
 
+// Playback is signaled once the lowest video and default audio are ready.
+- (void)testReadyNotification_Clear {
+  [self expectationForNotification:kStreamingReadyNotification object:_streaming handler:nil];
+  _streaming.mpdURL = [[NSBundle mainBundle] URLForResource:kManifestURL_Clear
+                                              withExtension:@"mpd"];
+  [_streaming processMpd:_streaming.mpdURL withCompletion:^(NSError *error) {
+    XCTAssertNil(error, @"MPD failed to load with error %@", error);
+  }];
+  [self waitForExpectationsWithTimeout:2 handler:nil];
+  BOOL videoDone = NO;
+  BOOL audioDone = NO;
+  for (Stream *stream in _streaming.streams) {
+    videoDone |= stream.isVideo && stream.done;
+    audioDone |= !stream.isVideo && stream.done;
+  }
+  XCTAssertTrue(videoDone);
+  XCTAssertTrue(audioDone);
+}
+
+// Building a live playlist leaves the parsed manifest alone, so a manifest without a
+// minimumUpdatePeriod is not refreshed and a refreshed one still compares equal.
+- (void)testTemplatePlaylistKeepsUpdatePeriod {
+  Stream *stream = [[Stream alloc] initWithStreaming:_streaming];
+  stream.dashMediaType = SEGMENT_TEMPLATE_DURATION;
+  stream.isVideo = YES;
+  stream.liveStream.segmentDuration = 2;
+  stream.liveStream.startNumber = 1;
+  XCTAssertNotNil([_streaming buildChildPlaylist:stream]);
+  XCTAssertEqual(stream.liveStream.minimumUpdatePeriod, 0);
+}
+
+// Every Streaming object is served by the shared server under its own path prefix.
+- (void)testSharedServer {
+  LocalWebServer *server = [LocalWebServer sharedInstance];
+  XCTAssertTrue(server.isRunning);
+  // Only reachable from the device unless AirPlay is active.
+  XCTAssertEqualObjects(server.interface, @"localhost");
+  Streaming *other = [[Streaming alloc] initWithAirplay:NO licenseServerURL:nil];
+  NSURL *playlistURL = _streaming.playlistURL;
+  XCTAssertEqualObjects(playlistURL.host, @"localhost");
+  XCTAssertEqual(playlistURL.port.intValue, (int)server.listeningPort);
+  XCTAssertEqualObjects(playlistURL.lastPathComponent, @"dash2hls.m3u8");
+  XCTAssertNotEqualObjects(playlistURL, other.playlistURL);
+  // Prefixes cannot be guessed from one another.
+  XCTAssertEqual(playlistURL.pathComponents[1].length, 36u);
+
+  NSString *relativePath = nil;
+  NSString *segmentPath = [playlistURL.path.stringByDeletingLastPathComponent
+      stringByAppendingPathComponent:@"0-5.ts"];
+  XCTAssertEqual([server streamingForPath:segmentPath relativePath:&relativePath], _streaming);
+  XCTAssertEqualObjects(relativePath, @"/0-5.ts");
+  XCTAssertEqual([server streamingForPath:other.playlistURL.path relativePath:&relativePath],
+                 other);
+  XCTAssertEqualObjects(relativePath, @"/dash2hls.m3u8");
+
+  // Stopped sessions and unknown prefixes are not served -- Negative Test.
+  [other stop];
+  XCTAssertNil([server streamingForPath:other.playlistURL.path relativePath:&relativePath]);
+  XCTAssertNil([server streamingForPath:@"/dash2hls.m3u8" relativePath:&relativePath]);
+  XCTAssertNil([server streamingForPath:@"" relativePath:&relativePath]);
+}
+
+// Sessions played over AirPlay are served by their own listener, which leaves the shared loopback
+// server alone and only serves their prefixes.
+- (void)testAirplayListener {
+  LocalWebServer *server = [LocalWebServer sharedInstance];
+  NSString *prefix = _streaming.playlistURL.pathComponents[1];
+  NSString *airplayPrefix = [@"/" stringByAppendingString:prefix];
+  NSError *error = nil;
+  UInt16 port = [server listenForPrefix:airplayPrefix onAddress:@"127.0.0.1" error:&error];
+  XCTAssertNotEqual(port, 0, @"%@", error);
+  XCTAssertNotEqual(port, server.listeningPort);
+  XCTAssertTrue(server.isRunning);
+  XCTAssertEqualObjects(server.interface, @"localhost");
+
+  // Unknown prefixes are not exposed -- Negative Test.
+  XCTAssertEqual([server listenForPrefix:@"/unknown" onAddress:@"127.0.0.1" error:&error], 0);
+
+  [server stopListeningForPrefix:airplayPrefix];
+  NSString *relativePath = nil;
+  XCTAssertEqual([server streamingForPath:_streaming.playlistURL.path relativePath:&relativePath],
+                 _streaming);
+}
+
+// Segments of streams outside the manifest are not served -- Negative Test.
+- (void)testSegmentIndexOutOfRange {
+  _streaming.streams = ParseStaticMpd(_streaming, kLiveMpdData, kEncContentMpdURL);
+  NSString *pastLast = [NSString stringWithFormat:@"/%tu-0.ts", _streaming.streams.count];
+  for (NSString *path in @[ @"/-1-0.ts", pastLast, @"/-1-0-iframe.ts", @"/-1-0.0.ts",
+                            @"/-1-0.m4s", @"/-1-init.mp4" ]) {
+    XCTAssertNil([_streaming responseForMethod:@"GET" path:path connection:nil], @"%@", path);
+  }
+}
+
+// Opens many encrypted streams at once while their licenses are rejected, so session creation,
+// joining and failure all race on the shared iOSCdm. Every stream has to finish loading and every
+// license request has to be answered exactly once.
+- (void)testConcurrentStreams_eDash {
+  LicenseManager *licMgr = [LicenseManager sharedInstance];
+  NSURLSession *licenseSession = licMgr.licenseSession;
+  licMgr.licenseSession = [MockLicenseServer session];
+  [MockLicenseServer reset];
+  [MockLicenseServer setResponseDelay:0.05];
+  [MockLicenseServer setResponder:^NSData *(NSURLRequest *request, NSInteger *statusCode) {
+    *statusCode = 403;
+    return nil;
+  }];
+
+  NSURL *mpdURL = [[NSBundle mainBundle] URLForResource:kManifestURL_eDash withExtension:@"mpd"];
+  NSMutableArray<Streaming *> *streamings = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kConcurrentStreams; ++i) {
+    Streaming *streaming = [[Streaming alloc] initWithAirplay:NO licenseServerURL:nil];
+    [streamings addObject:streaming];
+    XCTestExpectation *expectation =
+        [self expectationWithDescription:[NSString stringWithFormat:@"stream %tu", i]];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+      [streaming processMpd:mpdURL withCompletion:^(NSError *error) {
+        XCTAssertNil(error, @"MPD failed to load with error %@", error);
+        [expectation fulfill];
+      }];
+    });
+  }
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+
+  NSMutableSet<NSData *> *psshKeys = [NSMutableSet set];
+  for (Streaming *streaming in streamings) {
+    XCTAssertEqual(streaming.streams.count, kExpectedStreams);
+    for (Stream *stream in streaming.streams) {
+      if (stream.pssh) {
+        [psshKeys addObject:stream.pssh];
+      }
+    }
+  }
+  NSArray<NSData *> *keys = psshKeys.allObjects;
+  XCTAssertGreaterThan(keys.count, 0);
+  NSMutableArray<XCTestExpectation *> *expectations = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kConcurrentPsshRequests; ++i) {
+    [expectations addObject:[self expectationWithDescription:
+                                      [NSString stringWithFormat:@"pssh %tu", i]]];
+  }
+  dispatch_apply(kConcurrentPsshRequests, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                 ^(size_t i) {
+    XCTestExpectation *expectation = expectations[i];
+    [[iOSCdm sharedInstance] processPsshKey:keys[i % keys.count]
+                               isOfflineVod:NO
+                            completionBlock:^(NSError *error) {
+                              // Fulfilling twice fails the test.
+                              [expectation fulfill];
+                            }];
+  });
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+
+  licMgr.licenseSession = licenseSession;
+  [MockLicenseServer reset];
+}
+
+// Validate each track plays through every Period, with a discontinuity at the join, and that only
+// the stream with the same initialization segment, codec and key reuses the earlier session.
+- (void)testMultiPeriodPlaylist {
+  NSArray<Stream *> *streams = ParseStaticMpd(_streaming, kMultiPeriodMpdData, kEncContentMpdURL);
+  XCTAssertEqual(streams.count, 4);
+  if (streams.count != 4) {
+    return;
+  }
+  Stream *video0 = streams[0];
+  Stream *audio0 = streams[1];
+  Stream *video1 = streams[2];
+  Stream *audio1 = streams[3];
+  _streaming.streams = streams;
+  [_streaming linkPeriodStreams:streams];
+  XCTAssertEqualObjects(video0.periodStreams, @[ video1 ]);
+  XCTAssertEqualObjects(audio0.periodStreams, @[ audio1 ]);
+  XCTAssertEqual(video1.sessionStream, video0);
+  XCTAssertNil(audio1.sessionStream);
+  XCTAssertEqual(video1.periodStreams.count, 0);
+
+  // Not playable until every Period has a session -- Negative Test.
+  struct DashToHlsSession *session = NULL;
+  XCTAssertEqual(Udt_CreateSession(&session), kDashToHlsStatus_OK);
+  video0.session = session;
+  XCTAssertNil([_streaming buildChildPlaylist:video0]);
+
+  video1.session = session;
+  NSString *playlist = [[NSString alloc] initWithData:[_streaming buildChildPlaylist:video0]
+                                             encoding:NSUTF8StringEncoding];
+  XCTAssertTrue([playlist hasPrefix:@"#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-MEDIA-SEQUENCE:0\n"
+                                    @"#EXT-X-TARGETDURATION:3\n"]);
+  NSString *segments = @"#EXTINF:2.000000,\n0-1.ts\n#EXTINF:2.000000,\n0-2.ts\n"
+                       @"#EXT-X-DISCONTINUITY\n";
+  XCTAssertTrue([playlist containsString:segments], @"%@", playlist);
+  XCTAssertTrue([playlist containsString:@"#EXTINF:3.000000,\n2-1.ts\n#EXTINF:3.000000,\n2-2.ts\n"
+                                         @"#EXT-X-ENDLIST"], @"%@", playlist);
+  XCTAssertEqual([playlist componentsSeparatedByString:@"#EXT-X-DISCONTINUITY"].count, 2);
+  Udt_ReleaseSession(session);
+}
+
+// Validate HEVC and E-AC-3 are kept and served as fragmented MP4, and that each video is listed
+// with the audio codecs of every audio group.
+- (void)testHevcAndEac3 {
+  NSArray<Stream *> *streams = ParseStaticMpd(_streaming, kHevcMpdData, kEncContentMpdURL);
+  XCTAssertEqual(streams.count, 4);
+  if (streams.count != 4) {
+    return;
+  }
+  XCTAssertTrue(streams[0].isPassthrough);
+  XCTAssertFalse(streams[1].isPassthrough);
+  XCTAssertFalse(streams[2].isPassthrough);
+  XCTAssertTrue(streams[3].isPassthrough);
+  _streaming.streams = streams;
+
+  NSString *variant = [_streaming buildVariantPlaylist:streams];
+  XCTAssertTrue([variant hasPrefix:@"#EXTM3U\n#EXT-X-VERSION:7\n"], @"%@", variant);
+  XCTAssertEqual([variant componentsSeparatedByString:@"#EXT-X-STREAM-INF"].count, 5);
+  XCTAssertTrue([variant containsString:@"CODECS=\"hvc1.2.4.L120.90,mp4a.40.2\","
+                                        @"RESOLUTION=1920x1080,AUDIO=\"audio\"\n0.m3u8\n"],
+                @"%@", variant);
+  XCTAssertTrue([variant containsString:@"CODECS=\"avc1.4d401f,ec-3\","
+                                        @"RESOLUTION=1280x720,AUDIO=\"audio-ec-3\"\n1.m3u8\n"],
+                @"%@", variant);
+  XCTAssertTrue([variant containsString:@"URI=\"2.m3u8\",TYPE=AUDIO,GROUP-ID=\"audio\""]);
+  XCTAssertTrue([variant containsString:@"URI=\"3.m3u8\",TYPE=AUDIO,GROUP-ID=\"audio-ec-3\""]);
+
+  Stream *hevc = streams[0];
+  hevc.initializationSegment = [@"init" dataUsingEncoding:NSUTF8StringEncoding];
+  NSString *playlist = [[NSString alloc] initWithData:[_streaming buildChildPlaylist:hevc]
+                                             encoding:NSUTF8StringEncoding];
+  XCTAssertTrue([playlist hasPrefix:@"#EXTM3U\n#EXT-X-VERSION:7\n"], @"%@", playlist);
+  // Every resource is served encrypted with the loopback key and its own IV.
+  NSString *keyTag = @"#EXT-X-KEY:METHOD=AES-128,URI=\"cdmplayer-fmp4-key:key\",IV=0x";
+  NSString *segments = [@[
+    keyTag, @"00000004000000000000000000000000\n#EXT-X-MAP:URI=\"0-init.mp4\"\n",
+    keyTag, @"00000001000000000000000100000000\n#EXTINF:2.000000,\n0-1.m4s\n",
+    keyTag, @"00000001000000000000000200000000\n#EXTINF:2.000000,\n0-2.m4s\n",
+    @"#EXT-X-ENDLIST"
+  ] componentsJoinedByString:@""];
+  XCTAssertTrue([playlist containsString:segments], @"%@", playlist);
+}
+
+// Validate chunked CMAF streams are listed as low-latency HLS, with a part per chunk.
+- (void)testLowLatencyPlaylist {
+  NSString *mpd =
+      [kLiveMpdData stringByReplacingOccurrencesOfString:@"<SegmentTemplate "
+                                              withString:@"<SegmentTemplate "
+                                                         @"availabilityTimeOffset=\"1.5\" "];
+  _streaming.streams = ParseStaticMpd(_streaming, mpd, kEncContentMpdURL);
+  Stream *stream = _streaming.streams.firstObject;
+  XCTAssertEqual(stream.liveStream.availabilityTimeOffset, 1.5);
+  struct DashToHlsSession *session = NULL;
+  XCTAssertEqual(Udt_CreateSession(&session), kDashToHlsStatus_OK);
+  stream.session = session;
+
+  // Segment 6 is being written and none of its 0.5 second parts is complete yet.
+  stream.liveStream.availabilityStartTime = [NSDate dateWithTimeIntervalSinceNow:-10.25];
+  NSString *playlist = [[NSString alloc] initWithData:[_streaming buildChildPlaylist:stream]
+                                             encoding:NSUTF8StringEncoding];
+  XCTAssertTrue(stream.isLive);
+  XCTAssertTrue([playlist containsString:@"#EXT-X-MEDIA-SEQUENCE:1\n#EXT-X-TARGETDURATION:2\n"
+                                         @"#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,"
+                                         @"PART-HOLD-BACK=1.500000\n"
+                                         @"#EXT-X-PART-INF:PART-TARGET=0.500000\n"],
+                @"%@", playlist);
+  // Parts are only listed for the last three segments.
+  XCTAssertTrue([playlist containsString:@"#EXTINF:2.000000,\n0-2.ts\n"
+                                         @"#EXT-X-PART:DURATION=0.500000,URI=\"0-3.0.ts\","
+                                         @"INDEPENDENT=YES\n"
+                                         @"#EXT-X-PART:DURATION=0.500000,URI=\"0-3.1.ts\"\n"],
+                @"%@", playlist);
+  XCTAssertFalse([playlist containsString:@"0-2.0.ts"]);
+  XCTAssertTrue([playlist containsString:@"#EXT-X-PROGRAM-DATE-TIME:"], @"%@", playlist);
+  XCTAssertTrue([playlist containsString:@"URI=\"0-5.3.ts\"\n#EXTINF:2.000000,\n0-5.ts\n"]);
+  XCTAssertTrue([playlist hasSuffix:@"#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"0-6.0.ts\"\n"],
+                @"%@", playlist);
+  XCTAssertFalse([playlist containsString:@"#EXT-X-ENDLIST"]);
+  Udt_ReleaseSession(session);
+}
+
+// Validate live SegmentTemplate playlists list segments served before they are first listed with
+// their actual duration, keep the duration of listed segments, and start at the wall clock time of
+// the first segment.
+- (void)testActualSegmentDurations {
+  _streaming.streams = ParseStaticMpd(_streaming, kLiveMpdData, kEncContentMpdURL);
+  Stream *stream = _streaming.streams.firstObject;
+  NSDate *availabilityStartTime = [NSDate dateWithTimeIntervalSinceNow:-101];
+  stream.liveStream.availabilityStartTime = availabilityStartTime;
+  [stream setPts:900000 duration:181800 ofSegment:6];
+  XCTAssertEqual(stream.pts, 900000);
+  XCTAssertEqual(stream.actualDurationInPts, 181800);
+  XCTAssertEqualWithAccuracy([stream actualDurationOfSegment:6], 2.02, 0.000001);
+  XCTAssertEqual([stream actualDurationOfSegment:7], 0);
+
+  // Segments 5 to 50 are within the 90 second time shift buffer.
+  NSString *playlist = [[NSString alloc] initWithData:[_streaming buildChildPlaylist:stream]
+                                             encoding:NSUTF8StringEncoding];
+  XCTAssertTrue([playlist containsString:@"#EXT-X-MEDIA-SEQUENCE:5\n#EXT-X-TARGETDURATION:3\n"],
+                @"%@", playlist);
+  NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+  formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+  formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+  formatter.dateFormat = @"yyyy'-'MM'-'dd'T'HH':'mm':'ss.SSS'Z'";
+  NSString *programDateTime =
+      [formatter stringFromDate:[availabilityStartTime dateByAddingTimeInterval:8]];
+  NSString *segments = [NSString stringWithFormat:@"#EXT-X-PROGRAM-DATE-TIME:%@\n"
+                                                  @"#EXTINF:2.000000,\n0-5.ts\n"
+                                                  @"#EXTINF:2.020000,\n0-6.ts\n"
+                                                  @"#EXTINF:2.000000,\n0-7.ts\n",
+                                                  programDateTime];
+  XCTAssertTrue([playlist containsString:segments], @"%@", playlist);
+
+  // Segments already listed keep the duration they were first listed with.
+  [stream setPts:1081800 duration:181800 ofSegment:7];
+  playlist = [[NSString alloc] initWithData:[_streaming buildChildPlaylist:stream]
+                                   encoding:NSUTF8StringEncoding];
+  XCTAssertTrue([playlist containsString:@"#EXTINF:2.000000,\n0-7.ts\n"], @"%@", playlist);
+  XCTAssertEqualWithAccuracy([stream listedDurationOfSegment:7 nominalDuration:2], 2, 0.000001);
+  // Segments appended later are listed with their actual duration.
+  XCTAssertEqualWithAccuracy([stream listedDurationOfSegment:1000 nominalDuration:2], 2, 0.000001);
+  [stream setDuration:181800 ofSegment:1001];
+  XCTAssertEqualWithAccuracy([stream listedDurationOfSegment:1001 nominalDuration:2],
+                             2.02,
+                             0.000001);
+}
+
 #pragma mark private methods
 
 // Creates an output of an HLS Playlist from a MPD.